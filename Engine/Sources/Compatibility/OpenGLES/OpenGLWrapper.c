@@ -1,8 +1,11 @@
 #include "OpenGLES/OpenGLWrapper.h"
 
 #include <math.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #define OGLW_PI 3.14159265359f
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
@@ -41,6 +44,47 @@ typedef struct OpenGLWrapperTextureUnit_ {
     GLenum blending, blendingRequested;
 } OpenGLWrapperTextureUnit;
 
+#if defined(EGLW_GLES2)
+// Requested state of a queued batch.
+typedef struct OglwQueueState_ {
+    GLuint texture[2];
+    GLboolean texturingEnabled[2];
+    GLenum textureBlending[2];
+    bool smoothShadingEnabled;
+    bool blendingEnabled;
+    GLenum blendingSrc, blendingDst;
+    bool alphaTestEnabled;
+    bool depthTestEnabled;
+    bool stencilTestEnabled;
+    bool depthWriteEnabled;
+    float depthNear, depthFar;
+} OglwQueueState;
+
+typedef struct OglwQueueCommand_ {
+    OglwQueueState state;
+    int matrix; // Index in the queue matrices.
+    GLenum primitive;
+    int firstVertex, vertexNb;
+    int firstIndex, indexNb;
+} OglwQueueCommand;
+
+typedef struct OglwQueue_ {
+    bool enabled;
+    float depth; // Sort depth of the next batches, from 0 (near) to 1 (far).
+    float depthNear, depthFar; // Depth range when the queue began.
+    OglwQueueCommand *commands;
+    uint64_t *keys, *keysTmp;
+    int *order, *orderTmp;
+    int commandNb, commandCapacity;
+    OglwVertex *vertices;
+    int vertexNb, vertexCapacity;
+    GLushort *indices;
+    int indexNb, indexCapacity;
+    float *matrices;
+    int matrixNb, matrixCapacity;
+} OglwQueue;
+#endif
+
 struct OpenGLWrapper_ {
     struct {
         int x, y, width, height;
@@ -63,6 +107,40 @@ struct OpenGLWrapper_ {
     GLint a_color;
     GLint a_texcoord0;
     GLint a_texcoord1;
+
+    // Keyframe program, sharing the attribute locations.
+    GLuint keyframeVertexShader, keyframeFragmentShader, keyframeProgram;
+    GLint keyframe_u_transformation;
+    GLint keyframe_u_move;
+    GLint keyframe_u_frontScale;
+    GLint keyframe_u_backScale;
+    GLint keyframe_u_color;
+    GLint keyframe_u_light;
+    GLint keyframe_s_tex0;
+    const float *keyframeLightTable; // Last light table uploaded.
+
+    // Light style and dynamic light programs, sharing the attribute locations.
+    GLuint lightstyleVertexShader, lightstyleFragmentShader, lightstyleProgram;
+    GLint lightstyle_u_transformation;
+    GLint lightstyle_u_page;
+    GLint lightstyle_u_scale;
+    GLint lightstyle_s_tex0;
+    GLint lightstyle_s_tex1;
+    GLuint texturedLightstyleFragmentShader, texturedLightstyleProgram; // Shares the wrapper vertex shader.
+    GLint texturedLightstyle_u_transformation;
+    GLint texturedLightstyle_u_page;
+    GLint texturedLightstyle_u_scale;
+    GLint texturedLightstyle_s_tex0;
+    GLint texturedLightstyle_s_tex1;
+    GLint texturedLightstyle_s_tex2;
+    GLuint dlightVertexShader, dlightFragmentShader, dlightProgram;
+    GLint dlight_u_transformation;
+    GLint dlight_u_cutoff;
+    GLint dlight_u_scale;
+    bool dlightSubtract; // The blending equation is reversed subtraction.
+    GLint dlight_s_tex0;
+    GLuint programCurrent; // Program in use, and its transformation uniform.
+    GLint u_transformationCurrent;
     
 	GLenum matrixMode;
     OglwMatrixStack projectionStack;
@@ -98,7 +176,21 @@ struct OpenGLWrapper_ {
     GLushort maxIndex;
     
     #if defined(BUFFER_OBJECT_USED)
+    // Stream ring buffer, batches are appended and the storage is orphaned on wraparound.
     GLuint bufferId;
+    int bufferCapacity; // In vertices.
+    int bufferOffset; // First free vertex.
+    int arraysOffset; // Vertex the attribute pointers start at.
+    #if defined(GL_EXT_map_buffer_range)
+    PFNGLMAPBUFFERRANGEEXTPROC mapBufferRange;
+    PFNGLUNMAPBUFFEROESPROC unmapBuffer;
+    #endif
+    #endif
+
+    OglwStats stats;
+
+    #if defined(EGLW_GLES2)
+    OglwQueue queue;
     #endif
    
     bool beginFlag;
@@ -108,12 +200,20 @@ struct OpenGLWrapper_ {
 
 #define DEFAULT_VERTEX_CAPACITY (1024*16)
 #define DEFAULT_INDEX_CAPACITY (1024*16*6)
+#define DEFAULT_BUFFER_CAPACITY (1024*64)
 
 static void oglwSetupArrays(OpenGLWrapper *oglw);
 static void oglwCleanupArrays(OpenGLWrapper *oglw);
 static bool oglwReserveVertices(OpenGLWrapper *oglw, int verticesCapacityMin);
+#if defined(BUFFER_OBJECT_USED)
+static void oglwReserveBuffer(OpenGLWrapper *oglw, int bufferCapacityMin);
+#endif
 static bool oglwReserveIndices(OpenGLWrapper *oglw, int indicesCapacityMin);
 
+#if defined(EGLW_GLES2)
+static void oglwQueueRecord(OpenGLWrapper *oglw, GLenum primitive);
+#endif
+
 static OpenGLWrapper *l_openGLWrapper = NULL;
 
 //--------------------------------------------------------------------------------
@@ -190,6 +290,165 @@ static const char *oglwFragmentShaderSources =
 "}\n"
 ;
 
+// Interpolates between two frames of bytes, the fourth byte indexes the light table.
+static const char *oglwKeyframeVertexShaderSources =
+"precision highp float;\n"
+"uniform mat4 u_transformation;\n"
+"uniform vec3 u_move;\n"
+"uniform vec3 u_frontScale;\n"
+"uniform vec3 u_backScale;\n"
+"uniform vec4 u_color;\n"
+"uniform vec4 u_light[64];\n"
+"attribute vec4 a_frame0;\n"
+"attribute vec4 a_frame1;\n"
+"attribute vec2 a_texcoord0;\n"
+"varying vec4 v_color;\n"
+"varying vec2 v_texcoord0;\n"
+"void main()\n"
+"{\n"
+"   vec3 position = u_move + a_frame1.xyz * u_backScale + a_frame0.xyz * u_frontScale;\n"
+"   float index = a_frame0.w;\n"
+"   vec4 lights = u_light[int(index * 0.25)];\n"
+"   float light = dot(lights, vec4(equal(vec4(mod(index, 4.0)), vec4(0.0, 1.0, 2.0, 3.0))));\n"
+"   v_color = clamp(vec4(u_color.rgb * light, u_color.a), 0.0, 1.0);\n"
+"   v_texcoord0 = a_texcoord0;\n"
+"   gl_Position = vec4(position, 1.0) * u_transformation;\n"
+"}\n"
+;
+
+static const char *oglwKeyframeFragmentShaderSources =
+"precision mediump float;\n"
+"uniform sampler2D s_tex0;\n"
+"varying vec4 v_color;\n"
+"varying vec2 v_texcoord0;\n"
+"void main()\n"
+"{\n"
+"	gl_FragColor = v_color * texture2D(s_tex0, v_texcoord0.xy);\n"
+"}\n"
+;
+
+// Reads the light layers of a lightmap page and weights them by the style table.
+// The page stacks 4 light layers and a layer whose texels hold the 4 styles of the surface.
+static const char *oglwLightstyleVertexShaderSources =
+"precision highp float;\n"
+"uniform mat4 u_transformation;\n"
+"attribute vec4 a_position;\n"
+"attribute vec2 a_texcoord0;\n"
+"varying vec2 v_texcoord0;\n"
+"void main()\n"
+"{\n"
+"   v_texcoord0 = a_texcoord0;\n"
+"   gl_Position = vec4(a_position.xyz,1.0) * u_transformation;\n"
+"}\n"
+;
+
+static const char *oglwLightstyleFragmentShaderSources =
+"#ifdef GL_FRAGMENT_PRECISION_HIGH\n"
+"precision highp float;\n"
+"#else\n"
+"precision mediump float;\n"
+"#endif\n"
+"uniform vec2 u_page;\n"
+"uniform float u_scale;\n"
+"uniform sampler2D s_tex0;\n"
+"uniform sampler2D s_tex1;\n"
+"varying vec2 v_texcoord0;\n"
+"vec3 style(float index)\n"
+"{\n"
+"	return texture2D(s_tex1, vec2(index * (255.0 / 256.0) + (0.5 / 256.0), 0.5)).rgb;\n"
+"}\n"
+"void main()\n"
+"{\n"
+"	vec2 tc = vec2(v_texcoord0.x, v_texcoord0.y * 0.2);\n"
+"	vec2 size = vec2(u_page.x, u_page.y * 5.0);\n"
+// The styles are read at the texel center, so that neighbouring surfaces do not blend in.
+"	vec4 styles = texture2D(s_tex0, (floor(tc * size) + 0.5) / size + vec2(0.0, 0.8));\n"
+"	vec3 light = texture2D(s_tex0, tc).rgb * style(styles.x);\n"
+"	light += texture2D(s_tex0, tc + vec2(0.0, 0.2)).rgb * style(styles.y);\n"
+"	light += texture2D(s_tex0, tc + vec2(0.0, 0.4)).rgb * style(styles.z);\n"
+"	light += texture2D(s_tex0, tc + vec2(0.0, 0.6)).rgb * style(styles.w);\n"
+"	light *= u_scale;\n"
+"	float m = max(max(light.r, light.g), light.b);\n"
+"	gl_FragColor = vec4(light / max(m, 1.0), min(m, 1.0));\n"
+"}\n"
+;
+
+// Same light as above, modulating the texture and the vertex color so that lit surfaces are drawn in one pass.
+// The texture is in unit 0, the page in unit 1 and the style table in unit 2.
+static const char *oglwTexturedLightstyleFragmentShaderSources =
+"#ifdef GL_FRAGMENT_PRECISION_HIGH\n"
+"precision highp float;\n"
+"#else\n"
+"precision mediump float;\n"
+"#endif\n"
+"uniform vec2 u_page;\n"
+"uniform float u_scale;\n"
+"uniform sampler2D s_tex0;\n"
+"uniform sampler2D s_tex1;\n"
+"uniform sampler2D s_tex2;\n"
+"varying vec4 v_color;\n"
+"varying vec2 v_texcoord0;\n"
+"varying vec2 v_texcoord1;\n"
+"vec3 style(float index)\n"
+"{\n"
+"	return texture2D(s_tex2, vec2(index * (255.0 / 256.0) + (0.5 / 256.0), 0.5)).rgb;\n"
+"}\n"
+"void main()\n"
+"{\n"
+"	vec2 tc = vec2(v_texcoord1.x, v_texcoord1.y * 0.2);\n"
+"	vec2 size = vec2(u_page.x, u_page.y * 5.0);\n"
+"	vec4 styles = texture2D(s_tex1, (floor(tc * size) + 0.5) / size + vec2(0.0, 0.8));\n"
+"	vec3 light = texture2D(s_tex1, tc).rgb * style(styles.x);\n"
+"	light += texture2D(s_tex1, tc + vec2(0.0, 0.2)).rgb * style(styles.y);\n"
+"	light += texture2D(s_tex1, tc + vec2(0.0, 0.4)).rgb * style(styles.z);\n"
+"	light += texture2D(s_tex1, tc + vec2(0.0, 0.6)).rgb * style(styles.w);\n"
+"	light *= u_scale;\n"
+"	float m = max(max(light.r, light.g), light.b);\n"
+"	gl_FragColor = texture2D(s_tex0, v_texcoord0) * v_color * vec4(light / max(m, 1.0), min(m, 1.0));\n"
+"}\n"
+;
+
+// Adds a dynamic light to the texture. The offset of the light from the fragment is
+// in the texture coordinates set 1, the radius in the position w.
+static const char *oglwDlightVertexShaderSources =
+"precision highp float;\n"
+"uniform mat4 u_transformation;\n"
+"attribute vec4 a_position;\n"
+"attribute vec4 a_color;\n"
+"attribute vec2 a_texcoord0;\n"
+"attribute vec2 a_texcoord1;\n"
+"varying vec3 v_color;\n"
+"varying vec2 v_texcoord0;\n"
+"varying vec2 v_offset;\n"
+"varying float v_radius;\n"
+"void main()\n"
+"{\n"
+"   v_color = a_color.rgb;\n"
+"   v_texcoord0 = a_texcoord0;\n"
+"   v_offset = a_texcoord1;\n"
+"   v_radius = a_position.w;\n"
+"   gl_Position = vec4(a_position.xyz,1.0) * u_transformation;\n"
+"}\n"
+;
+
+static const char *oglwDlightFragmentShaderSources =
+"precision mediump float;\n"
+"uniform float u_cutoff;\n"
+"uniform float u_scale;\n"
+"uniform sampler2D s_tex0;\n"
+"varying vec3 v_color;\n"
+"varying vec2 v_texcoord0;\n"
+"varying vec2 v_offset;\n"
+"varying float v_radius;\n"
+"void main()\n"
+"{\n"
+"	float d = length(v_offset);\n"
+"	if (d >= v_radius - u_cutoff)\n"
+"	    discard;\n"
+"	gl_FragColor = vec4(texture2D(s_tex0, v_texcoord0).rgb * v_color * ((v_radius - d) * u_scale), 1.0);\n"
+"}\n"
+;
+
 static void Matrix4x4_setNull(float *m)
 {
     for (int i = 0; i < 16; i++) m[i] = 0.0f;
@@ -293,6 +552,18 @@ static void oglwInitializeShaders(OpenGLWrapper *oglw)
     oglw->vertexShader = 0;
     oglw->fragmentShader = 0;
     oglw->program = 0;
+    oglw->keyframeVertexShader = 0;
+    oglw->keyframeFragmentShader = 0;
+    oglw->keyframeProgram = 0;
+    oglw->keyframeLightTable = NULL;
+    oglw->lightstyleVertexShader = 0;
+    oglw->lightstyleFragmentShader = 0;
+    oglw->lightstyleProgram = 0;
+    oglw->texturedLightstyleFragmentShader = 0;
+    oglw->texturedLightstyleProgram = 0;
+    oglw->dlightVertexShader = 0;
+    oglw->dlightFragmentShader = 0;
+    oglw->dlightProgram = 0;
     OglwMatrixStack_initialize(&oglw->modelViewStack);
     OglwMatrixStack_initialize(&oglw->projectionStack);
     oglw->transformation = NULL;
@@ -303,6 +574,17 @@ static void oglwFinalizeShaders(OpenGLWrapper *oglw)
     free(oglw->transformation);
     OglwMatrixStack_free(&oglw->modelViewStack);
     OglwMatrixStack_free(&oglw->projectionStack);
+    glDeleteProgram(oglw->keyframeProgram);
+    glDeleteShader(oglw->keyframeVertexShader);
+    glDeleteShader(oglw->keyframeFragmentShader);
+    glDeleteProgram(oglw->lightstyleProgram);
+    glDeleteShader(oglw->lightstyleVertexShader);
+    glDeleteShader(oglw->lightstyleFragmentShader);
+    glDeleteProgram(oglw->texturedLightstyleProgram);
+    glDeleteShader(oglw->texturedLightstyleFragmentShader);
+    glDeleteProgram(oglw->dlightProgram);
+    glDeleteShader(oglw->dlightVertexShader);
+    glDeleteShader(oglw->dlightFragmentShader);
     glDeleteProgram(oglw->program);
     glDeleteShader(oglw->vertexShader);
     glDeleteShader(oglw->fragmentShader);
@@ -329,6 +611,163 @@ static GLint oglwGetAttributeLocation(GLuint program, const char *name)
     return location;
 }
 
+// The keyframe program is optional, keyframe models are not drawn without it.
+static void oglwSetupKeyframeShaders(OpenGLWrapper *oglw)
+{
+    GLuint vertexShader, fragmentShader, program;
+	GLint linked;
+
+    vertexShader = oglwCreateShader(oglwKeyframeVertexShaderSources, GL_VERTEX_SHADER);
+    if (vertexShader == 0) goto on_error;
+    oglw->keyframeVertexShader = vertexShader;
+
+    fragmentShader = oglwCreateShader(oglwKeyframeFragmentShaderSources, GL_FRAGMENT_SHADER);
+    if (fragmentShader == 0) goto on_error;
+    oglw->keyframeFragmentShader = fragmentShader;
+
+    program = glCreateProgram();
+    if (program == 0) goto on_error;
+    oglw->keyframeProgram = program;
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glBindAttribLocation(program, oglw->a_position, "a_frame0");
+    glBindAttribLocation(program, oglw->a_color, "a_frame1");
+    glBindAttribLocation(program, oglw->a_texcoord0, "a_texcoord0");
+    glLinkProgram(program);
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        GLint logLength;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+        if (logLength > 1)
+        {
+            char *log = malloc(logLength);
+            glGetProgramInfoLog(program, logLength, NULL, log);
+			printf("Error linking keyframe program. Log:\n%s\n", log);
+            free(log);
+        }
+        goto on_error;
+    }
+
+    if ((oglw->keyframe_u_transformation = oglwGetUniformLocation(program, "u_transformation")) < 0) goto on_error;
+    if ((oglw->keyframe_u_move = oglwGetUniformLocation(program, "u_move")) < 0) goto on_error;
+    if ((oglw->keyframe_u_frontScale = oglwGetUniformLocation(program, "u_frontScale")) < 0) goto on_error;
+    if ((oglw->keyframe_u_backScale = oglwGetUniformLocation(program, "u_backScale")) < 0) goto on_error;
+    if ((oglw->keyframe_u_color = oglwGetUniformLocation(program, "u_color")) < 0) goto on_error;
+    if ((oglw->keyframe_u_light = oglwGetUniformLocation(program, "u_light")) < 0) goto on_error;
+    if ((oglw->keyframe_s_tex0 = oglwGetUniformLocation(program, "s_tex0")) < 0) goto on_error;
+
+    glUseProgram(program);
+    glUniform1i(oglw->keyframe_s_tex0, 0);
+    glUseProgram(oglw->program);
+    return;
+on_error:
+    glDeleteProgram(oglw->keyframeProgram);
+    glDeleteShader(oglw->keyframeVertexShader);
+    glDeleteShader(oglw->keyframeFragmentShader);
+    oglw->keyframeVertexShader = 0;
+    oglw->keyframeFragmentShader = 0;
+    oglw->keyframeProgram = 0;
+    glUseProgram(oglw->program);
+}
+
+// Links a program using the attribute locations of the wrapper program. Returns 0 on error.
+static GLuint oglwLinkProgram(OpenGLWrapper *oglw, GLuint vertexShader, GLuint fragmentShader, const char *name)
+{
+	GLint linked;
+
+    GLuint program = glCreateProgram();
+    if (program == 0) return 0;
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glBindAttribLocation(program, oglw->a_position, "a_position");
+    glBindAttribLocation(program, oglw->a_color, "a_color");
+    glBindAttribLocation(program, oglw->a_texcoord0, "a_texcoord0");
+    glBindAttribLocation(program, oglw->a_texcoord1, "a_texcoord1");
+    glLinkProgram(program);
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        GLint logLength;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+        if (logLength > 1)
+        {
+            char *log = malloc(logLength);
+            glGetProgramInfoLog(program, logLength, NULL, log);
+			printf("Error linking %s program. Log:\n%s\n", name, log);
+            free(log);
+        }
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// The light programs are optional, lightmaps are built on the CPU without them.
+static void oglwSetupLightShaders(OpenGLWrapper *oglw)
+{
+    GLuint program;
+
+    if ((oglw->lightstyleVertexShader = oglwCreateShader(oglwLightstyleVertexShaderSources, GL_VERTEX_SHADER)) == 0) goto on_error;
+    if ((oglw->lightstyleFragmentShader = oglwCreateShader(oglwLightstyleFragmentShaderSources, GL_FRAGMENT_SHADER)) == 0) goto on_error;
+    if ((program = oglwLinkProgram(oglw, oglw->lightstyleVertexShader, oglw->lightstyleFragmentShader, "light style")) == 0) goto on_error;
+    oglw->lightstyleProgram = program;
+    if ((oglw->lightstyle_u_transformation = oglwGetUniformLocation(program, "u_transformation")) < 0) goto on_error;
+    if ((oglw->lightstyle_u_page = oglwGetUniformLocation(program, "u_page")) < 0) goto on_error;
+    if ((oglw->lightstyle_u_scale = oglwGetUniformLocation(program, "u_scale")) < 0) goto on_error;
+    if ((oglw->lightstyle_s_tex0 = oglwGetUniformLocation(program, "s_tex0")) < 0) goto on_error;
+    if ((oglw->lightstyle_s_tex1 = oglwGetUniformLocation(program, "s_tex1")) < 0) goto on_error;
+    glUseProgram(program);
+    glUniform1i(oglw->lightstyle_s_tex0, 0);
+    glUniform1i(oglw->lightstyle_s_tex1, 1);
+
+    if ((oglw->texturedLightstyleFragmentShader = oglwCreateShader(oglwTexturedLightstyleFragmentShaderSources, GL_FRAGMENT_SHADER)) == 0) goto on_error;
+    if ((program = oglwLinkProgram(oglw, oglw->vertexShader, oglw->texturedLightstyleFragmentShader, "textured light style")) == 0) goto on_error;
+    oglw->texturedLightstyleProgram = program;
+    if ((oglw->texturedLightstyle_u_transformation = oglwGetUniformLocation(program, "u_transformation")) < 0) goto on_error;
+    if ((oglw->texturedLightstyle_u_page = oglwGetUniformLocation(program, "u_page")) < 0) goto on_error;
+    if ((oglw->texturedLightstyle_u_scale = oglwGetUniformLocation(program, "u_scale")) < 0) goto on_error;
+    if ((oglw->texturedLightstyle_s_tex0 = oglwGetUniformLocation(program, "s_tex0")) < 0) goto on_error;
+    if ((oglw->texturedLightstyle_s_tex1 = oglwGetUniformLocation(program, "s_tex1")) < 0) goto on_error;
+    if ((oglw->texturedLightstyle_s_tex2 = oglwGetUniformLocation(program, "s_tex2")) < 0) goto on_error;
+    glUseProgram(program);
+    glUniform1i(oglw->texturedLightstyle_s_tex0, 0);
+    glUniform1i(oglw->texturedLightstyle_s_tex1, 1);
+    glUniform1i(oglw->texturedLightstyle_s_tex2, 2);
+
+    if ((oglw->dlightVertexShader = oglwCreateShader(oglwDlightVertexShaderSources, GL_VERTEX_SHADER)) == 0) goto on_error;
+    if ((oglw->dlightFragmentShader = oglwCreateShader(oglwDlightFragmentShaderSources, GL_FRAGMENT_SHADER)) == 0) goto on_error;
+    if ((program = oglwLinkProgram(oglw, oglw->dlightVertexShader, oglw->dlightFragmentShader, "dynamic light")) == 0) goto on_error;
+    oglw->dlightProgram = program;
+    if ((oglw->dlight_u_transformation = oglwGetUniformLocation(program, "u_transformation")) < 0) goto on_error;
+    if ((oglw->dlight_u_cutoff = oglwGetUniformLocation(program, "u_cutoff")) < 0) goto on_error;
+    if ((oglw->dlight_u_scale = oglwGetUniformLocation(program, "u_scale")) < 0) goto on_error;
+    if ((oglw->dlight_s_tex0 = oglwGetUniformLocation(program, "s_tex0")) < 0) goto on_error;
+    glUseProgram(program);
+    glUniform1i(oglw->dlight_s_tex0, 0);
+
+    glUseProgram(oglw->program);
+    return;
+on_error:
+    glDeleteProgram(oglw->lightstyleProgram);
+    glDeleteShader(oglw->lightstyleVertexShader);
+    glDeleteShader(oglw->lightstyleFragmentShader);
+    glDeleteProgram(oglw->texturedLightstyleProgram);
+    glDeleteShader(oglw->texturedLightstyleFragmentShader);
+    glDeleteProgram(oglw->dlightProgram);
+    glDeleteShader(oglw->dlightVertexShader);
+    glDeleteShader(oglw->dlightFragmentShader);
+    oglw->lightstyleVertexShader = 0;
+    oglw->lightstyleFragmentShader = 0;
+    oglw->lightstyleProgram = 0;
+    oglw->texturedLightstyleFragmentShader = 0;
+    oglw->texturedLightstyleProgram = 0;
+    oglw->dlightVertexShader = 0;
+    oglw->dlightFragmentShader = 0;
+    oglw->dlightProgram = 0;
+    glUseProgram(oglw->program);
+}
+
 static bool oglwSetupShaders(OpenGLWrapper *oglw)
 {
     GLuint vertexShader, fragmentShader, program;
@@ -369,6 +808,8 @@ static bool oglwSetupShaders(OpenGLWrapper *oglw)
     if ((oglw->a_texcoord1 = oglwGetAttributeLocation(program, "a_texcoord1")) < 0) goto on_error;
 
     if ((oglw->u_transformation = oglwGetUniformLocation(program, "u_transformation")) < 0) goto on_error;
+    oglw->programCurrent = program;
+    oglw->u_transformationCurrent = oglw->u_transformation;
     if ((oglw->u_tex0Enabled = oglwGetUniformLocation(program, "u_tex0Enabled")) < 0) goto on_error;
     if ((oglw->u_tex1Enabled = oglwGetUniformLocation(program, "u_tex1Enabled")) < 0) goto on_error;
     if ((oglw->u_tex0BlendingEnabled = oglwGetUniformLocation(program, "u_tex0BlendingEnabled")) < 0) goto on_error;
@@ -396,6 +837,11 @@ static bool oglwSetupShaders(OpenGLWrapper *oglw)
     glUniform1i(oglw->s_tex0, 0);
     glUniform1i(oglw->s_tex1, 1);
     glUniform1f(oglw->u_alphaThreshold, 0);
+
+    #if defined(BUFFER_OBJECT_USED)
+    oglwSetupKeyframeShaders(oglw);
+    #endif
+    oglwSetupLightShaders(oglw);
     
     return false;
 on_error:
@@ -452,6 +898,19 @@ bool oglwCreate() {
         
         #if defined(BUFFER_OBJECT_USED)
         oglw->bufferId = 0;
+        oglw->bufferCapacity = 0;
+        oglw->bufferOffset = 0;
+        oglw->arraysOffset = 0;
+        #if defined(GL_EXT_map_buffer_range)
+        oglw->mapBufferRange = NULL;
+        oglw->unmapBuffer = NULL;
+        #endif
+        #endif
+
+        oglwResetStats();
+
+        #if defined(EGLW_GLES2)
+        memset(&oglw->queue, 0, sizeof(oglw->queue));
         #endif
 
         oglw->viewport.x = 0;
@@ -540,6 +999,20 @@ bool oglwCreate() {
 
         #if defined(BUFFER_OBJECT_USED)
         glGenBuffers(1, &oglw->bufferId);
+        oglwReserveBuffer(oglw, DEFAULT_BUFFER_CAPACITY);
+        #if defined(GL_EXT_map_buffer_range)
+        const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+        if (extensions != NULL && strstr(extensions, "GL_EXT_map_buffer_range") && strstr(extensions, "GL_OES_mapbuffer"))
+        {
+            oglw->mapBufferRange = (PFNGLMAPBUFFERRANGEEXTPROC)eglGetProcAddress("glMapBufferRangeEXT");
+            oglw->unmapBuffer = (PFNGLUNMAPBUFFEROESPROC)eglGetProcAddress("glUnmapBufferOES");
+            if (oglw->mapBufferRange == NULL || oglw->unmapBuffer == NULL)
+            {
+                oglw->mapBufferRange = NULL;
+                oglw->unmapBuffer = NULL;
+            }
+        }
+        #endif
         #endif
         
         oglwReserveVertices(oglw, DEFAULT_VERTEX_CAPACITY);
@@ -563,6 +1036,17 @@ void oglwDestroy() {
 
         #if defined(BUFFER_OBJECT_USED)
         glDeleteBuffers(1, &oglw->bufferId);
+        #endif
+
+        #if defined(EGLW_GLES2)
+        free(oglw->queue.commands);
+        free(oglw->queue.keys);
+        free(oglw->queue.keysTmp);
+        free(oglw->queue.order);
+        free(oglw->queue.orderTmp);
+        free(oglw->queue.vertices);
+        free(oglw->queue.indices);
+        free(oglw->queue.matrices);
         #endif
 
 		free(oglw->vertices);
@@ -1015,18 +1499,10 @@ void oglwColorPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *poi
 }
 */
 
-static void oglwSetupArrays(OpenGLWrapper *oglw) {
-    #if defined(BUFFER_OBJECT_USED)
-    glBindBuffer(GL_ARRAY_BUFFER, oglw->bufferId);
-    glBufferData(GL_ARRAY_BUFFER, oglw->verticesCapacity * sizeof(OglwVertex), NULL, GL_STREAM_DRAW); // Should be GL_STREAM_DRAW but only for GLES 2.
-    #endif
-
+// Points the attributes at the vertices starting at base. Texture unit 0 reads texCoordSet0.
+static void oglwSetArrays(OpenGLWrapper *oglw, const char *base, int texCoordSet0) {
     if (!oglw->arrays[Array_Position].enabled) {
-        #if defined(BUFFER_OBJECT_USED)
-		void *p = (void*)((void*)&oglw->vertices[0].position[0] - (void*)&oglw->vertices[0]);
-        #else
-		void *p = &oglw->vertices[0].position[0];
-        #endif
+		const void *p = base + offsetof(OglwVertex, position);
         #if defined(EGLW_GLES1)
         glVertexPointer(4, GL_FLOAT, sizeof(OglwVertex), p);
         glEnableClientState(GL_VERTEX_ARRAY);
@@ -1036,11 +1512,7 @@ static void oglwSetupArrays(OpenGLWrapper *oglw) {
         #endif
     }
     if (!oglw->arrays[Array_Color].enabled) {
-        #if defined(BUFFER_OBJECT_USED)
-		void *p = (void*)((void*)&oglw->vertices[0].color[0] - (void*)&oglw->vertices[0]);
-        #else
-		void *p = &oglw->vertices[0].color[0];
-        #endif
+		const void *p = base + offsetof(OglwVertex, color);
         #if defined(EGLW_GLES1)
         glColorPointer(4, GL_FLOAT, sizeof(OglwVertex), p);
         glEnableClientState(GL_COLOR_ARRAY);
@@ -1050,11 +1522,7 @@ static void oglwSetupArrays(OpenGLWrapper *oglw) {
         #endif
     }
     if (!oglw->arrays[Array_TexCoord0].enabled) {
-        #if defined(BUFFER_OBJECT_USED)
-		void * p = (void*)((void*)&oglw->vertices[0].texCoord[0][0] - (void*)&oglw->vertices[0]);
-        #else
-		void *p = &oglw->vertices[0].texCoord[0][0];
-        #endif
+		const void *p = base + (texCoordSet0 ? offsetof(OglwVertex, texCoord[1][0]) : offsetof(OglwVertex, texCoord[0][0]));
         #if defined(EGLW_GLES1)
         glClientActiveTexture(GL_TEXTURE0);
         glTexCoordPointer(4, GL_FLOAT, sizeof(OglwVertex), p);
@@ -1065,11 +1533,7 @@ static void oglwSetupArrays(OpenGLWrapper *oglw) {
         #endif
     }
     if (!oglw->arrays[Array_TexCoord1].enabled) {
-        #if defined(BUFFER_OBJECT_USED)
-		void *p = (void*)((void*)&oglw->vertices[0].texCoord[1][0] - (void*)&oglw->vertices[0]);
-        #else
-        void *p = &oglw->vertices[0].texCoord[1][0];
-        #endif
+		const void *p = base + offsetof(OglwVertex, texCoord[1][0]);
         #if defined(EGLW_GLES1)
         glClientActiveTexture(GL_TEXTURE1);
         glTexCoordPointer(4, GL_FLOAT, sizeof(OglwVertex), p);
@@ -1082,6 +1546,15 @@ static void oglwSetupArrays(OpenGLWrapper *oglw) {
     }
 }
 
+static void oglwSetupArrays(OpenGLWrapper *oglw) {
+    #if defined(BUFFER_OBJECT_USED)
+    glBindBuffer(GL_ARRAY_BUFFER, oglw->bufferId);
+    oglwSetArrays(oglw, (const char *)(size_t)(oglw->arraysOffset * sizeof(OglwVertex)), 0);
+    #else
+    oglwSetArrays(oglw, (const char *)oglw->vertices, 0);
+    #endif
+}
+
 static void oglwCleanupArrays(OpenGLWrapper *oglw) {
     #if defined(BUFFER_OBJECT_USED)
     glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -1189,7 +1662,9 @@ static bool oglwReserveVertices(OpenGLWrapper *oglw, int verticesCapacityMin) {
         free(vertices);
         oglw->vertices=verticesNew;
         
+        #if !defined(BUFFER_OBJECT_USED)
         oglwSetupArrays(oglw);
+        #endif
     }
     return false;
 on_error:
@@ -1200,6 +1675,285 @@ on_error:
     return true;
 }
 
+#if defined(BUFFER_OBJECT_USED)
+static void oglwReserveBuffer(OpenGLWrapper *oglw, int bufferCapacityMin) {
+    if (oglw->bufferCapacity >= bufferCapacityMin) return;
+    oglw->bufferCapacity = bufferCapacityMin;
+    oglw->bufferOffset = 0;
+    oglw->arraysOffset = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, oglw->bufferId);
+    glBufferData(GL_ARRAY_BUFFER, oglw->bufferCapacity * sizeof(OglwVertex), NULL, GL_STREAM_DRAW);
+    oglwSetupArrays(oglw);
+}
+
+// Appends the current batch to the ring buffer and returns its first vertex relative to the attribute pointers.
+// GLES 2 has no fences: the storage is orphaned on wraparound, so the driver keeps the previous one alive
+// for the frames still in flight and appended ranges never overlap a pending draw.
+static int oglwStreamVertices(OpenGLWrapper *oglw) {
+    int length = oglw->verticesLength;
+    GLsizeiptr size = length * sizeof(OglwVertex);
+
+    glBindBuffer(GL_ARRAY_BUFFER, oglw->bufferId);
+    if (length > oglw->bufferCapacity) {
+        oglwReserveBuffer(oglw, 2 * length);
+    } else if (oglw->bufferOffset + length > oglw->bufferCapacity) {
+        glBufferData(GL_ARRAY_BUFFER, oglw->bufferCapacity * sizeof(OglwVertex), NULL, GL_STREAM_DRAW);
+        oglw->bufferOffset = 0;
+        oglw->stats.bufferWrapNb++;
+    }
+
+    int offset = oglw->bufferOffset;
+    GLintptr byteOffset = offset * sizeof(OglwVertex);
+    void *data = NULL;
+    #if defined(GL_EXT_map_buffer_range)
+    if (oglw->mapBufferRange != NULL) {
+        data = oglw->mapBufferRange(GL_ARRAY_BUFFER, byteOffset, size, GL_MAP_WRITE_BIT_EXT | GL_MAP_INVALIDATE_RANGE_BIT_EXT | GL_MAP_UNSYNCHRONIZED_BIT_EXT);
+        if (data != NULL) {
+            memcpy(data, oglw->vertices, size);
+            oglw->unmapBuffer(GL_ARRAY_BUFFER);
+        }
+    }
+    #endif
+    if (data == NULL) {
+        glBufferSubData(GL_ARRAY_BUFFER, byteOffset, size, oglw->vertices);
+    }
+    oglw->bufferOffset = offset + length;
+    oglw->stats.bytesStreamed += size;
+
+    // Indices are relative to the batch, while glDrawArrays can start anywhere after the pointers.
+    if (offset < oglw->arraysOffset || (oglw->indicesLength > 0 && offset != oglw->arraysOffset)) {
+        oglw->arraysOffset = offset;
+        oglwSetupArrays(oglw);
+    }
+    return offset - oglw->arraysOffset;
+}
+#endif
+
+//--------------------------------------------------------------------------------
+// Static buffers.
+//--------------------------------------------------------------------------------
+GLuint oglwCreateStaticBuffer(const OglwVertex *vertices, int vertexNb) {
+    #if defined(BUFFER_OBJECT_USED)
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    GLuint buffer = 0;
+    glGenBuffers(1, &buffer);
+    if (buffer == 0) return 0;
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, vertexNb * sizeof(OglwVertex), vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, oglw->bufferId);
+    if (glGetError() != GL_NO_ERROR) {
+        glDeleteBuffers(1, &buffer);
+        return 0;
+    }
+    return buffer;
+    #else
+    return 0;
+    #endif
+}
+
+void oglwDestroyStaticBuffer(GLuint buffer) {
+    #if defined(BUFFER_OBJECT_USED)
+    if (buffer != 0) glDeleteBuffers(1, &buffer);
+    #endif
+}
+
+void oglwDrawStaticElements(GLuint buffer, int first, const GLushort *indices, int indexNb, int texCoordSet0) {
+    #if defined(BUFFER_OBJECT_USED)
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    if (indexNb <= 0) return;
+    oglwUpdateState();
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    oglwSetArrays(oglw, (const char *)(size_t)(first * sizeof(OglwVertex)), texCoordSet0);
+    glDrawElements(GL_TRIANGLES, indexNb, GL_UNSIGNED_SHORT, indices);
+    oglw->stats.drawCallNb++;
+    // Back to the stream buffer.
+    oglwSetupArrays(oglw);
+    #endif
+}
+
+//--------------------------------------------------------------------------------
+// Keyframe models.
+//--------------------------------------------------------------------------------
+bool oglwIsKeyframeSupported() {
+    #if defined(EGLW_GLES2) && defined(BUFFER_OBJECT_USED)
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    return oglw->keyframeProgram != 0;
+    #else
+    return false;
+    #endif
+}
+
+bool oglwCreateKeyframeModel(OglwKeyframeModel *model, const GLubyte *frames, int frameNb, const GLfloat *texCoords, int vertexNb, const GLushort *indices, int indexNb) {
+    memset(model, 0, sizeof(*model));
+    #if defined(EGLW_GLES2) && defined(BUFFER_OBJECT_USED)
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    if (!oglw->keyframeProgram || vertexNb <= 0 || vertexNb > 65536 || frameNb <= 0 || indexNb <= 0) return true;
+    GLuint buffers[2] = { 0, 0 };
+    glGenBuffers(2, buffers);
+    if (buffers[0] == 0 || buffers[1] == 0) goto on_error;
+
+    // Texture coordinates, then the frames.
+    GLsizeiptr texCoordSize = vertexNb * 2 * sizeof(GLfloat);
+    GLsizeiptr frameSize = vertexNb * 4;
+    glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, texCoordSize + frameNb * frameSize, NULL, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, texCoordSize, texCoords);
+    glBufferSubData(GL_ARRAY_BUFFER, texCoordSize, frameNb * frameSize, frames);
+    glBindBuffer(GL_ARRAY_BUFFER, oglw->bufferId);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexNb * sizeof(GLushort), indices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    if (glGetError() != GL_NO_ERROR) goto on_error;
+
+    model->vertexBuffer = buffers[0];
+    model->indexBuffer = buffers[1];
+    model->vertexNb = vertexNb;
+    model->frameNb = frameNb;
+    model->indexNb = indexNb;
+    return false;
+on_error:
+    glDeleteBuffers(2, buffers);
+    return true;
+    #else
+    return true;
+    #endif
+}
+
+void oglwDestroyKeyframeModel(OglwKeyframeModel *model) {
+    #if defined(EGLW_GLES2) && defined(BUFFER_OBJECT_USED)
+    if (model->vertexBuffer != 0) glDeleteBuffers(1, &model->vertexBuffer);
+    if (model->indexBuffer != 0) glDeleteBuffers(1, &model->indexBuffer);
+    #endif
+    memset(model, 0, sizeof(*model));
+}
+
+void oglwDrawKeyframeModel(const OglwKeyframeModel *model, int frame, int oldFrame, const float move[3], const float frontScale[3], const float backScale[3], const float color[4], const float lightTable[256]) {
+    #if defined(EGLW_GLES2) && defined(BUFFER_OBJECT_USED)
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    if (!oglw->keyframeProgram || model->vertexBuffer == 0) return;
+    if (frame < 0 || frame >= model->frameNb || oldFrame < 0 || oldFrame >= model->frameNb) return;
+
+    // Applies the requested state and computes the transformation.
+    oglwUpdateState();
+
+    glUseProgram(oglw->keyframeProgram);
+    glUniformMatrix4fv(oglw->keyframe_u_transformation, 1, GL_FALSE, oglw->transformation);
+    glUniform3fv(oglw->keyframe_u_move, 1, move);
+    glUniform3fv(oglw->keyframe_u_frontScale, 1, frontScale);
+    glUniform3fv(oglw->keyframe_u_backScale, 1, backScale);
+    glUniform4fv(oglw->keyframe_u_color, 1, color);
+    if (oglw->keyframeLightTable != lightTable) {
+        oglw->keyframeLightTable = lightTable;
+        glUniform4fv(oglw->keyframe_u_light, 64, lightTable);
+    }
+
+    size_t texCoordSize = model->vertexNb * 2 * sizeof(GLfloat);
+    size_t frameSize = model->vertexNb * 4;
+    glBindBuffer(GL_ARRAY_BUFFER, model->vertexBuffer);
+    glVertexAttribPointer(oglw->a_position, 4, GL_UNSIGNED_BYTE, GL_FALSE, 4, (const void *)(texCoordSize + frame * frameSize));
+    glEnableVertexAttribArray(oglw->a_position);
+    glVertexAttribPointer(oglw->a_color, 4, GL_UNSIGNED_BYTE, GL_FALSE, 4, (const void *)(texCoordSize + oldFrame * frameSize));
+    glEnableVertexAttribArray(oglw->a_color);
+    glVertexAttribPointer(oglw->a_texcoord0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (const void *)0);
+    glEnableVertexAttribArray(oglw->a_texcoord0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->indexBuffer);
+    glDrawElements(GL_TRIANGLES, model->indexNb, GL_UNSIGNED_SHORT, (const void *)0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    oglw->stats.drawCallNb++;
+
+    // Back to the wrapper program and the stream buffer.
+    glUseProgram(oglw->program);
+    oglwSetupArrays(oglw);
+    #endif
+}
+
+//--------------------------------------------------------------------------------
+// Light programs.
+//--------------------------------------------------------------------------------
+bool oglwIsLightstyleSupported() {
+    #if defined(EGLW_GLES2)
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    return oglw->lightstyleProgram != 0 && oglw->texturedLightstyleProgram != 0 && oglw->dlightProgram != 0;
+    #else
+    return false;
+    #endif
+}
+
+#if defined(EGLW_GLES2)
+// Flushes the requested state for the wrapper program, then makes program current.
+static void oglwUseLightProgram(OpenGLWrapper *oglw, GLuint program, GLint u_transformation) {
+    oglwUpdateState();
+    glUseProgram(program);
+    glUniformMatrix4fv(u_transformation, 1, GL_FALSE, oglw->transformation);
+    oglw->programCurrent = program;
+    oglw->u_transformationCurrent = u_transformation;
+}
+#endif
+
+void oglwBeginLightstyles(int pageWidth, int pageHeight, float scale) {
+    #if defined(EGLW_GLES2)
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    if (!oglw->lightstyleProgram) return;
+    oglwUseLightProgram(oglw, oglw->lightstyleProgram, oglw->lightstyle_u_transformation);
+    glUniform2f(oglw->lightstyle_u_page, (float)pageWidth, (float)pageHeight);
+    glUniform1f(oglw->lightstyle_u_scale, scale);
+    #endif
+}
+
+void oglwBeginTexturedLightstyles(int pageWidth, int pageHeight, float scale, GLuint styleTable) {
+    #if defined(EGLW_GLES2)
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    if (!oglw->texturedLightstyleProgram) return;
+    oglwUseLightProgram(oglw, oglw->texturedLightstyleProgram, oglw->texturedLightstyle_u_transformation);
+    glUniform2f(oglw->texturedLightstyle_u_page, (float)pageWidth, (float)pageHeight);
+    glUniform1f(oglw->texturedLightstyle_u_scale, scale);
+    // Unit 2 is not tracked by the wrapper, nothing else uses it.
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, styleTable);
+    glActiveTexture(GL_TEXTURE0 + oglw->textureUnit);
+    #endif
+}
+
+void oglwBeginDynamicLights(float cutoff, float scale, bool subtractFlag) {
+    #if defined(EGLW_GLES2)
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    if (!oglw->dlightProgram) return;
+    oglwUseLightProgram(oglw, oglw->dlightProgram, oglw->dlight_u_transformation);
+    glUniform1f(oglw->dlight_u_cutoff, cutoff);
+    glUniform1f(oglw->dlight_u_scale, scale);
+    if (subtractFlag) {
+        glBlendEquation(GL_FUNC_REVERSE_SUBTRACT);
+        oglw->dlightSubtract = true;
+    }
+    #endif
+}
+
+void oglwEndLighting() {
+    #if defined(EGLW_GLES2)
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    if (oglw->programCurrent == oglw->program) return;
+    if (oglw->dlightSubtract) {
+        glBlendEquation(GL_FUNC_ADD);
+        oglw->dlightSubtract = false;
+    }
+    glUseProgram(oglw->program);
+    oglw->programCurrent = oglw->program;
+    oglw->u_transformationCurrent = oglw->u_transformation;
+    // The wrapper program may have missed transformation changes.
+    oglw->transformationDirty = true;
+    #endif
+}
+
+void oglwGetStats(OglwStats *stats) {
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    *stats = oglw->stats;
+}
+
+void oglwResetStats() {
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    memset(&oglw->stats, 0, sizeof(oglw->stats));
+}
+
 void oglwPointSize(float size) {
     #if defined(EGLW_GLES1)
     glPointSize(size);
@@ -1214,6 +1968,29 @@ void oglwBegin(GLenum primitive) {
     oglw->primitive = primitive;
 }
 
+// Draws the current vertices and indices.
+static void oglwDraw(OpenGLWrapper *oglw, GLenum primitive) {
+    oglwUpdateState();
+
+    #if defined(BUFFER_OBJECT_USED)
+    int first = oglwStreamVertices(oglw);
+    #else
+    int first = 0;
+    #endif
+    
+    if (oglw->indicesLength>0) {
+        if(oglw->maxIndex>255){
+            glDrawElements(primitive, oglw->indicesLength, GL_UNSIGNED_SHORT, oglw->indices);
+        }else{
+            glDrawElements(primitive, oglw->indicesLength, GL_UNSIGNED_BYTE, oglw->bindices);
+        }
+        
+    } else {
+        glDrawArrays(primitive, first, oglw->verticesLength);
+    }
+    oglw->stats.drawCallNb++;
+}
+
 void oglwEnd() {
     OpenGLWrapper *oglw = l_openGLWrapper;
     if (!oglw->beginFlag) return;
@@ -1256,23 +2033,12 @@ void oglwEnd() {
             break;
         }
 
-        oglwUpdateState();
-
-        #if defined(BUFFER_OBJECT_USED)
-        glBufferData(GL_ARRAY_BUFFER, oglw->verticesLength * sizeof(OglwVertex), oglw->vertices, GL_STREAM_DRAW);
-        //glBufferSubData(GL_ARRAY_BUFFER, 0, oglw->verticesLength * sizeof(OglwVertex), oglw->vertices);
+        #if defined(EGLW_GLES2)
+        if (oglw->queue.enabled)
+            oglwQueueRecord(oglw, primitive);
+        else
         #endif
-        
-        if (oglw->indicesLength>0) {
-            if(oglw->maxIndex>255){
-                glDrawElements(primitive, oglw->indicesLength, GL_UNSIGNED_SHORT, oglw->indices);
-            }else{
-                glDrawElements(primitive, oglw->indicesLength, GL_UNSIGNED_BYTE, oglw->bindices);
-            }
-            
-        } else {
-            glDrawArrays(primitive, 0, oglw->verticesLength);
-        }
+        oglwDraw(oglw, primitive);
     }
     
     oglwReset();
@@ -1297,7 +2063,7 @@ void oglwUpdateState() {
         Matrix4x4_mul(transposeMatrix, projectionMatrix, modelViewMatrix);
         Matrix4x4_transpose(transformationMatrix, transposeMatrix);
         #endif
-        glUniformMatrix4fv(oglw->u_transformation, 1, GL_FALSE, transformationMatrix);
+        glUniformMatrix4fv(oglw->u_transformationCurrent, 1, GL_FALSE, transformationMatrix);
     }
     #endif
     
@@ -1313,6 +2079,14 @@ void oglwUpdateState() {
         #endif
     }
     
+    // The wrapper uniforms only exist in the wrapper program: while a light program is current,
+    // they stay dirty and are sent once oglwEndLighting restores the wrapper program.
+    #if defined(EGLW_GLES2)
+    bool wrapperProgram = oglw->programCurrent == oglw->program;
+    #else
+    bool wrapperProgram = true;
+    #endif
+    
     int unit = oglw->textureUnitRequested ^ 1;
     for (int i = 0; i < 2; i++) {
         OpenGLWrapperTextureUnit *tu = &oglw->textureUnits[unit];
@@ -1323,8 +2097,9 @@ void oglwUpdateState() {
                 oglw->textureUnit=unit;
                 glActiveTexture(GL_TEXTURE0 + unit);
             }
-            if (tu->texturingEnabled!=tu->texturingEnabledRequested) {
+            if (tu->texturingEnabled!=tu->texturingEnabledRequested && wrapperProgram) {
                 tu->texturingEnabled=tu->texturingEnabledRequested;
+                oglw->stats.stateChangeNb++;
                 #if defined(EGLW_GLES1)
                 if (tu->texturingEnabledRequested)
                     glEnable(GL_TEXTURE_2D);
@@ -1339,8 +2114,9 @@ void oglwUpdateState() {
             }
 //            if (tu->texturingEnabled)
             {
-                if (tu->blending!=tu->blendingRequested) {
+                if (tu->blending!=tu->blendingRequested && wrapperProgram) {
                     tu->blending=tu->blendingRequested;
+                    oglw->stats.stateChangeNb++;
                     #if defined(EGLW_GLES1)
                     glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, tu->blendingRequested);
                     #else
@@ -1352,6 +2128,7 @@ void oglwUpdateState() {
                 }
                 if (tu->texture!=tu->textureRequested) {
                     tu->texture=tu->textureRequested;
+                    oglw->stats.stateChangeNb++;
                     glBindTexture(GL_TEXTURE_2D, tu->textureRequested);
                 }
             }
@@ -1368,6 +2145,7 @@ void oglwUpdateState() {
     
     if (oglw->blendingEnabled!=oglw->blendingEnabledRequested) {
         oglw->blendingEnabled=oglw->blendingEnabledRequested;
+        oglw->stats.stateChangeNb++;
         if (oglw->blendingEnabledRequested)
             glEnable(GL_BLEND);
         else
@@ -1378,12 +2156,14 @@ void oglwUpdateState() {
         if (oglw->blendingSrc!=oglw->blendingSrcRequested || oglw->blendingDst!=oglw->blendingDstRequested) {
             oglw->blendingSrc=oglw->blendingSrcRequested;
             oglw->blendingDst=oglw->blendingDstRequested;
+            oglw->stats.stateChangeNb++;
             glBlendFunc(oglw->blendingSrcRequested, oglw->blendingDstRequested);
         }
     }
     
-    if (oglw->alphaTestEnabled!=oglw->alphaTestEnabledRequested) {
+    if (oglw->alphaTestEnabled!=oglw->alphaTestEnabledRequested && wrapperProgram) {
         oglw->alphaTestEnabled=oglw->alphaTestEnabledRequested;
+        oglw->stats.stateChangeNb++;
         #if defined(EGLW_GLES1)
         if (oglw->alphaTestEnabledRequested) {
             glEnable(GL_ALPHA_TEST);
@@ -1397,6 +2177,7 @@ void oglwUpdateState() {
 
     if (oglw->depthTestEnabled!=oglw->depthTestEnabledRequested) {
         oglw->depthTestEnabled=oglw->depthTestEnabledRequested;
+        oglw->stats.stateChangeNb++;
         if (oglw->depthTestEnabledRequested)
             glEnable(GL_DEPTH_TEST);
         else
@@ -1405,6 +2186,7 @@ void oglwUpdateState() {
 
     if (oglw->stencilTestEnabled!=oglw->stencilTestEnabledRequested) {
         oglw->stencilTestEnabled=oglw->stencilTestEnabledRequested;
+        oglw->stats.stateChangeNb++;
         if (oglw->stencilTestEnabledRequested)
             glEnable(GL_STENCIL_TEST);
         else
@@ -1418,6 +2200,7 @@ void oglwUpdateStateWriteMask() {
     OpenGLWrapper *oglw = l_openGLWrapper;
     if (oglw->depthWriteEnabled!=oglw->depthWriteEnabledRequested) {
         oglw->depthWriteEnabled=oglw->depthWriteEnabledRequested;
+        oglw->stats.stateChangeNb++;
         if (oglw->depthWriteEnabledRequested)
             glDepthMask(GL_TRUE);
         else
@@ -1433,6 +2216,331 @@ void oglwReset() {
     oglw->maxIndex = 0;
 }
 
+//--------------------------------------------------------------------------------
+// Draw queue.
+//--------------------------------------------------------------------------------
+// While the queue is enabled, oglwEnd records the batch with its requested state and
+// transformation instead of drawing it. oglwEndQueue sorts the batches on a 64 bits key
+// and draws them, merging consecutive batches that share the same state.
+// Opaque key: pass (1) | shader state (15) | texture 0 (16) | texture 1 (16) | depth (16), front to back.
+// Blended key: pass (1) | submission order, blended batches keep their order and come after the opaque ones.
+#if defined(EGLW_GLES2)
+
+#define QUEUE_BLENDED_PASS ((uint64_t)1 << 63)
+
+static bool oglwQueueGrow(void **array, int *capacity, int needed, size_t size) {
+    if (needed <= *capacity) return false;
+    int capacityNew = *capacity * 2;
+    if (capacityNew < needed) capacityNew = needed + 256;
+    void *arrayNew = realloc(*array, capacityNew * size);
+    if (arrayNew == NULL) return true;
+    *array = arrayNew;
+    *capacity = capacityNew;
+    return false;
+}
+
+static bool oglwQueueGrowCommands(OglwQueue *q, int needed) {
+    if (needed <= q->commandCapacity) return false;
+    int capacity = q->commandCapacity;
+    if (oglwQueueGrow((void **)&q->commands, &capacity, needed, sizeof(OglwQueueCommand))) return true;
+    uint64_t *keys = realloc(q->keys, capacity * sizeof(uint64_t));
+    if (keys == NULL) return true;
+    q->keys = keys;
+    uint64_t *keysTmp = realloc(q->keysTmp, capacity * sizeof(uint64_t));
+    if (keysTmp == NULL) return true;
+    q->keysTmp = keysTmp;
+    int *order = realloc(q->order, capacity * sizeof(int));
+    if (order == NULL) return true;
+    q->order = order;
+    int *orderTmp = realloc(q->orderTmp, capacity * sizeof(int));
+    if (orderTmp == NULL) return true;
+    q->orderTmp = orderTmp;
+    q->commandCapacity = capacity;
+    return false;
+}
+
+static uint64_t oglwQueueKey(OglwQueue *q, const OglwQueueState *s, int sequence) {
+    if (s->blendingEnabled || !s->depthWriteEnabled)
+        return QUEUE_BLENDED_PASS | (uint32_t)sequence;
+
+    uint64_t bits = 0;
+    bits |= (s->depthNear != q->depthNear || s->depthFar != q->depthFar) << 8;
+    bits |= s->stencilTestEnabled << 7;
+    bits |= s->alphaTestEnabled << 6;
+    bits |= s->depthTestEnabled << 5;
+    bits |= (s->texturingEnabled[0] != 0) << 4;
+    bits |= (s->texturingEnabled[1] != 0) << 3;
+    bits |= (s->textureBlending[0] == GL_MODULATE) << 2;
+    bits |= (s->textureBlending[1] == GL_MODULATE) << 1;
+    bits |= s->smoothShadingEnabled;
+    uint64_t texture0 = s->texturingEnabled[0] ? (s->texture[0] & 0xffff) : 0;
+    uint64_t texture1 = s->texturingEnabled[1] ? (s->texture[1] & 0xffff) : 0;
+    float depth = q->depth < 0.0f ? 0.0f : (q->depth > 1.0f ? 1.0f : q->depth);
+    uint64_t depthBits = (uint64_t)(depth * 65535.0f);
+    return (bits << 48) | (texture0 << 32) | (texture1 << 16) | depthBits;
+}
+
+static void oglwQueueRecord(OpenGLWrapper *oglw, GLenum primitive) {
+    OglwQueue *q = &oglw->queue;
+    int vertexNb = oglw->verticesLength;
+    int indexNb = oglw->indicesLength;
+    if (oglwQueueGrowCommands(q, q->commandNb + 1)
+        || oglwQueueGrow((void **)&q->vertices, &q->vertexCapacity, q->vertexNb + vertexNb, sizeof(OglwVertex))
+        || oglwQueueGrow((void **)&q->indices, &q->indexCapacity, q->indexNb + indexNb, sizeof(GLushort))
+        || oglwQueueGrow((void **)&q->matrices, &q->matrixCapacity, (q->matrixNb + 1) * 16, sizeof(float))) {
+        oglwDraw(oglw, primitive); // Out of memory, draw it right away.
+        return;
+    }
+
+    OglwQueueCommand *c = &q->commands[q->commandNb];
+    OglwQueueState *s = &c->state;
+    memset(s, 0, sizeof(*s)); // The states are compared with memcmp, padding included.
+    for (int i = 0; i < 2; i++) {
+        OpenGLWrapperTextureUnit *tu = &oglw->textureUnits[i];
+        s->texture[i] = tu->textureRequested;
+        s->texturingEnabled[i] = tu->texturingEnabledRequested;
+        s->textureBlending[i] = tu->blendingRequested;
+    }
+    s->smoothShadingEnabled = oglw->smoothShadingEnabledRequested;
+    s->blendingEnabled = oglw->blendingEnabledRequested;
+    s->blendingSrc = oglw->blendingSrcRequested;
+    s->blendingDst = oglw->blendingDstRequested;
+    s->alphaTestEnabled = oglw->alphaTestEnabledRequested;
+    s->depthTestEnabled = oglw->depthTestEnabledRequested;
+    s->stencilTestEnabled = oglw->stencilTestEnabledRequested;
+    s->depthWriteEnabled = oglw->depthWriteEnabledRequested;
+    s->depthNear = oglw->viewport.depthNear;
+    s->depthFar = oglw->viewport.depthFar;
+
+    // Batches of the same entity share their transformation.
+    float *matrix = &q->matrices[q->matrixNb * 16];
+    Matrix4x4_mul(matrix, &oglw->projectionStack.matrices[oglw->projectionStack.depth * 16], &oglw->modelViewStack.matrices[oglw->modelViewStack.depth * 16]);
+    if (q->matrixNb == 0 || memcmp(matrix, matrix - 16, 16 * sizeof(float)) != 0)
+        q->matrixNb++;
+    c->matrix = q->matrixNb - 1;
+
+    c->primitive = primitive;
+    c->firstVertex = q->vertexNb;
+    c->vertexNb = vertexNb;
+    c->firstIndex = q->indexNb;
+    c->indexNb = indexNb;
+    memcpy(&q->vertices[q->vertexNb], oglw->vertices, vertexNb * sizeof(OglwVertex));
+    memcpy(&q->indices[q->indexNb], oglw->indices, indexNb * sizeof(GLushort));
+    q->vertexNb += vertexNb;
+    q->indexNb += indexNb;
+
+    q->keys[q->commandNb] = oglwQueueKey(q, s, q->commandNb);
+    q->order[q->commandNb] = q->commandNb;
+    q->commandNb++;
+}
+
+// Stable LSD radix sort of the keys and their command indices, skipping the bytes all keys share.
+static void oglwQueueSort(OglwQueue *q) {
+    int n = q->commandNb;
+    uint64_t *keys = q->keys, *keysTmp = q->keysTmp;
+    int *order = q->order, *orderTmp = q->orderTmp;
+    for (int shift = 0; shift < 64; shift += 8) {
+        int counts[256];
+        memset(counts, 0, sizeof(counts));
+        for (int i = 0; i < n; i++)
+            counts[(keys[i] >> shift) & 0xff]++;
+        if (counts[(keys[0] >> shift) & 0xff] == n)
+            continue;
+        int offset = 0;
+        for (int i = 0; i < 256; i++) {
+            int count = counts[i];
+            counts[i] = offset;
+            offset += count;
+        }
+        for (int i = 0; i < n; i++) {
+            int j = counts[(keys[i] >> shift) & 0xff]++;
+            keysTmp[j] = keys[i];
+            orderTmp[j] = order[i];
+        }
+        uint64_t *k = keys; keys = keysTmp; keysTmp = k;
+        int *o = order; order = orderTmp; orderTmp = o;
+    }
+    q->keys = keys;
+    q->keysTmp = keysTmp;
+    q->order = order;
+    q->orderTmp = orderTmp;
+}
+
+static bool oglwQueueCanMerge(OglwQueue *q, const OglwQueueCommand *c0, const OglwQueueCommand *c1, int vertexNb) {
+    if (c0->matrix != c1->matrix || c0->primitive != c1->primitive) return false;
+    if (c0->primitive != GL_TRIANGLES && c0->primitive != GL_LINES) return false;
+    if ((c0->indexNb > 0) != (c1->indexNb > 0)) return false;
+    if (vertexNb + c1->vertexNb > 65536) return false;
+    return memcmp(&c0->state, &c1->state, sizeof(OglwQueueState)) == 0;
+}
+
+static void oglwQueueApplyState(OpenGLWrapper *oglw, const OglwQueueState *s) {
+    for (int i = 0; i < 2; i++) {
+        OpenGLWrapperTextureUnit *tu = &oglw->textureUnits[i];
+        tu->textureRequested = s->texture[i];
+        tu->texturingEnabledRequested = s->texturingEnabled[i];
+        tu->blendingRequested = s->textureBlending[i];
+    }
+    oglw->smoothShadingEnabledRequested = s->smoothShadingEnabled;
+    oglw->blendingEnabledRequested = s->blendingEnabled;
+    oglw->blendingSrcRequested = s->blendingSrc;
+    oglw->blendingDstRequested = s->blendingDst;
+    oglw->alphaTestEnabledRequested = s->alphaTestEnabled;
+    oglw->depthTestEnabledRequested = s->depthTestEnabled;
+    oglw->stencilTestEnabledRequested = s->stencilTestEnabled;
+    oglw->depthWriteEnabledRequested = s->depthWriteEnabled;
+    oglwSetDepthRange(s->depthNear, s->depthFar);
+}
+
+static bool oglwQueueStateDiffers(const OglwQueueCommand *c0, const OglwQueueCommand *c1) {
+    return c0 == NULL || memcmp(&c0->state, &c1->state, sizeof(OglwQueueState)) != 0;
+}
+
+void oglwBeginQueue() {
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    OglwQueue *q = &oglw->queue;
+    if (q->enabled) return;
+    q->enabled = true;
+    q->depth = 0.0f;
+    q->depthNear = oglw->viewport.depthNear;
+    q->depthFar = oglw->viewport.depthFar;
+    q->commandNb = 0;
+    q->vertexNb = 0;
+    q->indexNb = 0;
+    q->matrixNb = 0;
+}
+
+void oglwSetQueueDepth(float depth) {
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    oglw->queue.depth = depth;
+}
+
+void oglwEndQueue() {
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    OglwQueue *q = &oglw->queue;
+    if (!q->enabled) return;
+    q->enabled = false;
+    if (q->commandNb == 0) return;
+
+    // Requested state to restore once the queue is drawn.
+    OglwQueueCommand current;
+    {
+        OglwQueueState *s = &current.state;
+        memset(s, 0, sizeof(*s));
+        for (int i = 0; i < 2; i++) {
+            OpenGLWrapperTextureUnit *tu = &oglw->textureUnits[i];
+            s->texture[i] = tu->textureRequested;
+            s->texturingEnabled[i] = tu->texturingEnabledRequested;
+            s->textureBlending[i] = tu->blendingRequested;
+        }
+        s->smoothShadingEnabled = oglw->smoothShadingEnabledRequested;
+        s->blendingEnabled = oglw->blendingEnabledRequested;
+        s->blendingSrc = oglw->blendingSrcRequested;
+        s->blendingDst = oglw->blendingDstRequested;
+        s->alphaTestEnabled = oglw->alphaTestEnabledRequested;
+        s->depthTestEnabled = oglw->depthTestEnabledRequested;
+        s->stencilTestEnabled = oglw->stencilTestEnabledRequested;
+        s->depthWriteEnabled = oglw->depthWriteEnabledRequested;
+        s->depthNear = oglw->viewport.depthNear;
+        s->depthFar = oglw->viewport.depthFar;
+    }
+
+    // State changes in submission order, for the statistics.
+    const OglwQueueCommand *previous = NULL;
+    for (int i = 0; i < q->commandNb; i++) {
+        const OglwQueueCommand *c = &q->commands[i];
+        if (oglwQueueStateDiffers(previous, c)) oglw->stats.queueStateChangeNbBefore++;
+        previous = c;
+    }
+    oglw->stats.queueBatchNb += q->commandNb;
+
+    oglwQueueSort(q);
+
+    previous = NULL;
+    int currentMatrix = -1;
+    for (int i = 0; i < q->commandNb; ) {
+        const OglwQueueCommand *c0 = &q->commands[q->order[i]];
+        int end = i + 1;
+        int vertexNb = c0->vertexNb;
+        while (end < q->commandNb && oglwQueueCanMerge(q, c0, &q->commands[q->order[end]], vertexNb)) {
+            vertexNb += q->commands[q->order[end]].vertexNb;
+            end++;
+        }
+
+        if (oglwQueueStateDiffers(previous, c0)) oglw->stats.queueStateChangeNbAfter++;
+        previous = c0;
+        oglwQueueApplyState(oglw, &c0->state);
+
+        if (oglwReserveVertices(oglw, vertexNb)) break;
+        int indexNb = 0;
+        for (int j = i; j < end; j++) indexNb += q->commands[q->order[j]].indexNb;
+        if (oglwReserveIndices(oglw, indexNb)) break;
+
+        // Gather the batches, rebasing their indices.
+        OglwVertex *vertices = oglw->vertices;
+        GLushort *indices = oglw->indices;
+        GLubyte *bindices = oglw->bindices;
+        int base = 0;
+        GLushort maxIndex = 0;
+        for (int j = i; j < end; j++) {
+            const OglwQueueCommand *c = &q->commands[q->order[j]];
+            memcpy(vertices + base, &q->vertices[c->firstVertex], c->vertexNb * sizeof(OglwVertex));
+            const GLushort *src = &q->indices[c->firstIndex];
+            for (int k = 0; k < c->indexNb; k++) {
+                GLushort index = src[k] + base;
+                *indices++ = index;
+                *bindices++ = (GLubyte)index;
+                if (maxIndex < index) maxIndex = index;
+            }
+            base += c->vertexNb;
+        }
+        oglw->beginFlag = true;
+        oglw->primitive = c0->primitive;
+        oglw->verticesLength = vertexNb;
+        oglw->indicesLength = indexNb;
+        oglw->maxIndex = maxIndex;
+
+        if (c0->matrix != currentMatrix) {
+            currentMatrix = c0->matrix;
+            glUniformMatrix4fv(oglw->u_transformation, 1, GL_FALSE, &q->matrices[currentMatrix * 16]);
+        }
+        oglw->transformationDirty = false;
+        oglwDraw(oglw, c0->primitive);
+        oglwReset();
+
+        i = end;
+    }
+
+    oglwQueueApplyState(oglw, &current.state);
+    oglw->transformationDirty = true;
+    q->commandNb = 0;
+    q->vertexNb = 0;
+    q->indexNb = 0;
+    q->matrixNb = 0;
+}
+
+bool oglwIsQueueEnabled() {
+    OpenGLWrapper *oglw = l_openGLWrapper;
+    return oglw->queue.enabled;
+}
+
+#else
+
+void oglwBeginQueue() {
+}
+
+void oglwSetQueueDepth(float depth) {
+}
+
+void oglwEndQueue() {
+}
+
+bool oglwIsQueueEnabled() {
+    return false;
+}
+
+#endif
+
 bool oglwIsEmpty() {
     OpenGLWrapper *oglw = l_openGLWrapper;
     return (oglw->verticesLength <= 0);
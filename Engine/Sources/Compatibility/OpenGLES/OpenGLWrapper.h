@@ -135,6 +135,69 @@ typedef struct oglwVertex_ {
 #pragma pack(pop) 
 
 
+typedef struct oglwStats_ {
+    int drawCallNb;
+    int stateChangeNb;
+    int bytesStreamed;
+    int bufferWrapNb;
+    // Draw queue: batches recorded, and state changes between them in submission and in sorted order.
+    int queueBatchNb;
+    int queueStateChangeNbBefore;
+    int queueStateChangeNbAfter;
+} OglwStats;
+
+// Draw queue. Between oglwBeginQueue and oglwEndQueue, batches are recorded with their state
+// and transformation, then sorted to reduce state changes and drawn by oglwEndQueue.
+// Blended batches are drawn after the opaque ones, in submission order.
+// Only state set through the wrapper is recorded.
+void oglwBeginQueue();
+// Sort depth of the next batches, from 0 (near) to 1 (far).
+void oglwSetQueueDepth(float depth);
+void oglwEndQueue();
+bool oglwIsQueueEnabled();
+
+// Static buffers, for geometry uploaded once. Creation returns 0 when buffer objects are not available.
+GLuint oglwCreateStaticBuffer(const OglwVertex *vertices, int vertexNb);
+void oglwDestroyStaticBuffer(GLuint buffer);
+// Draws triangles whose indices are relative to the vertex first. Texture unit 0 reads the texture coordinates set texCoordSet0.
+void oglwDrawStaticElements(GLuint buffer, int first, const GLushort *indices, int indexNb, int texCoordSet0);
+
+// Keyframe models, interpolated by a dedicated program. Each frame holds 4 bytes per vertex:
+// x, y, z and an index in the light table. Only available with GLES2 and buffer objects.
+typedef struct oglwKeyframeModel_ {
+    GLuint vertexBuffer, indexBuffer;
+    int vertexNb, frameNb, indexNb;
+} OglwKeyframeModel;
+
+bool oglwIsKeyframeSupported();
+// Returns true on error.
+bool oglwCreateKeyframeModel(OglwKeyframeModel *model, const GLubyte *frames, int frameNb, const GLfloat *texCoords, int vertexNb, const GLushort *indices, int indexNb);
+void oglwDestroyKeyframeModel(OglwKeyframeModel *model);
+// Draws the triangles with texture unit 0 modulated by the color.
+// position = move + oldFrame * backScale + frame * frontScale, color = color * lightTable[index].
+void oglwDrawKeyframeModel(const OglwKeyframeModel *model, int frame, int oldFrame, const float move[3], const float frontScale[3], const float backScale[3], const float color[4], const float lightTable[256]);
+
+// Light programs, drawing the lightmap pass of lit surfaces. Only available with GLES2.
+bool oglwIsLightstyleSupported();
+// Until oglwEndLighting, draws the light of lightmap pages. A page stacks 4 light layers, then a layer whose
+// texels hold the 4 style indices of their surface. Texture unit 0 holds the page and the texture coordinates
+// set 0 address its first layer. Texture unit 1 holds the style table, 256 texels of color / scale.
+void oglwBeginLightstyles(int pageWidth, int pageHeight, float scale);
+// Until oglwEndLighting, draws textured lit surfaces in one pass: color = vertexColor * texture * light.
+// Texture unit 0 holds the texture and unit 1 the page, read with the texture coordinates sets 0 and 1.
+// The style table is bound to texture unit 2.
+void oglwBeginTexturedLightstyles(int pageWidth, int pageHeight, float scale, GLuint styleTable);
+// Until oglwEndLighting, adds dynamic lights to texture unit 0. The vertex color is the light color, the
+// position w its radius on the surface and the texture coordinates set 1 the offset of the light center.
+// color = texture * lightColor * (radius - distance) * scale, where distance < radius - cutoff.
+// With subtractFlag, the color is subtracted from the framebuffer instead, for dark lights.
+void oglwBeginDynamicLights(float cutoff, float scale, bool subtractFlag);
+void oglwEndLighting();
+
+// Draw calls and vertex bytes streamed since the last reset.
+void oglwGetStats(OglwStats *stats);
+void oglwResetStats();
+
 void oglwPointSize(float size);
 
 /*
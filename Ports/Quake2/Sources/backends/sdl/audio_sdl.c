@@ -793,48 +793,48 @@ void SDL_UpdateScaletable()
 }
 
 /*
- * Saves a sound sample into cache. If
- * necessary endianess convertions are
- * performed.
+ * Returns the size of the cache of a
+ * sample at the playback rate, or 0
+ * for an empty sample.
  */
-qboolean SDL_Cache(sfx_t *sfx, wavinfo_t *info, byte *data)
+int SDL_CacheSize(wavinfo_t *info)
 {
 	float stepscale;
-	int i;
 	int len;
-	int sample;
-	int srcsample;
-	sfxcache_t *sc;
-	unsigned int samplefrac = 0;
 
 	stepscale = (float)info->rate / (float)sound.speed;
 	len = (int)((float)info->samples / stepscale);
 
 	if ((info->samples == 0) || (len == 0))
 	{
-		Com_Printf("WARNING: Zero length sound encountered: %s\n", sfx->name);
-		return false;
+		return 0;
 	}
 
-	len = len * info->width * info->channels;
-	sc = sfx->cache = Z_Malloc(len + (int)sizeof(sfxcache_t));
+	return len * info->width * info->channels + (int)sizeof(sfxcache_t);
+}
 
-	if (!sc)
-		return false;
+/*
+ * Resamples a sample into a cache of
+ * SDL_CacheSize bytes. If necessary
+ * endianess convertions are performed.
+ * Uses neither the zone nor the console,
+ * the registration workers call it.
+ */
+void SDL_Resample(wavinfo_t *info, byte *data, sfxcache_t *sc)
+{
+	float stepscale;
+	int i;
+	int sample;
+	int srcsample;
+	unsigned int samplefrac = 0;
+
+	stepscale = (float)info->rate / (float)sound.speed;
 
 	sc->loopstart = info->loopstart;
 	sc->stereo = 0;
 	sc->length = (int)((float)info->samples / stepscale);
 	sc->speed = sound.speed;
 
-	if ((int)((float)info->samples / stepscale) == 0)
-	{
-		Com_Printf("ResampleSfx: Invalid sound file '%s' (zero length)\n", sfx->name);
-		Z_Free(sfx->cache);
-		sfx->cache = NULL;
-		return false;
-	}
-
 	if (sc->loopstart != -1)
 	{
 		sc->loopstart = (int)((float)sc->loopstart / stepscale);
@@ -846,7 +846,7 @@ qboolean SDL_Cache(sfx_t *sfx, wavinfo_t *info, byte *data)
 		sc->width = info->width;
 
 	/* resample / decimate to the current source rate */
-	for (i = 0; i < (int)((float)info->samples / stepscale); i++)
+	for (i = 0; i < sc->length; i++)
 	{
 		srcsample = (int)(samplefrac >> 8);
 		samplefrac += (unsigned int)(stepscale * 256);
@@ -861,7 +861,30 @@ qboolean SDL_Cache(sfx_t *sfx, wavinfo_t *info, byte *data)
 		else
 			((signed char *)sc->data)[i] = (signed char)(sample >> 8);
 	}
+}
+
+/*
+ * Saves a sound sample into cache.
+ */
+qboolean SDL_Cache(sfx_t *sfx, wavinfo_t *info, byte *data)
+{
+	int size;
+	sfxcache_t *sc;
+
+	size = SDL_CacheSize(info);
+
+	if (!size)
+	{
+		Com_Printf("WARNING: Zero length sound encountered: %s\n", sfx->name);
+		return false;
+	}
+
+	sc = sfx->cache = Z_Malloc(size);
+
+	if (!sc)
+		return false;
 
+	SDL_Resample(info, data, sc);
 	return true;
 }
 
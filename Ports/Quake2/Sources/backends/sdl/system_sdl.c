@@ -50,6 +50,15 @@ int Sys_Milliseconds()
 	return curtime;
 }
 
+long long Sys_Microseconds()
+{
+	Uint64 counter = SDL_GetPerformanceCounter();
+	Uint64 frequency = SDL_GetPerformanceFrequency();
+
+	return (long long)((counter / frequency) * 1000000 +
+		(counter % frequency) * 1000000 / frequency);
+}
+
 void Sys_RedirectStdout()
 {
 	if (!logFileEnabled)
@@ -30,6 +30,7 @@
 #endif
 
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <errno.h>
 #include <sys/time.h>
 #include <unistd.h>
@@ -165,3 +166,37 @@ void Hunk_Free(void *base)
 		}
 	}
 }
+
+void* Sys_MapFile(FILE *f, int *size)
+{
+	struct stat st;
+	void *base;
+
+	if ((fstat(fileno(f), &st) != 0) || (st.st_size <= 0) || (st.st_size > 0x7fffffff))
+	{
+		return NULL;
+	}
+
+	/* Shared so every process using the pack shares its page cache. */
+	base = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fileno(f), 0);
+
+	if (base == MAP_FAILED)
+	{
+		return NULL;
+	}
+
+	*size = (int)st.st_size;
+
+	return base;
+}
+
+void Sys_UnmapFile(void *base, int size)
+{
+	if (base)
+	{
+		if (munmap(base, size))
+		{
+			Sys_Error("Sys_UnmapFile: munmap failed (%d)", errno);
+		}
+	}
+}
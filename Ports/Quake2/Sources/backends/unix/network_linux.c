@@ -42,6 +42,10 @@
 #include <errno.h>
 #include <arpa/inet.h>
 #include <net/if.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
 
 netadr_t net_local_adr;
 
@@ -62,12 +66,49 @@ typedef struct
 } loopback_t;
 
 loopback_t loopbacks[2];
+
+/* Packets are read from the sockets by batches and handed out one by
+   one by NET_GetPacket. Between NET_BeginBatch and NET_EndBatch, the
+   sent packets are queued and go out together. */
+#define NET_BATCH 32
+
+typedef struct
+{
+	byte data[MAX_MSGLEN];
+	int datalen;
+	struct sockaddr_storage from;
+} netrecvmsg_t;
+
+typedef struct
+{
+	netrecvmsg_t msgs[NET_BATCH];
+	int get, count;
+} netrecv_t;
+
+typedef struct
+{
+	int net_socket;
+	int addr_size;
+	struct sockaddr_storage addr;
+	netadr_t to;
+	byte data[MAX_MSGLEN];
+	int datalen;
+} netsendmsg_t;
+
+static netrecv_t net_recv[2];
+static netsendmsg_t net_send[NET_BATCH];
+static int net_sendNb;
+static qboolean net_sendBatching;
+
 int ip_sockets[2];
 int ip6_sockets[2];
 int ipx_sockets[2];
 char *multicast_interface = NULL;
 
 int NET_Socket(char *net_interface, int port, netsrc_t type, int family);
+#ifdef __linux__
+static void NET_Wait_forget(void);
+#endif
 char* NET_ErrorString(void);
 
 void NetadrToSockadr(netadr_t *a, struct sockaddr_storage *s)
@@ -503,72 +544,228 @@ void NET_SendLoopPacket(netsrc_t sock, int length, void *data, netadr_t to)
 	loop->msgs[i].datalen = length;
 }
 
-qboolean NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
+/*
+ * Reads up to max pending packets from the socket,
+ * returns the number of packets read
+ */
+static int NET_ReceiveBatch(int net_socket, netrecvmsg_t *msgs, int max)
 {
 	int ret;
-	struct sockaddr_storage from;
-	socklen_t fromlen;
-	int net_socket;
-	int protocol;
+	int i;
 	int err;
+#ifdef __linux__
+	struct mmsghdr hdrs[NET_BATCH];
+	struct iovec iovs[NET_BATCH];
 
-	if (NET_GetLoopPacket(sock, net_from, net_message))
+	memset(hdrs, 0, max * sizeof(hdrs[0]));
+
+	for (i = 0; i < max; i++)
 	{
-		return true;
+		iovs[i].iov_base = msgs[i].data;
+		iovs[i].iov_len = sizeof(msgs[i].data);
+		hdrs[i].msg_hdr.msg_name = &msgs[i].from;
+		hdrs[i].msg_hdr.msg_namelen = sizeof(msgs[i].from);
+		hdrs[i].msg_hdr.msg_iov = &iovs[i];
+		hdrs[i].msg_hdr.msg_iovlen = 1;
 	}
 
-	for (protocol = 0; protocol < 3; protocol++)
+	ret = recvmmsg(net_socket, hdrs, max, MSG_DONTWAIT, NULL);
+
+	if (ret == -1)
 	{
-		if (protocol == 0)
+		err = errno;
+
+		if ((err != EWOULDBLOCK) && (err != ECONNREFUSED))
 		{
-			net_socket = ip_sockets[sock];
+			Com_Printf("NET_GetPacket: %s\n", NET_ErrorString());
 		}
-		else
-		if (protocol == 1)
+
+		return 0;
+	}
+
+	for (i = 0; i < ret; i++)
+	{
+		msgs[i].datalen = hdrs[i].msg_len;
+	}
+
+	return ret;
+#else
+	socklen_t fromlen;
+
+	for (i = 0; i < max; i++)
+	{
+		fromlen = sizeof(msgs[i].from);
+		ret = recvfrom(net_socket, msgs[i].data, sizeof(msgs[i].data),
+				0, (struct sockaddr *)&msgs[i].from, &fromlen);
+
+		if (ret == -1)
 		{
-			net_socket = ip6_sockets[sock];
+			err = errno;
+
+			if ((err == EWOULDBLOCK) || (err == ECONNREFUSED))
+			{
+				break;
+			}
+
+			Com_Printf("NET_GetPacket: %s\n", NET_ErrorString());
+			break;
 		}
-		else
+
+		msgs[i].datalen = ret;
+	}
+
+	return i;
+#endif
+}
+
+qboolean NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
+{
+	int net_socket;
+	int protocol;
+	netrecv_t *recv;
+	netrecvmsg_t *msg;
+
+	if (NET_GetLoopPacket(sock, net_from, net_message))
+	{
+		return true;
+	}
+
+	recv = &net_recv[sock];
+
+	for ( ; ; )
+	{
+		if (recv->get >= recv->count)
 		{
-			net_socket = ipx_sockets[sock];
+			/* drain the sockets */
+			recv->get = 0;
+			recv->count = 0;
+
+			for (protocol = 0; protocol < 3; protocol++)
+			{
+				if (protocol == 0)
+				{
+					net_socket = ip_sockets[sock];
+				}
+				else
+				if (protocol == 1)
+				{
+					net_socket = ip6_sockets[sock];
+				}
+				else
+				{
+					net_socket = ipx_sockets[sock];
+				}
+
+				if (!net_socket || (recv->count == NET_BATCH))
+				{
+					continue;
+				}
+
+				recv->count += NET_ReceiveBatch(net_socket,
+						&recv->msgs[recv->count], NET_BATCH - recv->count);
+			}
+
+			if (!recv->count)
+			{
+				return false;
+			}
 		}
 
-		if (!net_socket)
+		msg = &recv->msgs[recv->get++];
+		SockadrToNetadr(&msg->from, net_from);
+
+		if ((msg->datalen >= net_message->maxsize) ||
+		    (msg->datalen == sizeof(msg->data)))
 		{
+			Com_Printf("Oversize packet from %s\n", NET_AdrToString(*net_from));
 			continue;
 		}
 
-		fromlen = sizeof(from);
-		ret = recvfrom(net_socket, net_message->data, net_message->maxsize,
-				0, (struct sockaddr *)&from, &fromlen);
+		memcpy(net_message->data, msg->data, msg->datalen);
+		net_message->cursize = msg->datalen;
+		return true;
+	}
+}
 
-		SockadrToNetadr(&from, net_from);
+/*
+ * Sends the queued packets, one system call per run of
+ * packets going through the same socket
+ */
+static void NET_FlushBatch(void)
+{
+	int ret;
+	int i, j, first;
+	netsendmsg_t *msg;
+#ifdef __linux__
+	struct mmsghdr hdrs[NET_BATCH];
+	struct iovec iovs[NET_BATCH];
 
-		if (ret == -1)
+	memset(hdrs, 0, net_sendNb * sizeof(hdrs[0]));
+
+	for (i = 0; i < net_sendNb; i++)
+	{
+		msg = &net_send[i];
+		iovs[i].iov_base = msg->data;
+		iovs[i].iov_len = msg->datalen;
+		hdrs[i].msg_hdr.msg_name = &msg->addr;
+		hdrs[i].msg_hdr.msg_namelen = msg->addr_size;
+		hdrs[i].msg_hdr.msg_iov = &iovs[i];
+		hdrs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	for (first = 0; first < net_sendNb; first = j)
+	{
+		for (j = first + 1; j < net_sendNb; j++)
 		{
-			err = errno;
+			if (net_send[j].net_socket != net_send[first].net_socket)
+			{
+				break;
+			}
+		}
 
-			if ((err == EWOULDBLOCK) || (err == ECONNREFUSED))
+		for (i = first; i < j; )
+		{
+			ret = sendmmsg(net_send[i].net_socket, &hdrs[i], j - i, 0);
+
+			if (ret > 0)
 			{
+				i += ret;
 				continue;
 			}
 
-			Com_Printf("NET_GetPacket: %s from %s\n", NET_ErrorString(),
-				NET_AdrToString(*net_from));
-			continue;
+			/* the packet at i failed, report it and skip it */
+			Com_Printf("NET_SendPacket ERROR: %s to %s\n", NET_ErrorString(),
+				NET_AdrToString(net_send[i].to));
+			i++;
 		}
+	}
+#else
+	for (i = 0; i < net_sendNb; i++)
+	{
+		msg = &net_send[i];
+		ret = sendto(msg->net_socket, msg->data, msg->datalen, 0,
+				(struct sockaddr *)&msg->addr, msg->addr_size);
 
-		if (ret == net_message->maxsize)
+		if (ret == -1)
 		{
-			Com_Printf("Oversize packet from %s\n", NET_AdrToString(*net_from));
-			continue;
+			Com_Printf("NET_SendPacket ERROR: %s to %s\n", NET_ErrorString(),
+				NET_AdrToString(msg->to));
 		}
-
-		net_message->cursize = ret;
-		return true;
 	}
+#endif
 
-	return false;
+	net_sendNb = 0;
+}
+
+void NET_BeginBatch(void)
+{
+	net_sendBatching = true;
+}
+
+void NET_EndBatch(void)
+{
+	NET_FlushBatch();
+	net_sendBatching = false;
 }
 
 void NET_SendPacket(netsrc_t sock, int length, void *data, netadr_t to)
@@ -710,6 +907,25 @@ void NET_SendPacket(netsrc_t sock, int length, void *data, netadr_t to)
 		}
 	}
 
+	if (net_sendBatching && (length <= MAX_MSGLEN))
+	{
+		netsendmsg_t *msg;
+
+		if (net_sendNb == NET_BATCH)
+		{
+			NET_FlushBatch();
+		}
+
+		msg = &net_send[net_sendNb++];
+		msg->net_socket = net_socket;
+		msg->addr_size = addr_size;
+		msg->addr = addr;
+		msg->to = to;
+		memcpy(msg->data, data, length);
+		msg->datalen = length;
+		return;
+	}
+
 	ret = sendto(net_socket,
 			data,
 			length,
@@ -765,9 +981,20 @@ void NET_Config(qboolean multiplayer)
 
 	if (!multiplayer)
 	{
+		/* the queued packets refer to the sockets */
+		NET_FlushBatch();
+		net_sendBatching = false;
+
+#ifdef __linux__
+		NET_Wait_forget();
+#endif
+
 		/* shut down any existing sockets */
 		for (i = 0; i < 2; i++)
 		{
+			net_recv[i].get = 0;
+			net_recv[i].count = 0;
+
 			if (ip_sockets[i])
 			{
 				close(ip_sockets[i]);
@@ -967,15 +1194,146 @@ char* NET_ErrorString(void)
 	return strerror(code);
 }
 
+#ifdef __linux__
+/*
+ * The dedicated server waits on an epoll set holding stdin, the server
+ * sockets and a timerfd armed for the next frame. The watched
+ * descriptors are only updated when they change.
+ */
+#define NET_WAIT_STDIN 0
+#define NET_WAIT_IP 1
+#define NET_WAIT_IP6 2
+#define NET_WAIT_TIMER 3
+
+static int net_epoll = -1;
+static int net_timer = -1;
+static int net_waitFds[3] = { -1, -1, -1 }; /* watched stdin and sockets */
+static int net_waitFailedFds[3] = { -1, -1, -1 }; /* refused by epoll, reported once */
+
+static void NET_Wait_update(int slot, int fd)
+{
+	struct epoll_event event;
+
+	if ((net_waitFds[slot] == fd) || (net_waitFailedFds[slot] == fd))
+	{
+		return;
+	}
+
+	if (net_waitFds[slot] != -1)
+	{
+		/* fails harmlessly when the descriptor was closed */
+		epoll_ctl(net_epoll, EPOLL_CTL_DEL, net_waitFds[slot], NULL);
+	}
+
+	net_waitFds[slot] = -1;
+
+	if (fd != -1)
+	{
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.u32 = slot;
+
+		/* a regular file or /dev/null on stdin gives EPERM */
+		if (epoll_ctl(net_epoll, EPOLL_CTL_ADD, fd, &event) == -1)
+		{
+			Com_Printf("NET_Wait_update: epoll_ctl: %s\n", NET_ErrorString());
+			net_waitFailedFds[slot] = fd;
+			return;
+		}
+
+		net_waitFds[slot] = fd;
+		net_waitFailedFds[slot] = -1;
+	}
+}
+
+static void NET_Wait_forget(void)
+{
+	/* closed sockets leave the epoll set by themselves */
+	net_waitFds[NET_WAIT_IP] = -1;
+	net_waitFds[NET_WAIT_IP6] = -1;
+	net_waitFailedFds[NET_WAIT_IP] = -1;
+	net_waitFailedFds[NET_WAIT_IP6] = -1;
+}
+
+static qboolean NET_Wait_start(void)
+{
+	struct epoll_event event;
+
+	if (net_epoll != -1)
+	{
+		return true;
+	}
+
+	net_epoll = epoll_create1(EPOLL_CLOEXEC);
+	net_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u32 = NET_WAIT_TIMER;
+
+	if ((net_epoll == -1) || (net_timer == -1) ||
+	    (epoll_ctl(net_epoll, EPOLL_CTL_ADD, net_timer, &event) == -1))
+	{
+		Com_Printf("NET_SleepUntil: %s, falling back to select\n", NET_ErrorString());
+
+		if (net_timer != -1)
+		{
+			close(net_timer);
+		}
+
+		if (net_epoll != -1)
+		{
+			close(net_epoll);
+		}
+
+		net_timer = -1;
+		net_epoll = -2; /* don't try again */
+		return false;
+	}
+
+	return true;
+}
+
+static void NET_Wait(long long usec)
+{
+	extern qboolean stdin_active;
+	struct itimerspec timer;
+	struct epoll_event events[4];
+	uint64_t expirations;
+	int i, ret;
+
+	NET_Wait_update(NET_WAIT_STDIN, stdin_active ? 0 : -1);
+	NET_Wait_update(NET_WAIT_IP, ip_sockets[NS_SERVER] ? ip_sockets[NS_SERVER] : -1);
+	NET_Wait_update(NET_WAIT_IP6, ip6_sockets[NS_SERVER] ? ip6_sockets[NS_SERVER] : -1);
+
+	/* rearming also clears a pending expiration */
+	memset(&timer, 0, sizeof(timer));
+	timer.it_value.tv_sec = usec / 1000000;
+	timer.it_value.tv_nsec = (usec % 1000000) * 1000;
+	timerfd_settime(net_timer, 0, &timer, NULL);
+
+	ret = epoll_wait(net_epoll, events, 4, -1);
+
+	for (i = 0; i < ret; i++)
+	{
+		if (events[i].data.u32 == NET_WAIT_TIMER)
+		{
+			read(net_timer, &expirations, sizeof(expirations));
+		}
+	}
+}
+#endif
+
 /*
- * sleeps msec or until net socket is ready
+ * sleeps until the Sys_Microseconds time or until net socket is ready
  */
-void NET_Sleep(int msec)
+void NET_SleepUntil(long long deadline)
 {
 	struct timeval timeout;
 	fd_set fdset;
 	extern cvar_t *dedicated;
 	extern qboolean stdin_active;
+	long long usec;
 
 	if ((!ip_sockets[NS_SERVER] &&
 	     !ip6_sockets[NS_SERVER]) || (dedicated && !dedicated->value))
@@ -983,6 +1341,21 @@ void NET_Sleep(int msec)
 		return; /* we're not a server, just run full speed */
 	}
 
+	usec = deadline - Sys_Microseconds();
+
+	if (usec <= 0)
+	{
+		return;
+	}
+
+#ifdef __linux__
+	if (NET_Wait_start())
+	{
+		NET_Wait(usec);
+		return;
+	}
+#endif
+
 	FD_ZERO(&fdset);
 
 	if (stdin_active)
@@ -992,8 +1365,8 @@ void NET_Sleep(int msec)
 
 	FD_SET(ip_sockets[NS_SERVER], &fdset); /* IPv4 network socket */
 	FD_SET(ip6_sockets[NS_SERVER], &fdset); /* IPv6 network socket */
-	timeout.tv_sec = msec / 1000;
-	timeout.tv_usec = (msec % 1000) * 1000;
+	timeout.tv_sec = usec / 1000000;
+	timeout.tv_usec = usec % 1000000;
 	select(MAX(ip_sockets[NS_SERVER],
 			ip6_sockets[NS_SERVER]) + 1, &fdset, NULL, NULL, &timeout);
 }
@@ -27,6 +27,8 @@
 #include "backends/windows/winquake.h"
 #include "common/common.h"
 
+#include <io.h>
+
 byte *membase;
 int hunkcount;
 int hunkmaxsize;
@@ -92,3 +94,46 @@ void Hunk_Free(void *base)
 
 	hunkcount--;
 }
+
+void* Sys_MapFile(FILE *f, int *size)
+{
+	HANDLE file, mapping;
+	LARGE_INTEGER length;
+	void *base;
+
+	file = (HANDLE)_get_osfhandle(_fileno(f));
+
+	if ((file == INVALID_HANDLE_VALUE) || !GetFileSizeEx(file, &length) ||
+	    (length.QuadPart <= 0) || (length.QuadPart > 0x7fffffff))
+	{
+		return NULL;
+	}
+
+	mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+	if (mapping == NULL)
+	{
+		return NULL;
+	}
+
+	/* The view keeps the mapping object alive. */
+	base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+
+	if (base == NULL)
+	{
+		return NULL;
+	}
+
+	*size = (int)length.QuadPart;
+
+	return base;
+}
+
+void Sys_UnmapFile(void *base, int size)
+{
+	if (base)
+	{
+		UnmapViewOfFile(base);
+	}
+}
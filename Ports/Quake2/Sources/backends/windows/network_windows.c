@@ -614,6 +614,17 @@ qboolean NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message
 
 /* ============================================================================= */
 
+/*
+ * Packets are sent one by one on Windows
+ */
+void NET_BeginBatch(void)
+{
+}
+
+void NET_EndBatch(void)
+{
+}
+
 void NET_SendPacket(netsrc_t sock, int length, void *data, netadr_t to)
 {
 	int ret;
@@ -1194,21 +1205,29 @@ void NET_Config(qboolean multiplayer)
 }
 
 /*
- * sleeps msec or until
- * net socket is ready
+ * sleeps until the Sys_Microseconds
+ * time or until net socket is ready
  */
-void NET_Sleep(int msec)
+void NET_SleepUntil(long long deadline)
 {
 	struct timeval timeout;
 	fd_set fdset;
 	extern cvar_t *dedicated;
 	int i;
+	long long usec;
 
 	if (!dedicated || !dedicated->value)
 	{
 		return; /* we're not a server, just run full speed */
 	}
 
+	usec = deadline - Sys_Microseconds();
+
+	if (usec <= 0)
+	{
+		return;
+	}
+
 	FD_ZERO(&fdset);
 	i = 0;
 
@@ -1234,8 +1253,8 @@ void NET_Sleep(int msec)
 		}
 	}
 
-	timeout.tv_sec = msec / 1000;
-	timeout.tv_usec = (msec % 1000) * 1000;
+	timeout.tv_sec = (long)(usec / 1000000);
+	timeout.tv_usec = (long)(usec % 1000000);
 	i = max(ip_sockets[NS_SERVER], ip6_sockets[NS_SERVER]);
 	i = max(i, ipx_sockets[NS_SERVER]);
 	select(i + 1, &fdset, NULL, NULL, &timeout);
@@ -693,6 +693,141 @@ void V_Viewpos_f(void)
 		(int)cl.refdef.viewangles[YAW]);
 }
 
+/*
+ * Registers every map of the paks with the models and sounds of its
+ * entities and the client precaches, and times the name lookups
+ * by replaying them while the registration is still open
+ */
+#define REGTEST_MAX_NAMES 256
+
+void V_RegistrationTest_f(void)
+{
+	static char models[REGTEST_MAX_NAMES][MAX_QPATH];
+	static char sounds[REGTEST_MAX_NAMES][MAX_QPATH];
+	int iterationNb = (Cmd_Argc() > 1) ? atoi(Cmd_Argv(1)) : 100;
+	int fileNb, mapNb = 0, nameNb = 0;
+	int registrationTime = 0, lookupTime = 0;
+
+	if (cls.state >= ca_connected)
+	{
+		Com_Printf("registration_test: disconnect first\n");
+		return;
+	}
+
+	if (iterationNb < 1)
+	{
+		iterationNb = 1;
+	}
+
+	char **files = FS_ListFiles2("maps/*.bsp", &fileNb, SFF_INPACK, 0);
+
+	for (int fileIndex = 0; fileIndex < fileNb - 1; fileIndex++)
+	{
+		byte *buffer;
+		int length = FS_LoadFile(files[fileIndex], (void **)&buffer);
+
+		if (!buffer)
+		{
+			continue;
+		}
+
+		if (length < (int)sizeof(dheader_t))
+		{
+			FS_FreeFile(buffer);
+			continue;
+		}
+
+		/* collect the models and sounds named by the entities */
+		int modelNb = 0, soundNb = 0;
+		dheader_t header = *(dheader_t *)buffer;
+		int ofs = LittleLong(header.lumps[LUMP_ENTITIES].fileofs);
+		int len = LittleLong(header.lumps[LUMP_ENTITIES].filelen);
+
+		if ((LittleLong(header.ident) == IDBSPHEADER) &&
+			(ofs >= 0) && (len > 0) && (ofs + len <= length))
+		{
+			char *entities = Z_Malloc(len + 1);
+			char *data = entities;
+			char key[MAX_QPATH];
+
+			memcpy(entities, buffer + ofs, len);
+
+			while (data)
+			{
+				Q_strlcpy(key, COM_Parse(&data), sizeof(key));
+
+				if (!data || (key[0] == '{') || (key[0] == '}'))
+				{
+					continue;
+				}
+
+				char *value = COM_Parse(&data);
+
+				if (!strcmp(key, "model") && (value[0] != '*') && value[0] && (modelNb < REGTEST_MAX_NAMES))
+				{
+					Q_strlcpy(models[modelNb++], value, MAX_QPATH);
+				}
+				else if (!strcmp(key, "noise") && value[0] && (soundNb < REGTEST_MAX_NAMES))
+				{
+					Q_strlcpy(sounds[soundNb++], value, MAX_QPATH);
+				}
+			}
+
+			Z_Free(entities);
+		}
+
+		FS_FreeFile(buffer);
+
+		char mapname[MAX_QPATH];
+		COM_FileBase(files[fileIndex], mapname);
+		mapNb++;
+
+		int start = Sys_Milliseconds();
+		S_BeginRegistration();
+		R_BeginRegistration(mapname);
+
+		int lookupStart = 0;
+
+		for (int iteration = 0; iteration <= iterationNb; iteration++)
+		{
+			/* the first pass registers, the others only look up */
+			if (iteration == 1)
+			{
+				lookupStart = Sys_Milliseconds();
+			}
+
+			SCR_TouchPics();
+			CL_RegisterTEntModels();
+			CL_RegisterTEntSounds();
+
+			for (int i = 0; i < modelNb; i++)
+			{
+				R_RegisterModel(models[i]);
+			}
+
+			for (int i = 0; i < soundNb; i++)
+			{
+				S_RegisterSound(sounds[i]);
+			}
+		}
+
+		lookupTime += Sys_Milliseconds() - lookupStart;
+		nameNb += modelNb + soundNb;
+
+		R_EndRegistration();
+		S_EndRegistration();
+		registrationTime += Sys_Milliseconds() - start;
+	}
+
+	if (files)
+	{
+		FS_FreeList(files, fileNb);
+	}
+
+	Com_Printf("%i maps, %i entity models and sounds, registration %i ms, %i lookup passes %i ms\n",
+		mapNb, nameNb, registrationTime - lookupTime, iterationNb, lookupTime);
+}
+
 void V_Init()
 {
 	Cmd_AddCommand("gun_next", V_Gun_Next_f);
@@ -700,6 +835,7 @@ void V_Init()
 	Cmd_AddCommand("gun_model", V_Gun_Model_f);
 
 	Cmd_AddCommand("viewpos", V_Viewpos_f);
+	Cmd_AddCommand("registration_test", V_RegistrationTest_f);
 
 	crosshair = Cvar_Get("crosshair", "0", CVAR_ARCHIVE);
 	crosshair_scale = Cvar_Get("crosshair_scale", "-1", CVAR_ARCHIVE);
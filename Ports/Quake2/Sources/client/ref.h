@@ -173,6 +173,20 @@ void R_View_setLightLevel();
 void R_BeginRegistration(char *map);
 void R_EndRegistration();
 
+/*
+ * Work for the registration worker pool. run is called on a worker thread
+ * and must not use the file system, the zone, the hunk or the console.
+ */
+typedef struct asynctask_s
+{
+	void (*run)(struct asynctask_s *task);
+	struct asynctask_s *next;
+	qboolean done;
+} asynctask_t;
+
+qboolean R_Async_queue(asynctask_t *task);
+void R_Async_wait(asynctask_t *task);
+
 struct model_s* R_RegisterModel(char *name);
 struct image_s* R_RegisterSkin(char *name);
 void R_Sky_set(char *name, float rotate, vec3_t axis);
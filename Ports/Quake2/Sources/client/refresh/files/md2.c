@@ -3,66 +3,96 @@
 
 #define MAX_LBM_HEIGHT 480
 
-void LoadMD2(model_t *mod, void *buffer)
+/*
+ * Byte swaps an MD2 file into a malloc'd copy. Doesn't use the hunk or the
+ * console so that the registration workers can call it: returns NULL with
+ * the reason in error if the model is rejected.
+ */
+dmdl_t* ParseMD2(const char *name, const void *buffer, char *error, int errorSize)
 {
 	int i, j;
-	dmdl_t *pinmodel, *pheader;
-	dstvert_t *pinst, *poutst;
-	dtriangle_t *pintri, *pouttri;
-	daliasframe_t *pinframe, *poutframe;
-	int *pincmd, *poutcmd;
+	const dmdl_t *pinmodel;
+	dmdl_t *pheader;
+	const dstvert_t *pinst;
+	dstvert_t *poutst;
+	const dtriangle_t *pintri;
+	dtriangle_t *pouttri;
+	const daliasframe_t *pinframe;
+	daliasframe_t *poutframe;
+	const int *pincmd;
+	int *poutcmd;
+	dmdl_t header;
 	int version;
 
-	pinmodel = (dmdl_t *)buffer;
+	pinmodel = (const dmdl_t *)buffer;
 
 	version = LittleLong(pinmodel->version);
 
 	if (version != ALIAS_VERSION)
 	{
-		R_error(ERR_DROP, "%s has wrong version number (%i should be %i)",
-				mod->name, version, ALIAS_VERSION);
+		snprintf(error, errorSize, "%s has wrong version number (%i should be %i)",
+				name, version, ALIAS_VERSION);
+		return NULL;
 	}
 
-	pheader = Hunk_Alloc(LittleLong(pinmodel->ofs_end));
-
 	/* byte swap the header fields and sanity check */
 	for (i = 0; i < (int)sizeof(dmdl_t) / 4; i++)
 	{
-		((int *)pheader)[i] = LittleLong(((int *)buffer)[i]);
+		((int *)&header)[i] = LittleLong(((const int *)buffer)[i]);
+	}
+
+	if (header.skinheight > MAX_LBM_HEIGHT)
+	{
+		snprintf(error, errorSize, "model %s has a skin taller than %d", name, MAX_LBM_HEIGHT);
+		return NULL;
+	}
+
+	if (header.num_xyz <= 0)
+	{
+		snprintf(error, errorSize, "model %s has no vertices", name);
+		return NULL;
 	}
 
-	if (pheader->skinheight > MAX_LBM_HEIGHT)
+	if (header.num_xyz > MAX_VERTS)
 	{
-		R_error(ERR_DROP, "model %s has a skin taller than %d", mod->name, MAX_LBM_HEIGHT);
+		snprintf(error, errorSize, "model %s has too many vertices", name);
+		return NULL;
 	}
 
-	if (pheader->num_xyz <= 0)
+	if (header.num_st <= 0)
 	{
-		R_error(ERR_DROP, "model %s has no vertices", mod->name);
+		snprintf(error, errorSize, "model %s has no st vertices", name);
+		return NULL;
 	}
 
-	if (pheader->num_xyz > MAX_VERTS)
+	if (header.num_tris <= 0)
 	{
-		R_error(ERR_DROP, "model %s has too many vertices", mod->name);
+		snprintf(error, errorSize, "model %s has no triangles", name);
+		return NULL;
 	}
 
-	if (pheader->num_st <= 0)
+	if (header.num_frames <= 0)
 	{
-		R_error(ERR_DROP, "model %s has no st vertices", mod->name);
+		snprintf(error, errorSize, "model %s has no frames", name);
+		return NULL;
 	}
 
-	if (pheader->num_tris <= 0)
+	if (header.ofs_end < (int)sizeof(dmdl_t))
 	{
-		R_error(ERR_DROP, "model %s has no triangles", mod->name);
+		snprintf(error, errorSize, "model %s is truncated", name);
+		return NULL;
 	}
 
-	if (pheader->num_frames <= 0)
+	pheader = malloc(header.ofs_end);
+	if (!pheader)
 	{
-		R_error(ERR_DROP, "model %s has no frames", mod->name);
+		snprintf(error, errorSize, "model %s: out of memory", name);
+		return NULL;
 	}
+	*pheader = header;
 
 	/* load base s and t vertices (not used in gl version) */
-	pinst = (dstvert_t *)((byte *)pinmodel + pheader->ofs_st);
+	pinst = (const dstvert_t *)((const byte *)pinmodel + pheader->ofs_st);
 	poutst = (dstvert_t *)((byte *)pheader + pheader->ofs_st);
 
 	for (i = 0; i < pheader->num_st; i++)
@@ -72,7 +102,7 @@ void LoadMD2(model_t *mod, void *buffer)
 	}
 
 	/* load triangle lists */
-	pintri = (dtriangle_t *)((byte *)pinmodel + pheader->ofs_tris);
+	pintri = (const dtriangle_t *)((const byte *)pinmodel + pheader->ofs_tris);
 	pouttri = (dtriangle_t *)((byte *)pheader + pheader->ofs_tris);
 
 	for (i = 0; i < pheader->num_tris; i++)
@@ -87,7 +117,7 @@ void LoadMD2(model_t *mod, void *buffer)
 	/* load the frames */
 	for (i = 0; i < pheader->num_frames; i++)
 	{
-		pinframe = (daliasframe_t *)((byte *)pinmodel
+		pinframe = (const daliasframe_t *)((const byte *)pinmodel
 				+ pheader->ofs_frames + i * pheader->framesize);
 		poutframe = (daliasframe_t *)((byte *)pheader
 				+ pheader->ofs_frames + i * pheader->framesize);
@@ -105,10 +135,8 @@ void LoadMD2(model_t *mod, void *buffer)
 				pheader->num_xyz * sizeof(dtrivertx_t));
 	}
 
-	mod->type = mod_alias;
-
 	/* load the glcmds */
-	pincmd = (int *)((byte *)pinmodel + pheader->ofs_glcmds);
+	pincmd = (const int *)((const byte *)pinmodel + pheader->ofs_glcmds);
 	poutcmd = (int *)((byte *)pheader + pheader->ofs_glcmds);
 
 	for (i = 0; i < pheader->num_glcmds; i++)
@@ -116,11 +144,27 @@ void LoadMD2(model_t *mod, void *buffer)
 		poutcmd[i] = LittleLong(pincmd[i]);
 	}
 
-	/* register all skins */
 	memcpy((char *)pheader + pheader->ofs_skins,
-			(char *)pinmodel + pheader->ofs_skins,
+			(const char *)pinmodel + pheader->ofs_skins,
 			pheader->num_skins * MAX_SKINNAME);
 
+	return pheader;
+}
+
+/*
+ * Moves a parsed MD2 to the hunk opened by the caller and registers its skins.
+ */
+void FinishMD2(model_t *mod, const dmdl_t *parsed)
+{
+	int i;
+	dmdl_t *pheader;
+
+	pheader = Hunk_Alloc(parsed->ofs_end);
+	memcpy(pheader, parsed, parsed->ofs_end);
+
+	mod->type = mod_alias;
+
+	/* register all skins */
 	for (i = 0; i < pheader->num_skins; i++)
 	{
 		mod->skins[i] = R_FindImage(
@@ -136,3 +180,18 @@ void LoadMD2(model_t *mod, void *buffer)
 	mod->maxs[2] = 32;
 }
 
+void LoadMD2(model_t *mod, void *buffer)
+{
+	char error[MAX_QPATH + 64];
+	dmdl_t *parsed;
+
+	parsed = ParseMD2(mod->name, buffer, error, sizeof(error));
+
+	if (!parsed)
+	{
+		R_error(ERR_DROP, "%s", error);
+	}
+
+	FinishMD2(mod, parsed);
+	free(parsed);
+}
@@ -26,114 +26,164 @@
 
 #include "client/refresh/r_private.h"
 
-void
-LoadPCX(char *origname, byte **pic, byte **palette, int *width, int *height)
+#include <stddef.h>
+
+/*
+ * Decodes a PCX file held in memory. The buffer is only read, so it may
+ * come straight from a mapped pack. Safe to call from loader threads.
+ */
+qboolean
+DecodePCX(const byte *raw, int len, byte **pic, byte **palette, int *width, int *height)
 {
-	byte *raw;
-	pcx_t *pcx;
+	pcx_t pcx;
+	const byte *data;
 	int x, y;
-	int len;
 	int dataByte, runLength;
 	byte *out, *pix;
-	char filename[256];
 
-	Q_strlcpy(filename, origname, sizeof(filename));
+	if (pic)
+		*pic = NULL;
+	if (palette)
+		*palette = NULL;
 
-	/* Add the extension */
-	if (strcmp(COM_FileExtension(filename), "pcx"))
+	if (len < (int)sizeof(pcx_t) + 768)
 	{
-		Q_strlcat(filename, ".pcx", sizeof(filename));
+		return false;
 	}
 
-    if (pic)
-        *pic = NULL;
-    if (palette)
-        *palette = NULL;
+	/* parse the PCX file */
+	memcpy(&pcx, raw, sizeof(pcx));
+
+	pcx.xmin = LittleShort(pcx.xmin);
+	pcx.ymin = LittleShort(pcx.ymin);
+	pcx.xmax = LittleShort(pcx.xmax);
+	pcx.ymax = LittleShort(pcx.ymax);
+	pcx.hres = LittleShort(pcx.hres);
+	pcx.vres = LittleShort(pcx.vres);
+	pcx.bytes_per_line = LittleShort(pcx.bytes_per_line);
+	pcx.palette_type = LittleShort(pcx.palette_type);
+
+	data = raw + offsetof(pcx_t, data);
+
+	if ((pcx.manufacturer != 0x0a) || (pcx.version != 5) ||
+		(pcx.encoding != 1) || (pcx.bits_per_pixel != 8) ||
+		(pcx.xmax >= 640) || (pcx.ymax >= 480))
+	{
+		return false;
+	}
 
-	/* load the file */
-	len = FS_LoadFile(filename, (void **)&raw);
+	out = malloc((pcx.ymax + 1) * (pcx.xmax + 1));
 
-	if (!raw)
+	if (!out)
 	{
-		R_printf(PRINT_DEVELOPER, "Bad pcx file %s\n", filename);
-		return;
+		return false;
 	}
 
-	/* parse the PCX file */
-	pcx = (pcx_t *)raw;
+	pix = out;
 
-	pcx->xmin = LittleShort(pcx->xmin);
-	pcx->ymin = LittleShort(pcx->ymin);
-	pcx->xmax = LittleShort(pcx->xmax);
-	pcx->ymax = LittleShort(pcx->ymax);
-	pcx->hres = LittleShort(pcx->hres);
-	pcx->vres = LittleShort(pcx->vres);
-	pcx->bytes_per_line = LittleShort(pcx->bytes_per_line);
-	pcx->palette_type = LittleShort(pcx->palette_type);
+	for (y = 0; y <= pcx.ymax; y++, pix += pcx.xmax + 1)
+	{
+		for (x = 0; x <= pcx.xmax; )
+		{
+			if (data >= raw + len)
+			{
+				break;
+			}
 
-	raw = &pcx->data;
+			dataByte = *data++;
 
-	if ((pcx->manufacturer != 0x0a) || (pcx->version != 5) ||
-		(pcx->encoding != 1) || (pcx->bits_per_pixel != 8) ||
-		(pcx->xmax >= 640) || (pcx->ymax >= 480))
-	{
-		R_printf(PRINT_ALL, "Bad pcx file %s\n", filename);
-		return;
-	}
+			if ((dataByte & 0xC0) == 0xC0)
+			{
+				if (data >= raw + len)
+				{
+					break;
+				}
 
-	out = malloc((pcx->ymax + 1) * (pcx->xmax + 1));
+				runLength = dataByte & 0x3F;
+				dataByte = *data++;
+			}
+			else
+			{
+				runLength = 1;
+			}
 
-	*pic = out;
+			while ((runLength-- > 0) && (x <= pcx.xmax))
+			{
+				pix[x++] = dataByte;
+			}
+		}
 
-	pix = out;
+		/* truncated RLE stream, the rest of the picture is missing */
+		if (x <= pcx.xmax)
+		{
+			free(out);
+			return false;
+		}
+	}
 
 	if (palette)
 	{
 		*palette = malloc(768);
-		memcpy(*palette, (byte *)pcx + len - 768, 768);
+
+		if (!*palette)
+		{
+			free(out);
+			return false;
+		}
+
+		memcpy(*palette, raw + len - 768, 768);
 	}
 
+	*pic = out;
+
 	if (width)
 	{
-		*width = pcx->xmax + 1;
+		*width = pcx.xmax + 1;
 	}
 
 	if (height)
 	{
-		*height = pcx->ymax + 1;
+		*height = pcx.ymax + 1;
 	}
 
-	for (y = 0; y <= pcx->ymax; y++, pix += pcx->xmax + 1)
+	return true;
+}
+
+void
+LoadPCX(char *origname, byte **pic, byte **palette, int *width, int *height)
+{
+	byte *raw;
+	int len;
+	char filename[256];
+
+	Q_strlcpy(filename, origname, sizeof(filename));
+
+	/* Add the extension */
+	if (strcmp(COM_FileExtension(filename), "pcx"))
 	{
-		for (x = 0; x <= pcx->xmax; )
-		{
-			dataByte = *raw++;
+		Q_strlcat(filename, ".pcx", sizeof(filename));
+	}
 
-			if ((dataByte & 0xC0) == 0xC0)
-			{
-				runLength = dataByte & 0x3F;
-				dataByte = *raw++;
-			}
-			else
-			{
-				runLength = 1;
-			}
+    if (pic)
+        *pic = NULL;
+    if (palette)
+        *palette = NULL;
 
-			while (runLength-- > 0)
-			{
-				pix[x++] = dataByte;
-			}
-		}
+	/* load the file */
+	len = FS_MapFile(filename, (void **)&raw);
+
+	if (!raw)
+	{
+		R_printf(PRINT_DEVELOPER, "Bad pcx file %s\n", filename);
+		return;
 	}
 
-	if (raw - (byte *)pcx > len)
+	if (!DecodePCX(raw, len, pic, palette, width, height))
 	{
-		R_printf(PRINT_DEVELOPER, "PCX file %s was malformed", filename);
-		free(*pic);
-		*pic = NULL;
+		R_printf(PRINT_ALL, "Bad pcx file %s\n", filename);
 	}
 
-	FS_FreeFile(pcx);
+	FS_FreeFile(raw);
 }
 
 void
@@ -142,7 +192,7 @@ GetPCXInfo(char *filename, int *width, int *height)
 	pcx_t *pcx;
 	byte *raw;
 
-	FS_LoadFile(filename, (void **)&raw);
+	FS_MapFile(filename, (void **)&raw);
 
 	if (!raw)
 	{
@@ -151,8 +201,8 @@ GetPCXInfo(char *filename, int *width, int *height)
 
 	pcx = (pcx_t *)raw;
 
-	*width = pcx->xmax + 1;
-	*height = pcx->ymax + 1;
+	*width = LittleShort(pcx->xmax) + 1;
+	*height = LittleShort(pcx->ymax) + 1;
 
 	FS_FreeFile(raw);
 
@@ -41,6 +41,20 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+/*
+ * Decodes a TGA, PNG or JPG file held in memory to RGBA.
+ * Safe to call from loader threads.
+ */
+qboolean
+DecodeSTB(const byte *raw, int len, byte **pic, int *width, int *height)
+{
+	int bytesPerPixel;
+
+	*pic = stbi_load_from_memory(raw, len, width, height, &bytesPerPixel, STBI_rgb_alpha);
+
+	return *pic != NULL;
+}
+
 /*
  * origname: the filename to be opened, might be without extension
  * type: extension of the type we wanna open ("jpg", "png" or "tga")
@@ -63,16 +77,15 @@ LoadSTB(const char *origname, const char* type, byte **pic, int *width, int *hei
 	*pic = NULL;
 
 	byte* rawdata = NULL;
-	int rawsize = FS_LoadFile(filename, (void **)&rawdata);
+	int rawsize = FS_MapFile(filename, (void **)&rawdata);
 	if (rawdata == NULL)
 	{
 		return false;
 	}
 
-	int w, h, bytesPerPixel;
+	int w, h;
 	byte* data = NULL;
-	data = stbi_load_from_memory(rawdata, rawsize, &w, &h, &bytesPerPixel, STBI_rgb_alpha);
-	if (data == NULL)
+	if (!DecodeSTB(rawdata, rawsize, &data, &w, &h))
 	{
 		R_printf(PRINT_ALL, "stb_image couldn't load data from %s: %s!\n", filename, stbi_failure_reason());
 		FS_FreeFile(rawdata);
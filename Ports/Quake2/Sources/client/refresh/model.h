@@ -89,6 +89,7 @@ typedef struct msurface_s
 	int numedges; /* are backwards edges */
 
 	glpoly_t *polys; /* multiple if warped */
+	int staticVertex; /* first vertex in the static world buffer, -1 if streamed */
 	short extents[2];
 
 	struct  msurface_s *texturechain;
@@ -105,6 +106,7 @@ typedef struct msurface_s
 	byte *samples; /* [numstyles*surfsize] */
 
 	short dlight_s, dlight_t; /* gl lightmap coordinates for dynamic lightmaps */
+	struct  msurface_s *dlightchain; /* surfaces lit by the dynamic light pass */
 	int dlightframe;
 	int dlightbits;
 } msurface_t;
@@ -151,6 +153,7 @@ typedef enum { mod_bad, mod_brush, mod_sprite, mod_alias } modtype_t;
 typedef struct model_s
 {
 	char name[MAX_QPATH];
+	registrynode_t registryNode; /* by name in the model registry */
 
 	int registration_sequence;
 
@@ -203,11 +206,15 @@ typedef struct model_s
 	msurface_t **marksurfaces;
 
 	dvis_t *vis;
+	byte *vismatrix; /* decompressed PVS rows, visstride bytes each */
+	int visstride;
 
 	byte *lightdata;
 
 	/* for alias models and skins */
 	image_t *skins[MAX_MD2SKINS];
+	OglwKeyframeModel keyframes; /* frames interpolated by the GPU */
+	qboolean keyframesBuilt;
 
 	int extradatasize;
 	void *extradata;
@@ -226,5 +233,7 @@ void Mod_Free(model_t *mod);
 
 void LoadSP2(model_t *mod, void *buffer, int modfilelen);
 void LoadMD2(model_t *mod, void *buffer);
+dmdl_t* ParseMD2(const char *name, const void *buffer, char *error, int errorSize);
+void FinishMD2(model_t *mod, const dmdl_t *parsed);
 
 #endif
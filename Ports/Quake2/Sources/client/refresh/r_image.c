@@ -77,6 +77,7 @@ void Scrap_Upload()
 
 static image_t gltextures[MAX_GLTEXTURES];
 static int numgltextures;
+static registry_t gltextures_registry;
 
 static byte intensitytable[256];
 static byte gammatable[256];
@@ -443,24 +444,8 @@ static bool R_Texture_checkAlpha(unsigned *data, int width, int height)
     return hasAlpha;
 }
 
-void R_Texture_upload(void *data, int x, int y, int width, int height, bool fullUploadFlag, bool noFilteringFlag, bool mipmapFlag)
+static void R_Texture_setFiltering(bool noFilteringFlag, bool mipmapFlag)
 {
-	#if defined(EGLW_GLES1)
-    if (mipmapFlag)
-        glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, true);
-	#endif
-    if (fullUploadFlag)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    else
-        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
-	#if defined(EGLW_GLES1)
-    if (mipmapFlag)
-        glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, false);
-    #else
-    if (mipmapFlag)
-        glGenerateMipmap(GL_TEXTURE_2D);
-	#endif
-
     if (noFilteringFlag)
     {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -490,84 +475,102 @@ void R_Texture_upload(void *data, int x, int y, int width, int height, bool full
     }
 }
 
-static bool R_Texture_uploadWithoutResampling32(unsigned *data, int width, int height, bool noFilteringFlag, bool mipmapFlag)
+void R_Texture_upload(void *data, int x, int y, int width, int height, bool fullUploadFlag, bool noFilteringFlag, bool mipmapFlag)
 {
-	bool hasAlpha = R_Texture_checkAlpha(data, width, height);
-	R_LightScaleTexture(data, width, height, !mipmapFlag);
-    R_Texture_upload(data, 0, 0, width, height, true, noFilteringFlag, mipmapFlag);
-	return hasAlpha;
+	#if defined(EGLW_GLES1)
+    if (mipmapFlag)
+        glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, true);
+	#endif
+    if (fullUploadFlag)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    else
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	#if defined(EGLW_GLES1)
+    if (mipmapFlag)
+        glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, false);
+    #else
+    if (mipmapFlag)
+        glGenerateMipmap(GL_TEXTURE_2D);
+	#endif
+
+    R_Texture_setFiltering(noFilteringFlag, mipmapFlag);
 }
 
-static bool R_Texture_uploadWithResampling32(unsigned *data, int width, int height, bool noFilteringFlag, bool mipmapFlag, int *uploadWidth, int *uploadHeight)
+// Computes the upload size, resamples and light scales. Returns the buffer to upload, either data or a new one to free.
+static unsigned* R_Texture_prepare32(unsigned *data, int width, int height, bool mipmapFlag, int *uploadWidth, int *uploadHeight)
 {
 	int scaled_width, scaled_height;
 
-	for (scaled_width = 1; scaled_width < width; scaled_width <<= 1)
-		;
-	if (r_texture_rounddown->value && (scaled_width > width) && mipmapFlag)
-		scaled_width >>= 1;
-
-	for (scaled_height = 1; scaled_height < height; scaled_height <<= 1)
-		;
-	if (r_texture_rounddown->value && (scaled_height > height) && mipmapFlag)
-		scaled_height >>= 1;
-
-	/* let people sample down the world textures for speed */
-	if (mipmapFlag)
+	if (gl_config.tex_npot)
 	{
-		scaled_width >>= (int)r_texture_scaledown->value;
-		scaled_height >>= (int)r_texture_scaledown->value;
+		scaled_width = width;
+		scaled_height = height;
 	}
+	else
+	{
+		for (scaled_width = 1; scaled_width < width; scaled_width <<= 1)
+			;
+		if (r_texture_rounddown->value && (scaled_width > width) && mipmapFlag)
+			scaled_width >>= 1;
+
+		for (scaled_height = 1; scaled_height < height; scaled_height <<= 1)
+			;
+		if (r_texture_rounddown->value && (scaled_height > height) && mipmapFlag)
+			scaled_height >>= 1;
+
+		/* let people sample down the world textures for speed */
+		if (mipmapFlag)
+		{
+			scaled_width >>= (int)r_texture_scaledown->value;
+			scaled_height >>= (int)r_texture_scaledown->value;
+		}
 
-    // TODO: Clamp to max supported size by OpenGL.
-	if (scaled_width < 1)
-		scaled_width = 1;
-//	if (scaled_width > 256)
-//		scaled_width = 256;
-	if (scaled_height < 1)
-		scaled_height = 1;
-//	if (scaled_height > 256)
-//		scaled_height = 256;
-
-    if (uploadWidth)
-        *uploadWidth = scaled_width;
-    if (uploadHeight)
-        *uploadHeight = scaled_height;
+		// TODO: Clamp to max supported size by OpenGL.
+		if (scaled_width < 1)
+			scaled_width = 1;
+		if (scaled_height < 1)
+			scaled_height = 1;
+	}
 
-	bool hasAlpha = R_Texture_checkAlpha(data, width, height);
+	if (uploadWidth)
+		*uploadWidth = scaled_width;
+	if (uploadHeight)
+		*uploadHeight = scaled_height;
 
-	unsigned *scaled = NULL;
 	if (scaled_width != width || scaled_height != height)
 	{
-		scaled = malloc(scaled_width * scaled_height * sizeof(unsigned));
+		unsigned *scaled = malloc(scaled_width * scaled_height * sizeof(unsigned));
 		R_ResampleTexture(data, width, height, scaled, scaled_width, scaled_height);
 		data = scaled;
 	}
 
 	R_LightScaleTexture(data, scaled_width, scaled_height, !mipmapFlag);
 
-    R_Texture_upload(data, 0, 0, scaled_width, scaled_height, true, noFilteringFlag, mipmapFlag);
-
-	free(scaled);
-
-	return hasAlpha;
+	return data;
 }
 
 static bool R_Texture_upload32(unsigned *data, int width, int height, bool noFilteringFlag, bool mipmapFlag, int *uploadWidth, int *uploadHeight)
 {
-	bool hasAlpha;
-	if (gl_config.tex_npot)
-    {
-		hasAlpha = R_Texture_uploadWithoutResampling32(data, width, height, noFilteringFlag, mipmapFlag);
-        *uploadWidth = width;
-        *uploadHeight = height;
-    }
-	else
-		hasAlpha = R_Texture_uploadWithResampling32(data, width, height, noFilteringFlag, mipmapFlag, uploadWidth, uploadHeight);
+	int scaled_width, scaled_height;
+	bool hasAlpha = R_Texture_checkAlpha(data, width, height);
+
+	unsigned *scaled = R_Texture_prepare32(data, width, height, mipmapFlag, &scaled_width, &scaled_height);
+
+	R_Texture_upload(scaled, 0, 0, scaled_width, scaled_height, true, noFilteringFlag, mipmapFlag);
+
+	if (scaled != data)
+		free(scaled);
+
+	if (uploadWidth)
+		*uploadWidth = scaled_width;
+	if (uploadHeight)
+		*uploadHeight = scaled_height;
+
 	return hasAlpha;
 }
 
-bool R_Texture_upload8(byte *data, int width, int height, bool noFilteringFlag, bool mipmapFlag, bool skyFlag, int *uploadWidth, int *uploadHeight)
+// Expands 8 bit paletted data to a new RGBA buffer.
+static unsigned* R_Texture_expand8(const byte *data, int width, int height)
 {
 	int s = width * height;
 	unsigned *buffer = (unsigned *)malloc(s * sizeof(unsigned));
@@ -612,6 +615,13 @@ bool R_Texture_upload8(byte *data, int width, int height, bool noFilteringFlag,
 		buffer[i] = c;
 	}
 
+	return buffer;
+}
+
+bool R_Texture_upload8(byte *data, int width, int height, bool noFilteringFlag, bool mipmapFlag, bool skyFlag, int *uploadWidth, int *uploadHeight)
+{
+	unsigned *buffer = R_Texture_expand8(data, width, height);
+
 	bool hasAlpha = R_Texture_upload32(buffer, width, height, noFilteringFlag, mipmapFlag, uploadWidth, uploadHeight);
 
 	free(buffer);
@@ -621,7 +631,7 @@ bool R_Texture_upload8(byte *data, int width, int height, bool noFilteringFlag,
 /*
  * This is also used as an entry point for the generated r_notexture
  */
-image_t* R_LoadPic(char *name, byte *pic, int width, int realwidth, int height, int realheight, imagetype_t type, int bits)
+static image_t* R_Image_allocate(char *name, int width, int height, imagetype_t type)
 {
 	image_t *image;
 	int i;
@@ -651,6 +661,7 @@ image_t* R_LoadPic(char *name, byte *pic, int width, int realwidth, int height,
 	}
 
 	strcpy(image->name, name);
+	Registry_Add(&gltextures_registry, &image->registryNode, image->name);
 	image->registration_sequence = registration_sequence;
 	image->image_chain_node = 0;
 	image->texturechain = 0;
@@ -660,6 +671,13 @@ image_t* R_LoadPic(char *name, byte *pic, int width, int realwidth, int height,
 	image->height = height;
 	image->type = type;
 
+	return image;
+}
+
+image_t* R_LoadPic(char *name, byte *pic, int width, int realwidth, int height, int realheight, imagetype_t type, int bits)
+{
+	image_t *image = R_Image_allocate(name, width, height, type);
+
 	if ((type == it_skin) && (bits == 8))
 	{
 		R_FloodFillSkin(pic, width, height);
@@ -731,13 +749,898 @@ nonscrap:
 	return image;
 }
 
+//--------------------------------------------------------------------------------
+// Texture cache.
+//--------------------------------------------------------------------------------
+// The images loaded on the worker threads are stored ready to upload in the
+// texcache directory: expanded, resampled, light scaled, with their whole mip
+// chain, and ETC1 compressed when opaque and r_texture_compress is set.
+// The file name is a hash of the source files and of everything that changes
+// the result, so stale files are never read. Workers access it with stdio only.
+
+#ifndef GL_ETC1_RGB8_OES
+#define GL_ETC1_RGB8_OES 0x8D64
+#endif
+
+#define TEXCACHE_IDENT (('C' << 24) + ('X' << 16) + ('T' << 8) + 'Q')
+#define TEXCACHE_VERSION 1
+#define TEXCACHE_MAX_LEVELS 16
+#define TEXCACHE_HASH_INIT 14695981039346656037ULL
+
+typedef struct
+{
+	int ident;
+	int version;
+	Uint64 key;
+	int width, height; // Size of the decoded image.
+	int hasAlpha;
+	int format; // GL_RGBA or GL_ETC1_RGB8_OES.
+	int levelNb;
+	int widths[TEXCACHE_MAX_LEVELS];
+	int heights[TEXCACHE_MAX_LEVELS];
+	int sizes[TEXCACHE_MAX_LEVELS];
+} texcacheheader_t;
+
+typedef struct
+{
+	texcacheheader_t header;
+	byte *data; // The levels one after the other.
+} texcache_t;
+
+static char texcache_path[MAX_OSPATH];
+static Uint64 texcache_settings; // 0 when the cache is disabled.
+static bool texcache_compress;
+
+static const int etc1_modifiers[8][2] =
+{
+	{ 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+};
+
+// FNV-1a.
+static Uint64 R_TexCache_hash(Uint64 hash, const void *data, int size)
+{
+	const byte *p = data;
+	for (int i = 0; i < size; i++)
+	{
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/*
+ * Hashes what the prepared textures depend on, at the beginning of a registration
+ */
+static void R_TexCache_begin()
+{
+	texcache_settings = 0;
+	if (!r_texture_cache->value)
+		return;
+
+	Com_sprintf(texcache_path, sizeof(texcache_path), "%s/texcache", FS_WritableGamedir());
+	Sys_Mkdir(texcache_path);
+
+	texcache_compress = r_texture_compress->value && gl_config.etc1;
+	int settings[5] = { TEXCACHE_VERSION, gl_config.tex_npot, (int)r_texture_rounddown->value, (int)r_texture_scaledown->value, texcache_compress };
+	Uint64 hash = R_TexCache_hash(TEXCACHE_HASH_INIT, d_8to24table, sizeof(d_8to24table));
+	hash = R_TexCache_hash(hash, lightScaleTable, sizeof(lightScaleTable));
+	hash = R_TexCache_hash(hash, settings, sizeof(settings));
+	texcache_settings = hash | 1;
+}
+
+static void R_TexCache_getPath(char *path, int size, Uint64 key, const char *suffix)
+{
+	Com_sprintf(path, size, "%s/%08x%08x%s", texcache_path, (unsigned)(key >> 32), (unsigned)key, suffix);
+}
+
+static bool R_TexCache_read(Uint64 key, texcache_t *cache)
+{
+	char path[MAX_OSPATH];
+	R_TexCache_getPath(path, sizeof(path), key, ".tex");
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return false;
+
+	texcacheheader_t *header = &cache->header;
+	bool valid = (fread(header, sizeof(*header), 1, f) == 1) && (header->ident == TEXCACHE_IDENT) && (header->version == TEXCACHE_VERSION)
+		&& (header->key == key) && (header->levelNb > 0) && (header->levelNb <= TEXCACHE_MAX_LEVELS);
+	int size = 0;
+	for (int i = 0; valid && i < header->levelNb; i++)
+	{
+		valid = (header->sizes[i] > 0) && (header->sizes[i] <= 4096 * 4096 * 4);
+		size += header->sizes[i];
+	}
+
+	cache->data = valid ? malloc(size) : NULL;
+	if (cache->data && (fread(cache->data, 1, size, f) != (size_t)size))
+	{
+		free(cache->data);
+		cache->data = NULL;
+	}
+	fclose(f);
+	return cache->data != NULL;
+}
+
+static void R_TexCache_write(const texcache_t *cache, int jobIndex)
+{
+	char path[MAX_OSPATH], temporaryPath[MAX_OSPATH], suffix[32];
+	R_TexCache_getPath(path, sizeof(path), cache->header.key, ".tex");
+	Com_sprintf(suffix, sizeof(suffix), ".%i.tmp", jobIndex);
+	R_TexCache_getPath(temporaryPath, sizeof(temporaryPath), cache->header.key, suffix);
+
+	FILE *f = fopen(temporaryPath, "wb");
+	if (!f)
+		return;
+	int size = 0;
+	for (int i = 0; i < cache->header.levelNb; i++)
+		size += cache->header.sizes[i];
+	bool written = (fwrite(&cache->header, sizeof(cache->header), 1, f) == 1) && (fwrite(cache->data, 1, size, f) == (size_t)size);
+	written = !fclose(f) && written;
+
+	// Readers only ever see complete files.
+	if (!written || rename(temporaryPath, path))
+		remove(temporaryPath);
+}
+
+// Box filters a level into the next one.
+static void R_TexCache_halve(const byte *in, int width, int height, byte *out, int outWidth, int outHeight)
+{
+	for (int y = 0; y < outHeight; y++)
+	{
+		const byte *row0 = in + (y * 2) * width * 4;
+		const byte *row1 = in + ((y * 2 + 1 < height) ? y * 2 + 1 : height - 1) * width * 4;
+		for (int x = 0; x < outWidth; x++, out += 4)
+		{
+			int x0 = x * 2 * 4;
+			int x1 = ((x * 2 + 1 < width) ? x * 2 + 1 : width - 1) * 4;
+			for (int c = 0; c < 4; c++)
+				out[c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2;
+		}
+	}
+}
+
+/*
+ * Finds the base color and the table of an ETC1 half block, returns its squared error
+ */
+static int R_TexCache_encodeHalfETC1(const byte *texels[8], int base4[3], int *table, int indices[8])
+{
+	int sum[3] = { 0, 0, 0 };
+	for (int i = 0; i < 8; i++)
+	{
+		for (int c = 0; c < 3; c++)
+			sum[c] += texels[i][c];
+	}
+
+	int base[3];
+	for (int c = 0; c < 3; c++)
+	{
+		base4[c] = (sum[c] * 15 + 1020) / 2040;
+		base[c] = (base4[c] << 4) | base4[c];
+	}
+
+	int bestError = 0x7fffffff;
+	for (int t = 0; t < 8; t++)
+	{
+		int deltas[4] = { etc1_modifiers[t][0], etc1_modifiers[t][1], -etc1_modifiers[t][0], -etc1_modifiers[t][1] };
+		int error = 0, tableIndices[8];
+		for (int i = 0; i < 8; i++)
+		{
+			int best = 0x7fffffff;
+			for (int k = 0; k < 4; k++)
+			{
+				int e = 0;
+				for (int c = 0; c < 3; c++)
+				{
+					int v = base[c] + deltas[k];
+					v = (v < 0) ? 0 : (v > 255) ? 255 : v;
+					e += (v - texels[i][c]) * (v - texels[i][c]);
+				}
+				if (e < best)
+				{
+					best = e;
+					tableIndices[i] = k;
+				}
+			}
+			error += best;
+		}
+		if (error < bestError)
+		{
+			bestError = error;
+			*table = t;
+			memcpy(indices, tableIndices, sizeof(tableIndices));
+		}
+	}
+	return bestError;
+}
+
+/*
+ * Encodes a 4x4 block in the individual mode of ETC1, trying both orientations of the half blocks
+ */
+static void R_TexCache_encodeBlockETC1(const byte *texels[16], byte *out)
+{
+	int bestError = 0x7fffffff;
+	for (int flip = 0; flip < 2; flip++)
+	{
+		const byte *halves[2][8];
+		int positions[2][8], counts[2] = { 0, 0 };
+		for (int y = 0; y < 4; y++)
+		{
+			for (int x = 0; x < 4; x++)
+			{
+				int h = flip ? (y >= 2) : (x >= 2);
+				halves[h][counts[h]] = texels[y * 4 + x];
+				positions[h][counts[h]++] = x * 4 + y;
+			}
+		}
+
+		int base4[2][3], tables[2], indices[2][8];
+		int error = R_TexCache_encodeHalfETC1(halves[0], base4[0], &tables[0], indices[0]);
+		error += R_TexCache_encodeHalfETC1(halves[1], base4[1], &tables[1], indices[1]);
+		if (error >= bestError)
+			continue;
+		bestError = error;
+
+		// Indices 0 to 3 are +a, +b, -a, -b: the high bit is the sign.
+		unsigned msb = 0, lsb = 0;
+		for (int h = 0; h < 2; h++)
+		{
+			for (int i = 0; i < 8; i++)
+			{
+				msb |= (indices[h][i] >> 1) << positions[h][i];
+				lsb |= (indices[h][i] & 1) << positions[h][i];
+			}
+		}
+		for (int c = 0; c < 3; c++)
+			out[c] = (base4[0][c] << 4) | base4[1][c];
+		out[3] = (tables[0] << 5) | (tables[1] << 2) | flip;
+		out[4] = msb >> 8;
+		out[5] = msb;
+		out[6] = lsb >> 8;
+		out[7] = lsb;
+	}
+}
+
+static void R_TexCache_encodeETC1(const byte *rgba, int width, int height, byte *out)
+{
+	for (int by = 0; by < height; by += 4)
+	{
+		for (int bx = 0; bx < width; bx += 4, out += 8)
+		{
+			// Partial blocks repeat the last row and column.
+			const byte *texels[16];
+			for (int y = 0; y < 4; y++)
+			{
+				int ty = (by + y < height) ? by + y : height - 1;
+				for (int x = 0; x < 4; x++)
+				{
+					int tx = (bx + x < width) ? bx + x : width - 1;
+					texels[y * 4 + x] = rgba + (ty * width + tx) * 4;
+				}
+			}
+			R_TexCache_encodeBlockETC1(texels, out);
+		}
+	}
+}
+
+/*
+ * Builds the mip chain of a prepared texture, compressed if asked.
+ * Returns false with no data if out of memory.
+ */
+static bool R_TexCache_build(texcache_t *cache, const unsigned *pixels, int width, int height, bool compress)
+{
+	texcacheheader_t *header = &cache->header;
+	header->format = compress ? GL_ETC1_RGB8_OES : GL_RGBA;
+
+	int rgbaSize = 0, size = 0;
+	for (header->levelNb = 0; header->levelNb < TEXCACHE_MAX_LEVELS;)
+	{
+		int i = header->levelNb++;
+		header->widths[i] = width;
+		header->heights[i] = height;
+		header->sizes[i] = compress ? ((width + 3) >> 2) * ((height + 3) >> 2) * 8 : width * height * 4;
+		rgbaSize += width * height * 4;
+		size += header->sizes[i];
+		if ((width == 1) && (height == 1))
+			break;
+		width = (width > 1) ? width >> 1 : 1;
+		height = (height > 1) ? height >> 1 : 1;
+	}
+
+	cache->data = NULL;
+	byte *rgba = malloc(rgbaSize);
+	if (!rgba)
+		return false;
+	memcpy(rgba, pixels, header->widths[0] * header->heights[0] * 4);
+	byte *level = rgba;
+	for (int i = 1; i < header->levelNb; i++)
+	{
+		byte *next = level + header->widths[i - 1] * header->heights[i - 1] * 4;
+		R_TexCache_halve(level, header->widths[i - 1], header->heights[i - 1], next, header->widths[i], header->heights[i]);
+		level = next;
+	}
+
+	if (!compress)
+	{
+		cache->data = rgba;
+		return true;
+	}
+
+	cache->data = malloc(size);
+	if (!cache->data)
+	{
+		free(rgba);
+		return false;
+	}
+	byte *out = cache->data;
+	level = rgba;
+	for (int i = 0; i < header->levelNb; i++)
+	{
+		R_TexCache_encodeETC1(level, header->widths[i], header->heights[i], out);
+		out += header->sizes[i];
+		level += header->widths[i] * header->heights[i] * 4;
+	}
+	free(rgba);
+	return true;
+}
+
+static void R_TexCache_upload(const texcache_t *cache, bool noFilteringFlag)
+{
+	const texcacheheader_t *header = &cache->header;
+	const byte *data = cache->data;
+	for (int i = 0; i < header->levelNb; data += header->sizes[i], i++)
+	{
+		if (header->format == GL_RGBA)
+			glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, header->widths[i], header->heights[i], 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+		else
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, header->format, header->widths[i], header->heights[i], 0, header->sizes[i], data);
+	}
+
+	R_Texture_setFiltering(noFilteringFlag, true);
+}
+
+//--------------------------------------------------------------------------------
+// Asynchronous loading.
+//--------------------------------------------------------------------------------
+// During level registration, R_FindImage only looks the files up and reserves
+// the image_t for walls, skins and sprites. Decoding, palette expansion,
+// resampling and light scaling run on worker threads, and the main thread
+// only performs the GL uploads in R_Image_finishLoading.
+// Workers never touch the file system, the zone or the console: the files
+// are mapped by the main thread and released by it once uploaded. With
+// r_texture_cache, they first look for the prepared texture in the cache.
+// The same workers parse the alias models and decode the sounds queued
+// with R_Async_queue.
+
+#define ASYNC_MAX_THREADS 4
+
+typedef enum
+{
+	async_pcx,
+	async_wal,
+	async_stb
+} asyncformat_t;
+
+typedef struct
+{
+	asynctask_t task;
+	image_t *image;
+	imagetype_t type;
+	bool noFilteringFlag;
+	bool mipmapFlag;
+
+	// Inputs, from FS_MapFile.
+	asyncformat_t format;
+	byte *raw;
+	int rawSize;
+	asyncformat_t fallbackFormat; // The original PCX or WAL when raw is a replacement.
+	byte *fallback;
+	int fallbackSize;
+	int realwidth, realheight;
+
+	// Outputs, written by a worker.
+	unsigned *pixels; // Ready to upload, NULL if decoding failed.
+	texcache_t cache; // Levels ready to upload instead of pixels when the cache is enabled.
+	bool cached; // Read from the cache.
+	int width, height;
+	int uploadWidth, uploadHeight;
+	bool hasAlpha;
+	Uint64 decodeTime;
+} asyncjob_t;
+
+static asyncjob_t async_jobs[MAX_GLTEXTURES];
+static int async_jobNb; // Queued images.
+static asynctask_t *async_taskFirst; // Next task to be taken by a worker.
+static asynctask_t *async_taskLast;
+static bool async_active; // Registration in progress.
+static bool async_quit;
+static SDL_mutex *async_mutex;
+static SDL_cond *async_jobCond; // Signaled when tasks are queued.
+static SDL_cond *async_doneCond; // Signaled when a task is done.
+static SDL_Thread *async_threads[ASYNC_MAX_THREADS];
+static int async_threadNb;
+
+// Registration timings.
+static int async_beginTime;
+static int async_fetchTime;
+static int async_waitTime;
+static int async_uploadTime;
+static Uint64 async_decodeTime;
+static int async_syncNb;
+static int async_cacheHitNb;
+
+static byte* R_Async_decode(asyncformat_t format, const byte *raw, int size, int *width, int *height, int *bits)
+{
+	byte *pic = NULL;
+
+	switch (format)
+	{
+	case async_pcx:
+		*bits = 8;
+		DecodePCX(raw, size, &pic, NULL, width, height);
+		break;
+
+	case async_wal:
+		*bits = 8;
+		if (size >= (int)sizeof(miptex_t))
+		{
+			miptex_t mt;
+			memcpy(&mt, raw, sizeof(mt));
+			int w = LittleLong(mt.width);
+			int h = LittleLong(mt.height);
+			int ofs = LittleLong(mt.offsets[0]);
+			if ((w > 0) && (h > 0) && (w <= 4096) && (h <= 4096) && (ofs >= 0) && (ofs <= size) && (w * h <= size - ofs))
+			{
+				pic = malloc(w * h);
+				memcpy(pic, raw + ofs, w * h);
+				*width = w;
+				*height = h;
+			}
+		}
+		break;
+
+	case async_stb:
+		*bits = 32;
+		DecodeSTB(raw, size, &pic, width, height);
+		break;
+	}
+
+	return pic;
+}
+
+static void R_Async_process(asyncjob_t *job)
+{
+	Uint64 start = SDL_GetPerformanceCounter();
+	int width = 0, height = 0, bits = 0;
+
+	Uint64 key = 0;
+	if (texcache_settings)
+	{
+		key = R_TexCache_hash(texcache_settings, job->raw, job->rawSize);
+		if (job->fallback)
+			key = R_TexCache_hash(key, job->fallback, job->fallbackSize);
+		key = R_TexCache_hash(key, &job->type, sizeof(job->type));
+		if (R_TexCache_read(key, &job->cache))
+		{
+			const texcacheheader_t *header = &job->cache.header;
+			job->width = header->width;
+			job->height = header->height;
+			job->uploadWidth = header->widths[0];
+			job->uploadHeight = header->heights[0];
+			job->hasAlpha = header->hasAlpha;
+			job->cached = true;
+			job->decodeTime = SDL_GetPerformanceCounter() - start;
+			return;
+		}
+	}
+
+	byte *pic = R_Async_decode(job->format, job->raw, job->rawSize, &width, &height, &bits);
+	if (!pic && job->fallback)
+	{
+		// Broken replacement, use the original like LoadSTB failing would.
+		pic = R_Async_decode(job->fallbackFormat, job->fallback, job->fallbackSize, &width, &height, &bits);
+		job->realwidth = 0;
+		job->realheight = 0;
+	}
+
+	if (pic)
+	{
+		unsigned *data;
+		if (bits == 8)
+		{
+			if (job->type == it_skin)
+				R_FloodFillSkin(pic, width, height);
+			data = R_Texture_expand8(pic, width, height);
+			free(pic);
+		}
+		else
+			data = (unsigned *)pic;
+
+		job->hasAlpha = R_Texture_checkAlpha(data, width, height);
+		job->pixels = R_Texture_prepare32(data, width, height, job->mipmapFlag, &job->uploadWidth, &job->uploadHeight);
+		if (job->pixels != data)
+			free(data);
+		job->width = width;
+		job->height = height;
+
+		if (key && job->pixels)
+		{
+			texcacheheader_t *header = &job->cache.header;
+			header->ident = TEXCACHE_IDENT;
+			header->version = TEXCACHE_VERSION;
+			header->key = key;
+			header->width = width;
+			header->height = height;
+			header->hasAlpha = job->hasAlpha;
+			// Out of memory, the pixels are uploaded without the cache.
+			if (R_TexCache_build(&job->cache, job->pixels, job->uploadWidth, job->uploadHeight, texcache_compress && !job->hasAlpha))
+			{
+				R_TexCache_write(&job->cache, job - async_jobs);
+				free(job->pixels);
+				job->pixels = NULL;
+			}
+		}
+	}
+
+	job->decodeTime = SDL_GetPerformanceCounter() - start;
+}
+
+static void R_Async_runImage(asynctask_t *task)
+{
+	R_Async_process((asyncjob_t *)task);
+}
+
+static int R_Async_thread(void *data)
+{
+	SDL_LockMutex(async_mutex);
+	for (;;)
+	{
+		while (!async_quit && !async_taskFirst)
+			SDL_CondWait(async_jobCond, async_mutex);
+
+		// Drain the queue before quitting, someone waits for these tasks.
+		asynctask_t *task = async_taskFirst;
+		if (!task)
+			break;
+		async_taskFirst = task->next;
+		if (!async_taskFirst)
+			async_taskLast = NULL;
+		SDL_UnlockMutex(async_mutex);
+
+		task->run(task);
+
+		SDL_LockMutex(async_mutex);
+		task->done = true;
+		SDL_CondBroadcast(async_doneCond);
+	}
+	SDL_UnlockMutex(async_mutex);
+	return 0;
+}
+
+static void R_Async_stop()
+{
+	if (!async_threadNb)
+		return;
+
+	SDL_LockMutex(async_mutex);
+	async_quit = true;
+	SDL_CondBroadcast(async_jobCond);
+	SDL_UnlockMutex(async_mutex);
+
+	for (int i = 0; i < async_threadNb; i++)
+		SDL_WaitThread(async_threads[i], NULL);
+	async_threadNb = 0;
+	async_quit = false;
+
+	SDL_DestroyCond(async_doneCond);
+	SDL_DestroyCond(async_jobCond);
+	SDL_DestroyMutex(async_mutex);
+}
+
+static bool R_Async_start()
+{
+	if (async_threadNb)
+		return true;
+
+	async_mutex = SDL_CreateMutex();
+	async_jobCond = SDL_CreateCond();
+	async_doneCond = SDL_CreateCond();
+	if (!async_mutex || !async_jobCond || !async_doneCond)
+	{
+		R_printf(PRINT_ALL, "R_Async_start: %s\n", SDL_GetError());
+		Cvar_SetValue("r_texture_async", 0);
+		return false;
+	}
+
+	// Leave a core to the main thread.
+	int threadNb = SDL_GetCPUCount() - 1;
+	if (threadNb < 1)
+		threadNb = 1;
+	if (threadNb > ASYNC_MAX_THREADS)
+		threadNb = ASYNC_MAX_THREADS;
+
+	for (int i = 0; i < threadNb; i++)
+	{
+		async_threads[i] = SDL_CreateThread(R_Async_thread, "R_Async", NULL);
+		if (!async_threads[i])
+			break;
+		async_threadNb++;
+	}
+
+	if (!async_threadNb)
+	{
+		R_printf(PRINT_ALL, "R_Async_start: %s\n", SDL_GetError());
+		SDL_DestroyCond(async_doneCond);
+		SDL_DestroyCond(async_jobCond);
+		SDL_DestroyMutex(async_mutex);
+		Cvar_SetValue("r_texture_async", 0);
+		return false;
+	}
+
+	return true;
+}
+
+static void R_Async_push(asynctask_t *task)
+{
+	task->next = NULL;
+	task->done = false;
+
+	SDL_LockMutex(async_mutex);
+	if (async_taskLast)
+		async_taskLast->next = task;
+	else
+		async_taskFirst = task;
+	async_taskLast = task;
+	SDL_CondSignal(async_jobCond);
+	SDL_UnlockMutex(async_mutex);
+}
+
+/*
+ * Hands a task to the worker pool. Returns false if it has to be run
+ * synchronously, when r_texture_async is off or the threads can't start.
+ */
+qboolean R_Async_queue(asynctask_t *task)
+{
+	if (!r_texture_async->value || !R_Async_start())
+		return false;
+
+	R_Async_push(task);
+	return true;
+}
+
+/*
+ * Waits for a task queued with R_Async_queue.
+ */
+void R_Async_wait(asynctask_t *task)
+{
+	// Stopping the pool runs the remaining tasks.
+	if (!async_threadNb)
+		return;
+
+	int start = Sys_Milliseconds();
+	SDL_LockMutex(async_mutex);
+	while (!task->done)
+		SDL_CondWait(async_doneCond, async_mutex);
+	SDL_UnlockMutex(async_mutex);
+	async_waitTime += Sys_Milliseconds() - start;
+}
+
+/*
+ * Queues a PCX or WAL image and its replacement. Returns false if the image
+ * has to be loaded synchronously, else image is the reserved image_t, or
+ * what the synchronous path would return for missing files.
+ */
+static bool R_Async_findImage(char *name, char *namewe, const char *ext, imagetype_t type, image_t **image)
+{
+	static const char *replacements[] = { "tga", "png", "jpg" };
+
+	if (!async_active || !r_texture_async->value)
+		return false;
+	if ((type != it_wall) && (type != it_skin) && (type != it_sprite))
+		return false; // Pics and skies are used right away.
+	if (strcmp(ext, "pcx") && strcmp(ext, "wal"))
+		return false;
+	if (!R_Async_start())
+		return false;
+
+	int start = Sys_Milliseconds();
+
+	asyncformat_t format = strcmp(ext, "pcx") ? async_wal : async_pcx;
+	byte *primary;
+	int primarySize = FS_MapFile(name, (void **)&primary);
+	if (!primary)
+	{
+		async_fetchTime += Sys_Milliseconds() - start;
+		if ((format == async_wal) && !r_texture_retexturing->value)
+		{
+			R_printf(PRINT_ALL, "LoadWall: can't load %s\n", name);
+			*image = r_notexture;
+		}
+		else
+			*image = NULL;
+		return true;
+	}
+
+	// Size of the original, replacements are drawn at that size.
+	int width = 0, height = 0;
+	if ((format == async_pcx) && (primarySize >= (int)sizeof(pcx_t)))
+	{
+		pcx_t pcx;
+		memcpy(&pcx, primary, sizeof(pcx));
+		width = LittleShort(pcx.xmax) + 1;
+		height = LittleShort(pcx.ymax) + 1;
+	}
+	else
+	if ((format == async_wal) && (primarySize >= (int)sizeof(miptex_t)))
+	{
+		miptex_t mt;
+		memcpy(&mt, primary, sizeof(mt));
+		width = LittleLong(mt.width);
+		height = LittleLong(mt.height);
+	}
+
+	byte *raw = NULL;
+	int rawSize = 0;
+	if (r_texture_retexturing->value)
+	{
+		for (int i = 0; i < (int)(sizeof(replacements) / sizeof(replacements[0])) && !raw; i++)
+		{
+			char path[MAX_QPATH];
+			Com_sprintf(path, sizeof(path), "%s.%s", namewe, replacements[i]);
+			rawSize = FS_MapFile(path, (void **)&raw);
+		}
+	}
+
+	asyncjob_t *job = &async_jobs[async_jobNb];
+	memset(job, 0, sizeof(*job));
+	job->type = type;
+	job->noFilteringFlag = (strstr(Cvar_VariableString("gl_nolerp_list"), name) != NULL);
+	job->mipmapFlag = true;
+	if (raw)
+	{
+		job->format = async_stb;
+		job->raw = raw;
+		job->rawSize = rawSize;
+		job->fallbackFormat = format;
+		job->fallback = primary;
+		job->fallbackSize = primarySize;
+		job->realwidth = width;
+		job->realheight = height;
+	}
+	else
+	{
+		job->format = format;
+		job->raw = primary;
+		job->rawSize = primarySize;
+	}
+
+	image_t *img = R_Image_allocate(name, width, height, type);
+	img->scrap = false;
+	img->texnum = TEXNUM_IMAGES + (img - gltextures);
+	img->upload_width = 0;
+	img->upload_height = 0;
+	img->has_alpha = false;
+	img->paletted = false;
+	img->sl = 0;
+	img->sh = 1;
+	img->tl = 0;
+	img->th = 1;
+	job->image = img;
+
+	job->task.run = R_Async_runImage;
+	R_Async_push(&job->task);
+	async_jobNb++;
+
+	async_fetchTime += Sys_Milliseconds() - start;
+
+	*image = img;
+	return true;
+}
+
+static void R_Async_upload(asyncjob_t *job)
+{
+	image_t *image = job->image;
+
+	oglwSetCurrentTextureUnitForced(0);
+	oglwBindTextureForced(0, image->texnum);
+
+	if (job->pixels || job->cache.data)
+	{
+		if (job->cache.data)
+			R_TexCache_upload(&job->cache, job->noFilteringFlag);
+		else
+			R_Texture_upload(job->pixels, 0, 0, job->uploadWidth, job->uploadHeight, true, job->noFilteringFlag, job->mipmapFlag);
+		image->upload_width = job->uploadWidth;
+		image->upload_height = job->uploadHeight;
+		image->has_alpha = job->hasAlpha;
+
+		// The size of the original was already handed out, keep it for replacements.
+		if (!job->realwidth || !job->realheight)
+		{
+			image->width = job->width;
+			image->height = job->height;
+		}
+		else
+		if ((job->realwidth > job->width) || (job->realheight > job->height))
+		{
+			R_printf(PRINT_DEVELOPER,
+				"Warning, image '%s' has hi-res replacement smaller than the original! (%d x %d) < (%d x %d)\n",
+				image->name, job->width, job->height, job->realwidth, job->realheight);
+		}
+
+		free(job->pixels);
+		free(job->cache.data);
+	}
+	else
+	{
+		static const unsigned black = 0xff000000;
+		R_printf(PRINT_ALL, "R_FindImage: couldn't decode %s\n", image->name);
+		R_Texture_upload((void *)&black, 0, 0, 1, 1, true, true, false);
+		image->upload_width = 1;
+		image->upload_height = 1;
+	}
+}
+
+void R_Image_beginLoading()
+{
+	// Leftovers from an aborted registration.
+	R_Image_finishLoading();
+
+	async_active = true;
+	async_beginTime = Sys_Milliseconds();
+	async_fetchTime = 0;
+	async_waitTime = 0;
+	async_uploadTime = 0;
+	async_decodeTime = 0;
+	async_syncNb = 0;
+	async_cacheHitNb = 0;
+
+	R_TexCache_begin();
+}
+
+/*
+ * Waits for the queued images, uploads them and prints the registration timings.
+ */
+void R_Image_finishLoading()
+{
+	if (!async_active)
+		return;
+	async_active = false;
+
+	int jobNb = async_jobNb;
+	for (int i = 0; i < jobNb; i++)
+	{
+		asyncjob_t *job = &async_jobs[i];
+
+		R_Async_wait(&job->task);
+
+		int start = Sys_Milliseconds();
+		R_Async_upload(job);
+		async_uploadTime += Sys_Milliseconds() - start;
+		async_decodeTime += job->decodeTime;
+		if (job->cached)
+			async_cacheHitNb++;
+
+		FS_FreeFile(job->raw);
+		if (job->fallback)
+			FS_FreeFile(job->fallback);
+	}
+
+	async_jobNb = 0;
+
+	int total = Sys_Milliseconds() - async_beginTime;
+	R_printf(PRINT_ALL, "Registration: %i ms, %i images on %i threads (%i ms decoding, %i from the texture cache), %i loaded synchronously.\n",
+		total, jobNb, async_threadNb, (int)(async_decodeTime * 1000 / SDL_GetPerformanceFrequency()), async_cacheHitNb, async_syncNb);
+	R_printf(PRINT_ALL, "Registration: %i ms looking up, %i ms waiting, %i ms uploading, %i ms for models and the rest.\n",
+		async_fetchTime, async_waitTime, async_uploadTime, total - async_fetchTime - async_waitTime - async_uploadTime);
+}
+
 /*
  * Finds or loads the given image
  */
 image_t* R_FindImage(char *name, imagetype_t type)
 {
 	image_t *image;
-	int i, len;
+	int len;
 	byte *pic, *palette;
 	int width, height;
 	char *ptr;
@@ -766,15 +1669,20 @@ image_t* R_FindImage(char *name, imagetype_t type)
 		*ptr = '/';
 
 	/* look for it */
-	for (i = 0, image = gltextures; i < numgltextures; i++, image++)
+	registrynode_t *node = Registry_Find(&gltextures_registry, name);
+	if (node)
 	{
-		if (!strcmp(name, image->name))
-		{
-			image->registration_sequence = registration_sequence;
-			return image;
-		}
+		image = REGISTRY_ENTRY(node, image_t, registryNode);
+		image->registration_sequence = registration_sequence;
+		return image;
 	}
 
+	/* decode it on the loader threads during registration */
+	if (R_Async_findImage(name, namewe, ext, type, &image))
+		return image;
+	if (async_active)
+		async_syncNb++;
+
 	/* load the pic from disk */
 	pic = NULL;
 	palette = NULL;
@@ -912,6 +1820,7 @@ void R_FreeUnusedImages()
 
 		/* free it */
 		glDeleteTextures(1, (GLuint *)&image->texnum);
+		Registry_Remove(&gltextures_registry, &image->registryNode);
 		memset(image, 0, sizeof(*image));
 	}
 }
@@ -976,6 +1885,10 @@ void R_ShutdownImages()
 {
 	int i;
 	image_t *image;
+
+	R_Image_finishLoading();
+	R_Async_stop();
+
 	for (i = 0, image = gltextures; i < numgltextures; i++, image++)
 	{
 		if (!image->registration_sequence)
@@ -985,4 +1898,5 @@ void R_ShutdownImages()
 		glDeleteTextures(1, (GLuint *)&image->texnum);
 		memset(image, 0, sizeof(*image));
 	}
+	Registry_Clear(&gltextures_registry);
 }
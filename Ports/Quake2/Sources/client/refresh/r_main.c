@@ -112,6 +112,9 @@ cvar_t *r_texture_scaledown;
 cvar_t *r_texture_filter;
 cvar_t *r_texture_anisotropy;
 cvar_t *r_texture_anisotropy_available;
+cvar_t *r_texture_async;
+cvar_t *r_texture_cache;
+cvar_t *r_texture_compress;
 
 cvar_t *gl_stereo;
 cvar_t *gl_stereo_separation;
@@ -125,10 +128,13 @@ cvar_t *gl_speeds;
 
 cvar_t *gl_novis;
 cvar_t *gl_lockpvs;
+cvar_t *r_vismatrix;
 cvar_t *gl_nocull;
 cvar_t *gl_cull;
 
 cvar_t *gl_lerpmodels;
+cvar_t *r_lerp_simd;
+cvar_t *r_gpu_lerp;
 cvar_t *gl_lefthand;
 cvar_t *gl_lightlevel;
 cvar_t *gl_shadows;
@@ -155,7 +161,11 @@ cvar_t *r_lightmap_only;
 cvar_t *r_lightmap_saturate;
 cvar_t *gl_modulate;
 cvar_t *r_lightmap_outline;
+cvar_t *r_lightmap_gpu;
+cvar_t *r_lightmap_simd;
 cvar_t *r_subdivision;
+cvar_t *r_world_static;
+cvar_t *r_draw_queue;
 
 cvar_t *r_fullscreenflash;
 cvar_t *r_lightflash;
@@ -483,9 +493,177 @@ void R_DynamicLighting_push()
 		R_DynamicLighting_markLights(l, 1 << i, r_worldmodel->nodes);
 }
 
+//--------------------------------------------------------------------------------
+// Static world geometry.
+//--------------------------------------------------------------------------------
+// The polygons of the world and of its inline models never move, so they are
+// uploaded once in a static buffer and each pass only appends index ranges.
+// Indices are 16 bits, the buffer is split in segments of 64K vertices that
+// are drawn with the attributes rebased on the segment.
+#define WORLD_SEGMENT_SHIFT 16
+#define WORLD_SEGMENT_SIZE (1 << WORLD_SEGMENT_SHIFT)
+#define WORLD_SEGMENT_MAX_NB 16
+
+typedef struct
+{
+	GLushort *indices;
+	int indexNb, indexCapacity;
+} worldindexlist_t;
+
+static struct
+{
+	GLuint buffer;
+	int vertexNb;
+	int segmentNb;
+	worldindexlist_t lists[WORLD_SEGMENT_MAX_NB];
+} r_worldStatic;
+
+static bool R_World_isStaticSurface(msurface_t *surf)
+{
+	if (surf->flags & (SURF_DRAWTURB | SURF_DRAWSKY))
+		return false;
+	if (surf->texinfo->flags & (SURF_SKY | SURF_WARP | SURF_FLOWING | SURF_TRANS33 | SURF_TRANS66))
+		return false; // Scrolling or alpha blended.
+	glpoly_t *p = surf->polys;
+	return p && !p->next && !p->chain && (p->numverts >= 3);
+}
+
+void R_World_freeStatic()
+{
+	oglwDestroyStaticBuffer(r_worldStatic.buffer);
+	r_worldStatic.buffer = 0;
+	r_worldStatic.vertexNb = 0;
+	r_worldStatic.segmentNb = 0;
+	for (int i = 0; i < WORLD_SEGMENT_MAX_NB; i++)
+	{
+		worldindexlist_t *list = &r_worldStatic.lists[i];
+		free(list->indices);
+		list->indices = NULL;
+		list->indexNb = 0;
+		list->indexCapacity = 0;
+	}
+}
+
+void R_World_buildStatic()
+{
+	R_World_freeStatic();
+
+	model_t *model = r_worldmodel;
+	if (!model || !r_world_static->value)
+		return;
+
+	// Place the polygons, a polygon never crosses a segment.
+	int vertexNb = 0;
+	msurface_t *surf = model->surfaces;
+	for (int i = 0; i < model->numsurfaces; i++, surf++)
+	{
+		surf->staticVertex = -1;
+		if (!R_World_isStaticSurface(surf))
+			continue;
+		int n = surf->polys->numverts;
+		if ((vertexNb & (WORLD_SEGMENT_SIZE - 1)) + n > WORLD_SEGMENT_SIZE)
+			vertexNb = ((vertexNb >> WORLD_SEGMENT_SHIFT) + 1) << WORLD_SEGMENT_SHIFT;
+		surf->staticVertex = vertexNb;
+		vertexNb += n;
+	}
+
+	int segmentNb = ((vertexNb + WORLD_SEGMENT_SIZE - 1) >> WORLD_SEGMENT_SHIFT);
+	OglwVertex *vertices = NULL;
+	if (vertexNb && (segmentNb <= WORLD_SEGMENT_MAX_NB))
+		vertices = calloc(vertexNb, sizeof(OglwVertex));
+
+	if (vertices)
+	{
+		surf = model->surfaces;
+		for (int i = 0; i < model->numsurfaces; i++, surf++)
+		{
+			if (surf->staticVertex < 0)
+				continue;
+			glpoly_t *p = surf->polys;
+			OglwVertex *vtx = &vertices[surf->staticVertex];
+			float *v = p->verts[0];
+			for (int j = 0; j < p->numverts; j++, v += VERTEXSIZE)
+				vtx = AddVertex3D_CT2(vtx, v[0], v[1], v[2], 1.0f, 1.0f, 1.0f, 1.0f, v[3], v[4], v[5], v[6]);
+		}
+		r_worldStatic.buffer = oglwCreateStaticBuffer(vertices, vertexNb);
+		free(vertices);
+	}
+
+	if (!r_worldStatic.buffer)
+	{
+		if (vertexNb)
+			R_printf(PRINT_DEVELOPER, "R_World_buildStatic: no static buffer for %i vertices, streaming the world.\n", vertexNb);
+		surf = model->surfaces;
+		for (int i = 0; i < model->numsurfaces; i++, surf++)
+			surf->staticVertex = -1;
+		return;
+	}
+
+	r_worldStatic.vertexNb = vertexNb;
+	r_worldStatic.segmentNb = segmentNb;
+	R_printf(PRINT_DEVELOPER, "Static world: %i vertices in %i segments.\n", vertexNb, segmentNb);
+}
+
+// Returns true if the surface is drawn by R_World_drawStatic.
+static bool R_World_addStatic(msurface_t *surf, float alpha)
+{
+	int first = surf->staticVertex;
+	if ((first < 0) || !r_worldStatic.buffer || (alpha != 1.0f) || !r_world_static->value)
+		return false;
+
+	worldindexlist_t *list = &r_worldStatic.lists[first >> WORLD_SEGMENT_SHIFT];
+	int n = surf->polys->numverts;
+	int indexNb = (n - 2) * 3;
+	if (list->indexNb + indexNb > list->indexCapacity)
+	{
+		int capacity = list->indexCapacity * 2;
+		if (capacity < list->indexNb + indexNb)
+			capacity = list->indexNb + indexNb + 4096;
+		GLushort *indices = realloc(list->indices, capacity * sizeof(GLushort));
+		if (!indices)
+			return false;
+		list->indices = indices;
+		list->indexCapacity = capacity;
+	}
+
+	GLushort *index = list->indices + list->indexNb;
+	int base = first & (WORLD_SEGMENT_SIZE - 1);
+	for (int i = 2; i < n; i++, index += 3)
+	{
+		index[0] = base;
+		index[1] = base + i - 1;
+		index[2] = base + i;
+	}
+	list->indexNb += indexNb;
+	return true;
+}
+
+// Draws the surfaces added since the last call. Texture unit 0 reads the texture coordinates set texCoordSet0.
+static void R_World_drawStatic(int texCoordSet0)
+{
+	for (int i = 0; i < r_worldStatic.segmentNb; i++)
+	{
+		worldindexlist_t *list = &r_worldStatic.lists[i];
+		if (list->indexNb)
+		{
+			oglwDrawStaticElements(r_worldStatic.buffer, i << WORLD_SEGMENT_SHIFT, list->indices, list->indexNb, texCoordSet0);
+			list->indexNb = 0;
+		}
+	}
+}
+
 //--------------------------------------------------------------------------------
 // Lightmap.
 //--------------------------------------------------------------------------------
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2_MATH__)
+#include <emmintrin.h>
+#define LIGHTMAP_SSE2
+#elif defined(__aarch64__)
+// Needs the IEEE square root of AArch64 to match the reference kernel.
+#include <arm_neon.h>
+#define LIGHTMAP_NEON
+#endif
+
 static float r_lightmap_block[34 * 34 * 3];
 static lightstyle_t r_lightmap_styles[MAX_LIGHTSTYLES];
 
@@ -604,7 +782,373 @@ void R_Lighmap_lightPoint(entity_t *e, vec3_t p, vec3_t color, vec3_t lightSpot,
 	VectorScale(color, gl_modulate->value, color);
 }
 
-static void R_Lighmap_addDynamicLights(msurface_t *surf)
+// The kernels accumulate the styles, add the dynamic lights and pack the block in RGBA8.
+// The SIMD kernels give the same bytes as the reference one. The builds use -ffast-math, which
+// lets the compiler fuse, reorder or approximate the scalar code differently from the vector code,
+// so the kernels are compiled with strict floating point and the rescale is done on integers.
+#if defined(__clang__)
+#pragma float_control(precise, on, push)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC optimize("no-fast-math", "fp-contract=off")
+#endif
+static void R_Lightmap_accumulateReference(float *block, const byte *lightmap, int size, const float scale[3], bool first)
+{
+	for (int i = 0; i < size; i++, lightmap += 3, block += 3)
+	{
+		float lr = lightmap[0] * scale[0];
+		float lg = lightmap[1] * scale[1];
+		float lb = lightmap[2] * scale[2];
+		if (first)
+		{
+			block[0] = lr;
+			block[1] = lg;
+			block[2] = lb;
+		}
+		else
+		{
+			block[0] += lr;
+			block[1] += lg;
+			block[2] += lb;
+		}
+	}
+}
+
+/*
+ * Adds the falloff of a light to the texels [s, smax[ of a row
+ */
+static inline void R_Lightmap_addLightRow(float *block, int s, int smax, float td, float localX, float frad, float fminlight, const float color[3])
+{
+	for (; s < smax; s++, block += 3)
+	{
+		float sd = localX - (s << 4);
+		float distance = sqrtf(td * td + sd * sd);
+		if (distance < fminlight)
+		{
+			float attenuation = frad - distance;
+			block[0] += attenuation * color[0];
+			block[1] += attenuation * color[1];
+			block[2] += attenuation * color[2];
+		}
+	}
+}
+
+static void R_Lightmap_addLightReference(float *block, int smax, int tmax, float localX, float localY, float frad, float fminlight, const float color[3])
+{
+	for (int t = 0; t < tmax; t++, block += smax * 3)
+		R_Lightmap_addLightRow(block, 0, smax, localY - (t << 4), localX, frad, fminlight, color);
+}
+
+static inline void R_Lightmap_packTexel(int r, int g, int b, byte *dest)
+{
+	/* catch negative lights */
+	if (r < 0)
+		r = 0;
+	if (g < 0)
+		g = 0;
+	if (b < 0)
+		b = 0;
+
+	/* determine the brightest of the three color components */
+	int max = r;
+	if (max < g)
+		max = g;
+	if (max < b)
+		max = b;
+
+	/* alpha is ONLY used for the mono lightmap case. For this
+	   reason we set it to the brightest of the color components
+	   so that things don't get too dim. */
+	int a = max;
+
+	/* rescale all the color components if the
+	   intensity of the greatest channel exceeds
+	   1.0f */
+	if (max > 255)
+	{
+		float t = 255.0F / max;
+		r = r * t;
+		g = g * t;
+		b = b * t;
+		a = a * t;
+	}
+
+	dest[0] = r;
+	dest[1] = g;
+	dest[2] = b;
+	dest[3] = a;
+}
+
+static inline void R_Lightmap_packRow(const float *block, int count, byte *dest)
+{
+	for (int j = 0; j < count; j++, block += 3, dest += 4)
+		R_Lightmap_packTexel(Q_ftol(block[0]), Q_ftol(block[1]), Q_ftol(block[2]), dest);
+}
+
+static void R_Lightmap_packReference(const float *block, int smax, int tmax, byte *dest, int stride)
+{
+	for (int i = 0; i < tmax; i++, block += smax * 3, dest += stride)
+		R_Lightmap_packRow(block, smax, dest);
+}
+
+#if defined(LIGHTMAP_SSE2)
+static void R_Lightmap_accumulateSSE2(float *block, const byte *lightmap, int size, const float scale[3], bool first)
+{
+	// 4 texels are 3 vectors of interleaved channels.
+	const __m128 scale0 = _mm_setr_ps(scale[0], scale[1], scale[2], scale[0]);
+	const __m128 scale1 = _mm_setr_ps(scale[1], scale[2], scale[0], scale[1]);
+	const __m128 scale2 = _mm_setr_ps(scale[2], scale[0], scale[1], scale[2]);
+	const __m128i zero = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 4 <= size; i += 4, lightmap += 12, block += 12)
+	{
+		int last;
+		memcpy(&last, lightmap + 8, sizeof(last));
+		__m128i bytes = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)lightmap), _mm_cvtsi32_si128(last));
+		__m128i lo = _mm_unpacklo_epi8(bytes, zero);
+		__m128i hi = _mm_unpackhi_epi8(bytes, zero);
+		__m128 l0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale0);
+		__m128 l1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale1);
+		__m128 l2 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale2);
+		if (!first)
+		{
+			l0 = _mm_add_ps(_mm_loadu_ps(block), l0);
+			l1 = _mm_add_ps(_mm_loadu_ps(block + 4), l1);
+			l2 = _mm_add_ps(_mm_loadu_ps(block + 8), l2);
+		}
+		_mm_storeu_ps(block, l0);
+		_mm_storeu_ps(block + 4, l1);
+		_mm_storeu_ps(block + 8, l2);
+	}
+	R_Lightmap_accumulateReference(block, lightmap, size - i, scale, first);
+}
+
+static void R_Lightmap_addLightSSE2(float *block, int smax, int tmax, float localX, float localY, float frad, float fminlight, const float color[3])
+{
+	const __m128 color0 = _mm_setr_ps(color[0], color[1], color[2], color[0]);
+	const __m128 color1 = _mm_setr_ps(color[1], color[2], color[0], color[1]);
+	const __m128 color2 = _mm_setr_ps(color[2], color[0], color[1], color[2]);
+	const __m128i steps = _mm_setr_epi32(0, 16, 32, 48);
+	const __m128 x = _mm_set1_ps(localX);
+	const __m128 rad = _mm_set1_ps(frad);
+	const __m128 minlight = _mm_set1_ps(fminlight);
+	for (int t = 0; t < tmax; t++)
+	{
+		float td = localY - (t << 4);
+		__m128 td2 = _mm_set1_ps(td * td);
+		int s = 0;
+		for (; s + 4 <= smax; s += 4, block += 12)
+		{
+			__m128 sd = _mm_sub_ps(x, _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(s << 4), steps)));
+			__m128 distance = _mm_sqrt_ps(_mm_add_ps(td2, _mm_mul_ps(sd, sd)));
+			__m128 lit = _mm_cmplt_ps(distance, minlight);
+			if (!_mm_movemask_ps(lit))
+				continue;
+			__m128 attenuation = _mm_sub_ps(rad, distance);
+
+			// Spread the 4 texels over the interleaved channels.
+			__m128 a0 = _mm_shuffle_ps(attenuation, attenuation, _MM_SHUFFLE(1, 0, 0, 0));
+			__m128 a1 = _mm_shuffle_ps(attenuation, attenuation, _MM_SHUFFLE(2, 2, 1, 1));
+			__m128 a2 = _mm_shuffle_ps(attenuation, attenuation, _MM_SHUFFLE(3, 3, 3, 2));
+			__m128 m0 = _mm_shuffle_ps(lit, lit, _MM_SHUFFLE(1, 0, 0, 0));
+			__m128 m1 = _mm_shuffle_ps(lit, lit, _MM_SHUFFLE(2, 2, 1, 1));
+			__m128 m2 = _mm_shuffle_ps(lit, lit, _MM_SHUFFLE(3, 3, 3, 2));
+			__m128 b0 = _mm_loadu_ps(block);
+			__m128 b1 = _mm_loadu_ps(block + 4);
+			__m128 b2 = _mm_loadu_ps(block + 8);
+			b0 = _mm_or_ps(_mm_and_ps(m0, _mm_add_ps(b0, _mm_mul_ps(a0, color0))), _mm_andnot_ps(m0, b0));
+			b1 = _mm_or_ps(_mm_and_ps(m1, _mm_add_ps(b1, _mm_mul_ps(a1, color1))), _mm_andnot_ps(m1, b1));
+			b2 = _mm_or_ps(_mm_and_ps(m2, _mm_add_ps(b2, _mm_mul_ps(a2, color2))), _mm_andnot_ps(m2, b2));
+			_mm_storeu_ps(block, b0);
+			_mm_storeu_ps(block + 4, b1);
+			_mm_storeu_ps(block + 8, b2);
+		}
+		R_Lightmap_addLightRow(block, s, smax, td, localX, frad, fminlight, color);
+		block += (smax - s) * 3;
+	}
+}
+
+static void R_Lightmap_packSSE2(const float *block, int smax, int tmax, byte *dest, int stride)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 limit = _mm_set1_ps(255.0f);
+	for (int i = 0; i < tmax; i++, dest += stride)
+	{
+		byte *out = dest;
+		int j = 0;
+		for (; j + 4 <= smax; j += 4, block += 12, out += 16)
+		{
+			// Deinterleave r0g0b0r1 g1b1r2g2 b2r3g3b3.
+			__m128 x0 = _mm_loadu_ps(block);
+			__m128 x1 = _mm_loadu_ps(block + 4);
+			__m128 x2 = _mm_loadu_ps(block + 8);
+			__m128 r = _mm_shuffle_ps(_mm_shuffle_ps(x0, x0, _MM_SHUFFLE(3, 0, 3, 0)), _mm_shuffle_ps(x1, x2, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 1, 0));
+			__m128 g = _mm_shuffle_ps(_mm_shuffle_ps(x0, x1, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(x1, x2, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 b = _mm_shuffle_ps(_mm_shuffle_ps(x0, x1, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(x2, x2, _MM_SHUFFLE(3, 0, 3, 0)), _MM_SHUFFLE(1, 0, 2, 0));
+
+			// Truncate and catch negative lights.
+			r = _mm_max_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(r)), zero);
+			g = _mm_max_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(g)), zero);
+			b = _mm_max_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(b)), zero);
+			__m128 a = _mm_max_ps(_mm_max_ps(r, g), b);
+
+			// Texels whose brightest channel exceeds 255 are rescaled by the reference.
+			if (_mm_movemask_ps(_mm_cmpgt_ps(a, limit)))
+			{
+				int ri[4], gi[4], bi[4];
+				_mm_storeu_si128((__m128i *)ri, _mm_cvttps_epi32(r));
+				_mm_storeu_si128((__m128i *)gi, _mm_cvttps_epi32(g));
+				_mm_storeu_si128((__m128i *)bi, _mm_cvttps_epi32(b));
+				for (int k = 0; k < 4; k++)
+					R_Lightmap_packTexel(ri[k], gi[k], bi[k], out + k * 4);
+				continue;
+			}
+
+			__m128i rgba = _mm_cvttps_epi32(r);
+			rgba = _mm_or_si128(rgba, _mm_slli_epi32(_mm_cvttps_epi32(g), 8));
+			rgba = _mm_or_si128(rgba, _mm_slli_epi32(_mm_cvttps_epi32(b), 16));
+			rgba = _mm_or_si128(rgba, _mm_slli_epi32(_mm_cvttps_epi32(a), 24));
+			_mm_storeu_si128((__m128i *)out, rgba);
+		}
+		R_Lightmap_packRow(block, smax - j, out);
+		block += (smax - j) * 3;
+	}
+}
+#endif
+
+#if defined(LIGHTMAP_NEON)
+static void R_Lightmap_accumulateNEON(float *block, const byte *lightmap, int size, const float scale[3], bool first)
+{
+	int i = 0;
+	for (; i + 8 <= size; i += 8, lightmap += 24)
+	{
+		uint8x8x3_t bytes = vld3_u8(lightmap);
+		for (int half = 0; half < 2; half++, block += 12)
+		{
+			float32x4x3_t l;
+			for (int c = 0; c < 3; c++)
+			{
+				uint16x8_t wide = vmovl_u8(bytes.val[c]);
+				uint32x4_t texels = half ? vmovl_u16(vget_high_u16(wide)) : vmovl_u16(vget_low_u16(wide));
+				l.val[c] = vmulq_n_f32(vcvtq_f32_u32(texels), scale[c]);
+			}
+			if (!first)
+			{
+				float32x4x3_t b = vld3q_f32(block);
+				for (int c = 0; c < 3; c++)
+					l.val[c] = vaddq_f32(b.val[c], l.val[c]);
+			}
+			vst3q_f32(block, l);
+		}
+	}
+	R_Lightmap_accumulateReference(block, lightmap, size - i, scale, first);
+}
+
+static void R_Lightmap_addLightNEON(float *block, int smax, int tmax, float localX, float localY, float frad, float fminlight, const float color[3])
+{
+	static const int32_t stepValues[4] = { 0, 16, 32, 48 };
+	const int32x4_t steps = vld1q_s32(stepValues);
+	const float32x4_t x = vdupq_n_f32(localX);
+	const float32x4_t rad = vdupq_n_f32(frad);
+	const float32x4_t minlight = vdupq_n_f32(fminlight);
+	for (int t = 0; t < tmax; t++)
+	{
+		float td = localY - (t << 4);
+		float32x4_t td2 = vdupq_n_f32(td * td);
+		int s = 0;
+		for (; s + 4 <= smax; s += 4, block += 12)
+		{
+			float32x4_t sd = vsubq_f32(x, vcvtq_f32_s32(vaddq_s32(vdupq_n_s32(s << 4), steps)));
+			float32x4_t distance = vsqrtq_f32(vaddq_f32(td2, vmulq_f32(sd, sd)));
+			uint32x4_t lit = vcltq_f32(distance, minlight);
+			if (!vmaxvq_u32(lit))
+				continue;
+			float32x4_t attenuation = vsubq_f32(rad, distance);
+			float32x4x3_t b = vld3q_f32(block);
+			for (int c = 0; c < 3; c++)
+				b.val[c] = vbslq_f32(lit, vaddq_f32(b.val[c], vmulq_n_f32(attenuation, color[c])), b.val[c]);
+			vst3q_f32(block, b);
+		}
+		R_Lightmap_addLightRow(block, s, smax, td, localX, frad, fminlight, color);
+		block += (smax - s) * 3;
+	}
+}
+
+static void R_Lightmap_packNEON(const float *block, int smax, int tmax, byte *dest, int stride)
+{
+	const float32x4_t zero = vdupq_n_f32(0.0f);
+	const float32x4_t limit = vdupq_n_f32(255.0f);
+	for (int i = 0; i < tmax; i++, dest += stride)
+	{
+		byte *out = dest;
+		int j = 0;
+		for (; j + 4 <= smax; j += 4, block += 12, out += 16)
+		{
+			float32x4x3_t x = vld3q_f32(block);
+
+			// Truncate and catch negative lights.
+			float32x4_t c[4];
+			for (int k = 0; k < 3; k++)
+				c[k] = vmaxq_f32(vcvtq_f32_s32(vcvtq_s32_f32(x.val[k])), zero);
+			c[3] = vmaxq_f32(vmaxq_f32(c[0], c[1]), c[2]);
+
+			// Texels whose brightest channel exceeds 255 are rescaled by the reference.
+			if (vmaxvq_u32(vcgtq_f32(c[3], limit)))
+			{
+				int32_t ci[3][4];
+				for (int k = 0; k < 3; k++)
+					vst1q_s32(ci[k], vcvtq_s32_f32(c[k]));
+				for (int k = 0; k < 4; k++)
+					R_Lightmap_packTexel(ci[0][k], ci[1][k], ci[2][k], out + k * 4);
+				continue;
+			}
+
+			uint32x4_t rgba = vcvtq_u32_f32(c[0]);
+			rgba = vorrq_u32(rgba, vshlq_n_u32(vcvtq_u32_f32(c[1]), 8));
+			rgba = vorrq_u32(rgba, vshlq_n_u32(vcvtq_u32_f32(c[2]), 16));
+			rgba = vorrq_u32(rgba, vshlq_n_u32(vcvtq_u32_f32(c[3]), 24));
+			vst1q_u8(out, vreinterpretq_u8_u32(rgba));
+		}
+		R_Lightmap_packRow(block, smax - j, out);
+		block += (smax - j) * 3;
+	}
+}
+#endif
+
+#if defined(__clang__)
+#pragma float_control(pop)
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+typedef struct
+{
+	const char *name;
+	void (*accumulate)(float *block, const byte *lightmap, int size, const float scale[3], bool first);
+	void (*addLight)(float *block, int smax, int tmax, float localX, float localY, float frad, float fminlight, const float color[3]);
+	void (*pack)(const float *block, int smax, int tmax, byte *dest, int stride);
+} lightmapkernels_t;
+
+static const lightmapkernels_t r_lightmap_kernels[] =
+{
+	{ "reference", R_Lightmap_accumulateReference, R_Lightmap_addLightReference, R_Lightmap_packReference },
+	#if defined(LIGHTMAP_SSE2)
+	{ "sse2", R_Lightmap_accumulateSSE2, R_Lightmap_addLightSSE2, R_Lightmap_packSSE2 },
+	#elif defined(LIGHTMAP_NEON)
+	{ "neon", R_Lightmap_accumulateNEON, R_Lightmap_addLightNEON, R_Lightmap_packNEON },
+	#endif
+};
+#define LIGHTMAP_KERNEL_NB (int)(sizeof(r_lightmap_kernels) / sizeof(r_lightmap_kernels[0]))
+
+static const lightmapkernels_t *R_Lightmap_getKernels()
+{
+	if ((LIGHTMAP_KERNEL_NB > 1) && r_lightmap_simd->value)
+		return &r_lightmap_kernels[1];
+	return &r_lightmap_kernels[0];
+}
+
+static void R_Lighmap_addDynamicLights(const lightmapkernels_t *kernels, msurface_t *surf)
 {
 	int smax = (surf->extents[0] >> 4) + 1;
 	int tmax = (surf->extents[1] >> 4) + 1;
@@ -633,28 +1177,8 @@ static void R_Lighmap_addDynamicLights(msurface_t *surf)
         // Position of the projection of the center of the light in 2D.
 		float localX = DotProduct(impact, tex->vecs[0]) + tex->vecs[0][3] - surf->texturemins[0];
 		float localY = DotProduct(impact, tex->vecs[1]) + tex->vecs[1][3] - surf->texturemins[1];
-        
-        float colorR = dl->color[0], colorG = dl->color[1], colorB = dl->color[2];
-		float *pfBL = r_lightmap_block;
-		for (int t = 0; t < tmax; t++)
-		{
-			float td = localY - (t << 4);
-			for (int s = 0; s < smax; s++, pfBL += 3)
-			{
-				float sd = localX - (s << 4);
-                float distance = sqrtf(td * td + sd * sd); // TODO: Could use sqrt approximation here (or rsqrt(x)*x).
-				if (distance < fminlight)
-				{
-                    float attenuation = frad - distance;
-                    float lr = pfBL[0] + attenuation * colorR;
-                    float lg = pfBL[1] + attenuation * colorG;
-                    float lb = pfBL[2] + attenuation * colorB;
-					pfBL[0] = lr;
-					pfBL[1] = lg;
-					pfBL[2] = lb;
-				}
-			}
-		}
+
+		kernels->addLight(r_lightmap_block, smax, tmax, localX, localY, frad, fminlight, dl->color);
 	}
 }
 
@@ -672,7 +1196,7 @@ static void R_Lightmap_setCacheState(msurface_t *surf)
 /*
  * Combine and scale multiple lightmaps into the floating format in blocklights
  */
-static void R_Lightmap_build(msurface_t *surf, byte *dest, int stride)
+static void R_Lightmap_buildWith(const lightmapkernels_t *kernels, msurface_t *surf, byte *dest, int stride)
 {
 	if (surf->texinfo->flags & (SURF_SKY | SURF_TRANS33 | SURF_TRANS66 | SURF_WARP))
 		R_error(ERR_DROP, "R_Lightmap_build called for non-lit surface");
@@ -692,143 +1216,332 @@ static void R_Lightmap_build(msurface_t *surf, byte *dest, int stride)
 	}
     else
 	{
-		// Count the number of maps.
-		int nummaps;
-		for (nummaps = 0; nummaps < MAXLIGHTMAPS; nummaps++)
-        {
-            if (surf->styles[nummaps] == 255)
-                break;
-        }
-
-		byte *lightmap = surf->samples;
-
 		/* add all the lightmaps */
-		if (nummaps == 1)
+		if (surf->styles[0] == 255)
+			memset(r_lightmap_block, 0, sizeof(r_lightmap_block[0]) * size * 3);
+		byte *lightmap = surf->samples;
+		for (int maps = 0; maps < MAXLIGHTMAPS && surf->styles[maps] != 255; maps++, lightmap += size * 3)
 		{
-            float modulate = gl_modulate->value;
-            float scale[3];
-            for (int i = 0; i < 3; i++)
-                scale[i] = modulate * r_newrefdef.lightstyles[surf->styles[0]].rgb[i];
+			float scale[3];
+			for (int i = 0; i < 3; i++)
+				scale[i] = gl_modulate->value * r_newrefdef.lightstyles[surf->styles[maps]].rgb[i];
+			kernels->accumulate(r_lightmap_block, lightmap, size, scale, maps == 0);
+		}
 
-            float *bl = r_lightmap_block;
-            if (scale[0] == 1.0f && scale[1] == 1.0f && scale[2] == 1.0f)
-            {
-                for (int i = 0; i < size; i++, lightmap += 3, bl += 3)
-                {
-                    float lr = lightmap[0];
-                    float lg = lightmap[1];
-                    float lb = lightmap[2];
-                    bl[0] = lr;
-                    bl[1] = lg;
-                    bl[2] = lb;
-                }
-            }
-            else
-            {
-                for (int i = 0; i < size; i++, lightmap += 3, bl += 3)
-                {
-                    float lr = lightmap[0] * scale[0];
-                    float lg = lightmap[1] * scale[1];
-                    float lb = lightmap[2] * scale[2];
-                    bl[0] = lr;
-                    bl[1] = lg;
-                    bl[2] = lb;
-                }
-            }
+		/* add all the dynamic lights */
+		if (surf->dlightframe == r_framecount)
+			R_Lighmap_addDynamicLights(kernels, surf);
+	}
+
+	kernels->pack(r_lightmap_block, smax, tmax, dest, stride);
+}
+
+static void R_Lightmap_build(msurface_t *surf, byte *dest, int stride)
+{
+	R_Lightmap_buildWith(R_Lightmap_getKernels(), surf, dest, stride);
+}
+
+/*
+ * Runs the kernels over every lit surface of the base maps, checks they match the reference one and times them.
+ */
+static void R_Lightmap_test_f(void)
+{
+	static const char *mapNames[] = { "maps/base1.bsp", "maps/base2.bsp", "maps/base3.bsp" };
+	int times[LIGHTMAP_KERNEL_NB] = { 0 };
+	int iterationNb = (Cmd_Argc() > 1) ? atoi(Cmd_Argv(1)) : 10;
+	if (iterationNb < 1)
+		iterationNb = 1;
+
+	// Styles with overbright values and two dynamic lights in front of every surface.
+	static lightstyle_t styles[MAX_LIGHTSTYLES];
+	for (int i = 0; i < MAX_LIGHTSTYLES; i++)
+	{
+		styles[i].rgb[0] = (i % 26) / 12.0f;
+		styles[i].rgb[1] = ((i + 7) % 26) / 12.0f;
+		styles[i].rgb[2] = ((i + 13) % 26) / 12.0f;
+		styles[i].white = styles[i].rgb[0] + styles[i].rgb[1] + styles[i].rgb[2];
+	}
+	static dlight_t dlights[2];
+	lightstyle_t *oldStyles = r_newrefdef.lightstyles;
+	dlight_t *oldDlights = r_newrefdef.dlights;
+	int oldDlightNb = r_newrefdef.num_dlights;
+	r_newrefdef.lightstyles = styles;
+	r_newrefdef.dlights = dlights;
+	r_newrefdef.num_dlights = 2;
+
+	int mapNb = 0, surfaceNb = 0, texelNb = 0, mismatchNb = 0;
+	for (int mapIndex = 0; mapIndex < (int)(sizeof(mapNames) / sizeof(mapNames[0])); mapIndex++)
+	{
+		byte *buffer;
+		int length = FS_LoadFile((char *)mapNames[mapIndex], (void **)&buffer);
+		if (!buffer)
+			continue;
+		const dheader_t *header = (const dheader_t *)buffer;
+		lump_t lumps[HEADER_LUMPS];
+		bool valid = (length >= (int)sizeof(dheader_t)) && (LittleLong(header->ident) == IDBSPHEADER) && (LittleLong(header->version) == BSPVERSION);
+		for (int i = 0; valid && i < HEADER_LUMPS; i++)
+		{
+			lumps[i].fileofs = LittleLong(header->lumps[i].fileofs);
+			lumps[i].filelen = LittleLong(header->lumps[i].filelen);
+			valid = (lumps[i].fileofs >= 0) && (lumps[i].filelen >= 0) && (lumps[i].fileofs + lumps[i].filelen <= length);
 		}
-		else
+		if (!valid)
 		{
-			memset(r_lightmap_block, 0, sizeof(r_lightmap_block[0]) * size * 3);
-			for (int maps = 0; maps < nummaps; maps++)
+			FS_FreeFile(buffer);
+			continue;
+		}
+		mapNb++;
+
+		const dplane_t *planes = (const dplane_t *)(buffer + lumps[LUMP_PLANES].fileofs);
+		const dvertex_t *vertexes = (const dvertex_t *)(buffer + lumps[LUMP_VERTEXES].fileofs);
+		const texinfo_t *texinfos = (const texinfo_t *)(buffer + lumps[LUMP_TEXINFO].fileofs);
+		const dface_t *faces = (const dface_t *)(buffer + lumps[LUMP_FACES].fileofs);
+		const dedge_t *edges = (const dedge_t *)(buffer + lumps[LUMP_EDGES].fileofs);
+		const int *surfedges = (const int *)(buffer + lumps[LUMP_SURFEDGES].fileofs);
+		byte *lightdata = buffer + lumps[LUMP_LIGHTING].fileofs;
+		int planeNb = lumps[LUMP_PLANES].filelen / sizeof(dplane_t);
+		int vertexNb = lumps[LUMP_VERTEXES].filelen / sizeof(dvertex_t);
+		int texinfoNb = lumps[LUMP_TEXINFO].filelen / sizeof(texinfo_t);
+		int faceNb = lumps[LUMP_FACES].filelen / sizeof(dface_t);
+		int edgeNb = lumps[LUMP_EDGES].filelen / sizeof(dedge_t);
+		int surfedgeNb = lumps[LUMP_SURFEDGES].filelen / sizeof(int);
+
+		msurface_t *surfaces = malloc(faceNb * sizeof(msurface_t));
+		mtexinfo_t *texinfo = malloc(texinfoNb * sizeof(mtexinfo_t));
+		cplane_t *plane = malloc(planeNb * sizeof(cplane_t));
+		vec3_t *centers = malloc(faceNb * sizeof(vec3_t));
+		int *offsets = malloc((faceNb + 1) * sizeof(int));
+		for (int i = 0; i < texinfoNb; i++)
+		{
+			for (int j = 0; j < 8; j++)
+				texinfo[i].vecs[j >> 2][j & 3] = LittleFloat(texinfos[i].vecs[j >> 2][j & 3]);
+			texinfo[i].flags = LittleLong(texinfos[i].flags);
+		}
+		for (int i = 0; i < planeNb; i++)
+		{
+			for (int j = 0; j < 3; j++)
+				plane[i].normal[j] = LittleFloat(planes[i].normal[j]);
+			plane[i].dist = LittleFloat(planes[i].dist);
+		}
+
+		int litNb = 0, outputSize = 0;
+		for (int faceIndex = 0; faceIndex < faceNb; faceIndex++)
+		{
+			const dface_t *face = &faces[faceIndex];
+			int planenum = LittleShort(face->planenum), ti = LittleShort(face->texinfo);
+			int firstedge = LittleLong(face->firstedge), numedges = LittleShort(face->numedges), lightofs = LittleLong(face->lightofs);
+			if ((lightofs < 0) || (planenum >= planeNb) || (ti < 0) || (ti >= texinfoNb) || (firstedge < 0) || (numedges < 3) || (firstedge + numedges > surfedgeNb)
+				|| (texinfo[ti].flags & (SURF_SKY | SURF_TRANS33 | SURF_TRANS66 | SURF_WARP)))
+				continue;
+
+			/* same extents as Mod_CalcSurfaceExtents */
+			msurface_t *surf = &surfaces[litNb];
+			memset(surf, 0, sizeof(*surf));
+			surf->texinfo = &texinfo[ti];
+			surf->plane = &plane[planenum];
+			float mins[2] = { 999999, 999999 }, maxs[2] = { -99999, -99999 };
+			vec3_t center = { 0, 0, 0 };
+			bool inside = true;
+			for (int i = 0; i < numedges && inside; i++)
+			{
+				int e = LittleLong(surfedges[firstedge + i]);
+				inside = (e < edgeNb) && (-e < edgeNb);
+				if (!inside)
+					break;
+				int v = (e >= 0) ? LittleShort(edges[e].v[0]) : LittleShort(edges[-e].v[1]);
+				v &= 0xffff;
+				inside = v < vertexNb;
+				if (!inside)
+					break;
+				vec3_t position;
+				for (int j = 0; j < 3; j++)
+					position[j] = LittleFloat(vertexes[v].point[j]);
+				VectorAdd(center, position, center);
+				for (int j = 0; j < 2; j++)
+				{
+					float val = position[0] * surf->texinfo->vecs[j][0] + position[1] * surf->texinfo->vecs[j][1] + position[2] * surf->texinfo->vecs[j][2] + surf->texinfo->vecs[j][3];
+					if (val < mins[j])
+						mins[j] = val;
+					if (val > maxs[j])
+						maxs[j] = val;
+				}
+			}
+			if (!inside)
+				continue;
+			for (int j = 0; j < 2; j++)
 			{
-                float scale[3];
-				for (int i = 0; i < 3; i++)
-					scale[i] = gl_modulate->value * r_newrefdef.lightstyles[surf->styles[maps]].rgb[i];
+				int bmin = floorf(mins[j] / 16), bmax = ceilf(maxs[j] / 16);
+				surf->texturemins[j] = bmin * 16;
+				surf->extents[j] = (bmax - bmin) * 16;
+			}
+			int smax = (surf->extents[0] >> 4) + 1, tmax = (surf->extents[1] >> 4) + 1;
+			int mapNbOfFace = 0;
+			while (mapNbOfFace < MAXLIGHTMAPS && face->styles[mapNbOfFace] != 255)
+				mapNbOfFace++;
+			if ((smax * tmax > (int)(sizeof(r_lightmap_block) >> 4)) || (lightofs + mapNbOfFace * smax * tmax * 3 > lumps[LUMP_LIGHTING].filelen))
+				continue;
+			memcpy(surf->styles, face->styles, sizeof(surf->styles));
+			surf->samples = lightdata + lightofs;
+			surf->dlightframe = r_framecount;
+			surf->dlightbits = 3;
+			VectorScale(center, 1.0f / numedges, centers[litNb]);
+			offsets[litNb++] = outputSize;
+			outputSize += smax * tmax * 4;
+		}
+		offsets[litNb] = outputSize;
 
-				float *bl = r_lightmap_block;
-				if (scale[0] == 1.0f && scale[1] == 1.0f && scale[2] == 1.0f)
+		byte *outputs[LIGHTMAP_KERNEL_NB];
+		for (int kernelIndex = 0; kernelIndex < LIGHTMAP_KERNEL_NB; kernelIndex++)
+		{
+			outputs[kernelIndex] = malloc(outputSize + 1);
+			int start = Sys_Milliseconds();
+			for (int iteration = 0; iteration < iterationNb; iteration++)
+			{
+				for (int i = 0; i < litNb; i++)
 				{
-					for (int i = 0; i < size; i++, lightmap += 3, bl += 3)
+					msurface_t *surf = &surfaces[i];
+					for (int j = 0; j < 2; j++)
 					{
-                        float lr = bl[0] + lightmap[0];
-                        float lg = bl[1] + lightmap[1];
-                        float lb = bl[2] + lightmap[2];
-						bl[0] = lr;
-						bl[1] = lg;
-						bl[2] = lb;
+						VectorMA(centers[i], 16.0f + 32.0f * j, surf->plane->normal, dlights[j].origin);
+						VectorSet(dlights[j].color, 1.0f, 0.5f + 0.5f * j, 0.25f);
+						dlights[j].intensity = 200.0f + 100.0f * j;
 					}
+					R_Lightmap_buildWith(&r_lightmap_kernels[kernelIndex], surf, outputs[kernelIndex] + offsets[i], ((surf->extents[0] >> 4) + 1) * 4);
 				}
-				else
+			}
+			times[kernelIndex] += Sys_Milliseconds() - start;
+		}
+		for (int kernelIndex = 1; kernelIndex < LIGHTMAP_KERNEL_NB; kernelIndex++)
+		{
+			for (int i = 0; i < litNb; i++)
+			{
+				if (memcmp(outputs[0] + offsets[i], outputs[kernelIndex] + offsets[i], offsets[i + 1] - offsets[i]))
 				{
-					for (int i = 0; i < size; i++, lightmap += 3, bl += 3)
-					{
-                        float lr = bl[0] + lightmap[0] * scale[0];
-                        float lg = bl[1] + lightmap[1] * scale[1];
-                        float lb = bl[2] + lightmap[2] * scale[2];
-						bl[0] = lr;
-						bl[1] = lg;
-						bl[2] = lb;
-					}
+					if (!mismatchNb)
+						R_printf(PRINT_ALL, "%s: %s differs from the reference on surface %i\n", mapNames[mapIndex], r_lightmap_kernels[kernelIndex].name, i);
+					mismatchNb++;
 				}
 			}
 		}
+		for (int kernelIndex = 0; kernelIndex < LIGHTMAP_KERNEL_NB; kernelIndex++)
+			free(outputs[kernelIndex]);
+		surfaceNb += litNb;
+		texelNb += outputSize / 4;
+
+		free(offsets);
+		free(centers);
+		free(plane);
+		free(texinfo);
+		free(surfaces);
+		FS_FreeFile(buffer);
+	}
+
+	r_newrefdef.lightstyles = oldStyles;
+	r_newrefdef.dlights = oldDlights;
+	r_newrefdef.num_dlights = oldDlightNb;
+
+	R_printf(PRINT_ALL, "%i maps, %i surfaces, %i texels x %i iterations, %i mismatches\n", mapNb, surfaceNb, texelNb, iterationNb, mismatchNb);
+	for (int kernelIndex = 0; kernelIndex < LIGHTMAP_KERNEL_NB; kernelIndex++)
+		R_printf(PRINT_ALL, "%-10s %6i ms\n", r_lightmap_kernels[kernelIndex].name, times[kernelIndex]);
+}
 
-		/* add all the dynamic lights */
-		if (surf->dlightframe == r_framecount)
-			R_Lighmap_addDynamicLights(surf);
+/*
+ * Copies the lightmap of each style of the surface in its own layer, and
+ * the style indices in the last layer, for the light style program.
+ */
+static void R_Lightmap_buildLayers(msurface_t *surf, byte *dest)
+{
+	int smax = (surf->extents[0] >> 4) + 1;
+	int tmax = (surf->extents[1] >> 4) + 1;
+	int stride = (LIGHTMAP_WIDTH - smax) << 2;
+
+	/* full bright if no light data, with the neutral style */
+	byte styles[MAXLIGHTMAPS];
+	for (int maps = 0; maps < MAXLIGHTMAPS; maps++)
+	{
+		if (!surf->samples)
+			styles[maps] = maps ? 255 : 0;
+		else if (maps && styles[maps - 1] == 255)
+			styles[maps] = 255;
+		else
+			styles[maps] = surf->styles[maps];
 	}
 
-	stride -= (smax << 2);
-	float *bl = r_lightmap_block;
-	for (int i = 0; i < tmax; i++, dest += stride)
+	byte *lightmap = surf->samples;
+	for (int maps = 0; maps < MAXLIGHTMAPS; maps++, dest += LIGHTMAP_LAYER_SIZE)
 	{
-		for (int j = 0; j < smax; j++)
+		byte *texel = dest;
+		for (int i = 0; i < tmax; i++, texel += stride)
 		{
-			int r = Q_ftol(bl[0]);
-			int g = Q_ftol(bl[1]);
-			int b = Q_ftol(bl[2]);
-
-			/* catch negative lights */
-			if (r < 0)
-				r = 0;
-			if (g < 0)
-				g = 0;
-			if (b < 0)
-				b = 0;
-
-			/* determine the brightest of the three color components */
-			int max = r;
-			if (max < g)
-				max = g;
-			if (max < b)
-				max = b;
-
-			/* alpha is ONLY used for the mono lightmap case. For this
-			   reason we set it to the brightest of the color components
-			   so that things don't get too dim. */
-			int a = max;
-
-			/* rescale all the color components if the
-			   intensity of the greatest channel exceeds
-			   1.0f */
-			if (max > 255)
+			for (int j = 0; j < smax; j++, texel += 4)
 			{
-				float t = 255.0F / max;
-				r = r * t;
-				g = g * t;
-				b = b * t;
-				a = a * t;
+				if (styles[maps] == 255)
+				{
+					texel[0] = texel[1] = texel[2] = 0;
+				}
+				else if (!lightmap)
+				{
+					texel[0] = texel[1] = texel[2] = 255;
+				}
+				else
+				{
+					texel[0] = lightmap[0];
+					texel[1] = lightmap[1];
+					texel[2] = lightmap[2];
+					lightmap += 3;
+				}
+				texel[3] = 255;
 			}
+		}
+	}
 
-			dest[0] = r;
-			dest[1] = g;
-			dest[2] = b;
-			dest[3] = a;
+	for (int i = 0; i < tmax; i++, dest += stride)
+	{
+		for (int j = 0; j < smax; j++, dest += 4)
+		{
+			dest[0] = styles[0];
+			dest[1] = styles[1];
+			dest[2] = styles[2];
+			dest[3] = styles[3];
+		}
+	}
+}
 
-			bl += 3;
-			dest += 4;
+/*
+ * Uploads the style values scaled by the modulation, when they changed.
+ * The table holds a quarter of the value, so that overbright styles fit.
+ */
+static void R_Lightmap_updateStyleTable()
+{
+	if (gl_lightmapState.styleTableFrame == r_framecount)
+		return;
+	gl_lightmapState.styleTableFrame = r_framecount;
+
+	byte table[256 * 4];
+	float modulate = gl_modulate->value * 0.25f * 255;
+	for (int i = 0; i < 256; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			int v = 0;
+			if (i < 255 && i < MAX_LIGHTSTYLES)
+				v = Q_ftol(r_newrefdef.lightstyles[i].rgb[j] * modulate + 0.5f);
+			if (v < 0)
+				v = 0;
+			if (v > 255)
+				v = 255;
+			table[i * 4 + j] = v;
 		}
+		table[i * 4 + 3] = 255;
 	}
+
+	if (!memcmp(table, gl_lightmapState.styleTable, sizeof(table)))
+		return;
+	memcpy(gl_lightmapState.styleTable, table, sizeof(table));
+
+	oglwSetCurrentTextureUnitForced(0);
+	oglwBindTextureForced(0, gl_state.lightmap_textures + LIGHTMAP_STYLE_TABLE);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 1, GL_RGBA, GL_UNSIGNED_BYTE, table);
 }
 
 static void R_Lightmap_initializeBlock()
@@ -866,6 +1579,18 @@ void R_Lightmap_upload(qboolean dynamic)
 		}
         else
             gl_lightmapState.staticLightmapNb = texture + 1;
+        if (gl_lightmapState.gpuStyles)
+        {
+            // The layers are not mipmapped, the style indices must not be filtered between surfaces.
+            oglwSetCurrentTextureUnitForced(0);
+            oglwBindTextureForced(0, gl_state.lightmap_textures + texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, LIGHTMAP_WIDTH, LIGHTMAP_HEIGHT * LIGHTMAP_LAYER_NB, 0, GL_RGBA, GL_UNSIGNED_BYTE, gl_lightmapState.lightmap_buffer);
+            return;
+        }
         bool mipmapFlag = r_lightmap_mipmap->value != 0;
         oglwSetCurrentTextureUnitForced(0);
         oglwBindTextureForced(0, gl_state.lightmap_textures + texture);
@@ -992,7 +1717,10 @@ void R_Lightmap_createSurface(msurface_t *surf)
 
 	R_Lightmap_setCacheState(surf);
 	byte *base = gl_lightmapState.lightmap_buffer + (surf->light_t * LIGHTMAP_WIDTH + surf->light_s) * 4;
-	R_Lightmap_build(surf, base, LIGHTMAP_WIDTH * 4);
+	if (gl_lightmapState.gpuStyles)
+		R_Lightmap_buildLayers(surf, base);
+	else
+		R_Lightmap_build(surf, base, LIGHTMAP_WIDTH * 4);
 }
 
 void R_Lightmap_beginBuilding(model_t *m)
@@ -1019,6 +1747,28 @@ void R_Lightmap_beginBuilding(model_t *m)
 
 	gl_lightmapState.staticLightmapNb = 0;
 	gl_lightmapState.dynamicLightmapCurrent = 0;
+	gl_lightmapState.gpuStyles = r_lightmap_gpu->value && oglwIsLightstyleSupported();
+
+	int bufferSize = (gl_lightmapState.gpuStyles ? LIGHTMAP_LAYER_NB : 1) * LIGHTMAP_LAYER_SIZE;
+	if (gl_lightmapState.lightmapBufferSize != bufferSize)
+	{
+		free(gl_lightmapState.lightmap_buffer);
+		gl_lightmapState.lightmap_buffer = malloc(bufferSize);
+		if (!gl_lightmapState.lightmap_buffer)
+			R_error(ERR_FATAL, "R_Lightmap_beginBuilding: can't allocate the lightmap buffer\n");
+		gl_lightmapState.lightmapBufferSize = bufferSize;
+	}
+
+	// Initialize the style table, filled before the first lightmap pass.
+	memset(gl_lightmapState.styleTable, 0, sizeof(gl_lightmapState.styleTable));
+	gl_lightmapState.styleTableFrame = -1;
+	oglwSetCurrentTextureUnitForced(0);
+	oglwBindTextureForced(0, gl_state.lightmap_textures + LIGHTMAP_STYLE_TABLE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 256, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, gl_lightmapState.styleTable);
 
 	// Initialize the dynamic lightmap texture.
 	oglwSetCurrentTextureUnitForced(0);
@@ -1036,11 +1786,39 @@ void R_Lightmap_endBuilding()
 	R_Lightmap_upload(false);
 }
 
+static void R_Lightmap_chainStatic(msurface_t *surf, int lightmapIndex)
+{
+    msurface_t *lightmapSurfaces = gl_lightmapState.lightmapSurfaces[lightmapIndex];
+    if (lightmapSurfaces == NULL)
+    {
+        int staticLightmapNbInFrame = gl_lightmapState.staticLightmapNbInFrame;
+        gl_lightmapState.staticLightmapSurfacesInFrame[staticLightmapNbInFrame] = lightmapIndex;
+        gl_lightmapState.staticLightmapNbInFrame = staticLightmapNbInFrame + 1;
+    }
+    surf->lightmapchain = lightmapSurfaces;
+    gl_lightmapState.lightmapSurfaces[lightmapIndex] = surf;
+}
+
 static void R_Lightmap_setup(msurface_t *surf, bool immediate)
 {
     if ((surf->texinfo->flags & (SURF_SKY | SURF_TRANS33 | SURF_TRANS66 | SURF_WARP)))
         return; // These surfaces do not have lightmap.
 
+	if (gl_lightmapState.gpuStyles)
+	{
+		// Styles are blended by the light style programs, dynamic lights are added by another pass.
+		if (surf->dlightframe == r_framecount)
+		{
+			surf->dlightchain = gl_lightmapState.dlightSurfaces;
+			gl_lightmapState.dlightSurfaces = surf;
+		}
+		if (immediate)
+			oglwBindTexture(1, gl_state.lightmap_textures + surf->lightmaptexturenum);
+		else
+			R_Lightmap_chainStatic(surf, surf->lightmaptexturenum);
+		return;
+	}
+
 	bool updateNeeded = false;
 
 	// check for lightmap modification
@@ -1097,17 +1875,7 @@ static void R_Lightmap_setup(msurface_t *surf, bool immediate)
 	if (!immediate)
 	{
         if (lightmapIndex < LIGHTMAP_STATIC_MAX_NB)
-        {
-            msurface_t *lightmapSurfaces = gl_lightmapState.lightmapSurfaces[lightmapIndex];
-            if (lightmapSurfaces == NULL)
-            {
-                int staticLightmapNbInFrame = gl_lightmapState.staticLightmapNbInFrame;
-                gl_lightmapState.staticLightmapSurfacesInFrame[staticLightmapNbInFrame] = lightmapIndex;
-                gl_lightmapState.staticLightmapNbInFrame = staticLightmapNbInFrame + 1;
-            }
-            surf->lightmapchain = lightmapSurfaces;
-            gl_lightmapState.lightmapSurfaces[lightmapIndex] = surf;
-        }
+            R_Lightmap_chainStatic(surf, lightmapIndex);
         else
         {
             msurface_t *lightmapSurfaces = gl_lightmapState.lightmapSurfaces[LIGHTMAP_STATIC_MAX_NB];
@@ -1132,7 +1900,7 @@ static void R_Lightmap_drawChainStatic(model_t *model, float alpha)
         do
         {
             glpoly_t *p = surf->polys;
-            if (p)
+            if (p && !R_World_addStatic(surf, alpha))
             {
                 for (; p != 0; p = p->chain)
                 {
@@ -1149,6 +1917,7 @@ static void R_Lightmap_drawChainStatic(model_t *model, float alpha)
             surf = surf->lightmapchain;
         } while (surf);
         oglwEnd();
+        R_World_drawStatic(1);
 	}
 }
 
@@ -1229,6 +1998,114 @@ static void R_Lightmap_drawChainDynamic(model_t *model, float alpha)
     }
 }
 
+/*
+ * Adds a polygon per dynamic light touching the surface, with the
+ * offset of the light center in texture space (see R_Lighmap_addDynamicLights).
+ * With darkFlag, only the negative components of the light colors are added,
+ * negated, for the subtractive pass.
+ */
+#define DLIGHT_SCALE 256.0f // Keeps the offsets in the range of mediump floats.
+
+static void R_Lightmap_addDynamicLightPolygons(msurface_t *surf, bool darkFlag)
+{
+	mtexinfo_t *tex = surf->texinfo;
+
+	for (int lnum = 0; lnum < r_newrefdef.num_dlights; lnum++)
+	{
+		if (!(surf->dlightbits & (1 << lnum)))
+			continue; /* not lit by this light */
+
+		dlight_t *dl = &r_newrefdef.dlights[lnum];
+		vec3_t color;
+		for (int i = 0; i < 3; i++)
+		{
+			float c = darkFlag ? -dl->color[i] : dl->color[i];
+			color[i] = c > 0.0f ? c : 0.0f;
+		}
+		if (color[0] == 0.0f && color[1] == 0.0f && color[2] == 0.0f)
+			continue;
+
+		float fdist = DotProduct(dl->origin, surf->plane->normal) - surf->plane->dist;
+		float frad = dl->intensity - fabsf(fdist);
+		if (frad - DLIGHT_CUTOFF < 0.0f)
+			continue;
+
+		vec3_t impact;
+		for (int i = 0; i < 3; i++)
+			impact[i] = dl->origin[i] - surf->plane->normal[i] * fdist;
+
+		float localX = DotProduct(impact, tex->vecs[0]) + tex->vecs[0][3];
+		float localY = DotProduct(impact, tex->vecs[1]) + tex->vecs[1][3];
+		float radius = frad * (1.0f / DLIGHT_SCALE);
+
+		for (glpoly_t *p = surf->polys; p != 0; p = p->chain)
+		{
+			float *v = p->verts[0];
+			if (v == NULL)
+				break;
+			OglwVertex *vtx = oglwAllocateTriangleFan(p->numverts);
+			if (vtx == NULL)
+				continue;
+			for (int j = 0; j < p->numverts; j++, v += VERTEXSIZE, vtx++)
+			{
+				float sd = localX - (DotProduct(v, tex->vecs[0]) + tex->vecs[0][3]);
+				float td = localY - (DotProduct(v, tex->vecs[1]) + tex->vecs[1][3]);
+				Vertex_set3P(vtx->position, v[0], v[1], v[2]);
+				vtx->position[3] = PosFloatToFloat16(radius);
+				Vertex_set4(vtx->color, color[0], color[1], color[2], 1.0f);
+				Vertex_set2TC(vtx->texCoord[0], v[3], v[4]);
+				Vertex_set2TC(vtx->texCoord[1], sd * (1.0f / DLIGHT_SCALE), td * (1.0f / DLIGHT_SCALE));
+			}
+		}
+	}
+}
+
+static void R_Lightmap_drawChainLightPass(bool darkFlag)
+{
+	oglwBeginDynamicLights(DLIGHT_CUTOFF / DLIGHT_SCALE, DLIGHT_SCALE / 255.0f, darkFlag);
+
+	GLuint currentTexture = 0;
+	for (msurface_t *surf = gl_lightmapState.dlightSurfaces; surf != NULL; surf = surf->dlightchain)
+	{
+		GLuint texture = surf->current_image->texnum;
+		if (currentTexture != texture)
+		{
+			currentTexture = texture;
+			oglwEnd(); // We can do this even if there was no previous oglwBegin().
+			oglwBindTexture(0, texture);
+			oglwBegin(GL_TRIANGLES);
+		}
+		R_Lightmap_addDynamicLightPolygons(surf, darkFlag);
+	}
+	oglwEnd();
+
+	oglwEndLighting();
+}
+
+// Adds the dynamic lights to the textures of the surfaces, after the light styles.
+// Dark lights, with negative colors, are subtracted by a second pass.
+static void R_Lightmap_drawChainLights()
+{
+	if (gl_lightmapState.dlightSurfaces == NULL || r_lightmap_only->value)
+		return;
+
+	bool dark = false;
+	for (int lnum = 0; lnum < r_newrefdef.num_dlights && !dark; lnum++)
+	{
+		const float *color = r_newrefdef.dlights[lnum].color;
+		dark = color[0] < 0.0f || color[1] < 0.0f || color[2] < 0.0f;
+	}
+
+	oglwEnableBlending(true);
+	oglwSetBlendingFunction(GL_ONE, GL_ONE);
+	oglwEnableDepthWrite(false);
+	R_Lightmap_drawChainLightPass(false);
+	if (dark)
+		R_Lightmap_drawChainLightPass(true);
+
+	gl_lightmapState.dlightSurfaces = NULL;
+}
+
 // This routine takes all the given light mapped surfaces in the world and blends them into the framebuffer.
 static void R_Lightmap_drawChain(model_t *model, float alpha)
 {
@@ -1253,9 +2130,22 @@ static void R_Lightmap_drawChain(model_t *model, float alpha)
 	if (model == r_worldmodel)
 		c_visible_lightmaps = 0;
 
-	R_Lightmap_drawChainStatic(model, alpha); // render static lightmaps first
-	if (r_lightmap_dynamic->value)
-		R_Lightmap_drawChainDynamic(model, alpha); // render dynamic lightmaps
+	if (gl_lightmapState.gpuStyles)
+	{
+		R_Lightmap_updateStyleTable();
+		oglwBindTexture(1, gl_state.lightmap_textures + LIGHTMAP_STYLE_TABLE);
+		oglwBeginLightstyles(LIGHTMAP_WIDTH, LIGHTMAP_HEIGHT, 4.0f);
+		R_Lightmap_drawChainStatic(model, alpha);
+		oglwEndLighting();
+		if (r_lightmap_dynamic->value)
+			R_Lightmap_drawChainLights();
+	}
+	else
+	{
+		R_Lightmap_drawChainStatic(model, alpha); // render static lightmaps first
+		if (r_lightmap_dynamic->value)
+			R_Lightmap_drawChainDynamic(model, alpha); // render dynamic lightmaps
+	}
 
 	oglwEnableBlending(false);
 	oglwSetBlendingFunction(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -1978,6 +2868,12 @@ static void R_Surface_drawTranslucent(msurface_t *surf, float intensity, float a
 //--------------------------------------------------------------------------------
 // Surface rendering with sorting.
 //--------------------------------------------------------------------------------
+// With the light style programs, only the lightmap view needs its own pass.
+static bool R_Surface_isMultitextured()
+{
+	return r_multitexturing->value != 0 && !(gl_lightmapState.gpuStyles && r_lightmap_only->value);
+}
+
 static void R_Surface_chain(entity_t *e, msurface_t *surf)
 {
 	image_t *image = R_Surface_getAnimatedTexture(e, surf->texinfo);
@@ -1989,6 +2885,7 @@ static void R_Surface_chain(entity_t *e, msurface_t *surf)
 	}
 	surf->texturechain = image->texturechain;
 	image->texturechain = surf;
+	surf->current_image = image;
 }
 
 static void R_Surface_drawChain(float alpha, int chain)
@@ -2012,10 +2909,12 @@ static void R_Surface_drawChain(float alpha, int chain)
 				if (!(s->flags & SURF_DRAWTURB))
 				{
 					c_brush_polys++;
-					R_Surface_drawBase(s, 1.0f, alpha);
+					if (!R_World_addStatic(s, alpha))
+						R_Surface_drawBase(s, 1.0f, alpha);
 				}
 			}
 			oglwEnd();
+			R_World_drawStatic(0);
 		}
 		image_t *imageNext = image->image_chain_node;
 		image = imageNext;
@@ -2111,10 +3010,12 @@ static void R_Surface_draw(entity_t *entity, msurface_t *surf, bool immediate, f
     R_Lightmap_setup(surf, immediate && !alphaFlag);
     if (alphaFlag)
         R_Surface_chainAlpha(entity, surf, alpha, chain);
-    else if (immediate)
+    else if (immediate && !(gl_lightmapState.gpuStyles && (surf->flags & SURF_DRAWTURB)))
     {
+        // Water is chained while the textured light style program is in use.
         c_brush_polys++;
         image_t *image = R_Surface_getAnimatedTexture(entity, surf->texinfo);
+        surf->current_image = image; // For the dynamic light pass.
         if (surf->texinfo->flags & (SURF_TRANS33 | SURF_TRANS66))
         {
             oglwEnableBlending(true);
@@ -2164,7 +3065,7 @@ static void R_BrushModel_drawPolys(entity_t *entity, float alpha)
 			R_DynamicLighting_markLights(lt, 1 << k, model->nodes + model->firstnode);
 	}
 
-	qboolean multitexturing = r_multitexturing->value != 0;
+	qboolean multitexturing = R_Surface_isMultitextured();
 
 	msurface_t *psurf = &model->surfaces[model->firstmodelsurface];
 	for (int i = 0; i < model->nummodelsurfaces; i++, psurf++)
@@ -2185,21 +3086,28 @@ static void R_BrushModel_drawBegin()
     gl_lightmapState.staticLightmapNbInFrame = 0;
     gl_lightmapState.dynamicLightmapNbInFrame = 0;
 	memset(gl_lightmapState.lightmapSurfaces, 0, sizeof(gl_lightmapState.lightmapSurfaces));
+	gl_lightmapState.dlightSurfaces = NULL;
 
 	oglwSetTextureBlending(0, GL_MODULATE);
 
-	if (r_multitexturing->value != 0 && !r_lightmap_disabled->value)
+	if (R_Surface_isMultitextured() && !r_lightmap_disabled->value)
 	{
 		oglwEnableTexturing(1, GL_TRUE);
 		if (r_lightmap_only->value)
 			oglwSetTextureBlending(1, GL_REPLACE);
 		else
 			oglwSetTextureBlending(1, GL_MODULATE);
+		if (gl_lightmapState.gpuStyles)
+		{
+			R_Lightmap_updateStyleTable();
+			oglwBeginTexturedLightstyles(LIGHTMAP_WIDTH, LIGHTMAP_HEIGHT, 4.0f, gl_state.lightmap_textures + LIGHTMAP_STYLE_TABLE);
+		}
 	}
 }
 
 static void R_BrushModel_drawEnd()
 {
+	oglwEndLighting();
 	oglwSetTextureBlending(0, GL_REPLACE);
 	oglwEnableTexturing(1, GL_FALSE);
 	oglwSetTextureBlending(1, GL_REPLACE);
@@ -2321,9 +3229,9 @@ void R_World_markLeaves()
 	/* may have to combine two clusters because of solid water boundaries */
 	if (r_viewcluster2 != r_viewcluster)
 	{
-		memcpy(fatvis, vis, (r_worldmodel->numleafs + 7) / 8);
+		memcpy(fatvis, vis, (r_worldmodel->vis->numclusters + 7) / 8);
 		vis = Mod_ClusterPVS(r_viewcluster2, r_worldmodel);
-		c = (r_worldmodel->numleafs + 31) / 32;
+		c = (r_worldmodel->vis->numclusters + 31) / 32;
 
 		for (i = 0; i < c; i++)
 		{
@@ -2429,7 +3337,7 @@ static void R_World_drawR(entity_t *worldEntity, mnode_t *node)
 	R_World_drawR(worldEntity, node->children[side]);
 
 	/* draw stuff */
-	qboolean multitexturing = r_multitexturing->value != 0;
+	qboolean multitexturing = R_Surface_isMultitextured();
 
 	{
 		int c;
@@ -2737,19 +3645,64 @@ static void R_Entity_draw(entity_t *entity)
 	}
 }
 
+// Brush models upload lightmaps while drawing, and the left handed weapon changes the culling, so they are not queued.
+static qboolean R_Entity_isQueued(const entity_t *entity)
+{
+	if (entity->flags & RF_BEAM)
+		return true;
+	if (entity->model && entity->model->type == mod_brush)
+		return false;
+	if ((entity->flags & RF_WEAPONMODEL) && (gl_lefthand->value == 1.0F))
+		return false;
+	return true;
+}
+
 static void R_Entity_drawAll()
 {
 	if (!gl_drawentities->value)
 		return;
 
-	// draw non-transparent first
-    int entityNb = r_newrefdef.num_entities;
+	int entityNb = r_newrefdef.num_entities;
 	entity_t *entities = r_newrefdef.entities;
+	if (!r_draw_queue->value)
+	{
+		for (int entityIndex = 0; entityIndex < entityNb; entityIndex++)
+		{
+			entity_t *entity = &entities[entityIndex];
+			R_Entity_draw(entity);
+		}
+		return;
+	}
+
+	// Opaque brush models first.
+	for (int entityIndex = 0; entityIndex < entityNb; entityIndex++)
+	{
+		entity_t *entity = &entities[entityIndex];
+		if (!R_Entity_isQueued(entity) && !(entity->flags & RF_TRANSLUCENT) && entity->model && entity->model->type == mod_brush)
+			R_Entity_draw(entity);
+	}
+
+	// Then the other entities, sorted by state and front to back.
+	oglwBeginQueue();
 	for (int entityIndex = 0; entityIndex < entityNb; entityIndex++)
 	{
 		entity_t *entity = &entities[entityIndex];
+		if (!R_Entity_isQueued(entity))
+			continue;
+		vec3_t delta;
+		VectorSubtract(entity->origin, r_origin, delta);
+		oglwSetQueueDepth(VectorLength(delta) / 8192.0f);
 		R_Entity_draw(entity);
 	}
+	oglwEndQueue();
+
+	// Translucent brush models and the left handed weapon last.
+	for (int entityIndex = 0; entityIndex < entityNb; entityIndex++)
+	{
+		entity_t *entity = &entities[entityIndex];
+		if (!R_Entity_isQueued(entity) && ((entity->flags & RF_TRANSLUCENT) || !entity->model || entity->model->type != mod_brush))
+			R_Entity_draw(entity);
+	}
 }
 
 //********************************************************************************
@@ -3306,6 +4259,7 @@ void R_View_draw(refdef_t *fd)
 	{
 		c_brush_polys = 0;
 		c_alias_polys = 0;
+		oglwResetStats();
 	}
 
 	R_DynamicLighting_push();
@@ -3322,9 +4276,15 @@ void R_View_draw(refdef_t *fd)
 
 	if (gl_speeds->value)
 	{
-		R_printf(PRINT_ALL, "%4i wpoly %4i epoly %i tex %i lmaps\n",
+		OglwStats stats;
+		oglwGetStats(&stats);
+		R_printf(PRINT_ALL, "%4i wpoly %4i epoly %i tex %i lmaps %i draws %i states %i KB streamed %i wraps\n",
 			c_brush_polys, c_alias_polys, c_visible_textures,
-			c_visible_lightmaps);
+			c_visible_lightmaps, stats.drawCallNb, stats.stateChangeNb,
+			stats.bytesStreamed >> 10, stats.bufferWrapNb);
+		if (stats.queueBatchNb > 0)
+			R_printf(PRINT_ALL, "queue: %i batches, %i state changes unsorted, %i sorted\n",
+				stats.queueBatchNb, stats.queueStateChangeNbBefore, stats.queueStateChangeNbAfter);
 	}
 
 	switch (gl_state.stereo_mode)
@@ -4097,10 +5057,13 @@ static void R_Register()
 	gl_nocull = Cvar_Get("gl_nocull", "0", 0);
 	gl_cull = Cvar_Get("gl_cull", "1", 0);
 	gl_lockpvs = Cvar_Get("gl_lockpvs", "0", 0);
+	r_vismatrix = Cvar_Get("r_vismatrix", "4096", CVAR_ARCHIVE);
 
 	gl_lefthand = Cvar_Get("hand", "0", CVAR_USERINFO | CVAR_ARCHIVE);
 	gl_farsee = Cvar_Get("gl_farsee", "0", CVAR_LATCH | CVAR_ARCHIVE);
 	gl_lerpmodels = Cvar_Get("gl_lerpmodels", "1", 0);
+	r_lerp_simd = Cvar_Get("r_lerp_simd", "1", CVAR_ARCHIVE);
+	r_gpu_lerp = Cvar_Get("r_gpu_lerp", "1", CVAR_ARCHIVE);
 	gl_lightlevel = Cvar_Get("gl_lightlevel", "0", 0);
 	gl_modulate = Cvar_Get("gl_modulate", "1", CVAR_ARCHIVE);
 	r_lightmap_saturate = Cvar_Get("r_lightmap_saturate", "0", 0);
@@ -4133,6 +5096,12 @@ static void R_Register()
 	r_lightflash = Cvar_Get("r_lightflash", "0", CVAR_ARCHIVE);
     #endif
 	r_lightmap_outline = Cvar_Get("r_lightmap_outline", "0", 0);
+	// Light styles and dynamic lights evaluated by shaders, applied when the next map is loaded.
+	// Off by default until the programs have been checked on GLES2 devices.
+	r_lightmap_gpu = Cvar_Get("r_lightmap_gpu", "0", CVAR_ARCHIVE);
+	r_lightmap_simd = Cvar_Get("r_lightmap_simd", "1", CVAR_ARCHIVE);
+	r_world_static = Cvar_Get("r_world_static", "1", CVAR_ARCHIVE);
+	r_draw_queue = Cvar_Get("r_draw_queue", "1", CVAR_ARCHIVE);
 	r_nobind = Cvar_Get("r_nobind", "0", 0);
     r_subdivision = Cvar_Get("r_subdivision", "64", CVAR_ARCHIVE);
 
@@ -4150,6 +5119,9 @@ static void R_Register()
 	r_texture_solidformat = Cvar_Get("r_texture_solidformat", "default", CVAR_ARCHIVE);
 	r_texture_rounddown = Cvar_Get("r_texture_rounddown", "0", 0);
 	r_texture_scaledown = Cvar_Get("r_texture_scaledown", "0", 0);
+	r_texture_async = Cvar_Get("r_texture_async", "1", CVAR_ARCHIVE);
+	r_texture_cache = Cvar_Get("r_texture_cache", "1", CVAR_ARCHIVE);
+	r_texture_compress = Cvar_Get("r_texture_compress", "0", CVAR_ARCHIVE);
 
 	gl_shadows = Cvar_Get("gl_shadows", "1", CVAR_ARCHIVE);
 	gl_stencilshadow = Cvar_Get("gl_stencilshadow", "1", CVAR_ARCHIVE);
@@ -4163,6 +5135,8 @@ static void R_Register()
 	Cmd_AddCommand("screenshot", R_ScreenShot);
 	Cmd_AddCommand("modellist", Mod_Modellist_f);
 	Cmd_AddCommand("gl_strings", R_Strings);
+	Cmd_AddCommand("r_lerp_test", R_AliasModel_lerpTest_f);
+	Cmd_AddCommand("r_lightmap_test", R_Lightmap_test_f);
 }
 
 static bool R_setup()
@@ -4228,6 +5202,17 @@ static bool R_setup()
 		Cvar_SetValue("r_texture_anisotropy_available", 0.0f);
 	}
 
+	if (strstr(extensions_string, "GL_OES_compressed_ETC1_RGB8_texture"))
+	{
+		R_printf(PRINT_ALL, "Using GL_OES_compressed_ETC1_RGB8_texture\n");
+		gl_config.etc1 = true;
+	}
+	else
+	{
+		R_printf(PRINT_ALL, "GL_OES_compressed_ETC1_RGB8_texture not found\n");
+		gl_config.etc1 = false;
+	}
+
 	#if 0
 	if (strstr(extensions_string, "OES_texture_npot"))
 	{
@@ -4269,7 +5254,10 @@ void R_finalize()
 	Cmd_RemoveCommand("screenshot");
 	Cmd_RemoveCommand("imagelist");
 	Cmd_RemoveCommand("gl_strings");
+	Cmd_RemoveCommand("r_lerp_test");
+	Cmd_RemoveCommand("r_lightmap_test");
 
+	R_World_freeStatic();
 	Mod_FreeAll();
 
 	R_ShutdownImages();
@@ -15,51 +15,458 @@ float r_avertexnormal_dots[SHADEDOT_QUANT][256] =
 
 static vec4_t s_lerped[MAX_VERTS];
 
-void R_AliasModel_lerp(entity_t *entity, int nverts, dtrivertx_t *v, dtrivertx_t *ov, dtrivertx_t *verts, float *lerp, float move[3], float frontv[3], float backv[3])
+//********************************************************************************
+// Frame interpolation.
+//********************************************************************************
+// The kernels interpolate each vertex once, light it and pack it in the vertex format of the wrapper,
+// the draw commands then only copy the packed vertices.
+// The SIMD kernels give the same bits as the reference one.
+#if defined(POS_USING_FLOAT16)
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2_MATH__)
+#include <emmintrin.h>
+#define ALIAS_LERP_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ALIAS_LERP_NEON
+#endif
+#endif
+
+// Beginning of OglwVertex.
+typedef struct
 {
-	if (entity->flags & (RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE | RF_SHELL_DOUBLE | RF_SHELL_HALF_DAM))
+	float_pos position[4];
+	uint8_t color[4];
+} aliasvertex_t;
+
+typedef struct
+{
+	const dtrivertx_t *v, *ov;
+	int nverts;
+	float move[4], frontv[4], backv[4];
+	qboolean shell; // Pushes the vertices along their normal.
+	const float *shadedots; // Indexed by the light normal.
+	float shadelight[4];
+	float alpha;
+	vec4_t *lerped;
+	aliasvertex_t *packed;
+} aliaslerp_t;
+
+typedef void (*aliaslerpkernel_t)(const aliaslerp_t *lerp);
+
+static aliasvertex_t s_packed[MAX_VERTS];
+static float s_normals[NUMVERTEXNORMALS][4]; // Padded normals, scaled for shells.
+static float s_flatdots[256]; // Shade dots for flat shells.
+static qboolean s_lerpInitialized = false;
+
+static void R_AliasModel_lerpInitialize()
+{
+	if (s_lerpInitialized)
+		return;
+	s_lerpInitialized = true;
+	for (int i = 0; i < NUMVERTEXNORMALS; i++)
 	{
-		for (int i = 0; i < nverts; i++, v++, ov++, lerp += 4)
+		for (int j = 0; j < 3; j++)
+			s_normals[i][j] = r_avertexnormals[i][j] * POWERSUIT_SCALE;
+		s_normals[i][3] = 0.0f;
+	}
+	for (int i = 0; i < 256; i++)
+		s_flatdots[i] = 1.0f;
+}
+
+static void R_AliasModel_lerpReference(const aliaslerp_t *lerp)
+{
+	const dtrivertx_t *v = lerp->v, *ov = lerp->ov;
+	const float *move = lerp->move, *frontv = lerp->frontv, *backv = lerp->backv;
+	const float *shadelight = lerp->shadelight;
+	uint8_t alpha = intC(lerp->alpha);
+	for (int i = 0; i < lerp->nverts; i++, v++, ov++)
+	{
+		float *p = lerp->lerped[i];
+		p[0] = move[0] + ov->v[0] * backv[0] + v->v[0] * frontv[0];
+		p[1] = move[1] + ov->v[1] * backv[1] + v->v[1] * frontv[1];
+		p[2] = move[2] + ov->v[2] * backv[2] + v->v[2] * frontv[2];
+		p[3] = 0.0f;
+		if (lerp->shell)
 		{
-			float *normal = r_avertexnormals[verts[i].lightnormalindex];
-			lerp[0] = move[0] + ov->v[0] * backv[0] + v->v[0] * frontv[0] + normal[0] * POWERSUIT_SCALE;
-			lerp[1] = move[1] + ov->v[1] * backv[1] + v->v[1] * frontv[1] + normal[1] * POWERSUIT_SCALE;
-			lerp[2] = move[2] + ov->v[2] * backv[2] + v->v[2] * frontv[2] + normal[2] * POWERSUIT_SCALE;
+			const float *normal = s_normals[v->lightnormalindex];
+			p[0] += normal[0];
+			p[1] += normal[1];
+			p[2] += normal[2];
 		}
+
+		aliasvertex_t *packed = &lerp->packed[i];
+		Vertex_set3P(packed->position, p[0], p[1], p[2]);
+		packed->position[3] = PosFloatToFloat16(0.0f);
+		float l = lerp->shadedots[v->lightnormalindex];
+		packed->color[0] = intC(l * shadelight[0]);
+		packed->color[1] = intC(l * shadelight[1]);
+		packed->color[2] = intC(l * shadelight[2]);
+		packed->color[3] = alpha;
 	}
-	else
+}
+
+#if defined(ALIAS_LERP_SSE2)
+// Same operations as FloatToFloat16, the denormal results use it directly.
+static inline __m128i R_AliasModel_packFloat16(__m128 x)
+{
+	__m128i b = _mm_add_epi32(_mm_castps_si128(x), _mm_set1_epi32(0x00001000));
+	__m128i e = _mm_srli_epi32(_mm_and_si128(b, _mm_set1_epi32(0x7F800000)), 23);
+	__m128i m = _mm_and_si128(b, _mm_set1_epi32(0x007FFFFF));
+	__m128i sign = _mm_srli_epi32(_mm_and_si128(b, _mm_set1_epi32(0x80000000)), 16);
+	__m128i normal = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(_mm_sub_epi32(e, _mm_set1_epi32(112)), 10), _mm_set1_epi32(0x7C00)), _mm_srli_epi32(m, 13));
+	normal = _mm_and_si128(normal, _mm_cmpgt_epi32(e, _mm_set1_epi32(112)));
+	__m128i saturated = _mm_and_si128(_mm_set1_epi32(0x7FFF), _mm_cmpgt_epi32(e, _mm_set1_epi32(143)));
+	__m128i h = _mm_or_si128(_mm_or_si128(sign, normal), saturated);
+	__m128i denormal = _mm_and_si128(_mm_cmplt_epi32(e, _mm_set1_epi32(113)), _mm_cmpgt_epi32(e, _mm_set1_epi32(101)));
+	if (_mm_movemask_epi8(denormal))
+	{
+		float xs[4];
+		uint16_t hs[4];
+		_mm_storeu_ps(xs, x);
+		for (int i = 0; i < 4; i++)
+			hs[i] = FloatToFloat16(xs[i]);
+		return _mm_set_epi32(hs[3], hs[2], hs[1], hs[0]);
+	}
+	return h;
+}
+
+static void R_AliasModel_lerpSSE2(const aliaslerp_t *lerp)
+{
+	const dtrivertx_t *v = lerp->v, *ov = lerp->ov;
+	__m128 move = _mm_loadu_ps(lerp->move);
+	__m128 frontv = _mm_loadu_ps(lerp->frontv);
+	__m128 backv = _mm_loadu_ps(lerp->backv);
+	__m128 shadelight = _mm_setr_ps(lerp->shadelight[0], lerp->shadelight[1], lerp->shadelight[2], 1.0f);
+	__m128 scale = _mm_set1_ps(256.0f), maxColor = _mm_set1_ps(255.0f), zero = _mm_setzero_ps();
+	__m128i mask = _mm_setr_epi32(-1, -1, -1, 0);
+	for (int i = 0; i < lerp->nverts; i++, v++, ov++)
+	{
+		int vi, ovi;
+		memcpy(&vi, v, 4);
+		memcpy(&ovi, ov, 4);
+		__m128i vb = _mm_and_si128(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(vi), _mm_setzero_si128()), _mm_setzero_si128()), mask);
+		__m128i ovb = _mm_and_si128(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(ovi), _mm_setzero_si128()), _mm_setzero_si128()), mask);
+		__m128 p = _mm_add_ps(_mm_add_ps(move, _mm_mul_ps(_mm_cvtepi32_ps(ovb), backv)), _mm_mul_ps(_mm_cvtepi32_ps(vb), frontv));
+		if (lerp->shell)
+			p = _mm_add_ps(p, _mm_loadu_ps(s_normals[v->lightnormalindex]));
+		_mm_storeu_ps(lerp->lerped[i], p);
+
+		aliasvertex_t *packed = &lerp->packed[i];
+		__m128i h = R_AliasModel_packFloat16(p);
+		h = _mm_srai_epi32(_mm_slli_epi32(h, 16), 16);
+		_mm_storel_epi64((__m128i *)packed->position, _mm_packs_epi32(h, h));
+
+		float l = lerp->shadedots[v->lightnormalindex];
+		__m128 c = _mm_mul_ps(_mm_setr_ps(l, l, l, lerp->alpha), shadelight);
+		__m128i ci = _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(c, scale), maxColor), zero));
+		ci = _mm_packs_epi32(ci, ci);
+		int color = _mm_cvtsi128_si32(_mm_packus_epi16(ci, ci));
+		memcpy(packed->color, &color, 4);
+	}
+}
+#endif
+
+#if defined(ALIAS_LERP_NEON)
+#if !defined(__aarch64__)
+// Same operations as FloatToFloat16.
+static inline uint16x4_t R_AliasModel_packFloat16(float32x4_t x)
+{
+	uint32x4_t b = vaddq_u32(vreinterpretq_u32_f32(x), vdupq_n_u32(0x00001000));
+	uint32x4_t e = vshrq_n_u32(vandq_u32(b, vdupq_n_u32(0x7F800000)), 23);
+	uint32x4_t m = vandq_u32(b, vdupq_n_u32(0x007FFFFF));
+	uint32x4_t sign = vshrq_n_u32(vandq_u32(b, vdupq_n_u32(0x80000000)), 16);
+	uint32x4_t normal = vorrq_u32(vandq_u32(vshlq_n_u32(vsubq_u32(e, vdupq_n_u32(112)), 10), vdupq_n_u32(0x7C00)), vshrq_n_u32(m, 13));
+	normal = vandq_u32(normal, vcgtq_u32(e, vdupq_n_u32(112)));
+	int32x4_t shift = vsubq_s32(vreinterpretq_s32_u32(e), vdupq_n_s32(125)); // Negative, shifts right.
+	uint32x4_t denormal = vshrq_n_u32(vaddq_u32(vshlq_u32(vaddq_u32(vdupq_n_u32(0x007FF000), m), shift), vdupq_n_u32(1)), 1);
+	denormal = vandq_u32(denormal, vandq_u32(vcltq_u32(e, vdupq_n_u32(113)), vcgtq_u32(e, vdupq_n_u32(101))));
+	uint32x4_t saturated = vandq_u32(vdupq_n_u32(0x7FFF), vcgtq_u32(e, vdupq_n_u32(143)));
+	return vmovn_u32(vorrq_u32(vorrq_u32(sign, normal), vorrq_u32(denormal, saturated)));
+}
+#endif
+
+static void R_AliasModel_lerpNEON(const aliaslerp_t *lerp)
+{
+	const dtrivertx_t *v = lerp->v, *ov = lerp->ov;
+	float32x4_t move = vld1q_f32(lerp->move);
+	float32x4_t frontv = vld1q_f32(lerp->frontv);
+	float32x4_t backv = vld1q_f32(lerp->backv);
+	float shadelightValues[4] = { lerp->shadelight[0], lerp->shadelight[1], lerp->shadelight[2], 1.0f };
+	float32x4_t shadelight = vld1q_f32(shadelightValues);
+	float32x4_t scale = vdupq_n_f32(256.0f), maxColor = vdupq_n_f32(255.0f), zero = vdupq_n_f32(0.0f);
+	uint32_t maskValues[4] = { 0xFF, 0xFF, 0xFF, 0 };
+	uint32x4_t mask = vld1q_u32(maskValues);
+	for (int i = 0; i < lerp->nverts; i++, v++, ov++)
+	{
+		uint32_t vi, ovi;
+		memcpy(&vi, v, 4);
+		memcpy(&ovi, ov, 4);
+		uint32x4_t vb = vandq_u32(vmovl_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(vi))))), mask);
+		uint32x4_t ovb = vandq_u32(vmovl_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(ovi))))), mask);
+		#if defined(__aarch64__)
+		// The compiler fuses the multiply-adds of the reference kernel.
+		float32x4_t p = vfmaq_f32(vfmaq_f32(move, vcvtq_f32_u32(ovb), backv), vcvtq_f32_u32(vb), frontv);
+		#else
+		float32x4_t p = vaddq_f32(vaddq_f32(move, vmulq_f32(vcvtq_f32_u32(ovb), backv)), vmulq_f32(vcvtq_f32_u32(vb), frontv));
+		#endif
+		if (lerp->shell)
+			p = vaddq_f32(p, vld1q_f32(s_normals[v->lightnormalindex]));
+		vst1q_f32(lerp->lerped[i], p);
+
+		aliasvertex_t *packed = &lerp->packed[i];
+		#if defined(__aarch64__)
+		vst1_f16((float16_t *)packed->position, vcvt_f16_f32(p));
+		#else
+		vst1_u16(packed->position, R_AliasModel_packFloat16(p));
+		#endif
+
+		float l = lerp->shadedots[v->lightnormalindex];
+		float lightValues[4] = { l, l, l, lerp->alpha };
+		float32x4_t c = vmulq_f32(vld1q_f32(lightValues), shadelight);
+		uint32x4_t ci = vcvtq_u32_f32(vmaxq_f32(vminq_f32(vmulq_f32(c, scale), maxColor), zero));
+		uint8x8_t cb = vmovn_u16(vcombine_u16(vmovn_u32(ci), vmovn_u32(ci)));
+		vst1_lane_u32((uint32_t *)packed->color, vreinterpret_u32_u8(cb), 0);
+	}
+}
+#endif
+
+static aliaslerpkernel_t R_AliasModel_getLerpKernel()
+{
+	#if defined(ALIAS_LERP_SSE2)
+	if (r_lerp_simd->value)
+		return R_AliasModel_lerpSSE2;
+	#elif defined(ALIAS_LERP_NEON)
+	if (r_lerp_simd->value)
+		return R_AliasModel_lerpNEON;
+	#endif
+	return R_AliasModel_lerpReference;
+}
+
+/*
+ * Runs the kernels over every model, checks they match the reference one and times them.
+ */
+void R_AliasModel_lerpTest_f(void)
+{
+	static const struct
+	{
+		const char *name;
+		aliaslerpkernel_t kernel;
+	} kernels[] =
 	{
-		for (int i = 0; i < nverts; i++, v++, ov++, lerp += 4)
+		{ "reference", R_AliasModel_lerpReference },
+		#if defined(ALIAS_LERP_SSE2)
+		{ "sse2", R_AliasModel_lerpSSE2 },
+		#elif defined(ALIAS_LERP_NEON)
+		{ "neon", R_AliasModel_lerpNEON },
+		#endif
+	};
+	const int kernelNb = sizeof(kernels) / sizeof(kernels[0]);
+	int times[sizeof(kernels) / sizeof(kernels[0])] = { 0 };
+	int iterationNb = (Cmd_Argc() > 1) ? atoi(Cmd_Argv(1)) : 10;
+	if (iterationNb < 1)
+		iterationNb = 1;
+
+	R_AliasModel_lerpInitialize();
+	static vec4_t lerped[2][MAX_VERTS];
+	static aliasvertex_t packed[2][MAX_VERTS];
+
+	int fileNb;
+	char **files = FS_ListFiles2("models/*.md2", &fileNb, 0, 0);
+	int modelNb = 0, vertexNb = 0, mismatchNb = 0;
+	for (int fileIndex = 0; fileIndex < fileNb - 1; fileIndex++)
+	{
+		byte *buffer;
+		int length = FS_LoadFile(files[fileIndex], (void **)&buffer);
+		if (!buffer)
+			continue;
+		const dmdl_t *header = (const dmdl_t *)buffer;
+		int nverts = LittleLong(header->num_xyz), frameNb = LittleLong(header->num_frames);
+		int framesize = LittleLong(header->framesize), ofs_frames = LittleLong(header->ofs_frames);
+		if ((length < (int)sizeof(dmdl_t)) || (LittleLong(header->ident) != IDALIASHEADER) || (LittleLong(header->version) != ALIAS_VERSION)
+			|| (nverts <= 0) || (nverts > MAX_VERTS) || (frameNb <= 0) || (framesize < (int)sizeof(daliasframe_t) - 4 + nverts * 4)
+			|| (ofs_frames < 0) || (ofs_frames + frameNb * framesize > length))
 		{
-			lerp[0] = move[0] + ov->v[0] * backv[0] + v->v[0] * frontv[0];
-			lerp[1] = move[1] + ov->v[1] * backv[1] + v->v[1] * frontv[1];
-			lerp[2] = move[2] + ov->v[2] * backv[2] + v->v[2] * frontv[2];
+			FS_FreeFile(buffer);
+			continue;
 		}
+		modelNb++;
+
+		for (int shell = 0; shell < 2; shell++)
+		{
+			for (int frameIndex = 0; frameIndex < frameNb; frameIndex++)
+			{
+				const daliasframe_t *frame = (const daliasframe_t *)(buffer + ofs_frames + frameIndex * framesize);
+				const daliasframe_t *oldframe = (const daliasframe_t *)(buffer + ofs_frames + ((frameIndex + 1) % frameNb) * framesize);
+				aliaslerp_t lerp;
+				lerp.v = frame->verts;
+				lerp.ov = oldframe->verts;
+				lerp.nverts = nverts;
+				float backlerp = 0.25f;
+				for (int i = 0; i < 3; i++)
+				{
+					lerp.move[i] = backlerp * LittleFloat(oldframe->translate[i]) + (1.0f - backlerp) * LittleFloat(frame->translate[i]);
+					lerp.frontv[i] = (1.0f - backlerp) * LittleFloat(frame->scale[i]);
+					lerp.backv[i] = backlerp * LittleFloat(oldframe->scale[i]);
+					lerp.shadelight[i] = 0.5f + 0.25f * i;
+				}
+				lerp.move[3] = lerp.frontv[3] = lerp.backv[3] = lerp.shadelight[3] = 0.0f;
+				lerp.shell = shell;
+				lerp.shadedots = r_avertexnormal_dots[frameIndex & (SHADEDOT_QUANT - 1)];
+				lerp.alpha = 0.75f;
+
+				for (int kernelIndex = 0; kernelIndex < kernelNb; kernelIndex++)
+				{
+					lerp.lerped = lerped[kernelIndex > 0];
+					lerp.packed = packed[kernelIndex > 0];
+					int start = Sys_Milliseconds();
+					for (int iteration = 0; iteration < iterationNb; iteration++)
+						kernels[kernelIndex].kernel(&lerp);
+					times[kernelIndex] += Sys_Milliseconds() - start;
+					if ((kernelIndex > 0) && (memcmp(lerped[0], lerped[1], nverts * sizeof(vec4_t)) || memcmp(packed[0], packed[1], nverts * sizeof(aliasvertex_t))))
+					{
+						if (!mismatchNb)
+							R_printf(PRINT_ALL, "%s: %s differs from the reference on frame %i\n", files[fileIndex], kernels[kernelIndex].name, frameIndex);
+						mismatchNb++;
+					}
+				}
+				vertexNb += nverts;
+			}
+		}
+		FS_FreeFile(buffer);
 	}
+	if (files)
+		FS_FreeList(files, fileNb);
+
+	R_printf(PRINT_ALL, "%i models, %i vertices x %i iterations, %i mismatches\n", modelNb, vertexNb, iterationNb, mismatchNb);
+	for (int kernelIndex = 0; kernelIndex < kernelNb; kernelIndex++)
+		R_printf(PRINT_ALL, "%-10s %6i ms\n", kernels[kernelIndex].name, times[kernelIndex]);
 }
 
+//********************************************************************************
+// GPU frame interpolation.
+//********************************************************************************
 /*
- * Interpolates between two frames and origins
+ * Converts the glcmds to an indexed triangle list and uploads all the frames
  */
-void R_AliasModel_drawLerp(entity_t *entity, dmdl_t *paliashdr, float backlerp, float *shadelight, float *shadedots)
+void R_AliasModel_buildKeyframes(model_t *model)
 {
-	float alpha = 1.0f;
-	if (entity->flags & RF_TRANSLUCENT)
-		alpha = entity->alpha;
-    if (alpha < 1.0f)
-    {
-		oglwEnableBlending(true);
-		oglwEnableDepthWrite(false);
-    }
-    
-	if (entity->flags & (RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE | RF_SHELL_DOUBLE | RF_SHELL_HALF_DAM))
-		oglwEnableTexturing(0, GL_FALSE);
+	if (model->keyframesBuilt || (model->type != mod_alias))
+		return;
+	model->keyframesBuilt = true;
+	if (!oglwIsKeyframeSupported())
+		return;
 
-	daliasframe_t *frame = (daliasframe_t *)((byte *)paliashdr + paliashdr->ofs_frames + entity->frame * paliashdr->framesize);
-	daliasframe_t *oldframe = (daliasframe_t *)((byte *)paliashdr + paliashdr->ofs_frames + entity->oldframe * paliashdr->framesize);
+	dmdl_t *paliashdr = (dmdl_t *)model->extradata;
+	int referenceNb = 0, indexNb = 0;
+	for (int *order = (int *)((byte *)paliashdr + paliashdr->ofs_glcmds); *order; )
+	{
+		int count = abs(*order++);
+		referenceNb += count;
+		if (count > 2)
+			indexNb += (count - 2) * 3;
+		order += 3 * count;
+	}
+	if (indexNb == 0)
+		return;
+
+	/* vertices are the distinct xyz index and texture coordinates pairs */
+	int *firstByXyz = malloc(paliashdr->num_xyz * sizeof(int));
+	int *xyzIndices = malloc(referenceNb * sizeof(int));
+	int *nextVertices = malloc(referenceNb * sizeof(int));
+	GLfloat *texCoords = malloc(referenceNb * 2 * sizeof(GLfloat));
+	GLushort *indices = malloc(indexNb * sizeof(GLushort));
+	int *commandVertices = malloc(referenceNb * sizeof(int));
+	GLubyte *frames = NULL;
+	if (!firstByXyz || !xyzIndices || !nextVertices || !texCoords || !indices || !commandVertices)
+		goto cleanup;
+	for (int i = 0; i < paliashdr->num_xyz; i++)
+		firstByXyz[i] = -1;
+
+	int vertexNb = 0;
+	indexNb = 0;
+	for (int *order = (int *)((byte *)paliashdr + paliashdr->ofs_glcmds); *order; )
+	{
+		int count = *order++;
+		qboolean fan = count < 0;
+		if (fan)
+			count = -count;
+		for (int i = 0; i < count; i++, order += 3)
+		{
+			int xyz = order[2];
+			float *tc = (float *)order;
+			if ((xyz < 0) || (xyz >= paliashdr->num_xyz))
+				goto cleanup;
+			int vertex = firstByXyz[xyz];
+			while ((vertex >= 0) && ((texCoords[vertex * 2] != tc[0]) || (texCoords[vertex * 2 + 1] != tc[1])))
+				vertex = nextVertices[vertex];
+			if (vertex < 0)
+			{
+				if (vertexNb >= 65536)
+					goto cleanup;
+				vertex = vertexNb++;
+				xyzIndices[vertex] = xyz;
+				texCoords[vertex * 2] = tc[0];
+				texCoords[vertex * 2 + 1] = tc[1];
+				nextVertices[vertex] = firstByXyz[xyz];
+				firstByXyz[xyz] = vertex;
+			}
+			commandVertices[i] = vertex;
+		}
+		/* same triangles as the wrapper strips and fans */
+		for (int ti = 0, swap = 0; ti < count - 2; ti++, swap ^= 1)
+		{
+			if (fan)
+			{
+				indices[indexNb++] = commandVertices[0];
+				indices[indexNb++] = commandVertices[ti + 1];
+				indices[indexNb++] = commandVertices[ti + 2];
+			}
+			else
+			{
+				indices[indexNb++] = commandVertices[ti];
+				indices[indexNb++] = commandVertices[ti + 1 + swap];
+				indices[indexNb++] = commandVertices[ti + 2 - swap];
+			}
+		}
+	}
+
+	frames = malloc(paliashdr->num_frames * vertexNb * 4);
+	if (!frames)
+		goto cleanup;
+	for (int f = 0; f < paliashdr->num_frames; f++)
+	{
+		daliasframe_t *frame = (daliasframe_t *)((byte *)paliashdr + paliashdr->ofs_frames + f * paliashdr->framesize);
+		GLubyte *out = &frames[f * vertexNb * 4];
+		for (int i = 0; i < vertexNb; i++, out += 4)
+			memcpy(out, &frame->verts[xyzIndices[i]], 4);
+	}
+
+	if (oglwCreateKeyframeModel(&model->keyframes, frames, paliashdr->num_frames, texCoords, vertexNb, indices, indexNb))
+		R_printf(PRINT_DEVELOPER, "R_AliasModel_buildKeyframes %s: cannot create the buffers\n", model->name);
+
+cleanup:
+	free(frames);
+	free(commandVertices);
+	free(indices);
+	free(texCoords);
+	free(nextVertices);
+	free(xyzIndices);
+	free(firstByXyz);
+}
 
+void R_AliasModel_freeKeyframes(model_t *model)
+{
+	oglwDestroyKeyframeModel(&model->keyframes);
+	model->keyframesBuilt = false;
+}
+
+/*
+ * Computes the interpolation of the frames: position = move + old * backv + current * frontv
+ */
+static void R_AliasModel_computeLerp(entity_t *entity, daliasframe_t *frame, daliasframe_t *oldframe, float backlerp, vec3_t move, vec3_t frontv, vec3_t backv)
+{
 	/* move should be the delta back to the previous frame * backlerp */
-	vec3_t move, delta, vectors[3];
+	vec3_t delta, vectors[3];
 	VectorSubtract(entity->oldorigin, entity->origin, delta);
 	AngleVectors(entity->angles, vectors[0], vectors[1], vectors[2]);
 	move[0] = DotProduct(delta, vectors[0]); /* forward */
@@ -72,16 +479,73 @@ void R_AliasModel_drawLerp(entity_t *entity, dmdl_t *paliashdr, float backlerp,
 	for (int i = 0; i < 3; i++)
 		move[i] = backlerp * move[i] + frontlerp * frame->translate[i];
 
-	vec3_t frontv, backv;
 	for (int i = 0; i < 3; i++)
 	{
 		frontv[i] = frontlerp * frame->scale[i];
 		backv[i] = backlerp * oldframe->scale[i];
 	}
+}
 
-	float *lerp = s_lerped[0];
-	dtrivertx_t *verts = frame->verts, *v = verts, *ov = oldframe->verts;
-	R_AliasModel_lerp(entity, paliashdr->num_xyz, v, ov, verts, lerp, move, frontv, backv);
+/*
+ * Draws with the frames interpolated by the GPU, returns false when the model has to be interpolated by the CPU
+ */
+static qboolean R_AliasModel_drawKeyframes(entity_t *entity, dmdl_t *paliashdr, float backlerp, float *shadelight, float *shadedots)
+{
+	model_t *model = entity->model;
+	if (!r_gpu_lerp->value || (entity->flags & (RF_TRANSLUCENT | RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE | RF_SHELL_DOUBLE | RF_SHELL_HALF_DAM)))
+		return false;
+	R_AliasModel_buildKeyframes(model);
+	if (!model->keyframes.vertexBuffer)
+		return false;
+
+	daliasframe_t *frame = (daliasframe_t *)((byte *)paliashdr + paliashdr->ofs_frames + entity->frame * paliashdr->framesize);
+	daliasframe_t *oldframe = (daliasframe_t *)((byte *)paliashdr + paliashdr->ofs_frames + entity->oldframe * paliashdr->framesize);
+	vec3_t move, frontv, backv;
+	R_AliasModel_computeLerp(entity, frame, oldframe, backlerp, move, frontv, backv);
+	float color[4] = { shadelight[0], shadelight[1], shadelight[2], 1.0f };
+	oglwDrawKeyframeModel(&model->keyframes, entity->frame, entity->oldframe, move, frontv, backv, color, shadedots);
+	return true;
+}
+
+/*
+ * Interpolates between two frames and origins
+ */
+void R_AliasModel_drawLerp(entity_t *entity, dmdl_t *paliashdr, float backlerp, float *shadelight, float *shadedots)
+{
+	float alpha = 1.0f;
+	if (entity->flags & RF_TRANSLUCENT)
+		alpha = entity->alpha;
+    if (alpha < 1.0f)
+    {
+		oglwEnableBlending(true);
+		oglwEnableDepthWrite(false);
+    }
+    
+	if (entity->flags & (RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE | RF_SHELL_DOUBLE | RF_SHELL_HALF_DAM))
+		oglwEnableTexturing(0, GL_FALSE);
+
+	daliasframe_t *frame = (daliasframe_t *)((byte *)paliashdr + paliashdr->ofs_frames + entity->frame * paliashdr->framesize);
+	daliasframe_t *oldframe = (daliasframe_t *)((byte *)paliashdr + paliashdr->ofs_frames + entity->oldframe * paliashdr->framesize);
+
+	vec3_t move, frontv, backv;
+	R_AliasModel_computeLerp(entity, frame, oldframe, backlerp, move, frontv, backv);
+
+	R_AliasModel_lerpInitialize();
+	aliaslerp_t lerp;
+	lerp.v = frame->verts;
+	lerp.ov = oldframe->verts;
+	lerp.nverts = paliashdr->num_xyz;
+	VectorCopy(move, lerp.move);
+	VectorCopy(frontv, lerp.frontv);
+	VectorCopy(backv, lerp.backv);
+	VectorCopy(shadelight, lerp.shadelight);
+	lerp.move[3] = lerp.frontv[3] = lerp.backv[3] = lerp.shadelight[3] = 0.0f;
+	lerp.shell = (entity->flags & (RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE | RF_SHELL_DOUBLE | RF_SHELL_HALF_DAM)) != 0;
+	lerp.shadedots = (entity->flags & (RF_SHELL_RED | RF_SHELL_GREEN | RF_SHELL_BLUE)) ? s_flatdots : shadedots;
+	lerp.alpha = alpha;
+	lerp.lerped = s_lerped;
+	lerp.packed = s_packed;
+	R_AliasModel_getLerpKernel()(&lerp);
 
 	int *order = (int *)((byte *)paliashdr + paliashdr->ofs_glcmds);
 
@@ -111,9 +575,8 @@ void R_AliasModel_drawLerp(entity_t *entity, dmdl_t *paliashdr, float backlerp,
 		{
 			do
 			{
-				int index_xyz = order[2];
-				float *p = s_lerped[index_xyz];
-				vtx = AddVertex3D_C(vtx, p[0], p[1], p[2], shadelight[0], shadelight[1], shadelight[2], alpha);
+				memcpy(vtx, &s_packed[order[2]], sizeof(aliasvertex_t));
+				vtx++;
 				order += 3;
 			}
 			while (--count);
@@ -122,13 +585,12 @@ void R_AliasModel_drawLerp(entity_t *entity, dmdl_t *paliashdr, float backlerp,
 		{
 			do
 			{
-				int index_xyz = order[2];
-				float *p = s_lerped[index_xyz];
-				float l = shadedots[verts[index_xyz].lightnormalindex];
-				float *tc = (float *)order;
 				/* texture coordinates come from the draw list */
 				/* normals and vertexes come from the frame list */
-				vtx = AddVertex3D_CT1(vtx, p[0], p[1], p[2], l * shadelight[0], l * shadelight[1], l * shadelight[2], alpha, tc[0], tc[1]);
+				memcpy(vtx, &s_packed[order[2]], sizeof(aliasvertex_t));
+				float *tc = (float *)order;
+				Vertex_set2TC(vtx->texCoord[0], tc[0], tc[1]);
+				vtx++;
 				order += 3;
 			}
 			while (--count);
@@ -497,7 +959,10 @@ void R_AliasModel_draw(entity_t *entity)
     vec3_t lightSpot;
     R_AliasModel_light(entity, shadelight, lightSpot);
 	float *shadedots = r_avertexnormal_dots[((int)(entity->angles[1] * (SHADEDOT_QUANT / 360.0f))) & (SHADEDOT_QUANT - 1)];
-	R_AliasModel_drawLerp(entity, paliashdr, entity->backlerp, shadelight, shadedots);
+	/* shadows need the vertices interpolated by the CPU */
+	qboolean shadow = gl_shadows->value && !(entity->flags & (RF_TRANSLUCENT | RF_WEAPONMODEL | RF_NOSHADOW));
+	if (shadow || !R_AliasModel_drawKeyframes(entity, paliashdr, entity->backlerp, shadelight, shadedots))
+		R_AliasModel_drawLerp(entity, paliashdr, entity->backlerp, shadelight, shadedots);
 
 	oglwEnableSmoothShading(false);
 
@@ -516,7 +981,7 @@ void R_AliasModel_draw(entity_t *entity)
 		oglwSetDepthRange(gldepthmin, gldepthmax);
 	}
 
-	if (gl_shadows->value && !(entity->flags & (RF_TRANSLUCENT | RF_WEAPONMODEL | RF_NOSHADOW)))
+	if (shadow)
 	{
 		oglwPushMatrix();
 
@@ -32,11 +32,28 @@ static model_t *loadmodel;
 static byte mod_novis[MAX_MAP_LEAFS / 8];
 static model_t mod_known[MAX_MOD_KNOWN];
 static int mod_numknown;
+static registry_t mod_registry;
 int registration_sequence;
 static byte *mod_base;
 
 static void Mod_LoadBrushModel(model_t *mod, void *buffer);
 
+/* during registration, alias models are parsed by the worker
+   pool into malloc'd copies that Mod_Async_finish moves to
+   the hunk on the main thread */
+typedef struct
+{
+	asynctask_t task;
+	model_t *model;
+	void *raw; /* from FS_MapFile */
+	dmdl_t *parsed; /* NULL if the model is rejected */
+	char error[MAX_QPATH + 64];
+} modjob_t;
+
+static modjob_t mod_jobs[MAX_MOD_KNOWN];
+static int mod_jobNb;
+static qboolean mod_loading;
+
 /* the inline * models from the current map are kept seperate */
 model_t mod_inline[MAX_MOD_KNOWN];
 
@@ -68,9 +85,8 @@ mleaf_t* Mod_PointInLeaf(vec3_t p, model_t *model)
 	return NULL; /* never reached */
 }
 
-byte* Mod_DecompressVis(byte *in, model_t *model)
+static void Mod_DecompressVisRow(byte *in, model_t *model, byte *decompressed)
 {
-	static byte decompressed[MAX_MAP_LEAFS / 8];
 	int c;
 	byte *out;
 	int row;
@@ -86,7 +102,7 @@ byte* Mod_DecompressVis(byte *in, model_t *model)
 			*out++ = 0xff;
 			row--;
 		}
-		return decompressed;
+		return;
 	}
 
 	do
@@ -107,6 +123,13 @@ byte* Mod_DecompressVis(byte *in, model_t *model)
 		}
 	}
 	while (out - decompressed < row);
+}
+
+byte* Mod_DecompressVis(byte *in, model_t *model)
+{
+	static byte decompressed[MAX_MAP_LEAFS / 8];
+
+	Mod_DecompressVisRow(in, model, decompressed);
 
 	return decompressed;
 }
@@ -115,6 +138,8 @@ byte* Mod_ClusterPVS(int cluster, model_t *model)
 {
 	if ((cluster == -1) || !model->vis)
 		return mod_novis;
+	if (model->vismatrix)
+		return model->vismatrix + cluster * model->visstride;
 	return Mod_DecompressVis((byte *)model->vis + model->vis->bitofs[cluster][DVIS_PVS], model);
 }
 
@@ -143,6 +168,81 @@ void Mod_Init()
 	memset(mod_novis, 0xff, sizeof(mod_novis));
 }
 
+static void Mod_Async_parse(asynctask_t *task)
+{
+	modjob_t *job = (modjob_t *)task;
+
+	job->parsed = ParseMD2(job->model->name, job->raw, job->error, sizeof(job->error));
+}
+
+/*
+ * Hands an alias model to the worker pool, returns false
+ * if it has to be loaded right away
+ */
+static qboolean Mod_Async_queue(model_t *mod, void *buf)
+{
+	if (!mod_loading)
+		return false;
+
+	modjob_t *job = &mod_jobs[mod_jobNb];
+	memset(job, 0, sizeof(*job));
+	job->task.run = Mod_Async_parse;
+	job->model = mod;
+	job->raw = buf;
+
+	if (!R_Async_queue(&job->task))
+		return false;
+
+	mod_jobNb++;
+	return true;
+}
+
+/*
+ * Waits for the queued alias models and moves them to the hunk,
+ * or drops them when discard is set
+ */
+static void Mod_Async_finish(qboolean discard)
+{
+	char error[MAX_QPATH + 64];
+	int jobNb = mod_jobNb;
+
+	error[0] = 0;
+	mod_jobNb = 0;
+
+	for (int i = 0; i < jobNb; i++)
+	{
+		modjob_t *job = &mod_jobs[i];
+		model_t *mod = job->model;
+
+		R_Async_wait(&job->task);
+		FS_FreeFile(job->raw);
+
+		if (!job->parsed || discard)
+		{
+			if (!job->parsed && !error[0])
+				strcpy(error, job->error);
+			free(job->parsed);
+			Mod_Free(mod);
+			continue;
+		}
+
+		mod->extradata = Hunk_Begin(0x200000);
+		FinishMD2(mod, job->parsed);
+		mod->extradatasize = Hunk_End();
+		mod->numframes = job->parsed->num_frames;
+		free(job->parsed);
+
+		if (r_gpu_lerp->value)
+			R_AliasModel_buildKeyframes(mod);
+	}
+
+	if (error[0] && !discard)
+		R_error(ERR_DROP, "%s", error);
+
+	if (jobNb && !discard)
+		R_printf(PRINT_ALL, "Registration: %i models parsed by the workers.\n", jobNb);
+}
+
 /*
  * Loads in a model for the given name
  */
@@ -167,13 +267,9 @@ model_t* Mod_ForName(char *name, qboolean crash)
 	}
 
 	/* search the currently loaded models */
-	for (i = 0, mod = mod_known; i < mod_numknown; i++, mod++)
-	{
-		if (!mod->name[0])
-			continue;
-		if (!strcmp(mod->name, name))
-			return mod;
-	}
+	registrynode_t *node = Registry_Find(&mod_registry, name);
+	if (node)
+		return REGISTRY_ENTRY(node, model_t, registryNode);
 
 	/* find a free model slot spot */
 	for (i = 0, mod = mod_known; i < mod_numknown; i++, mod++)
@@ -192,7 +288,7 @@ model_t* Mod_ForName(char *name, qboolean crash)
 	strcpy(mod->name, name);
 
 	/* load the file */
-	int modfilelen = FS_LoadFile(mod->name, (void **)&buf);
+	int modfilelen = FS_MapFile(mod->name, (void **)&buf);
 	if (!buf)
 	{
 		if (crash)
@@ -200,6 +296,7 @@ model_t* Mod_ForName(char *name, qboolean crash)
 		memset(mod->name, 0, sizeof(mod->name));
 		return NULL;
 	}
+	Registry_Add(&mod_registry, &mod->registryNode, mod->name);
 
 	loadmodel = mod;
 
@@ -207,6 +304,8 @@ model_t* Mod_ForName(char *name, qboolean crash)
 	switch (LittleLong(*(unsigned *)buf))
 	{
 	case IDALIASHEADER:
+		if (Mod_Async_queue(mod, buf))
+			return mod;
 		loadmodel->extradata = Hunk_Begin(0x200000);
 		LoadMD2(mod, buf);
 		break;
@@ -250,6 +349,7 @@ void Mod_LoadLighting(lump_t *l)
 void Mod_LoadVisibility(lump_t *l)
 {
 	int i;
+	int size;
 
 	if (!l->filelen)
 	{
@@ -267,6 +367,24 @@ void Mod_LoadVisibility(lump_t *l)
 		loadmodel->vis->bitofs[i][0] = LittleLong(loadmodel->vis->bitofs[i][0]);
 		loadmodel->vis->bitofs[i][1] = LittleLong(loadmodel->vis->bitofs[i][1]);
 	}
+
+	/* decompress all the PVS rows up front when they fit in r_vismatrix kilobytes */
+	loadmodel->visstride = ((loadmodel->vis->numclusters + 31) >> 5) << 2;
+	size = loadmodel->vis->numclusters * loadmodel->visstride;
+
+	if (size <= 0 || size > r_vismatrix->value * 1024)
+		return;
+
+	/* without it, Mod_ClusterPVS decompresses the rows on demand */
+	loadmodel->vismatrix = calloc(1, size);
+	if (!loadmodel->vismatrix)
+		return;
+
+	for (i = 0; i < loadmodel->vis->numclusters; i++)
+	{
+		Mod_DecompressVisRow((byte *)loadmodel->vis + loadmodel->vis->bitofs[i][DVIS_PVS],
+			loadmodel, loadmodel->vismatrix + i * loadmodel->visstride);
+	}
 }
 
 void Mod_LoadVertexes(lump_t *l)
@@ -527,6 +645,7 @@ static void Mod_LoadFaces(model_t *model, lump_t *l)
 		out->numedges = LittleShort(in->numedges);
 		out->flags = 0;
 		out->polys = NULL;
+		out->staticVertex = -1;
 
 		planenum = LittleShort(in->planenum);
 		side = LittleShort(in->side);
@@ -794,7 +913,7 @@ void Mod_LoadPlanes(lump_t *l)
 void Mod_LoadBrushModel(model_t *mod, void *buffer)
 {
 	int i;
-	dheader_t *header;
+	dheader_t header;
 	mmodel_t *bm;
 
     model_t *model = loadmodel;
@@ -804,9 +923,10 @@ void Mod_LoadBrushModel(model_t *mod, void *buffer)
 	if (model != mod_known)
 		R_error(ERR_DROP, "Loaded a brush model after the world");
 
-	header = (dheader_t *)buffer;
+	/* the buffer may be a read-only mapping, swap a copy of the header */
+	header = *(dheader_t *)buffer;
 
-	i = LittleLong(header->version);
+	i = LittleLong(header.version);
 
 	if (i != BSPVERSION)
 	{
@@ -814,26 +934,26 @@ void Mod_LoadBrushModel(model_t *mod, void *buffer)
 	}
 
 	/* swap all the lumps */
-	mod_base = (byte *)header;
+	mod_base = (byte *)buffer;
 
 	for (i = 0; i < (int)sizeof(dheader_t) / 4; i++)
 	{
-		((int *)header)[i] = LittleLong(((int *)header)[i]);
+		((int *)&header)[i] = LittleLong(((int *)&header)[i]);
 	}
 
 	/* load into heap */
-	Mod_LoadVertexes(&header->lumps[LUMP_VERTEXES]);
-	Mod_LoadEdges(&header->lumps[LUMP_EDGES]);
-	Mod_LoadSurfedges(&header->lumps[LUMP_SURFEDGES]);
-	Mod_LoadLighting(&header->lumps[LUMP_LIGHTING]);
-	Mod_LoadPlanes(&header->lumps[LUMP_PLANES]);
-	Mod_LoadTexinfo(&header->lumps[LUMP_TEXINFO]);
-	Mod_LoadFaces(model, &header->lumps[LUMP_FACES]);
-	Mod_LoadMarksurfaces(&header->lumps[LUMP_LEAFFACES]);
-	Mod_LoadVisibility(&header->lumps[LUMP_VISIBILITY]);
-	Mod_LoadLeafs(&header->lumps[LUMP_LEAFS]);
-	Mod_LoadNodes(&header->lumps[LUMP_NODES]);
-	Mod_LoadSubmodels(&header->lumps[LUMP_MODELS]);
+	Mod_LoadVertexes(&header.lumps[LUMP_VERTEXES]);
+	Mod_LoadEdges(&header.lumps[LUMP_EDGES]);
+	Mod_LoadSurfedges(&header.lumps[LUMP_SURFEDGES]);
+	Mod_LoadLighting(&header.lumps[LUMP_LIGHTING]);
+	Mod_LoadPlanes(&header.lumps[LUMP_PLANES]);
+	Mod_LoadTexinfo(&header.lumps[LUMP_TEXINFO]);
+	Mod_LoadFaces(model, &header.lumps[LUMP_FACES]);
+	Mod_LoadMarksurfaces(&header.lumps[LUMP_LEAFFACES]);
+	Mod_LoadVisibility(&header.lumps[LUMP_VISIBILITY]);
+	Mod_LoadLeafs(&header.lumps[LUMP_LEAFS]);
+	Mod_LoadNodes(&header.lumps[LUMP_NODES]);
+	Mod_LoadSubmodels(&header.lumps[LUMP_MODELS]);
 	mod->numframes = 2; /* regular and alternate animation */
 
 	/* set up the submodels */
@@ -870,12 +990,19 @@ void Mod_LoadBrushModel(model_t *mod, void *buffer)
 
 void Mod_Free(model_t *mod)
 {
+	if (mod->name[0])
+		Registry_Remove(&mod_registry, &mod->registryNode);
+	R_AliasModel_freeKeyframes(mod);
+	free(mod->vismatrix);
 	Hunk_Free(mod->extradata);
 	memset(mod, 0, sizeof(*mod));
 }
 
 void Mod_FreeAll()
 {
+	Mod_Async_finish(true);
+	mod_loading = false;
+
 	for (int i = 0; i < mod_numknown; i++)
 	{
 		if (mod_known[i].extradatasize)
@@ -894,6 +1021,13 @@ void R_BeginRegistration(char *model)
 	registration_sequence++;
 	r_oldviewcluster = -1; /* force markleafs */
 
+	R_Image_beginLoading();
+	R_World_freeStatic();
+
+	/* leftovers from an aborted registration */
+	Mod_Async_finish(true);
+	mod_loading = true;
+
 	Com_sprintf(fullname, sizeof(fullname), "maps/%s.bsp", model);
 
 	/* explicitly free the old map if different
@@ -946,6 +1080,9 @@ struct model_s* R_RegisterModel(char *name)
 			}
 
 			mod->numframes = pheader->num_frames;
+
+			if (r_gpu_lerp->value)
+				R_AliasModel_buildKeyframes(mod);
 		}
 		else
 		if (mod->type == mod_brush)
@@ -965,6 +1102,11 @@ void R_EndRegistration()
 {
 	int i;
 	model_t *mod;
+
+	/* before the images, the skins of the models are queued too */
+	mod_loading = false;
+	Mod_Async_finish(false);
+
 	for (i = 0, mod = mod_known; i < mod_numknown; i++, mod++)
 	{
 		if (!mod->name[0])
@@ -972,5 +1114,7 @@ void R_EndRegistration()
 		if (mod->registration_sequence != registration_sequence)
 			Mod_Free(mod); /* don't need this model */
 	}
+	R_Image_finishLoading();
 	R_FreeUnusedImages();
+	R_World_buildStatic();
 }
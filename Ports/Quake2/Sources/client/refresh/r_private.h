@@ -45,6 +45,7 @@ typedef enum
 typedef struct image_s
 {
 	char name[MAX_QPATH]; /* game path, including extension */
+	registrynode_t registryNode; /* by name in the image registry */
 	imagetype_t type;
 	int width, height; /* source image */
 	int upload_width, upload_height; /* after power of two and picmip */
@@ -119,6 +120,9 @@ extern cvar_t *r_texture_scaledown;
 extern cvar_t *r_texture_filter;
 extern cvar_t *r_texture_anisotropy;
 extern cvar_t *r_texture_anisotropy_available;
+extern cvar_t *r_texture_async;
+extern cvar_t *r_texture_cache;
+extern cvar_t *r_texture_compress;
 
 extern cvar_t *gl_stereo;
 extern cvar_t *gl_stereo_separation;
@@ -132,10 +136,13 @@ extern cvar_t *gl_speeds;
 
 extern cvar_t *gl_novis;
 extern cvar_t *gl_lockpvs;
+extern cvar_t *r_vismatrix;
 extern cvar_t *gl_nocull;
 extern cvar_t *gl_cull;
 
 extern cvar_t *gl_lerpmodels;
+extern cvar_t *r_lerp_simd;
+extern cvar_t *r_gpu_lerp;
 extern cvar_t *gl_lefthand;
 extern cvar_t *gl_lightlevel;
 extern cvar_t *gl_shadows;
@@ -162,7 +169,11 @@ extern cvar_t *r_lightmap_only;
 extern cvar_t *r_lightmap_saturate;
 extern cvar_t *gl_modulate;
 extern cvar_t *r_lightmap_outline;
+extern cvar_t *r_lightmap_gpu;
+extern cvar_t *r_lightmap_simd;
 extern cvar_t *r_subdivision;
+extern cvar_t *r_world_static;
+extern cvar_t *r_draw_queue;
 
 extern cvar_t *r_lightflash;
 extern cvar_t *r_fullscreenflash;
@@ -181,6 +192,8 @@ extern cvar_t *r_sizerender;
 #define TEXNUM_IMAGES (TEXNUM_SCRAPS + SCRAP_MAX_NB)
 
 void LoadPCX(char *filename, byte **pic, byte **palette, int *width, int *height);
+qboolean DecodePCX(const byte *raw, int len, byte **pic, byte **palette, int *width, int *height);
+qboolean DecodeSTB(const byte *raw, int len, byte **pic, int *width, int *height);
 image_t* LoadWal(char *name);
 qboolean LoadSTB(const char *origname, const char * type, byte **pic, int *width, int *height);
 void GetWalInfo(char *name, int *width, int *height);
@@ -193,6 +206,8 @@ void Scrap_Upload();
 
 void R_InitImages();
 void R_ShutdownImages();
+void R_Image_beginLoading();
+void R_Image_finishLoading();
 void R_FreeUnusedImages();
 void R_ImageList_f();
 void R_ResampleTexture(unsigned *in, int inwidth, int inheight, unsigned *out, int outwidth, int outheight);
@@ -214,6 +229,9 @@ void V_AddBlend(float r, float g, float b, float a, float *v_blend);
 void R_View_setupProjection(GLfloat fovy, GLfloat aspect, GLfloat zNear, GLfloat zFar);
 
 void R_AliasModel_draw(entity_t *e);
+void R_AliasModel_lerpTest_f(void);
+void R_AliasModel_buildKeyframes(model_t *model);
+void R_AliasModel_freeKeyframes(model_t *model);
 void R_BrushModel_draw(entity_t *e);
 
 void R_Lighmap_lightPoint(entity_t *e, vec3_t p, vec3_t color, vec3_t lightSpot, cplane_t **lightPlane);
@@ -223,6 +241,8 @@ void R_Lightmap_endBuilding(void);
 void R_Lightmap_beginBuilding(model_t *m);
 
 void R_Surface_subdivide(model_t *model, msurface_t *fa, float subdivisionSize);
+void R_World_buildStatic();
+void R_World_freeStatic();
 
 extern model_t *r_worldmodel;
 
@@ -238,6 +258,7 @@ typedef struct
 	PFNGLDISCARDFRAMEBUFFEREXTPROC discardFramebuffer;
 	bool anisotropic;
 	bool tex_npot;
+	bool etc1;
 	float max_anisotropy;
 } glconfig_t;
 
@@ -271,8 +292,12 @@ typedef struct
 #define LIGHTMAP_HEIGHT 128
 #define LIGHTMAP_STATIC_MAX_NB 128
 #define LIGHTMAP_DYNAMIC_MAX_NB 16
-#define LIGHTMAP_MAX_NB (LIGHTMAP_STATIC_MAX_NB + LIGHTMAP_DYNAMIC_MAX_NB)
+#define LIGHTMAP_STYLE_TABLE (LIGHTMAP_STATIC_MAX_NB + LIGHTMAP_DYNAMIC_MAX_NB) // Texture of the light style values.
+#define LIGHTMAP_MAX_NB (LIGHTMAP_STYLE_TABLE + 1)
 #define LIGHTMAP_SURFACE_MAX_NB (LIGHTMAP_STATIC_MAX_NB + 1)
+// With the light style program, a static lightmap stacks one layer per style and a layer of style indices.
+#define LIGHTMAP_LAYER_NB (MAXLIGHTMAPS + 1)
+#define LIGHTMAP_LAYER_SIZE (4 * LIGHTMAP_WIDTH * LIGHTMAP_HEIGHT)
 
 typedef struct
 {
@@ -287,7 +312,14 @@ typedef struct
 
 	short allocated[LIGHTMAP_WIDTH];
 	// The lightmap texture data needs to be kept in main memory so texsubimage can update properly.
-	byte lightmap_buffer[4 * LIGHTMAP_WIDTH * LIGHTMAP_HEIGHT];
+	// One layer, or LIGHTMAP_LAYER_NB with the light style program.
+	byte *lightmap_buffer;
+	int lightmapBufferSize;
+
+	bool gpuStyles; // Static lightmaps hold the styles separately, blended by the light style program.
+	msurface_t *dlightSurfaces; // Surfaces drawn by the dynamic light program.
+	byte styleTable[256 * 4]; // Last style values uploaded.
+	int styleTableFrame;
 } gllightmapstate_t;
 
 extern glconfig_t gl_config;
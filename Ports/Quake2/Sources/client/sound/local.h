@@ -63,6 +63,7 @@ typedef struct
 typedef struct sfx_s
 {
 	char name[MAX_QPATH];
+	registrynode_t registryNode; /* by name in the sound registry */
 	int registration_sequence;
 	sfxcache_t *cache;
 	char *truename;
@@ -250,6 +251,18 @@ void SDL_ClearBuffer(void);
  */
 qboolean SDL_Cache(sfx_t *sfx, wavinfo_t *info, byte *data);
 
+/*
+ * Size of the SDL backend cache
+ * of a sample, 0 if it's empty
+ */
+int SDL_CacheSize(wavinfo_t *info);
+
+/*
+ * Resamples a sample into a cache,
+ * safe on the registration workers
+ */
+void SDL_Resample(wavinfo_t *info, byte *data, sfxcache_t *sc);
+
 /*
  * Performs all sound calculations
  * for the SDL backendend and fills
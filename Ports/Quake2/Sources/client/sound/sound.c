@@ -68,25 +68,168 @@ int s_registration_sequence;
 portable_samplepair_t s_rawsamples[MAX_RAW_SAMPLES];
 qboolean snd_initialized = false;
 sfx_t known_sfx[MAX_SFX];
+static registry_t known_sfx_registry;
 sndstarted_t sound_started = SS_NOT;
 sound_t sound;
 static bool s_registering;
 
 qboolean snd_is_underwater;
 qboolean snd_is_underwater_enabled;
+
+/* During registration, the SDL backend samples are
+   resampled by the refresh worker pool into malloc'd
+   caches, which S_LoadSound moves to the zone. */
+typedef struct
+{
+	asynctask_t task;
+	byte *data; /* from FS_MapFile */
+	wavinfo_t info;
+	sfxcache_t *cache; /* NULL if the sample is empty */
+	int size;
+	qboolean queued;
+} sfxjob_t;
+
+static sfxjob_t s_jobs[MAX_SFX];
+static int s_jobNb;
 /* ----------------------------------------------------------------- */
 
+/*
+ * Maps the file of a sample
+ */
+static int S_MapSound(sfx_t *s, byte **data)
+{
+	char namebuffer[MAX_QPATH];
+	char *name;
+
+	if (s->truename)
+	{
+		name = s->truename;
+	}
+	else
+	{
+		name = s->name;
+	}
+
+	if (name[0] == '#')
+	{
+		strcpy(namebuffer, &name[1]);
+	}
+	else
+	{
+		Com_sprintf(namebuffer, sizeof(namebuffer), "sound/%s", name);
+	}
+
+	*data = NULL;
+	int size = FS_MapFile(namebuffer, (void **)data);
+
+	if (!*data)
+	{
+		Com_DPrintf("Couldn't load %s\n", namebuffer);
+	}
+
+	return size;
+}
+
+static void S_Async_resample(asynctask_t *task)
+{
+	sfxjob_t *job = (sfxjob_t *)task;
+
+	job->size = SDL_CacheSize(&job->info);
+
+	if (job->size)
+	{
+		job->cache = malloc(job->size);
+
+		if (job->cache)
+		{
+			SDL_Resample(&job->info, job->data + job->info.dataofs, job->cache);
+		}
+	}
+}
+
+/*
+ * Hands a sample to the worker pool, S_LoadSound
+ * loads it right away if it can't be queued
+ */
+static void S_Async_queue(sfx_t *s)
+{
+	sfxjob_t *job = &s_jobs[s - known_sfx];
+	byte *data;
+	wavinfo_t info;
+	int size;
+
+	if ((sound_started != SS_SDL) || s->cache || job->queued || (s->name[0] == '*'))
+	{
+		return;
+	}
+
+	size = S_MapSound(s, &data);
+
+	if (!data)
+	{
+		return;
+	}
+
+	info = GetWavinfo(s->name, data, size);
+
+	if (info.channels != 1)
+	{
+		FS_FreeFile(data);
+		return;
+	}
+
+	memset(job, 0, sizeof(*job));
+	job->task.run = S_Async_resample;
+	job->data = data;
+	job->info = info;
+
+	if (!R_Async_queue(&job->task))
+	{
+		FS_FreeFile(data);
+		return;
+	}
+
+	job->queued = true;
+	s_jobNb++;
+}
+
+/*
+ * Moves a sample resampled by the
+ * worker pool to the zone
+ */
+static sfxcache_t* S_Async_finish(sfx_t *s)
+{
+	sfxjob_t *job = &s_jobs[s - known_sfx];
+
+	R_Async_wait(&job->task);
+	job->queued = false;
+	FS_FreeFile(job->data);
+
+	if (!job->size)
+	{
+		Com_Printf("WARNING: Zero length sound encountered: %s\n", s->name);
+		return NULL;
+	}
+
+	if (job->cache)
+	{
+		s->cache = Z_Malloc(job->size);
+		memcpy(s->cache, job->cache, job->size);
+		free(job->cache);
+	}
+
+	return s->cache;
+}
+
 /*
  * Loads one sample into memory
  */
 sfxcache_t* S_LoadSound(sfx_t *s)
 {
-	char namebuffer[MAX_QPATH];
 	byte *data;
 	wavinfo_t info;
 	sfxcache_t *sc;
 	int size;
-	char *name;
 
 	if (s->name[0] == '*')
 	{
@@ -101,31 +244,18 @@ sfxcache_t* S_LoadSound(sfx_t *s)
 		return sc;
 	}
 
-	/* load it */
-	if (s->truename)
-	{
-		name = s->truename;
-	}
-	else
-	{
-		name = s->name;
-	}
-
-	if (name[0] == '#')
-	{
-		strcpy(namebuffer, &name[1]);
-	}
-	else
+	/* see if resampled by the workers */
+	if (s_jobs[s - known_sfx].queued)
 	{
-		Com_sprintf(namebuffer, sizeof(namebuffer), "sound/%s", name);
+		return S_Async_finish(s);
 	}
 
-	size = FS_LoadFile(namebuffer, (void **)&data);
+	/* load it */
+	size = S_MapSound(s, &data);
 
 	if (!data)
 	{
 		s->cache = NULL;
-		Com_DPrintf("Couldn't load %s\n", namebuffer);
 		return NULL;
 	}
 
@@ -185,12 +315,11 @@ sfx_t* S_FindName(char *name, qboolean create)
 	}
 
 	/* see if already loaded */
-	for (i = 0; i < num_sfx; i++)
+	registrynode_t *node = Registry_Find(&known_sfx_registry, name);
+
+	if (node)
 	{
-		if (!strcmp(known_sfx[i].name, name))
-		{
-			return &known_sfx[i];
-		}
+		return REGISTRY_ENTRY(node, sfx_t, registryNode);
 	}
 
 	if (!create)
@@ -220,6 +349,7 @@ sfx_t* S_FindName(char *name, qboolean create)
 	sfx = &known_sfx[i];
 	sfx->truename = NULL;
 	strcpy(sfx->name, name);
+	Registry_Add(&known_sfx_registry, &sfx->registryNode, sfx->name);
 	sfx->registration_sequence = s_registration_sequence;
 
 	return sfx;
@@ -260,6 +390,7 @@ sfx_t* S_AliasName(char *aliasname, char *truename)
 	sfx = &known_sfx[i];
 	sfx->cache = NULL;
 	strcpy(sfx->name, aliasname);
+	Registry_Add(&known_sfx_registry, &sfx->registryNode, sfx->name);
 	sfx->registration_sequence = s_registration_sequence;
 	sfx->truename = s;
 
@@ -295,6 +426,10 @@ sfx_t* S_RegisterSound(char *name)
 	{
 		S_LoadSound(sfx);
 	}
+	else
+	{
+		S_Async_queue(sfx);
+	}
 
 	return sfx;
 }
@@ -371,6 +506,7 @@ void S_EndRegistration(void)
 {
 	int i;
 	sfx_t *sfx;
+	int start = Sys_Milliseconds();
 
 	/* free any sounds not from this registration sequence */
 	for (i = 0, sfx = known_sfx; i < num_sfx; i++, sfx++)
@@ -383,6 +519,11 @@ void S_EndRegistration(void)
 		if (sfx->registration_sequence != s_registration_sequence)
 		{
 			/* it is possible to have a leftover */
+			if (s_jobs[i].queued)
+			{
+				S_Async_finish(sfx);
+			}
+
 			if (sfx->cache)
 			{
 				Z_Free(sfx->cache); /* from a server that didn't finish loading */
@@ -394,6 +535,7 @@ void S_EndRegistration(void)
 			}
 
 			sfx->cache = NULL;
+			Registry_Remove(&known_sfx_registry, &sfx->registryNode);
 			sfx->name[0] = 0;
 		}
 	}
@@ -410,6 +552,13 @@ void S_EndRegistration(void)
 	}
 
 	s_registering = false;
+
+	if (s_jobNb)
+	{
+		Com_Printf("Sound registration: %i ms, %i samples resampled by the workers.\n",
+			Sys_Milliseconds() - start, s_jobNb);
+		s_jobNb = 0;
+	}
 }
 
 /* ----------------------------------------------------------------- */
@@ -1027,6 +1176,7 @@ void S_Init(void)
 	}
 
 	num_sfx = 0;
+	Registry_Clear(&known_sfx_registry);
 	paintedtime = 0;
 
 	#ifdef OGG
@@ -1067,6 +1217,11 @@ void S_Shutdown()
 			continue;
 		}
 
+		if (s_jobs[i].queued)
+		{
+			S_Async_finish(sfx);
+		}
+
 		#if USE_OPENAL
 		if (sound_started == SS_OAL)
 		{
@@ -1086,7 +1241,9 @@ void S_Shutdown()
 	}
 
 	memset(known_sfx, 0, sizeof(known_sfx));
+	Registry_Clear(&known_sfx_registry);
 	num_sfx = 0;
+	s_jobNb = 0;
 
 	#if USE_OPENAL
 	if (sound_started == SS_OAL)
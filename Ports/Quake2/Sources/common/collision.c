@@ -26,6 +26,15 @@
  */
 
 #include "common/common.h"
+#include "SDL/SDLWrapper.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2_MATH__)
+#include <emmintrin.h>
+#define CM_SIDES_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CM_SIDES_NEON
+#endif
 
 typedef struct
 {
@@ -53,7 +62,6 @@ typedef struct
 	int contents;
 	int numsides;
 	int firstbrushside;
-	int checkcount; /* to avoid repeated testings */
 } cbrush_t;
 
 typedef struct
@@ -64,10 +72,58 @@ typedef struct
 	int floodvalid;
 } carea_t;
 
+#define TRACE_CHECKED 128 /* power of two */
+
+/* state of a trace, on the stack so that traces are reentrant */
+typedef struct
+{
+	trace_t trace;
+	int contents;
+	qboolean ispoint; /* optimized case */
+	vec3_t start, end;
+	vec3_t mins, maxs;
+	vec3_t extents;
+	unsigned short checked[TRACE_CHECKED]; /* brush numbers + 1 */
+
+	/* the brush sides, the map ones but for CM_BoxTraceToBox */
+	cbrushside_t *sides;
+	float *sidenormals[3];
+	float *sidedists;
+} tracework_t;
+
+#define TRACE_CACHE_SIZE 1024 /* power of two */
+
+typedef struct
+{
+	vec3_t start, end;
+	vec3_t mins, maxs;
+	int headnode;
+	int brushmask;
+} tracekey_t;
+
+typedef struct
+{
+	tracekey_t key;
+	int generation;
+	trace_t trace;
+} tracecache_t;
+
+/* a decompressed vis row held by the row cache */
+typedef struct visrow_s
+{
+	int key; /* cluster * 2 + vis, -1 while unused */
+	byte *bits;
+	struct visrow_s *prev, *next;
+} visrow_t;
+
+/* sides clipped per call of the side kernels */
+#define CM_SIDE_BATCH 16
+
 byte *cmod_base;
 byte map_visibility[MAX_MAP_VISIBILITY];
 byte pvsrow[MAX_MAP_LEAFS / 8];
 byte phsrow[MAX_MAP_LEAFS / 8];
+byte novisrow[MAX_MAP_LEAFS / 8];
 carea_t map_areas[MAX_MAP_AREAS];
 cbrush_t map_brushes[MAX_MAP_BRUSHES];
 cbrushside_t map_brushsides[MAX_MAP_BRUSHSIDES];
@@ -80,17 +136,14 @@ cmodel_t map_cmodels[MAX_MAP_MODELS];
 cnode_t map_nodes[MAX_MAP_NODES + 6]; /* extra for box hull */
 cplane_t *box_planes;
 cplane_t map_planes[MAX_MAP_PLANES + 6]; /* extra for box hull */
+cvar_t *cm_tracecache;
+cvar_t *cm_vismatrix;
 cvar_t *map_noareas;
 dareaportal_t map_areaportals[MAX_MAP_AREAPORTALS];
 dvis_t *map_vis = (dvis_t *)map_visibility;
 int box_headnode;
-int checkcount;
 int emptyleaf, solidleaf;
 int floodvalid;
-float *leaf_mins, *leaf_maxs;
-int leaf_count, leaf_maxcount;
-int *leaf_list;
-int leaf_topnode;
 int numareaportals;
 int numareas = 1;
 int numbrushes;
@@ -104,20 +157,39 @@ int numnodes;
 int numplanes;
 int numtexinfo;
 int numvisibility;
-int trace_contents;
 mapsurface_t map_surfaces[MAX_MAP_TEXINFO];
 mapsurface_t nullsurface;
 qboolean portalopen[MAX_MAP_AREAPORTALS];
-qboolean trace_ispoint; /* optimized case */
-trace_t trace_trace;
 unsigned short map_leafbrushes[MAX_MAP_LEAFBRUSHES];
-vec3_t trace_start, trace_end;
-vec3_t trace_mins, trace_maxs;
-vec3_t trace_extents;
+
+/* the planes of map_brushsides split by component, for the side kernels */
+float map_sidenormals[3][MAX_MAP_BRUSHSIDES];
+float map_sidedists[MAX_MAP_BRUSHSIDES];
+
+/* decompressed vis rows, map_visstride bytes per cluster */
+byte *map_pvsmatrix;
+byte *map_phsmatrix;
+int map_visstride;
+
+/* least recently used rows for the vis kinds the matrices don't hold */
+visrow_t *map_visrows;
+visrow_t map_visrowlru;
+byte *map_visrowbits;
+int *map_visrowslots;
+
+static void CM_FreeVisMatrix(void);
+static void CM_BuildVisMatrix(void);
+
+tracecache_t map_tracecache[TRACE_CACHE_SIZE];
+SDL_SpinLock map_tracecachelocks[TRACE_CACHE_SIZE];
+int map_tracegeneration;
 
 #ifndef DEDICATED_ONLY
 int c_pointcontents;
 int c_traces, c_brush_traces;
+int c_tracehits;
+Uint64 c_traceticks; /* only counted while showtrace is set */
+extern cvar_t *showtrace;
 #endif
 
 /* 1/32 epsilon to keep floating point happy */
@@ -300,6 +372,21 @@ qboolean CM_HeadnodeVisible(int nodenum, byte *visbits)
 	return CM_HeadnodeVisible(node->children[1], visbits);
 }
 
+static void CM_SetSidePlanes(int first, int count)
+{
+	int i;
+	cplane_t *plane;
+
+	for (i = first; i < first + count; i++)
+	{
+		plane = map_brushsides[i].plane;
+		map_sidenormals[0][i] = plane->normal[0];
+		map_sidenormals[1][i] = plane->normal[1];
+		map_sidenormals[2][i] = plane->normal[2];
+		map_sidedists[i] = plane->dist;
+	}
+}
+
 /*
  * Set up the planes and nodes so that the six floats of a bounding box
  * can just be stored out and get a proper clipping hull structure.
@@ -372,6 +459,8 @@ void CM_InitBoxHull(void)
 		VectorClear(p->normal);
 		p->normal[i >> 1] = -1;
 	}
+
+	CM_SetSidePlanes(numbrushsides, 6);
 }
 
 /*
@@ -393,6 +482,8 @@ int CM_HeadnodeForBox(vec3_t mins, vec3_t maxs)
 	box_planes[10].dist = mins[2];
 	box_planes[11].dist = -mins[2];
 
+	CM_SetSidePlanes(box_brush->firstbrushside, 6);
+
 	return box_headnode;
 }
 
@@ -447,7 +538,16 @@ int CM_PointLeafnum(vec3_t p)
  * Fills in a list of all the leafs touched
  */
 
-void CM_BoxLeafnums_r(int nodenum)
+/* state of a leaf search, on the stack so that searches are reentrant */
+typedef struct
+{
+	float *mins, *maxs;
+	int count, maxcount;
+	int *list;
+	int topnode;
+} boxleafs_t;
+
+static void CM_BoxLeafnums_r(boxleafs_t *bl, int nodenum)
 {
 	cplane_t *plane;
 	cnode_t *node;
@@ -457,18 +557,18 @@ void CM_BoxLeafnums_r(int nodenum)
 	{
 		if (nodenum < 0)
 		{
-			if (leaf_count >= leaf_maxcount)
+			if (bl->count >= bl->maxcount)
 			{
 				return;
 			}
 
-			leaf_list[leaf_count++] = -1 - nodenum;
+			bl->list[bl->count++] = -1 - nodenum;
 			return;
 		}
 
 		node = &map_nodes[nodenum];
 		plane = node->plane;
-		s = BOX_ON_PLANE_SIDE(leaf_mins, leaf_maxs, plane);
+		s = BOX_ON_PLANE_SIDE(bl->mins, bl->maxs, plane);
 
 		if (s == 1)
 		{
@@ -482,12 +582,12 @@ void CM_BoxLeafnums_r(int nodenum)
 		else
 		{
 			/* go down both */
-			if (leaf_topnode == -1)
+			if (bl->topnode == -1)
 			{
-				leaf_topnode = nodenum;
+				bl->topnode = nodenum;
 			}
 
-			CM_BoxLeafnums_r(node->children[0]);
+			CM_BoxLeafnums_r(bl, node->children[0]);
 			nodenum = node->children[1];
 		}
 	}
@@ -495,22 +595,24 @@ void CM_BoxLeafnums_r(int nodenum)
 
 int CM_BoxLeafnums_headnode(vec3_t mins, vec3_t maxs, int *list, int listsize, int headnode, int *topnode)
 {
-	leaf_list = list;
-	leaf_count = 0;
-	leaf_maxcount = listsize;
-	leaf_mins = mins;
-	leaf_maxs = maxs;
+	boxleafs_t bl;
+
+	bl.list = list;
+	bl.count = 0;
+	bl.maxcount = listsize;
+	bl.mins = mins;
+	bl.maxs = maxs;
 
-	leaf_topnode = -1;
+	bl.topnode = -1;
 
-	CM_BoxLeafnums_r(headnode);
+	CM_BoxLeafnums_r(&bl, headnode);
 
 	if (topnode)
 	{
-		*topnode = leaf_topnode;
+		*topnode = bl.topnode;
 	}
 
-	return leaf_count;
+	return bl.count;
 }
 
 int CM_BoxLeafnums(vec3_t mins, vec3_t maxs, int *list, int listsize, int *topnode)
@@ -564,17 +666,147 @@ int CM_TransformedPointContents(vec3_t p, int headnode, vec3_t origin, vec3_t an
 	return map_leafs[l].contents;
 }
 
-void CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2, trace_t *trace, cbrush_t *brush)
+/*
+ * Remembers the brushes a trace already went through, so that brushes
+ * spanning several leafs are only clipped once. Clipping a brush again
+ * doesn't change the result, so a slot taken over by another brush
+ * only costs the repeated work.
+ */
+static qboolean CM_BrushChecked(tracework_t *tw, int brushnum)
 {
-	int i, j;
-	cplane_t *plane, *clipplane;
+	unsigned short *slot = &tw->checked[brushnum & (TRACE_CHECKED - 1)];
+
+	if (*slot == brushnum + 1)
+	{
+		return true;
+	}
+
+	*slot = brushnum + 1;
+	return false;
+}
+
+/*
+ * Distances of the trace end points to count brush sides, with the
+ * planes pushed out for the box of the trace.
+ */
+static void CM_SideDistancesReference(const tracework_t *tw, int first, int count, float *d1, float *d2)
+{
+	int i;
+	float nx, ny, nz;
 	float dist;
+
+	for (i = 0; i < count; i++)
+	{
+		nx = tw->sidenormals[0][first + i];
+		ny = tw->sidenormals[1][first + i];
+		nz = tw->sidenormals[2][first + i];
+		dist = tw->sidedists[first + i];
+
+		if (!tw->ispoint)
+		{
+			dist -= (nx < 0 ? tw->maxs[0] : tw->mins[0]) * nx +
+			        (ny < 0 ? tw->maxs[1] : tw->mins[1]) * ny +
+			        (nz < 0 ? tw->maxs[2] : tw->mins[2]) * nz;
+		}
+
+		d1[i] = (tw->start[0] * nx + tw->start[1] * ny + tw->start[2] * nz) - dist;
+		d2[i] = (tw->end[0] * nx + tw->end[1] * ny + tw->end[2] * nz) - dist;
+	}
+}
+
+#if defined(CM_SIDES_SSE2)
+static void CM_SideDistancesSSE2(const tracework_t *tw, int first, int count, float *d1, float *d2)
+{
+	__m128 zero = _mm_setzero_ps();
+	__m128 minx = _mm_set1_ps(tw->mins[0]), miny = _mm_set1_ps(tw->mins[1]), minz = _mm_set1_ps(tw->mins[2]);
+	__m128 maxx = _mm_set1_ps(tw->maxs[0]), maxy = _mm_set1_ps(tw->maxs[1]), maxz = _mm_set1_ps(tw->maxs[2]);
+	__m128 sx = _mm_set1_ps(tw->start[0]), sy = _mm_set1_ps(tw->start[1]), sz = _mm_set1_ps(tw->start[2]);
+	__m128 ex = _mm_set1_ps(tw->end[0]), ey = _mm_set1_ps(tw->end[1]), ez = _mm_set1_ps(tw->end[2]);
+	__m128 nx, ny, nz, dist, ox, oy, oz, m;
+	int i;
+
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		nx = _mm_loadu_ps(&tw->sidenormals[0][first + i]);
+		ny = _mm_loadu_ps(&tw->sidenormals[1][first + i]);
+		nz = _mm_loadu_ps(&tw->sidenormals[2][first + i]);
+		dist = _mm_loadu_ps(&tw->sidedists[first + i]);
+
+		if (!tw->ispoint)
+		{
+			m = _mm_cmplt_ps(nx, zero);
+			ox = _mm_or_ps(_mm_and_ps(m, maxx), _mm_andnot_ps(m, minx));
+			m = _mm_cmplt_ps(ny, zero);
+			oy = _mm_or_ps(_mm_and_ps(m, maxy), _mm_andnot_ps(m, miny));
+			m = _mm_cmplt_ps(nz, zero);
+			oz = _mm_or_ps(_mm_and_ps(m, maxz), _mm_andnot_ps(m, minz));
+			dist = _mm_sub_ps(dist, _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, nx), _mm_mul_ps(oy, ny)), _mm_mul_ps(oz, nz)));
+		}
+
+		_mm_storeu_ps(d1 + i, _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, nx), _mm_mul_ps(sy, ny)), _mm_mul_ps(sz, nz)), dist));
+		_mm_storeu_ps(d2 + i, _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, nx), _mm_mul_ps(ey, ny)), _mm_mul_ps(ez, nz)), dist));
+	}
+
+	CM_SideDistancesReference(tw, first + i, count - i, d1 + i, d2 + i);
+}
+#endif
+
+#if defined(CM_SIDES_NEON)
+static void CM_SideDistancesNEON(const tracework_t *tw, int first, int count, float *d1, float *d2)
+{
+	float32x4_t zero = vdupq_n_f32(0.0f);
+	float32x4_t minx = vdupq_n_f32(tw->mins[0]), miny = vdupq_n_f32(tw->mins[1]), minz = vdupq_n_f32(tw->mins[2]);
+	float32x4_t maxx = vdupq_n_f32(tw->maxs[0]), maxy = vdupq_n_f32(tw->maxs[1]), maxz = vdupq_n_f32(tw->maxs[2]);
+	float32x4_t sx = vdupq_n_f32(tw->start[0]), sy = vdupq_n_f32(tw->start[1]), sz = vdupq_n_f32(tw->start[2]);
+	float32x4_t ex = vdupq_n_f32(tw->end[0]), ey = vdupq_n_f32(tw->end[1]), ez = vdupq_n_f32(tw->end[2]);
+	float32x4_t nx, ny, nz, dist, ox, oy, oz;
+	int i;
+
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		nx = vld1q_f32(&tw->sidenormals[0][first + i]);
+		ny = vld1q_f32(&tw->sidenormals[1][first + i]);
+		nz = vld1q_f32(&tw->sidenormals[2][first + i]);
+		dist = vld1q_f32(&tw->sidedists[first + i]);
+
+		if (!tw->ispoint)
+		{
+			ox = vbslq_f32(vcltq_f32(nx, zero), maxx, minx);
+			oy = vbslq_f32(vcltq_f32(ny, zero), maxy, miny);
+			oz = vbslq_f32(vcltq_f32(nz, zero), maxz, minz);
+			dist = vsubq_f32(dist, vaddq_f32(vaddq_f32(vmulq_f32(ox, nx), vmulq_f32(oy, ny)), vmulq_f32(oz, nz)));
+		}
+
+		vst1q_f32(d1 + i, vsubq_f32(vaddq_f32(vaddq_f32(vmulq_f32(sx, nx), vmulq_f32(sy, ny)), vmulq_f32(sz, nz)), dist));
+		vst1q_f32(d2 + i, vsubq_f32(vaddq_f32(vaddq_f32(vmulq_f32(ex, nx), vmulq_f32(ey, ny)), vmulq_f32(ez, nz)), dist));
+	}
+
+	CM_SideDistancesReference(tw, first + i, count - i, d1 + i, d2 + i);
+}
+#endif
+
+static void CM_SideDistances(const tracework_t *tw, int first, int count, float *d1, float *d2)
+{
+	#if defined(CM_SIDES_SSE2)
+	CM_SideDistancesSSE2(tw, first, count, d1, d2);
+	#elif defined(CM_SIDES_NEON)
+	CM_SideDistancesNEON(tw, first, count, d1, d2);
+	#else
+	CM_SideDistancesReference(tw, first, count, d1, d2);
+	#endif
+}
+
+static void CM_ClipBoxToBrush(tracework_t *tw, cbrush_t *brush)
+{
+	int i, base, count;
+	cplane_t *clipplane;
 	float enterfrac, leavefrac;
-	vec3_t ofs;
+	float d1s[CM_SIDE_BATCH], d2s[CM_SIDE_BATCH];
 	float d1, d2;
 	qboolean getout, startout;
 	float f;
 	cbrushside_t *side, *leadside;
+	trace_t *trace = &tw->trace;
 
 	enterfrac = -1;
 	leavefrac = 1;
@@ -593,82 +825,66 @@ void CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2, trace_t *
 	startout = false;
 	leadside = NULL;
 
-	for (i = 0; i < brush->numsides; i++)
+	for (base = 0; base < brush->numsides; base += CM_SIDE_BATCH)
 	{
-		side = &map_brushsides[brush->firstbrushside + i];
-		plane = side->plane;
+		count = brush->numsides - base;
 
-		if (!trace_ispoint)
+		if (count > CM_SIDE_BATCH)
 		{
-			/* general box case
-			   push the plane out
-			   apropriately for mins/maxs */
-			for (j = 0; j < 3; j++)
-			{
-				if (plane->normal[j] < 0)
-				{
-					ofs[j] = maxs[j];
-				}
-				else
-				{
-					ofs[j] = mins[j];
-				}
-			}
-
-			dist = DotProduct(ofs, plane->normal);
-			dist = plane->dist - dist;
-		}
-		else
-		{
-			/* special point case */
-			dist = plane->dist;
+			count = CM_SIDE_BATCH;
 		}
 
-		d1 = DotProduct(p1, plane->normal) - dist;
-		d2 = DotProduct(p2, plane->normal) - dist;
+		CM_SideDistances(tw, brush->firstbrushside + base, count, d1s, d2s);
 
-		if (d2 > 0)
+		for (i = 0; i < count; i++)
 		{
-			getout = true; /* endpoint is not in solid */
-		}
+			side = &tw->sides[brush->firstbrushside + base + i];
+			d1 = d1s[i];
+			d2 = d2s[i];
 
-		if (d1 > 0)
-		{
-			startout = true;
-		}
-
-		/* if completely in front of face, no intersection */
-		if ((d1 > 0) && (d2 >= d1))
-		{
-			return;
-		}
+			if (d2 > 0)
+			{
+				getout = true; /* endpoint is not in solid */
+			}
 
-		if ((d1 <= 0) && (d2 <= 0))
-		{
-			continue;
-		}
+			if (d1 > 0)
+			{
+				startout = true;
+			}
 
-		/* crosses face */
-		if (d1 > d2)
-		{
-			/* enter */
-			f = (d1 - DIST_EPSILON) / (d1 - d2);
+			/* if completely in front of face, no intersection */
+			if ((d1 > 0) && (d2 >= d1))
+			{
+				return;
+			}
 
-			if (f > enterfrac)
+			if ((d1 <= 0) && (d2 <= 0))
 			{
-				enterfrac = f;
-				clipplane = plane;
-				leadside = side;
+				continue;
 			}
-		}
-		else
-		{
-			/* leave */
-			f = (d1 + DIST_EPSILON) / (d1 - d2);
 
-			if (f < leavefrac)
+			/* crosses face */
+			if (d1 > d2)
+			{
+				/* enter */
+				f = (d1 - DIST_EPSILON) / (d1 - d2);
+
+				if (f > enterfrac)
+				{
+					enterfrac = f;
+					clipplane = side->plane;
+					leadside = side;
+				}
+			}
+			else
 			{
-				leavefrac = f;
+				/* leave */
+				f = (d1 + DIST_EPSILON) / (d1 - d2);
+
+				if (f < leavefrac)
+				{
+					leavefrac = f;
+				}
 			}
 		}
 	}
@@ -708,49 +924,36 @@ void CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2, trace_t *
 	}
 }
 
-void CM_TestBoxInBrush(vec3_t mins, vec3_t maxs, vec3_t p1, trace_t *trace, cbrush_t *brush)
+static void CM_TestBoxInBrush(tracework_t *tw, cbrush_t *brush)
 {
-	int i, j;
-	cplane_t *plane;
-	float dist;
-	vec3_t ofs;
-	float d1;
-	cbrushside_t *side;
+	int i, base, count;
+	float d1s[CM_SIDE_BATCH], d2s[CM_SIDE_BATCH];
+	trace_t *trace = &tw->trace;
 
 	if (!brush->numsides)
 	{
 		return;
 	}
 
-	for (i = 0; i < brush->numsides; i++)
+	/* the end point is the start point, so only d1 matters */
+	for (base = 0; base < brush->numsides; base += CM_SIDE_BATCH)
 	{
-		side = &map_brushsides[brush->firstbrushside + i];
-		plane = side->plane;
+		count = brush->numsides - base;
 
-		/* general box case
-		   push the plane out
-		   apropriately for mins/maxs */
-		for (j = 0; j < 3; j++)
+		if (count > CM_SIDE_BATCH)
 		{
-			if (plane->normal[j] < 0)
-			{
-				ofs[j] = maxs[j];
-			}
-			else
-			{
-				ofs[j] = mins[j];
-			}
+			count = CM_SIDE_BATCH;
 		}
 
-		dist = DotProduct(ofs, plane->normal);
-		dist = plane->dist - dist;
+		CM_SideDistances(tw, brush->firstbrushside + base, count, d1s, d2s);
 
-		d1 = DotProduct(p1, plane->normal) - dist;
-
-		/* if completely in front of face, no intersection */
-		if (d1 > 0)
+		for (i = 0; i < count; i++)
 		{
-			return;
+			/* if completely in front of face, no intersection */
+			if (d1s[i] > 0)
+			{
+				return;
+			}
 		}
 	}
 
@@ -760,7 +963,7 @@ void CM_TestBoxInBrush(vec3_t mins, vec3_t maxs, vec3_t p1, trace_t *trace, cbru
 	trace->contents = brush->contents;
 }
 
-void CM_TraceToLeaf(int leafnum)
+static void CM_TraceToLeaf(tracework_t *tw, int leafnum)
 {
 	int k;
 	int brushnum;
@@ -769,7 +972,7 @@ void CM_TraceToLeaf(int leafnum)
 
 	leaf = &map_leafs[leafnum];
 
-	if (!(leaf->contents & trace_contents))
+	if (!(leaf->contents & tw->contents))
 	{
 		return;
 	}
@@ -780,29 +983,26 @@ void CM_TraceToLeaf(int leafnum)
 		brushnum = map_leafbrushes[leaf->firstleafbrush + k];
 		b = &map_brushes[brushnum];
 
-		if (b->checkcount == checkcount)
+		if (CM_BrushChecked(tw, brushnum))
 		{
 			continue; /* already checked this brush in another leaf */
 		}
 
-		b->checkcount = checkcount;
-
-		if (!(b->contents & trace_contents))
+		if (!(b->contents & tw->contents))
 		{
 			continue;
 		}
 
-		CM_ClipBoxToBrush(trace_mins, trace_maxs, trace_start,
-			trace_end, &trace_trace, b);
+		CM_ClipBoxToBrush(tw, b);
 
-		if (!trace_trace.fraction)
+		if (!tw->trace.fraction)
 		{
 			return;
 		}
 	}
 }
 
-void CM_TestInLeaf(int leafnum)
+static void CM_TestInLeaf(tracework_t *tw, int leafnum)
 {
 	int k;
 	int brushnum;
@@ -811,7 +1011,7 @@ void CM_TestInLeaf(int leafnum)
 
 	leaf = &map_leafs[leafnum];
 
-	if (!(leaf->contents & trace_contents))
+	if (!(leaf->contents & tw->contents))
 	{
 		return;
 	}
@@ -822,28 +1022,26 @@ void CM_TestInLeaf(int leafnum)
 		brushnum = map_leafbrushes[leaf->firstleafbrush + k];
 		b = &map_brushes[brushnum];
 
-		if (b->checkcount == checkcount)
+		if (CM_BrushChecked(tw, brushnum))
 		{
 			continue; /* already checked this brush in another leaf */
 		}
 
-		b->checkcount = checkcount;
-
-		if (!(b->contents & trace_contents))
+		if (!(b->contents & tw->contents))
 		{
 			continue;
 		}
 
-		CM_TestBoxInBrush(trace_mins, trace_maxs, trace_start, &trace_trace, b);
+		CM_TestBoxInBrush(tw, b);
 
-		if (!trace_trace.fraction)
+		if (!tw->trace.fraction)
 		{
 			return;
 		}
 	}
 }
 
-void CM_RecursiveHullCheck(int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
+static void CM_RecursiveHullCheck(tracework_t *tw, int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 {
 	cnode_t *node;
 	cplane_t *plane;
@@ -855,7 +1053,7 @@ void CM_RecursiveHullCheck(int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	int side;
 	float midf;
 
-	if (trace_trace.fraction <= p1f)
+	if (tw->trace.fraction <= p1f)
 	{
 		return; /* already hit something nearer */
 	}
@@ -863,7 +1061,7 @@ void CM_RecursiveHullCheck(int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	/* if < 0, we are in a leaf node */
 	if (num < 0)
 	{
-		CM_TraceToLeaf(-1 - num);
+		CM_TraceToLeaf(tw, -1 - num);
 		return;
 	}
 
@@ -876,35 +1074,35 @@ void CM_RecursiveHullCheck(int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 	{
 		t1 = p1[plane->type] - plane->dist;
 		t2 = p2[plane->type] - plane->dist;
-		offset = trace_extents[plane->type];
+		offset = tw->extents[plane->type];
 	}
 	else
 	{
 		t1 = DotProduct(plane->normal, p1) - plane->dist;
 		t2 = DotProduct(plane->normal, p2) - plane->dist;
 
-		if (trace_ispoint)
+		if (tw->ispoint)
 		{
 			offset = 0;
 		}
 		else
 		{
-			offset = (float)fabsf(trace_extents[0] * plane->normal[0]) +
-			        (float)fabsf(trace_extents[1] * plane->normal[1]) +
-			        (float)fabsf(trace_extents[2] * plane->normal[2]);
+			offset = (float)fabsf(tw->extents[0] * plane->normal[0]) +
+			        (float)fabsf(tw->extents[1] * plane->normal[1]) +
+			        (float)fabsf(tw->extents[2] * plane->normal[2]);
 		}
 	}
 
 	/* see which sides we need to consider */
 	if ((t1 >= offset) && (t2 >= offset))
 	{
-		CM_RecursiveHullCheck(node->children[0], p1f, p2f, p1, p2);
+		CM_RecursiveHullCheck(tw, node->children[0], p1f, p2f, p1, p2);
 		return;
 	}
 
 	if ((t1 < -offset) && (t2 < -offset))
 	{
-		CM_RecursiveHullCheck(node->children[1], p1f, p2f, p1, p2);
+		CM_RecursiveHullCheck(tw, node->children[1], p1f, p2f, p1, p2);
 		return;
 	}
 
@@ -949,7 +1147,7 @@ void CM_RecursiveHullCheck(int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 		mid[i] = p1[i] + frac * (p2[i] - p1[i]);
 	}
 
-	CM_RecursiveHullCheck(node->children[side], p1f, midf, p1, mid);
+	CM_RecursiveHullCheck(tw, node->children[side], p1f, midf, p1, mid);
 
 	/* go past the node */
 	if (frac2 < 0)
@@ -969,34 +1167,26 @@ void CM_RecursiveHullCheck(int num, float p1f, float p2f, vec3_t p1, vec3_t p2)
 		mid[i] = p1[i] + frac2 * (p2[i] - p1[i]);
 	}
 
-	CM_RecursiveHullCheck(node->children[side ^ 1], midf, p2f, mid, p2);
+	CM_RecursiveHullCheck(tw, node->children[side ^ 1], midf, p2f, mid, p2);
 }
 
-trace_t CM_BoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs, int headnode, int brushmask)
+static void CM_BoxTraceWork(tracework_t *tw, vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs, int headnode, int brushmask)
 {
 	int i;
 
-	checkcount++; /* for multi-check avoidance */
-
-	#ifndef DEDICATED_ONLY
-	c_traces++; /* for statistics, may be zeroed */
-	#endif
+	memset(tw->checked, 0, sizeof(tw->checked));
 
-	/* fill in a default trace */
-	memset(&trace_trace, 0, sizeof(trace_trace));
-	trace_trace.fraction = 1;
-	trace_trace.surface = &(nullsurface.c);
+	tw->sides = map_brushsides;
+	tw->sidenormals[0] = map_sidenormals[0];
+	tw->sidenormals[1] = map_sidenormals[1];
+	tw->sidenormals[2] = map_sidenormals[2];
+	tw->sidedists = map_sidedists;
 
-	if (!numnodes) /* map not loaded */
-	{
-		return trace_trace;
-	}
-
-	trace_contents = brushmask;
-	VectorCopy(start, trace_start);
-	VectorCopy(end, trace_end);
-	VectorCopy(mins, trace_mins);
-	VectorCopy(maxs, trace_maxs);
+	tw->contents = brushmask;
+	VectorCopy(start, tw->start);
+	VectorCopy(end, tw->end);
+	VectorCopy(mins, tw->mins);
+	VectorCopy(maxs, tw->maxs);
 
 	/* check for position test special case */
 	if ((start[0] == end[0]) && (start[1] == end[1]) && (start[2] == end[2]))
@@ -1006,6 +1196,9 @@ trace_t CM_BoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs, int head
 		vec3_t c1, c2;
 		int topnode;
 
+		/* CM_TestBoxInBrush always pushes the planes out */
+		tw->ispoint = false;
+
 		VectorAdd(start, mins, c1);
 		VectorAdd(start, maxs, c2);
 
@@ -1020,50 +1213,165 @@ trace_t CM_BoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs, int head
 
 		for (i = 0; i < numleafs; i++)
 		{
-			CM_TestInLeaf(leafs[i]);
+			CM_TestInLeaf(tw, leafs[i]);
 
-			if (trace_trace.allsolid)
+			if (tw->trace.allsolid)
 			{
 				break;
 			}
 		}
 
-		VectorCopy(start, trace_trace.endpos);
-		return trace_trace;
+		VectorCopy(start, tw->trace.endpos);
+		return;
 	}
 
 	/* check for point special case */
 	if ((mins[0] == 0) && (mins[1] == 0) && (mins[2] == 0) &&
 	    (maxs[0] == 0) && (maxs[1] == 0) && (maxs[2] == 0))
 	{
-		trace_ispoint = true;
-		VectorClear(trace_extents);
+		tw->ispoint = true;
+		VectorClear(tw->extents);
 	}
 	else
 	{
-		trace_ispoint = false;
-		trace_extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
-		trace_extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
-		trace_extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
+		tw->ispoint = false;
+		tw->extents[0] = -mins[0] > maxs[0] ? -mins[0] : maxs[0];
+		tw->extents[1] = -mins[1] > maxs[1] ? -mins[1] : maxs[1];
+		tw->extents[2] = -mins[2] > maxs[2] ? -mins[2] : maxs[2];
 	}
 
 	/* general sweeping through world */
-	CM_RecursiveHullCheck(headnode, 0, 1, start, end);
+	CM_RecursiveHullCheck(tw, headnode, 0, 1, start, end);
 
-	if (trace_trace.fraction == 1)
+	if (tw->trace.fraction == 1)
 	{
-		VectorCopy(end, trace_trace.endpos);
+		VectorCopy(end, tw->trace.endpos);
 	}
 	else
 	{
 		for (i = 0; i < 3; i++)
 		{
-			trace_trace.endpos[i] = start[i] + trace_trace.fraction *
+			tw->trace.endpos[i] = start[i] + tw->trace.fraction *
 			        (end[i] - start[i]);
 		}
 	}
+}
+
+/*
+ * The trace cache keeps recent results by their exact inputs. The
+ * world and inline models don't move in their own frames, so results
+ * stay valid until the next map load; only traces against the shared
+ * box hull aren't kept.
+ */
+static unsigned CM_TraceCache_hash(const tracekey_t *key)
+{
+	const unsigned *words = (const unsigned *)key;
+	unsigned h = 2166136261u;
+	int i;
+
+	for (i = 0; i < (int)(sizeof(*key) / sizeof(unsigned)); i++)
+	{
+		h = (h ^ words[i]) * 16777619u;
+	}
+
+	return (h ^ (h >> 15)) & (TRACE_CACHE_SIZE - 1);
+}
+
+static qboolean CM_TraceCache_find(const tracekey_t *key, unsigned slot, trace_t *trace)
+{
+	tracecache_t *entry = &map_tracecache[slot];
+	qboolean found;
+
+	SDL_AtomicLock(&map_tracecachelocks[slot]);
+	found = (entry->generation == map_tracegeneration) &&
+	        !memcmp(&entry->key, key, sizeof(*key));
+
+	if (found)
+	{
+		*trace = entry->trace;
+	}
+
+	SDL_AtomicUnlock(&map_tracecachelocks[slot]);
+
+	return found;
+}
+
+static void CM_TraceCache_store(const tracekey_t *key, unsigned slot, const trace_t *trace)
+{
+	tracecache_t *entry = &map_tracecache[slot];
 
-	return trace_trace;
+	SDL_AtomicLock(&map_tracecachelocks[slot]);
+	entry->key = *key;
+	entry->generation = map_tracegeneration;
+	entry->trace = *trace;
+	SDL_AtomicUnlock(&map_tracecachelocks[slot]);
+}
+
+trace_t CM_BoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs, int headnode, int brushmask)
+{
+	tracework_t tw;
+	tracekey_t key;
+	unsigned slot = 0;
+	qboolean cached;
+
+	#ifndef DEDICATED_ONLY
+	Uint64 begin = showtrace->value ? SDL_GetPerformanceCounter() : 0;
+
+	c_traces++; /* for statistics, may be zeroed */
+	#endif
+
+	/* fill in a default trace */
+	memset(&tw.trace, 0, sizeof(tw.trace));
+	tw.trace.fraction = 1;
+	tw.trace.surface = &(nullsurface.c);
+
+	if (!numnodes) /* map not loaded */
+	{
+		return tw.trace;
+	}
+
+	cached = cm_tracecache->value && (headnode != box_headnode);
+
+	if (cached)
+	{
+		VectorCopy(start, key.start);
+		VectorCopy(end, key.end);
+		VectorCopy(mins, key.mins);
+		VectorCopy(maxs, key.maxs);
+		key.headnode = headnode;
+		key.brushmask = brushmask;
+		slot = CM_TraceCache_hash(&key);
+
+		if (CM_TraceCache_find(&key, slot, &tw.trace))
+		{
+			#ifndef DEDICATED_ONLY
+			c_tracehits++;
+
+			if (begin)
+			{
+				c_traceticks += SDL_GetPerformanceCounter() - begin;
+			}
+			#endif
+
+			return tw.trace;
+		}
+	}
+
+	CM_BoxTraceWork(&tw, start, end, mins, maxs, headnode, brushmask);
+
+	if (cached)
+	{
+		CM_TraceCache_store(&key, slot, &tw.trace);
+	}
+
+	#ifndef DEDICATED_ONLY
+	if (begin)
+	{
+		c_traceticks += SDL_GetPerformanceCounter() - begin;
+	}
+	#endif
+
+	return tw.trace;
 }
 
 /*
@@ -1130,6 +1438,85 @@ trace_t CM_TransformedBoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t max
 	return trace;
 }
 
+/*
+ * Same as CM_TransformedBoxTrace against the hull of CM_HeadnodeForBox,
+ * but the box brush is clipped directly with planes of its own instead
+ * of going through the shared box hull, so that it can run on any
+ * thread. Boxes don't rotate.
+ */
+trace_t CM_BoxTraceToBox(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs, vec3_t boxmins, vec3_t boxmaxs, int brushmask, vec3_t origin)
+{
+	tracework_t tw;
+	cplane_t planes[6];
+	cbrushside_t sides[6];
+	float normals[3][6], dists[6];
+	cbrush_t brush;
+	int i, axis;
+
+	#ifndef DEDICATED_ONLY
+	c_traces++;
+	#endif
+
+	memset(&tw.trace, 0, sizeof(tw.trace));
+	tw.trace.fraction = 1;
+	tw.trace.surface = &(nullsurface.c);
+
+	/* the sides of box_brush, in the same order */
+	for (i = 0; i < 6; i++)
+	{
+		axis = i >> 1;
+		memset(&planes[i], 0, sizeof(planes[i]));
+		planes[i].normal[axis] = (i & 1) ? -1 : 1;
+		planes[i].dist = (i & 1) ? -boxmins[axis] : boxmaxs[axis];
+		planes[i].type = (i & 1) ? 3 + axis : axis;
+
+		sides[i].plane = &planes[i];
+		sides[i].surface = &nullsurface;
+
+		normals[0][i] = planes[i].normal[0];
+		normals[1][i] = planes[i].normal[1];
+		normals[2][i] = planes[i].normal[2];
+		dists[i] = planes[i].dist;
+	}
+
+	brush.contents = CONTENTS_MONSTER;
+	brush.numsides = 6;
+	brush.firstbrushside = 0;
+
+	tw.sides = sides;
+	tw.sidenormals[0] = normals[0];
+	tw.sidenormals[1] = normals[1];
+	tw.sidenormals[2] = normals[2];
+	tw.sidedists = dists;
+
+	tw.contents = brushmask;
+	VectorSubtract(start, origin, tw.start);
+	VectorSubtract(end, origin, tw.end);
+	VectorCopy(mins, tw.mins);
+	VectorCopy(maxs, tw.maxs);
+
+	if (brushmask & brush.contents)
+	{
+		if ((start[0] == end[0]) && (start[1] == end[1]) && (start[2] == end[2]))
+		{
+			tw.ispoint = false;
+			CM_TestBoxInBrush(&tw, &brush);
+		}
+		else
+		{
+			tw.ispoint = (mins[0] == 0) && (mins[1] == 0) && (mins[2] == 0) &&
+			             (maxs[0] == 0) && (maxs[1] == 0) && (maxs[2] == 0);
+			CM_ClipBoxToBrush(&tw, &brush);
+		}
+	}
+
+	tw.trace.endpos[0] = start[0] + tw.trace.fraction * (end[0] - start[0]);
+	tw.trace.endpos[1] = start[1] + tw.trace.fraction * (end[1] - start[1]);
+	tw.trace.endpos[2] = start[2] + tw.trace.fraction * (end[2] - start[2]);
+
+	return tw.trace;
+}
+
 void CMod_LoadSubmodels(lump_t *l)
 {
 	dmodel_t *in;
@@ -1478,6 +1865,8 @@ void CMod_LoadBrushSides(lump_t *l)
 
 		out->surface = &map_surfaces[j];
 	}
+
+	CM_SetSidePlanes(0, numbrushsides);
 }
 
 void CMod_LoadAreas(lump_t *l)
@@ -1577,6 +1966,8 @@ cmodel_t* CM_LoadMap(char *name, qboolean clientload, unsigned *checksum)
 	static unsigned last_checksum;
 
 	map_noareas = Cvar_Get("map_noareas", "0", 0);
+	cm_tracecache = Cvar_Get("cm_tracecache", "1", CVAR_ARCHIVE);
+	cm_vismatrix = Cvar_Get("cm_vismatrix", "8192", CVAR_ARCHIVE);
 
 	if (name != NULL && !strcmp(map_name, name) && (clientload || !Cvar_VariableValue("flushmap")))
 	{
@@ -1592,11 +1983,13 @@ cmodel_t* CM_LoadMap(char *name, qboolean clientload, unsigned *checksum)
 	}
 
 	/* free old stuff */
+	map_tracegeneration++;
 	numplanes = 0;
 	numnodes = 0;
 	numleafs = 0;
 	numcmodels = 0;
 	numvisibility = 0;
+	CM_FreeVisMatrix();
 	numentitychars = 0;
 	map_entitystring[0] = 0;
 	map_name[0] = 0;
@@ -1610,7 +2003,7 @@ cmodel_t* CM_LoadMap(char *name, qboolean clientload, unsigned *checksum)
 		return &map_cmodels[0]; /* cinematic servers won't have anything at all */
 	}
 
-	length = FS_LoadFile(name, (void **)&buf);
+	length = FS_MapFile(name, (void **)&buf);
 
 	if (!buf)
 	{
@@ -1652,6 +2045,8 @@ cmodel_t* CM_LoadMap(char *name, qboolean clientload, unsigned *checksum)
 
 	FS_FreeFile(buf);
 
+	CM_BuildVisMatrix();
+
 	CM_InitBoxHull();
 
 	memset(portalopen, 0, sizeof(portalopen));
@@ -1773,32 +2168,325 @@ void CM_DecompressVis(byte *in, byte *out)
 	while (out_p - out < row);
 }
 
-byte* CM_ClusterPVS(int cluster)
+static void CM_FreeVisMatrix(void)
 {
-	if (cluster == -1)
+	if (map_pvsmatrix)
+	{
+		Z_Free(map_pvsmatrix);
+	}
+
+	if (map_phsmatrix)
+	{
+		Z_Free(map_phsmatrix);
+	}
+
+	if (map_visrows)
+	{
+		Z_Free(map_visrows);
+		Z_Free(map_visrowbits);
+		Z_Free(map_visrowslots);
+	}
+
+	map_pvsmatrix = NULL;
+	map_phsmatrix = NULL;
+	map_visrows = NULL;
+	map_visrowbits = NULL;
+	map_visrowslots = NULL;
+	map_visstride = 0;
+}
+
+/*
+ * qvis always writes a PHS, but some compilers leave the
+ * offsets zeroed or pointing outside of the lump
+ */
+static qboolean CM_HasPHS(void)
+{
+	int i;
+	int ofs;
+
+	for (i = 0; i < numclusters; i++)
+	{
+		ofs = LittleLong(map_vis->bitofs[i][DVIS_PHS]);
+
+		if ((ofs < (int)sizeof(map_vis->bitofs[0]) * numclusters) ||
+			(ofs >= numvisibility))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Builds the PHS the way qvis does: every cluster that is
+ * potentially visible from a cluster of the PVS can be heard
+ */
+static void CM_CalcPHS(const byte *pvs, byte *phs)
+{
+	int i, j, k;
+	int ints;
+	const byte *row;
+	const int *src;
+	int *dest;
+
+	ints = map_visstride >> 2;
+
+	for (i = 0; i < numclusters; i++)
+	{
+		row = pvs + i * map_visstride;
+		dest = (int *)(phs + i * map_visstride);
+
+		memcpy(dest, row, map_visstride);
+
+		for (j = 0; j < numclusters; j++)
+		{
+			if (!(row[j >> 3] & (1 << (j & 7))))
+			{
+				continue;
+			}
+
+			src = (const int *)(pvs + j * map_visstride);
+
+			for (k = 0; k < ints; k++)
+			{
+				dest[k] |= src[k];
+			}
+		}
+	}
+}
+
+/*
+ * Decompresses every PVS and PHS row up front when they fit in
+ * cm_vismatrix kilobytes. Larger maps keep what is left of the
+ * budget as a cache of the most recently used rows.
+ */
+static void CM_BuildVisMatrix(void)
+{
+	int i;
+	int size, budget, count;
+	qboolean hasphs;
+	byte *pvs;
+
+	CM_FreeVisMatrix();
+
+	if (!numvisibility || (numclusters < 1) ||
+		(map_vis->numclusters < numclusters))
 	{
-		memset(pvsrow, 0, (numclusters + 7) >> 3);
+		return;
+	}
+
+	/* rows are padded to ints so they can be ORed together */
+	map_visstride = ((numclusters + 31) >> 5) << 2;
+	size = numclusters * map_visstride;
+	budget = cm_vismatrix->value > 0 ? (int)(cm_vismatrix->value * 1024) : 0;
+	hasphs = CM_HasPHS();
+
+	if ((size * 2 <= budget) || !hasphs)
+	{
+		pvs = Z_Malloc(size);
+
+		for (i = 0; i < numclusters; i++)
+		{
+			CM_DecompressVis(map_visibility +
+				LittleLong(map_vis->bitofs[i][DVIS_PVS]),
+				pvs + i * map_visstride);
+		}
+
+		map_phsmatrix = Z_Malloc(size);
+
+		if (hasphs)
+		{
+			for (i = 0; i < numclusters; i++)
+			{
+				CM_DecompressVis(map_visibility +
+					LittleLong(map_vis->bitofs[i][DVIS_PHS]),
+					map_phsmatrix + i * map_visstride);
+			}
+		}
+		else
+		{
+			Com_DPrintf("CM_BuildVisMatrix: map has no PHS, building it\n");
+			CM_CalcPHS(pvs, map_phsmatrix);
+		}
+
+		if (size * 2 <= budget)
+		{
+			map_pvsmatrix = pvs;
+			Com_DPrintf("CM_BuildVisMatrix: %i clusters, %i KB\n",
+				numclusters, (size * 2) >> 10);
+			return;
+		}
+
+		/* only needed the PVS to build the PHS */
+		Z_Free(pvs);
+		budget -= size;
+	}
+
+	count = budget / map_visstride;
+
+	if (count > numclusters * 2)
+	{
+		count = numclusters * 2;
+	}
+
+	if (count < 1)
+	{
+		return;
+	}
+
+	map_visrows = Z_Malloc(count * sizeof(visrow_t));
+	map_visrowbits = Z_Malloc(count * map_visstride);
+	map_visrowslots = Z_Malloc(numclusters * 2 * sizeof(int));
+
+	for (i = 0; i < numclusters * 2; i++)
+	{
+		map_visrowslots[i] = -1;
+	}
+
+	map_visrowlru.next = map_visrowlru.prev = &map_visrowlru;
+
+	for (i = 0; i < count; i++)
+	{
+		map_visrows[i].key = -1;
+		map_visrows[i].bits = map_visrowbits + i * map_visstride;
+		map_visrows[i].prev = &map_visrowlru;
+		map_visrows[i].next = map_visrowlru.next;
+		map_visrowlru.next->prev = &map_visrows[i];
+		map_visrowlru.next = &map_visrows[i];
+	}
+
+	Com_DPrintf("CM_BuildVisMatrix: %i clusters, caching %i rows\n",
+		numclusters, count);
+}
+
+/*
+ * Returns the row from the row cache, decompressing it over the
+ * least recently used one on a miss. Not thread safe.
+ */
+static byte* CM_CachedVisRow(int cluster, int vis)
+{
+	int key;
+	visrow_t *row;
+
+	key = cluster * 2 + vis;
+
+	if (map_visrowslots[key] >= 0)
+	{
+		row = &map_visrows[map_visrowslots[key]];
 	}
 	else
 	{
+		row = map_visrowlru.prev;
+
+		if (row->key >= 0)
+		{
+			map_visrowslots[row->key] = -1;
+		}
+
+		row->key = key;
+		map_visrowslots[key] = (int)(row - map_visrows);
+
 		CM_DecompressVis(map_visibility +
-			LittleLong(map_vis->bitofs[cluster][DVIS_PVS]), pvsrow);
+			LittleLong(map_vis->bitofs[cluster][vis]), row->bits);
 	}
 
-	return pvsrow;
+	/* move to the front */
+	row->prev->next = row->next;
+	row->next->prev = row->prev;
+	row->prev = &map_visrowlru;
+	row->next = map_visrowlru.next;
+	map_visrowlru.next->prev = row;
+	map_visrowlru.next = row;
+
+	return row->bits;
 }
 
-byte* CM_ClusterPHS(int cluster)
+/*
+ * Returns the decompressed PVS (DVIS_PVS) or PHS (DVIS_PHS) row of a
+ * cluster if the vis matrix holds it, NULL otherwise. The row must
+ * not be written to. Can be called from several threads.
+ */
+byte* CM_ClusterVisRow(int cluster, int vis)
 {
+	byte *matrix;
+
 	if (cluster == -1)
 	{
-		memset(phsrow, 0, (numclusters + 7) >> 3);
+		return novisrow;
+	}
+
+	matrix = (vis == DVIS_PHS) ? map_phsmatrix : map_pvsmatrix;
+
+	if (!matrix)
+	{
+		return NULL;
+	}
+
+	return matrix + cluster * map_visstride;
+}
+
+/*
+ * Decompresses the PVS (DVIS_PVS) or PHS (DVIS_PHS) row of a cluster
+ * into out, which must hold (CM_NumClusters() + 7) >> 3 bytes.
+ * Unlike CM_ClusterPVS and CM_ClusterPHS, it can be called from
+ * several threads.
+ */
+void CM_ClusterVis(int cluster, int vis, byte *out)
+{
+	byte *row;
+
+	row = CM_ClusterVisRow(cluster, vis);
+
+	if (row)
+	{
+		memcpy(out, row, (numclusters + 7) >> 3);
 	}
 	else
 	{
 		CM_DecompressVis(map_visibility +
-			LittleLong(map_vis->bitofs[cluster][DVIS_PHS]), phsrow);
+			LittleLong(map_vis->bitofs[cluster][vis]), out);
+	}
+}
+
+byte* CM_ClusterPVS(int cluster)
+{
+	byte *row;
+
+	row = CM_ClusterVisRow(cluster, DVIS_PVS);
+
+	if (row)
+	{
+		return row;
 	}
 
+	if (map_visrows)
+	{
+		return CM_CachedVisRow(cluster, DVIS_PVS);
+	}
+
+	CM_ClusterVis(cluster, DVIS_PVS, pvsrow);
+
+	return pvsrow;
+}
+
+byte* CM_ClusterPHS(int cluster)
+{
+	byte *row;
+
+	row = CM_ClusterVisRow(cluster, DVIS_PHS);
+
+	if (row)
+	{
+		return row;
+	}
+
+	if (map_visrows)
+	{
+		return CM_CachedVisRow(cluster, DVIS_PHS);
+	}
+
+	CM_ClusterVis(cluster, DVIS_PHS, phsrow);
+
 	return phsrow;
 }
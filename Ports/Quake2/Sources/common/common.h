@@ -31,6 +31,7 @@
 
 #include "common/crc.h"
 #include "common/shared/shared.h"
+#include <stddef.h>
 
 /* Should have 4 characters. */
 #define QUAKE2_VERSION_NAME "1.1"
@@ -74,6 +75,36 @@ void SZ_Print(sizebuf_t *buf, char *data); /* strcats onto the sizebuf */
 
 /* ================================================================== */
 
+/* REGISTRY - name lookup of the images, models and sounds
+ *
+ * The nodes are embedded in the registered structures and point
+ * to their names, so registering never allocates. Whoever clears
+ * or overwrites a name must remove its node first. */
+
+#define REGISTRY_BUCKETS 1024 /* must be a power of 2 */
+
+typedef struct registrynode_s
+{
+	struct registrynode_s *next;
+	unsigned hash;
+	const char *name;
+} registrynode_t;
+
+typedef struct
+{
+	registrynode_t *buckets[REGISTRY_BUCKETS];
+	int count;
+} registry_t;
+
+#define REGISTRY_ENTRY(node, type, member) ((type *)((byte *)(node) - offsetof(type, member)))
+
+void Registry_Clear(registry_t *registry);
+void Registry_Add(registry_t *registry, registrynode_t *node, const char *name);
+void Registry_Remove(registry_t *registry, registrynode_t *node);
+registrynode_t* Registry_Find(registry_t *registry, const char *name);
+
+/* ================================================================== */
+
 struct usercmd_s;
 struct entity_state_s;
 
@@ -511,13 +542,15 @@ void NET_Config(qboolean multiplayer);
 
 qboolean NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message);
 void NET_SendPacket(netsrc_t sock, int length, void *data, netadr_t to);
+void NET_BeginBatch(void); /* queue the sent packets */
+void NET_EndBatch(void); /* send the queued packets */
 
 qboolean NET_CompareAdr(netadr_t a, netadr_t b);
 qboolean NET_CompareBaseAdr(netadr_t a, netadr_t b);
 qboolean NET_IsLocalAddress(netadr_t adr);
 char* NET_AdrToString(netadr_t a);
 qboolean NET_StringToAdr(char *s, netadr_t *a);
-void NET_Sleep(int msec);
+void NET_SleepUntil(long long deadline); /* Sys_Microseconds time */
 
 /*=================================================================== */
 
@@ -593,9 +626,12 @@ int CM_TransformedPointContents(vec3_t p, int headnode, vec3_t origin, vec3_t an
 
 trace_t CM_BoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs, int headnode, int brushmask);
 trace_t CM_TransformedBoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs, int headnode, int brushmask, vec3_t origin, vec3_t angles);
+trace_t CM_BoxTraceToBox(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs, vec3_t boxmins, vec3_t boxmaxs, int brushmask, vec3_t origin);
 
 byte* CM_ClusterPVS(int cluster);
 byte* CM_ClusterPHS(int cluster);
+void CM_ClusterVis(int cluster, int vis, byte *out);
+byte* CM_ClusterVisRow(int cluster, int vis);
 
 int CM_PointLeafnum(vec3_t p);
 
@@ -671,6 +707,9 @@ int FS_LoadFile(char *path, void **buffer);
 
 /* properly handles partial reads */
 
+/* like FS_LoadFile, but may return a read-only view into a mapped pack */
+int FS_MapFile(char *path, void **buffer);
+
 void FS_FreeFile(void *buffer);
 qboolean FS_CreatePath(char *path);
 
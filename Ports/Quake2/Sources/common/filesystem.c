@@ -40,6 +40,7 @@
 
 #define MAX_HANDLES 512
 #define MAX_PAKS 100
+#define MAX_PK3_HANDLES 4 /* Idle unzip handles kept per PK3. */
 
 typedef struct
 {
@@ -49,6 +50,10 @@ typedef struct
 	#ifdef ZIP
 	unzFile *zip; /* (file or zip) */
 	#endif
+	const byte *mapped; /* (or a view into a mapped pack) */
+	int mappedSize;
+	int mappedPos;
+	struct fsPack_s *pack; /* Pack the file was opened from, if any. */
 } fsHandle_t;
 
 typedef struct fsLink_s
@@ -63,17 +68,24 @@ typedef struct
 {
 	char name[MAX_QPATH];
 	int size;
-	int offset; /* Ignored in PK3 files. */
+	int offset; /* In PK3 files only set for stored entries, else -1. */
+	#ifdef ZIP
+	unz_file_pos zipPos; /* Central directory entry in PK3 files. */
+	#endif
 } fsPackFile_t;
 
-typedef struct
+typedef struct fsPack_s
 {
 	char name[MAX_OSPATH];
 	int numFiles;
 	FILE *pak;
 	#ifdef ZIP
 	unzFile *pk3;
+	unzFile *zipPool[MAX_PK3_HANDLES]; /* Idle handles for reading. */
+	int numZipPool;
 	#endif
+	byte *mapped; /* Whole PAK mapped read-only, NULL if not mappable. */
+	int mappedSize;
 	fsPackFile_t *files;
 } fsPack_t;
 
@@ -127,6 +139,31 @@ int file_from_pk3 = 0;
 char file_from_pk3_name[MAX_QPATH];
 #endif
 
+/* Hashed index of every file reachable through the search path. Built
+   lazily by FS_BuildIndex() and invalidated whenever the path changes. */
+#define FS_INDEX_MAX_DEPTH 8
+
+typedef struct
+{
+	char *name; /* Pack: points into pack->files. Loose: Z_Malloc'ed. */
+	fsSearchPath_t *search; /* Winning search path. */
+	int fileIndex; /* Index in search->pack->files, -1 for loose files. */
+	int next; /* Next entry in the bucket, -1 terminates the chain. */
+} fsIndexEntry_t;
+
+static fsIndexEntry_t *fs_indexEntries;
+static int fs_indexNumEntries;
+static int fs_indexMaxEntries;
+static int *fs_indexBuckets;
+static int fs_indexNumBuckets; /* Always a power of two. */
+static qboolean fs_indexDirty = true;
+
+static int fs_indexLookups;
+static int fs_indexMisses;
+static int fs_indexFallbacks;
+static int fs_indexBuilds;
+static int fs_indexBuildTime;
+
 cvar_t *fs_homepath;
 cvar_t *fs_basedir;
 cvar_t *fs_cddir;
@@ -280,7 +317,7 @@ fsHandle_t* FS_HandleForFile(const char *path, fileHandle_t *f)
 		    #ifdef ZIP
 		    && (handle->zip == NULL)
 		    #endif
-		    )
+		    && (handle->mapped == NULL))
 		{
 			Q_strlcpy(handle->name, path, sizeof(handle->name));
 			*f = i + 1;
@@ -375,10 +412,16 @@ void FS_FCloseFile(fileHandle_t f)
 	if (handle->zip)
 	{
 		unzCloseCurrentFile(handle->zip);
-		unzClose(handle->zip);
+
+		/* Keep it around for the next file from this pack. */
+		if (handle->pack && (handle->pack->numZipPool < MAX_PK3_HANDLES))
+			handle->pack->zipPool[handle->pack->numZipPool++] = handle->zip;
+		else
+			unzClose(handle->zip);
 	}
 	#endif
 
+	/* Mapped views belong to their pack, nothing to release. */
 	memset(handle, 0, sizeof(*handle));
 }
 
@@ -395,16 +438,350 @@ int Developer_searchpath(int who)
 	return 0;
 }
 
+/*
+ * Case-folded FNV-1a hash, '\\' and '/' hash the same.
+ */
+static unsigned FS_HashName(const char *name)
+{
+	unsigned hash = 2166136261u;
+
+	for ( ; *name; name++)
+	{
+		int c = *name;
+
+		if (c == '\\')
+			c = '/';
+		else if ((c >= 'A') && (c <= 'Z'))
+			c += 'a' - 'A';
+
+		hash = (hash ^ (unsigned)c) * 16777619u;
+	}
+
+	return hash;
+}
+
+static void FS_FreeIndex(void)
+{
+	for (int i = 0; i < fs_indexNumEntries; i++)
+	{
+		if (fs_indexEntries[i].fileIndex < 0)
+			Z_Free(fs_indexEntries[i].name);
+	}
+
+	if (fs_indexEntries)
+		Z_Free(fs_indexEntries);
+	if (fs_indexBuckets)
+		Z_Free(fs_indexBuckets);
+
+	fs_indexEntries = NULL;
+	fs_indexBuckets = NULL;
+	fs_indexNumEntries = fs_indexMaxEntries = fs_indexNumBuckets = 0;
+}
+
+static void FS_IndexAppend(fsSearchPath_t *search, int fileIndex, char *name)
+{
+	fsIndexEntry_t *entry;
+
+	if (fs_indexNumEntries == fs_indexMaxEntries)
+	{
+		fsIndexEntry_t *entries;
+
+		fs_indexMaxEntries = fs_indexMaxEntries ? fs_indexMaxEntries * 2 : 1024;
+		entries = Z_Malloc(fs_indexMaxEntries * sizeof(fsIndexEntry_t));
+
+		if (fs_indexEntries)
+		{
+			memcpy(entries, fs_indexEntries, fs_indexNumEntries * sizeof(fsIndexEntry_t));
+			Z_Free(fs_indexEntries);
+		}
+
+		fs_indexEntries = entries;
+	}
+
+	entry = &fs_indexEntries[fs_indexNumEntries++];
+	entry->name = name;
+	entry->search = search;
+	entry->fileIndex = fileIndex;
+	entry->next = -1;
+}
+
+static fsIndexEntry_t* FS_IndexFind(const char *name)
+{
+	int i;
+
+	if (fs_indexNumBuckets == 0)
+		return NULL;
+
+	for (i = fs_indexBuckets[FS_HashName(name) & (fs_indexNumBuckets - 1)]; i >= 0; i = fs_indexEntries[i].next)
+	{
+		if (Q_stricmp(fs_indexEntries[i].name, name) == 0)
+			return &fs_indexEntries[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Adds the loose files below dir, recursing into subdirectories.
+ */
+static void FS_IndexDirectory(fsSearchPath_t *search, const char *dir, int depth)
+{
+	char findname[MAX_OSPATH];
+	char **list;
+	int nfiles;
+	int baseLength = Q_strlen(search->path) + 1;
+
+	Com_sprintf(findname, sizeof(findname), "%s/*", dir);
+
+	if ((list = FS_ListFiles(findname, &nfiles, 0, SFF_SUBDIR)) != NULL)
+	{
+		for (int i = 0; i < nfiles - 1; i++)
+		{
+			if (Q_strlen(list[i] + baseLength) < MAX_QPATH)
+				FS_IndexAppend(search, -1, CopyString(list[i] + baseLength));
+		}
+
+		FS_FreeList(list, nfiles);
+	}
+
+	if (depth >= FS_INDEX_MAX_DEPTH)
+		return;
+
+	if ((list = FS_ListFiles(findname, &nfiles, SFF_SUBDIR, 0)) != NULL)
+	{
+		for (int i = 0; i < nfiles - 1; i++)
+			FS_IndexDirectory(search, list[i], depth + 1);
+
+		FS_FreeList(list, nfiles);
+	}
+}
+
+/*
+ * Collects every pack entry and loose file in search order and hashes them
+ * by case-folded name. The first occurrence wins, like the linear search.
+ */
+static void FS_BuildIndex(void)
+{
+	fsSearchPath_t *search;
+	int start = Sys_Milliseconds();
+	int i;
+
+	FS_FreeIndex();
+
+	for (search = fs_searchPaths; search; search = search->next)
+	{
+		if (search->pack)
+		{
+			for (i = 0; i < search->pack->numFiles; i++)
+				FS_IndexAppend(search, i, search->pack->files[i].name);
+		}
+		else
+		{
+			FS_IndexDirectory(search, search->path, 0);
+		}
+	}
+
+	for (fs_indexNumBuckets = 256; fs_indexNumBuckets < fs_indexNumEntries * 2; fs_indexNumBuckets <<= 1)
+		;
+
+	fs_indexBuckets = Z_Malloc(fs_indexNumBuckets * sizeof(int));
+	memset(fs_indexBuckets, 0xff, fs_indexNumBuckets * sizeof(int));
+
+	for (i = 0; i < fs_indexNumEntries; i++)
+	{
+		fsIndexEntry_t *entry = &fs_indexEntries[i];
+		int *bucket;
+
+		if (FS_IndexFind(entry->name))
+			continue; /* Shadowed by an earlier search path. */
+
+		bucket = &fs_indexBuckets[FS_HashName(entry->name) & (fs_indexNumBuckets - 1)];
+		entry->next = *bucket;
+		*bucket = i;
+	}
+
+	fs_indexDirty = false;
+	fs_indexBuilds++;
+	fs_indexBuildTime = Sys_Milliseconds() - start;
+}
+
+void FS_IndexStats_f(void)
+{
+	int used = 0, longest = 0;
+
+	if (fs_indexDirty)
+		FS_BuildIndex();
+
+	for (int i = 0; i < fs_indexNumBuckets; i++)
+	{
+		int length = 0;
+
+		for (int j = fs_indexBuckets[i]; j >= 0; j = fs_indexEntries[j].next)
+			length++;
+
+		if (length)
+			used++;
+		if (length > longest)
+			longest = length;
+	}
+
+	Com_Printf("%i files, %i/%i buckets used, longest chain %i.\n",
+		fs_indexNumEntries, used, fs_indexNumBuckets, longest);
+	Com_Printf("%i lookups, %i misses, %i directory fallbacks.\n",
+		fs_indexLookups, fs_indexMisses, fs_indexFallbacks);
+	Com_Printf("Built %i times, last build took %i ms.\n",
+		fs_indexBuilds, fs_indexBuildTime);
+}
+
+/*
+ * Returns the i-th file of a mapped pack, NULL if it isn't inside the mapping.
+ */
+static const byte* FS_MappedPackFile(fsPack_t *pack, int i)
+{
+	fsPackFile_t *file = &pack->files[i];
+
+	if ((pack->mapped == NULL) || (file->offset < 0) || (file->size < 0) ||
+	    (file->offset > pack->mappedSize - file->size))
+	{
+		return NULL;
+	}
+
+	return pack->mapped + file->offset;
+}
+
+static void FS_FoundInPack(const char *name, fsPack_t *pack)
+{
+	Com_FilePath(pack->name, fs_fileInPath, sizeof(fs_fileInPath));
+	fs_fileInPack = true;
+
+	if (pack->pak)
+	{
+		file_from_pak = 1;
+	}
+	#ifdef ZIP
+	else
+	{
+		file_from_pk3 = 1;
+		Q_strlcpy(file_from_pk3_name, strrchr(pack->name, '/') + 1, sizeof(file_from_pk3_name));
+	}
+	#endif
+
+	if (fs_debug->value)
+	{
+		Com_Printf("FS_FOpenFile: '%s' (found in '%s').\n",
+			name, pack->name);
+	}
+}
+
+/*
+ * Opens the i-th file of a pack. Returns its size.
+ */
+static int FS_OpenPackFile(fsHandle_t *handle, fsPack_t *pack, int i)
+{
+	FS_FoundInPack(handle->name, pack);
+	handle->pack = pack;
+
+	if ((handle->mapped = FS_MappedPackFile(pack, i)) != NULL)
+	{
+		/* Mapped PAK or stored PK3 entry, no need to reopen it. */
+		handle->mappedSize = pack->files[i].size;
+		handle->mappedPos = 0;
+		return pack->files[i].size;
+	}
+
+	if (pack->pak)
+	{
+		/* PAK */
+		handle->file = fopen(pack->name, "rb");
+
+		if (handle->file)
+		{
+			fseek(handle->file, pack->files[i].offset, SEEK_SET);
+			return pack->files[i].size;
+		}
+	}
+	#ifdef ZIP
+	else
+	if (pack->pk3)
+	{
+		/* PK3, jump straight to the entry recorded by FS_LoadPK3. */
+		if (pack->numZipPool > 0)
+			handle->zip = pack->zipPool[--pack->numZipPool];
+		else
+			handle->zip = unzOpen(pack->name);
+
+		if (handle->zip)
+		{
+			if (unzGoToFilePos(handle->zip, &pack->files[i].zipPos) == UNZ_OK)
+			{
+				if (unzOpenCurrentFile(handle->zip) == UNZ_OK)
+				{
+					return pack->files[i].size;
+				}
+			}
+
+			unzClose(handle->zip);
+			handle->zip = NULL;
+		}
+	}
+	#endif
+
+	Com_Error(ERR_FATAL, "Couldn't reopen '%s'", pack->name);
+
+	return -1;
+}
+
+/*
+ * Opens a loose file below a search directory. Returns filesize or -1.
+ */
+static int FS_OpenDirectoryFile(fsHandle_t *handle, fsSearchPath_t *search, const char *name)
+{
+	char path[MAX_OSPATH];
+
+	Com_sprintf(path, sizeof(path), "%s/%s", search->path, name);
+
+	handle->file = fopen(path, "rb");
+
+	if (!handle->file)
+	{
+		Q_strlwr(path);
+		handle->file = fopen(path, "rb");
+	}
+
+	if (!handle->file)
+	{
+		return -1;
+	}
+
+	/* Found it! */
+	Q_strlcpy(fs_fileInPath, search->path, sizeof(fs_fileInPath));
+	fs_fileInPack = false;
+
+	if (fs_debug->value)
+	{
+		Com_Printf("FS_FOpenFile: '%s' (found in '%s').\n",
+			handle->name, search->path);
+	}
+
+	return FS_FileLength(handle->file);
+}
+
 /*
  * Finds the file in the search path. Returns filesize and an open FILE *. Used
  * for streaming data out of either a pak file or a seperate file.
+ *
+ * Lookups go through the hashed index first. Files missing from it can only
+ * have been written to a directory since it was built (downloads, saves), so
+ * only directories are searched again; packs are skipped.
  */
 int FS_FOpenFile(const char *name, fileHandle_t *f, qboolean gamedir_only)
 {
-	char path[MAX_OSPATH];
 	fsHandle_t *handle;
 	fsPack_t *pack;
 	fsSearchPath_t *search;
+	fsIndexEntry_t *entry;
+	qboolean skipPacks = false;
+	int size;
 	int i;
 
 	file_from_pak = 0;
@@ -416,6 +793,31 @@ int FS_FOpenFile(const char *name, fileHandle_t *f, qboolean gamedir_only)
 	Q_strlcpy(handle->name, name, sizeof(handle->name));
 	handle->mode = FS_READ;
 
+	if (!gamedir_only)
+	{
+		if (fs_indexDirty)
+			FS_BuildIndex();
+
+		fs_indexLookups++;
+
+		if ((entry = FS_IndexFind(handle->name)) != NULL)
+		{
+			if (entry->search->pack)
+				return FS_OpenPackFile(handle, entry->search->pack, entry->fileIndex);
+
+			if ((size = FS_OpenDirectoryFile(handle, entry->search, entry->name)) >= 0)
+				return size;
+
+			/* Deleted since indexing, a pack may still provide it. */
+			fs_indexFallbacks++;
+		}
+		else
+		{
+			fs_indexMisses++;
+			skipPacks = true;
+		}
+	}
+
 	/* Search through the path, one element at a time. */
 	for (search = fs_searchPaths; search; search = search->next)
 	{
@@ -430,6 +832,9 @@ int FS_FOpenFile(const char *name, fileHandle_t *f, qboolean gamedir_only)
 		/* Search inside a pack file. */
 		if (search->pack)
 		{
+			if (skipPacks)
+				continue;
+
 			pack = search->pack;
 
 			for (i = 0; i < pack->numFiles; i++)
@@ -437,86 +842,19 @@ int FS_FOpenFile(const char *name, fileHandle_t *f, qboolean gamedir_only)
 				if (Q_stricmp(pack->files[i].name, handle->name) == 0)
 				{
 					/* Found it! */
-					Com_FilePath(pack->name, fs_fileInPath, sizeof(fs_fileInPath));
-					fs_fileInPack = true;
-
-					if (fs_debug->value)
-					{
-						Com_Printf("FS_FOpenFile: '%s' (found in '%s').\n",
-							handle->name, pack->name);
-					}
-
-					if (pack->pak)
-					{
-						/* PAK */
-						file_from_pak = 1;
-						handle->file = fopen(pack->name, "rb");
-
-						if (handle->file)
-						{
-							fseek(handle->file, pack->files[i].offset, SEEK_SET);
-							return pack->files[i].size;
-						}
-					}
-					#ifdef ZIP
-					else
-					if (pack->pk3)
-					{
-						/* PK3 */
-						file_from_pk3 = 1;
-						Q_strlcpy(file_from_pk3_name, strrchr(pack->name, '/') + 1, sizeof(file_from_pk3_name));
-						handle->zip = unzOpen(pack->name);
-
-						if (handle->zip)
-						{
-							if (unzLocateFile(handle->zip, handle->name, 2) == UNZ_OK)
-							{
-								if (unzOpenCurrentFile(handle->zip) == UNZ_OK)
-								{
-									return pack->files[i].size;
-								}
-							}
-
-							unzClose(handle->zip);
-						}
-					}
-					#endif
-
-					Com_Error(ERR_FATAL, "Couldn't reopen '%s'", pack->name);
+					return FS_OpenPackFile(handle, pack, i);
 				}
 			}
 		}
 		else
 		{
 			/* Search in a directory tree. */
-			Com_sprintf(path, sizeof(path), "%s/%s", search->path, handle->name);
-
-			handle->file = fopen(path, "rb");
-
-			if (!handle->file)
+			if ((size = FS_OpenDirectoryFile(handle, search, handle->name)) >= 0)
 			{
-				Q_strlwr(path);
-				handle->file = fopen(path, "rb");
-			}
+				if (skipPacks)
+					fs_indexFallbacks++;
 
-			if (!handle->file)
-			{
-				continue;
-			}
-
-			if (handle->file)
-			{
-				/* Found it! */
-				Q_strlcpy(fs_fileInPath, search->path, sizeof(fs_fileInPath));
-				fs_fileInPack = false;
-
-				if (fs_debug->value)
-				{
-					Com_Printf("FS_FOpenFile: '%s' (found in '%s').\n",
-						handle->name, search->path);
-				}
-
-				return FS_FileLength(handle->file);
+				return size;
 			}
 		}
 	}
@@ -567,6 +905,14 @@ int FS_Read(void *buffer, int size, fileHandle_t f)
 		}
 		#endif
 		else
+		if (handle->mapped)
+		{
+			r = handle->mappedSize - handle->mappedPos;
+			r = (r < remaining) ? r : remaining;
+			memcpy(buf, handle->mapped + handle->mappedPos, r);
+			handle->mappedPos += r;
+		}
+		else
 		{
 			return 0;
 		}
@@ -639,6 +985,14 @@ int FS_FRead(void *buffer, int size, int count, fileHandle_t f)
 			}
 			#endif
 			else
+			if (handle->mapped)
+			{
+				r = handle->mappedSize - handle->mappedPos;
+				r = (r < remaining) ? r : remaining;
+				memcpy(buf, handle->mapped + handle->mappedPos, r);
+				handle->mappedPos += r;
+			}
+			else
 			{
 				return 0;
 			}
@@ -712,6 +1066,61 @@ int FS_LoadFile(char *path, void **buffer)
 	return size;
 }
 
+/*
+ * Like FS_LoadFile, but files stored in a mapped PAK are returned as a
+ * pointer straight into the mapping instead of being copied. The buffer
+ * must be treated as read-only and released with FS_FreeFile.
+ */
+int FS_MapFile(char *path, void **buffer)
+{
+	fsIndexEntry_t *entry;
+	const byte *data;
+
+	if (fs_indexDirty)
+		FS_BuildIndex();
+
+	entry = FS_IndexFind(path);
+
+	if ((entry != NULL) && (entry->search->pack != NULL) &&
+	    ((data = FS_MappedPackFile(entry->search->pack, entry->fileIndex)) != NULL) &&
+	    (entry->search->pack->files[entry->fileIndex].size > 0))
+	{
+		fs_indexLookups++;
+		file_from_pak = 0;
+		#ifdef ZIP
+		file_from_pk3 = 0;
+		#endif
+		FS_FoundInPack(path, entry->search->pack);
+
+		*buffer = (void *)data;
+		return entry->search->pack->files[entry->fileIndex].size;
+	}
+
+	return FS_LoadFile(path, buffer);
+}
+
+/*
+ * Returns true if buffer points into one of the mapped packs.
+ */
+static qboolean FS_IsMapped(const void *buffer)
+{
+	fsSearchPath_t *search;
+
+	for (search = fs_searchPaths; search; search = search->next)
+	{
+		fsPack_t *pack = search->pack;
+
+		if ((pack != NULL) && (pack->mapped != NULL) &&
+		    ((const byte *)buffer >= pack->mapped) &&
+		    ((const byte *)buffer < pack->mapped + pack->mappedSize))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 void FS_FreeFile(void *buffer)
 {
 	if (buffer == NULL)
@@ -720,6 +1129,11 @@ void FS_FreeFile(void *buffer)
 		return;
 	}
 
+	if (FS_IsMapped(buffer))
+	{
+		return;
+	}
+
 	Z_Free(buffer);
 }
 
@@ -787,6 +1201,7 @@ fsPack_t* FS_LoadPAK(const char *packPath)
 	#ifdef ZIP
 	pack->pk3 = NULL;
 	#endif
+	pack->mapped = Sys_MapFile(handle, &pack->mappedSize);
 	pack->numFiles = numFiles;
 	pack->files = files;
 
@@ -796,6 +1211,56 @@ fsPack_t* FS_LoadPAK(const char *packPath)
 }
 
 #ifdef ZIP
+static int FS_ZipShort(const byte *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static int FS_ZipLong(const byte *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+}
+
+/*
+ * Returns the offset of the data of the current PK3 entry in the mapped
+ * archive if it is stored uncompressed, -1 otherwise. The local header
+ * offset isn't exposed by unzip, so it's read from the central directory.
+ */
+static int FS_PK3StoredOffset(unzFile *handle, const unz_file_info *info, const byte *base, int size)
+{
+	const byte *central;
+	int offset; /* Central directory entry, then local header. */
+	int data;
+
+	if ((base == NULL) || (info->compression_method != 0) || (info->flag & 1) ||
+	    (info->compressed_size != info->uncompressed_size))
+	{
+		return -1;
+	}
+
+	offset = (int)unzGetOffset(handle);
+
+	if ((offset < 0) || (offset > size - 46))
+		return -1;
+
+	central = base + offset;
+
+	if (FS_ZipLong(central) != 0x02014b50)
+		return -1;
+
+	offset = FS_ZipLong(central + 42);
+
+	if ((offset < 0) || (offset > size - 30) || (FS_ZipLong(base + offset) != 0x04034b50))
+		return -1;
+
+	data = offset + 30 + FS_ZipShort(base + offset + 26) + FS_ZipShort(base + offset + 28);
+
+	if (data > size - (int)info->uncompressed_size)
+		return -1;
+
+	return data;
+}
+
 /*
  * Takes an explicit (not game tree related) path to a pack file.
  *
@@ -813,6 +1278,9 @@ fsPack_t* FS_LoadPK3(const char *packPath)
 	unzFile *handle; /* Zip file handle. */
 	unz_file_info info; /* Zip file info. */
 	unz_global_info global; /* Zip file global info. */
+	FILE *mapHandle; /* Used to map the archive. */
+	byte *mapped = NULL;
+	int mappedSize = 0;
 
 	handle = unzOpen(packPath);
 
@@ -821,6 +1289,13 @@ fsPack_t* FS_LoadPK3(const char *packPath)
 		return NULL;
 	}
 
+	/* Stored entries are read straight from the mapping. */
+	if ((mapHandle = fopen(packPath, "rb")) != NULL)
+	{
+		mapped = Sys_MapFile(mapHandle, &mappedSize);
+		fclose(mapHandle);
+	}
+
 	if (unzGetGlobalInfo(handle, &global) != UNZ_OK)
 	{
 		unzClose(handle);
@@ -847,8 +1322,9 @@ fsPack_t* FS_LoadPK3(const char *packPath)
 		unzGetCurrentFileInfo(handle, &info, fileName, MAX_QPATH,
 			NULL, 0, NULL, 0);
 		Q_strlcpy(files[i].name, fileName, sizeof(files[i].name));
-		files[i].offset = -1; /* Not used in ZIP files */
+		files[i].offset = FS_PK3StoredOffset(handle, &info, mapped, mappedSize);
 		files[i].size = info.uncompressed_size;
+		unzGetFilePos(handle, &files[i].zipPos);
 		i++;
 		status = unzGoToNextFile(handle);
 	}
@@ -857,6 +1333,8 @@ fsPack_t* FS_LoadPK3(const char *packPath)
 	Q_strlcpy(pack->name, packPath, sizeof(pack->name));
 	pack->pak = NULL;
 	pack->pk3 = handle;
+	pack->mapped = mapped;
+	pack->mappedSize = mappedSize;
 	pack->numFiles = numFiles;
 	pack->files = files;
 
@@ -882,6 +1360,7 @@ static void FS_AddGameDirectory(const char *dir)
 	fsPack_t *pack; /* PAK / PK3 file. */
 
 	pack = NULL;
+	fs_indexDirty = true;
 
 	/* Add the directory to the search path. */
 	search = Z_Malloc(sizeof(fsSearchPath_t));
@@ -1072,7 +1551,8 @@ void FS_Path_f()
 	{
 		if (search->pack != NULL)
 		{
-			Com_Printf("%s (%i files)\n", search->pack->name, search->pack->numFiles);
+			Com_Printf("%s (%i files%s)\n", search->pack->name, search->pack->numFiles,
+				search->pack->mapped ? ", mapped" : "");
 			totalFiles += search->pack->numFiles;
 		}
 		else
@@ -1089,7 +1569,7 @@ void FS_Path_f()
 		    #ifdef ZIP
 		    || (handle->zip != NULL)
 		    #endif
-		    )
+		    || (handle->mapped != NULL))
 		{
 			Com_Printf("Handle %i: '%s'.\n", i + 1, handle->name);
 		}
@@ -1108,6 +1588,27 @@ void FS_Path_f()
 	#endif
 }
 
+/*
+ * Closes the handles still reading from a pack that is about to be freed.
+ */
+static void FS_ClosePackHandles(fsPack_t *pack)
+{
+	for (int i = 0; i < MAX_HANDLES; i++)
+	{
+		if (fs_handles[i].pack == pack)
+		{
+			FS_FCloseFile(i + 1);
+		}
+	}
+
+	#ifdef ZIP
+	while (pack->numZipPool > 0)
+	{
+		unzClose(pack->zipPool[--pack->numZipPool]);
+	}
+	#endif
+}
+
 /*
  * Sets the gamedir and path to a different directory.
  */
@@ -1122,11 +1623,22 @@ void FS_SetGamedir(char *dir)
 		return;
 	}
 
+	/* The index points into the packs freed below. */
+	FS_FreeIndex();
+	fs_indexDirty = true;
+
 	/* Free up any current game dir info. */
 	while (fs_searchPaths != fs_baseSearchPaths)
 	{
 		if (fs_searchPaths->pack)
 		{
+			FS_ClosePackHandles(fs_searchPaths->pack);
+
+			if (fs_searchPaths->pack->mapped)
+			{
+				Sys_UnmapFile(fs_searchPaths->pack->mapped, fs_searchPaths->pack->mappedSize);
+			}
+
 			if (fs_searchPaths->pack->pak)
 			{
 				fclose(fs_searchPaths->pack->pak);
@@ -1156,6 +1668,7 @@ void FS_SetGamedir(char *dir)
 		     #ifdef ZIP
 		     || (fs_handles[i].zip != NULL)
 		     #endif
+		     || (fs_handles[i].mapped != NULL)
 		    ))
 		{
 			FS_FCloseFile(i);
@@ -1550,6 +2063,7 @@ void FS_InitFilesystem()
 	Cmd_AddCommand("path", FS_Path_f);
 	Cmd_AddCommand("link", FS_Link_f);
 	Cmd_AddCommand("dir", FS_Dir_f);
+	Cmd_AddCommand("fs_index_stats", FS_IndexStats_f);
 
 	/* basedir <path> Allows the game to run from outside the data tree.  */
 	fs_basedir = Cvar_Get("basedir", ".", CVAR_NOSET);
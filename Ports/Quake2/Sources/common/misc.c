@@ -50,7 +50,6 @@ cvar_t *dedicated;
 
 extern cvar_t *consoleLogFile;
 extern jmp_buf abortframe; /* an ERR_DROP occured, exit the entire frame */
-extern zhead_t z_chain;
 
 static byte chktbl[1024] =
 {
@@ -194,8 +193,6 @@ static void Qcommon_Init(int argc, char **argv)
 		Sys_Error("Error during initialization");
 	}
 
-	z_chain.next = z_chain.prev = &z_chain;
-
 	/* prepare enough of the subsystems to handle
 	   cvar and command buffer management */
 	COM_InitArgv(argc, argv);
@@ -348,12 +345,16 @@ static void Qcommon_Frame(int msec_)
 	#ifndef DEDICATED_ONLY
 	if (showtrace->value)
 	{
-		extern int c_traces, c_brush_traces;
+		extern int c_traces, c_brush_traces, c_tracehits;
 		extern int c_pointcontents;
+		extern Uint64 c_traceticks;
+		int ns = c_traces ? (int)(c_traceticks * 1000000000 / SDL_GetPerformanceFrequency() / c_traces) : 0;
 
-		Com_Printf("%4i traces  %4i points\n", c_traces, c_pointcontents);
+		Com_Printf("%4i traces  %4i points  %4i cached  %5i ns/trace\n", c_traces, c_pointcontents, c_tracehits, ns);
 		c_traces = 0;
 		c_brush_traces = 0;
+		c_tracehits = 0;
+		c_traceticks = 0;
 		c_pointcontents = 0;
 	}
 	#endif
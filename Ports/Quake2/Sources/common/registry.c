@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Intrusive string hash table, used by the image, model and sound
+ * registries.
+ *
+ * =======================================================================
+ */
+
+#include "common/common.h"
+
+/* FNV-1a */
+static unsigned Registry_Hash(const char *name)
+{
+	unsigned hash = 2166136261u;
+
+	for ( ; *name; name++)
+	{
+		hash ^= (byte)*name;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+void Registry_Clear(registry_t *registry)
+{
+	memset(registry, 0, sizeof(*registry));
+}
+
+void Registry_Add(registry_t *registry, registrynode_t *node, const char *name)
+{
+	registrynode_t **bucket;
+
+	node->hash = Registry_Hash(name);
+	node->name = name;
+
+	bucket = &registry->buckets[node->hash & (REGISTRY_BUCKETS - 1)];
+	node->next = *bucket;
+	*bucket = node;
+	registry->count++;
+}
+
+void Registry_Remove(registry_t *registry, registrynode_t *node)
+{
+	registrynode_t **link;
+
+	for (link = &registry->buckets[node->hash & (REGISTRY_BUCKETS - 1)]; *link; link = &(*link)->next)
+	{
+		if (*link == node)
+		{
+			*link = node->next;
+			node->next = NULL;
+			registry->count--;
+			return;
+		}
+	}
+}
+
+registrynode_t* Registry_Find(registry_t *registry, const char *name)
+{
+	unsigned hash = Registry_Hash(name);
+	registrynode_t *node;
+
+	for (node = registry->buckets[hash & (REGISTRY_BUCKETS - 1)]; node; node = node->next)
+	{
+		if ((node->hash == hash) && !strcmp(node->name, name))
+		{
+			return node;
+		}
+	}
+
+	return NULL;
+}
@@ -287,6 +287,7 @@ void randk_seed(void);
 extern int curtime; /* time returned by last Sys_Milliseconds */
 
 int Sys_Milliseconds(void);
+long long Sys_Microseconds(void); /* monotonic, for scheduling */
 qboolean Sys_Mkdir(char *path);
 
 /* large block stack allocation routines */
@@ -295,6 +296,10 @@ void* Hunk_Alloc(int size);
 void Hunk_Free(void *buf);
 int Hunk_End(void);
 
+/* read-only file mappings, NULL if the file can't be mapped */
+void* Sys_MapFile(FILE *f, int *size);
+void Sys_UnmapFile(void *base, int size);
+
 /* directory searching */
 #define SFF_ARCH 0x01
 #define SFF_HIDDEN 0x02
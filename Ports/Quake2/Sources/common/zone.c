@@ -19,7 +19,11 @@
  *
  * =======================================================================
  *
- * Zone malloc. It's just a normal malloc with tags.
+ * Zone malloc. Blocks up to Z_MAX_SLAB_SIZE are carved out of per tag
+ * arenas of Z_CHUNK_SIZE bytes, rounded up to a power of two size class,
+ * and recycled through per tag free lists. Bigger blocks are plain mallocs
+ * chained to their tag. Z_FreeTags releases the arena chunks of a tag
+ * without walking its blocks.
  *
  * =======================================================================
  */
@@ -28,74 +32,261 @@
 #include "common/zone.h"
 
 #define Z_MAGIC 0x1d1d
+#define Z_MAGIC_SLAB 0x1d1e
+#define Z_MAGIC_FREE 0x1d1f
+
+#define Z_MIN_CLASS_SHIFT 5 /* 32 bytes */
+#define Z_NUM_CLASSES 7
+#define Z_MAX_SLAB_SIZE (1 << (Z_MIN_CLASS_SHIFT + Z_NUM_CLASSES - 1))
+#define Z_CHUNK_SIZE (64 * 1024)
+#define Z_MAX_TAGS 64
+
+typedef struct zchunk_s
+{
+	struct zchunk_s *next;
+	int used; /* bytes handed out after the chunk header */
+	int pad;
+} zchunk_t;
+
+typedef struct
+{
+	short tag;
+	zchunk_t *chunks; /* bump arena, current chunk first */
+	zhead_t *freeLists[Z_NUM_CLASSES];
+	zhead_t large; /* blocks too big for the arena */
+	int bytes, blocks, peak;
+	int reserved; /* bytes obtained from malloc */
+} ztag_t;
+
+static ztag_t z_tags[Z_MAX_TAGS];
+static int z_numTags;
+static ztag_t *z_lastTag;
 
-zhead_t z_chain;
 int z_count, z_bytes;
 
+static ztag_t* Z_FindTag(int tag, qboolean create)
+{
+	ztag_t *t;
+	int i;
+
+	if (z_lastTag && (z_lastTag->tag == tag))
+	{
+		return z_lastTag;
+	}
+
+	for (i = 0, t = z_tags; i < z_numTags; i++, t++)
+	{
+		if (t->tag == tag)
+		{
+			z_lastTag = t;
+			return t;
+		}
+	}
+
+	if (!create)
+	{
+		return NULL;
+	}
+
+	if (z_numTags == Z_MAX_TAGS)
+	{
+		Com_Error(ERR_FATAL, "Z_TagMalloc: too many tags");
+	}
+
+	t = &z_tags[z_numTags++];
+	memset(t, 0, sizeof(*t));
+	t->tag = tag;
+	t->large.next = t->large.prev = &t->large;
+	z_lastTag = t;
+
+	return t;
+}
+
+static int Z_SizeClass(int size)
+{
+	int c = 0;
+
+	while ((1 << (Z_MIN_CLASS_SHIFT + c)) < size)
+	{
+		c++;
+	}
+
+	return c;
+}
+
 void Z_Free(void *ptr)
 {
 	zhead_t *z;
+	ztag_t *t;
 
 	z = ((zhead_t *)ptr) - 1;
 
-	if (z->magic != Z_MAGIC)
+	if ((z->magic != Z_MAGIC) && (z->magic != Z_MAGIC_SLAB))
 	{
 		printf("free: %p failed\n", ptr);
 		abort();
 		Com_Error(ERR_FATAL, "Z_Free: bad magic");
 	}
 
-	z->prev->next = z->next;
-	z->next->prev = z->prev;
+	t = Z_FindTag(z->tag, false);
 
 	z_count--;
 	z_bytes -= z->size;
+	t->blocks--;
+	t->bytes -= z->size;
+
+	if (z->magic == Z_MAGIC_SLAB)
+	{
+		int c = Z_SizeClass(z->size);
+
+		z->magic = Z_MAGIC_FREE;
+		z->next = t->freeLists[c];
+		t->freeLists[c] = z;
+		return;
+	}
+
+	z->prev->next = z->next;
+	z->next->prev = z->prev;
+
+	t->reserved -= z->size;
 	free(z);
 }
 
 void Z_Stats_f(void)
 {
+	ztag_t *t;
+	int i;
+
 	Com_Printf("%i bytes in %i blocks\n", z_bytes, z_count);
+	Com_Printf("  tag      bytes  blocks       peak   reserved  frag\n");
+
+	for (i = 0, t = z_tags; i < z_numTags; i++, t++)
+	{
+		int frag = 0;
+
+		if (t->reserved)
+		{
+			frag = (int)(100.0 * (t->reserved - t->bytes) / t->reserved);
+		}
+
+		Com_Printf("%5i %10i %7i %10i %10i  %3i%%\n",
+				t->tag, t->bytes, t->blocks, t->peak, t->reserved, frag);
+	}
 }
 
 void Z_FreeTags(int tag)
 {
+	ztag_t *t;
+	zchunk_t *chunk, *nextChunk;
 	zhead_t *z, *next;
 
-	for (z = z_chain.next; z != &z_chain; z = next)
+	t = Z_FindTag(tag, false);
+
+	if (!t)
 	{
-		next = z->next;
+		return;
+	}
 
-		if (z->tag == tag)
-		{
-			Z_Free((void *)(z + 1));
-		}
+	for (chunk = t->chunks; chunk; chunk = nextChunk)
+	{
+		nextChunk = chunk->next;
+		free(chunk);
+	}
+
+	for (z = t->large.next; z != &t->large; z = next)
+	{
+		next = z->next;
+		free(z);
 	}
+
+	z_count -= t->blocks;
+	z_bytes -= t->bytes;
+
+	t->chunks = NULL;
+	memset(t->freeLists, 0, sizeof(t->freeLists));
+	t->large.next = t->large.prev = &t->large;
+	t->bytes = 0;
+	t->blocks = 0;
+	t->reserved = 0;
 }
 
 void* Z_TagMalloc(int size, int tag)
 {
 	zhead_t *z;
+	ztag_t *t;
 
 	size = size + sizeof(zhead_t);
-	z = malloc(size);
+	t = Z_FindTag(tag, true);
 
-	if (!z)
+	if (size <= Z_MAX_SLAB_SIZE)
 	{
-		Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", size);
+		int c = Z_SizeClass(size);
+		int blockSize = 1 << (Z_MIN_CLASS_SHIFT + c);
+
+		if (t->freeLists[c])
+		{
+			z = t->freeLists[c];
+			t->freeLists[c] = z->next;
+			memset(z, 0, blockSize);
+		}
+		else
+		{
+			zchunk_t *chunk = t->chunks;
+
+			if (!chunk || (chunk->used + blockSize > Z_CHUNK_SIZE - (int)sizeof(zchunk_t)))
+			{
+				/* the tail of the previous chunk is lost until Z_FreeTags */
+				chunk = calloc(1, Z_CHUNK_SIZE);
+
+				if (!chunk)
+				{
+					Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", Z_CHUNK_SIZE);
+				}
+
+				chunk->next = t->chunks;
+				t->chunks = chunk;
+				t->reserved += Z_CHUNK_SIZE;
+			}
+
+			/* fresh chunks come zero filled */
+			z = (zhead_t *)((byte *)(chunk + 1) + chunk->used);
+			chunk->used += blockSize;
+		}
+
+		z->magic = Z_MAGIC_SLAB;
+	}
+	else
+	{
+		z = malloc(size);
+
+		if (!z)
+		{
+			Com_Error(ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", size);
+		}
+
+		memset(z, 0, size);
+		z->magic = Z_MAGIC;
+
+		z->next = t->large.next;
+		z->prev = &t->large;
+		t->large.next->prev = z;
+		t->large.next = z;
+
+		t->reserved += size;
 	}
 
-	memset(z, 0, size);
-	z_count++;
-	z_bytes += size;
-	z->magic = Z_MAGIC;
 	z->tag = tag;
 	z->size = size;
 
-	z->next = z_chain.next;
-	z->prev = &z_chain;
-	z_chain.next->prev = z;
-	z_chain.next = z;
+	z_count++;
+	z_bytes += size;
+	t->blocks++;
+	t->bytes += size;
+
+	if (t->bytes > t->peak)
+	{
+		t->peak = t->bytes;
+	}
 
 	return (void *)(z + 1);
 }
@@ -29,7 +29,7 @@
 
 typedef struct zhead_s
 {
-	struct zhead_s *prev, *next;
+	struct zhead_s *prev, *next; /* next links the free list of arena blocks */
 	short magic;
 	short tag; /* for group free */
 	int size;
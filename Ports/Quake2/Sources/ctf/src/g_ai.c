@@ -422,7 +422,7 @@ void FoundTarget(edict_t *self)
 	self->monsterinfo.aiflags |= AI_COMBAT_POINT;
 
 	/* clear the targetname, that point is ours! */
-	self->movetarget->targetname = NULL;
+	G_SetTargetname(self->movetarget, NULL);
 	self->monsterinfo.pausetime = 0;
 
 	/* run for it */
@@ -2399,7 +2399,7 @@ static void SpawnTech(gitem_t *item, edict_t *spot)
 
 	ent = G_Spawn();
 
-	ent->classname = item->classname;
+	G_SetClassname(ent, item->classname);
 	ent->item = item;
 	ent->spawnflags = DROPPED_ITEM;
 	ent->s.effects = item->world_model_flags;
@@ -555,6 +555,7 @@ void SpawnEntities(char *mapname, char *entities, char *spawnpoint)
 	gi.FreeTags(TAG_LEVEL);
 
 	memset(&level, 0, sizeof(level));
+	G_SuspendFindIndex();
 	memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
 
 	strncpy(level.mapname, mapname, sizeof(level.mapname) - 1);
@@ -641,6 +642,8 @@ void SpawnEntities(char *mapname, char *entities, char *spawnpoint)
 		ED_CallSpawn(ent);
 	}
 
+	G_InvalidateFindIndex();
+
 	gi.dprintf("%i entities inhibited.\n", inhibit);
 
 	G_FindTeams();
@@ -34,6 +34,324 @@ void G_ProjectSource(vec3_t point, vec3_t distance, vec3_t forward, vec3_t right
 	        distance[2];
 }
 
+/*
+ * Hash index for the two fields nearly every
+ * G_Find() goes through, classname and targetname.
+ * Chains hold edict numbers in ascending order, so
+ * a lookup returns the same edict the linear scan
+ * would. Both fields must be written through
+ * G_SetClassname() and G_SetTargetname(), except
+ * while the index is suspended during spawning
+ * and loading. It is rebuilt on the next lookup
+ * after G_InvalidateFindIndex().
+ */
+
+#define FINDINDEX_HASH 1024
+#define FINDINDEX_FIELDS 2
+
+typedef struct
+{
+	int head[FINDINDEX_HASH]; /* edict number + 1 */
+	int *next;                /* edict number + 1 */
+	int *bucket;              /* -1 when unlinked */
+} findindex_t;
+
+static findindex_t findindex[FINDINDEX_FIELDS];
+static int findindex_size;
+static qboolean findindex_valid;
+static qboolean findindex_suspended;
+
+/*
+ * The radius cache keeps the edicts touching the
+ * bounds of the last findradius() query, sorted
+ * by number, for the rest of its iteration.
+ */
+static edict_t *radius_list[MAX_EDICTS];
+static int radius_count;
+static int radius_framenum = -1;
+static vec3_t radius_org;
+static float radius_rad;
+
+static int G_FindIndex_field(int fieldofs)
+{
+	if (fieldofs == FOFS(classname))
+	{
+		return 0;
+	}
+
+	if (fieldofs == FOFS(targetname))
+	{
+		return 1;
+	}
+
+	return -1;
+}
+
+static char* G_FindIndex_value(edict_t *ent, int field)
+{
+	return field ? ent->targetname : ent->classname;
+}
+
+static unsigned G_FindIndex_hash(const char *s)
+{
+	unsigned h = 2166136261u;
+	int c;
+
+	while ((c = *(const unsigned char *)s++) != 0)
+	{
+		if ((c >= 'A') && (c <= 'Z'))
+		{
+			c += 'a' - 'A';
+		}
+
+		h = (h ^ c) * 16777619u;
+	}
+
+	return h & (FINDINDEX_HASH - 1);
+}
+
+static void G_FindIndex_unlink(int field, int num)
+{
+	findindex_t *index = &findindex[field];
+	int *link;
+
+	if (index->bucket[num] < 0)
+	{
+		return;
+	}
+
+	for (link = &index->head[index->bucket[num]]; *link; link = &index->next[*link - 1])
+	{
+		if (*link == num + 1)
+		{
+			*link = index->next[num];
+			break;
+		}
+	}
+
+	index->next[num] = 0;
+	index->bucket[num] = -1;
+}
+
+static void G_FindIndex_link(int field, int num)
+{
+	findindex_t *index = &findindex[field];
+	char *s = G_FindIndex_value(&g_edicts[num], field);
+	int *link;
+	int b;
+
+	if (!s)
+	{
+		return;
+	}
+
+	b = G_FindIndex_hash(s);
+
+	for (link = &index->head[b]; *link && *link <= num; link = &index->next[*link - 1])
+	{
+	}
+
+	index->next[num] = *link;
+	index->bucket[num] = b;
+	*link = num + 1;
+}
+
+static void G_FindIndex_relink(edict_t *ent, int field)
+{
+	int num;
+
+	if (!findindex_valid || findindex_suspended)
+	{
+		return;
+	}
+
+	num = ent - g_edicts;
+
+	G_FindIndex_unlink(field, num);
+	G_FindIndex_link(field, num);
+}
+
+static void G_FindIndex_rebuild(void)
+{
+	int field, num;
+
+	if (findindex_size < game.maxentities)
+	{
+		for (field = 0; field < FINDINDEX_FIELDS; field++)
+		{
+			free(findindex[field].next);
+			free(findindex[field].bucket);
+			findindex[field].next = malloc(game.maxentities * sizeof(int));
+			findindex[field].bucket = malloc(game.maxentities * sizeof(int));
+		}
+
+		findindex_size = game.maxentities;
+	}
+
+	for (field = 0; field < FINDINDEX_FIELDS; field++)
+	{
+		memset(findindex[field].head, 0, sizeof(findindex[field].head));
+		memset(findindex[field].next, 0, findindex_size * sizeof(int));
+		memset(findindex[field].bucket, 0xff, findindex_size * sizeof(int));
+
+		/* walk backwards so every link goes to the chain head */
+		for (num = globals.num_edicts - 1; num >= 0; num--)
+		{
+			G_FindIndex_link(field, num);
+		}
+	}
+
+	findindex_valid = true;
+}
+
+/*
+ * Stops index maintenance while edict fields are
+ * written wholesale; G_Find() scans linearly until
+ * G_InvalidateFindIndex() is called.
+ */
+void G_SuspendFindIndex(void)
+{
+	findindex_suspended = true;
+	findindex_valid = false;
+	radius_framenum = -1;
+}
+
+void G_InvalidateFindIndex(void)
+{
+	findindex_suspended = false;
+	findindex_valid = false;
+	radius_framenum = -1;
+}
+
+void G_SetClassname(edict_t *ent, char *classname)
+{
+	ent->classname = classname;
+	G_FindIndex_relink(ent, 0);
+}
+
+void G_SetTargetname(edict_t *ent, char *targetname)
+{
+	ent->targetname = targetname;
+	G_FindIndex_relink(ent, 1);
+}
+
+static edict_t* G_FindIndex_find(edict_t *from, int field, char *match)
+{
+	findindex_t *index = &findindex[field];
+	int first = from - g_edicts;
+	edict_t *ent;
+	char *s;
+	int i;
+
+	for (i = index->head[G_FindIndex_hash(match)]; i; i = index->next[i - 1])
+	{
+		if (i - 1 < first)
+		{
+			continue;
+		}
+
+		if (i - 1 >= globals.num_edicts)
+		{
+			break;
+		}
+
+		ent = &g_edicts[i - 1];
+
+		if (!ent->inuse)
+		{
+			continue;
+		}
+
+		s = G_FindIndex_value(ent, field);
+
+		if (s && !Q_stricmp(s, match))
+		{
+			return ent;
+		}
+	}
+
+	return NULL;
+}
+
+static int G_RadiusCache_compare(const void *a, const void *b)
+{
+	const edict_t *ea = *(edict_t * const *)a;
+	const edict_t *eb = *(edict_t * const *)b;
+
+	return (ea > eb) - (ea < eb);
+}
+
+/*
+ * Answers a findradius() step from the entities
+ * the area index returns for the query bounds.
+ * Only linked entities are found, so this gives
+ * up (returns false) when the query doesn't match
+ * the cached one and the caller scans instead.
+ */
+static qboolean G_RadiusCache_next(edict_t *from, vec3_t org, float rad, edict_t **result)
+{
+	vec3_t mins, maxs, eorg;
+	edict_t *ent;
+	int i, j;
+
+	if (!from)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			mins[j] = org[j] - rad;
+			maxs[j] = org[j] + rad;
+		}
+
+		radius_count = gi.BoxEdicts(mins, maxs, radius_list, MAX_EDICTS, AREA_SOLID);
+		radius_count += gi.BoxEdicts(mins, maxs, radius_list + radius_count,
+				MAX_EDICTS - radius_count, AREA_TRIGGERS);
+		qsort(radius_list, radius_count, sizeof(radius_list[0]), G_RadiusCache_compare);
+
+		VectorCopy(org, radius_org);
+		radius_rad = rad;
+		radius_framenum = level.framenum;
+		i = 0;
+	}
+	else
+	{
+		if ((radius_framenum != level.framenum) || (radius_rad != rad) ||
+			!VectorCompare(radius_org, org))
+		{
+			return false;
+		}
+
+		for (i = 0; i < radius_count && radius_list[i] <= from; i++)
+		{
+		}
+	}
+
+	for ( ; i < radius_count; i++)
+	{
+		ent = radius_list[i];
+
+		if (!ent->inuse || (ent->solid == SOLID_NOT))
+		{
+			continue;
+		}
+
+		for (j = 0; j < 3; j++)
+		{
+			eorg[j] = org[j] - (ent->s.origin[j] + (ent->mins[j] + ent->maxs[j]) * 0.5f);
+		}
+
+		if (VectorLength(eorg) > rad)
+		{
+			continue;
+		}
+
+		*result = ent;
+		return true;
+	}
+
+	*result = NULL;
+	return true;
+}
+
 /*
  * Searches all active entities for the next one
  * that holds the matching string at fieldofs (use
@@ -46,6 +364,7 @@ void G_ProjectSource(vec3_t point, vec3_t distance, vec3_t forward, vec3_t right
 edict_t* G_Find(edict_t *from, int fieldofs, char *match)
 {
 	char *s;
+	int field;
 
 	if (!from)
 	{
@@ -56,6 +375,18 @@ edict_t* G_Find(edict_t *from, int fieldofs, char *match)
 		from++;
 	}
 
+	field = G_FindIndex_field(fieldofs);
+
+	if (match && (field >= 0) && !findindex_suspended)
+	{
+		if (!findindex_valid)
+		{
+			G_FindIndex_rebuild();
+		}
+
+		return G_FindIndex_find(from, field, match);
+	}
+
 	for (; from < &g_edicts[globals.num_edicts]; from++)
 	{
 		if (!from->inuse)
@@ -85,8 +416,14 @@ edict_t* G_Find(edict_t *from, int fieldofs, char *match)
 edict_t* findradius(edict_t *from, vec3_t org, float rad)
 {
 	vec3_t eorg;
+	edict_t *result;
 	int j;
 
+	if (G_RadiusCache_next(from, org, rad, &result))
+	{
+		return result;
+	}
+
 	if (!from)
 	{
 		from = g_edicts;
@@ -200,7 +537,7 @@ void G_UseTargets(edict_t *ent, edict_t *activator)
 	{
 		/* create a temp object to fire at a later time */
 		t = G_Spawn();
-		t->classname = "DelayedUse";
+		G_SetClassname(t, "DelayedUse");
 		t->nextthink = level.time + ent->delay;
 		t->think = Think_Delay;
 		t->activator = activator;
@@ -444,7 +781,7 @@ char* G_CopyString(char *in)
 void G_InitEdict(edict_t *e)
 {
 	e->inuse = true;
-	e->classname = "noclass";
+	G_SetClassname(e, "noclass");
 	e->gravity = 1.0f;
 	e->s.number = e - g_edicts;
 }
@@ -497,7 +834,8 @@ void G_FreeEdict(edict_t *ed)
 	}
 
 	memset(ed, 0, sizeof(*ed));
-	ed->classname = "freed";
+	G_FindIndex_relink(ed, 1);
+	G_SetClassname(ed, "freed");
 	ed->freetime = level.time;
 	ed->inuse = false;
 }
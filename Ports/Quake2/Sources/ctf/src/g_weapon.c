@@ -147,51 +147,66 @@ qboolean fire_hit(edict_t *self, vec3_t aim, int damage, int kick)
 	return true;
 }
 
+/* a bullet between its aim and its impact, so that pellets can be traced together */
+typedef struct
+{
+	vec3_t end;
+	vec3_t water_start;
+	qboolean water;
+	int content_mask;
+} lead_t;
+
+#define MAX_BATCHED_PELLETS 32
+
 /*
- * This is an internal support routine
- * used for bullet/pellet based weapons.
+ * Spreads a bullet that left the muzzle.
  */
-static void fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick, int te_impact, int hspread, int vspread, int mod)
+static void fire_lead_aim(vec3_t start, vec3_t aimdir, int hspread, int vspread, lead_t *lead)
 {
-	trace_t tr;
 	vec3_t dir;
 	vec3_t forward, right, up;
-	vec3_t end;
 	float r;
 	float u;
-	vec3_t water_start;
-	qboolean water = false;
-	int content_mask = MASK_SHOT | MASK_WATER;
 
-	tr = gi.trace(self->s.origin, NULL, NULL, start, self, MASK_SHOT);
+	lead->content_mask = MASK_SHOT | MASK_WATER;
 
-	if (!(tr.fraction < 1.0f))
-	{
-		vectoangles(aimdir, dir);
-		AngleVectors(dir, forward, right, up);
+	vectoangles(aimdir, dir);
+	AngleVectors(dir, forward, right, up);
 
-		r = crandom() * hspread;
-		u = crandom() * vspread;
-		VectorMA(start, 8192, forward, end);
-		VectorMA(end, r, right, end);
-		VectorMA(end, u, up, end);
+	r = crandom() * hspread;
+	u = crandom() * vspread;
+	VectorMA(start, 8192, forward, lead->end);
+	VectorMA(lead->end, r, right, lead->end);
+	VectorMA(lead->end, u, up, lead->end);
 
-		if (gi.pointcontents(start) & MASK_WATER)
-		{
-			water = true;
-			VectorCopy(start, water_start);
-			content_mask &= ~MASK_WATER;
-		}
+	if (gi.pointcontents(start) & MASK_WATER)
+	{
+		lead->water = true;
+		VectorCopy(start, lead->water_start);
+		lead->content_mask &= ~MASK_WATER;
+	}
+}
 
-		tr = gi.trace(start, NULL, NULL, end, self, content_mask);
+/*
+ * Finishes a bullet from the trace of its aim, or
+ * from the trace that stopped it at the muzzle.
+ */
+static void fire_lead_impact(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick, int te_impact, int hspread, int vspread, int mod, lead_t *lead, trace_t tr, qboolean aimed)
+{
+	vec3_t dir;
+	vec3_t forward, right, up;
+	float r;
+	float u;
 
+	if (aimed)
+	{
 		/* see if we hit water */
 		if (tr.contents & MASK_WATER)
 		{
 			int color;
 
-			water = true;
-			VectorCopy(tr.endpos, water_start);
+			lead->water = true;
+			VectorCopy(tr.endpos, lead->water_start);
 
 			if (!VectorCompare(start, tr.endpos))
 			{
@@ -233,18 +248,18 @@ static void fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, in
 				}
 
 				/* change bullet's course when it enters water */
-				VectorSubtract(end, start, dir);
+				VectorSubtract(lead->end, start, dir);
 				vectoangles(dir, dir);
 				AngleVectors(dir, forward, right, up);
 				r = crandom() * hspread * 2;
 				u = crandom() * vspread * 2;
-				VectorMA(water_start, 8192, forward, end);
-				VectorMA(end, r, right, end);
-				VectorMA(end, u, up, end);
+				VectorMA(lead->water_start, 8192, forward, lead->end);
+				VectorMA(lead->end, r, right, lead->end);
+				VectorMA(lead->end, u, up, lead->end);
 			}
 
 			/* re-trace ignoring water this time */
-			tr = gi.trace(water_start, NULL, NULL, end, self, MASK_SHOT);
+			tr = gi.trace(lead->water_start, NULL, NULL, lead->end, self, MASK_SHOT);
 		}
 	}
 
@@ -279,11 +294,11 @@ static void fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, in
 
 	/* if went through water, determine where
 	   the end and make a bubble trail */
-	if (water)
+	if (lead->water)
 	{
 		vec3_t pos;
 
-		VectorSubtract(tr.endpos, water_start, dir);
+		VectorSubtract(tr.endpos, lead->water_start, dir);
 		VectorNormalize(dir);
 		VectorMA(tr.endpos, -2, dir, pos);
 
@@ -293,20 +308,46 @@ static void fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, in
 		}
 		else
 		{
-			tr = gi.trace(pos, NULL, NULL, water_start, tr.ent, MASK_WATER);
+			tr = gi.trace(pos, NULL, NULL, lead->water_start, tr.ent, MASK_WATER);
 		}
 
-		VectorAdd(water_start, tr.endpos, pos);
+		VectorAdd(lead->water_start, tr.endpos, pos);
 		VectorScale(pos, 0.5f, pos);
 
 		gi.WriteByte(svc_temp_entity);
 		gi.WriteByte(TE_BUBBLETRAIL);
-		gi.WritePosition(water_start);
+		gi.WritePosition(lead->water_start);
 		gi.WritePosition(tr.endpos);
 		gi.multicast(pos, MULTICAST_PVS);
 	}
 }
 
+/*
+ * This is an internal support routine
+ * used for bullet/pellet based weapons.
+ */
+static void fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick, int te_impact, int hspread, int vspread, int mod)
+{
+	trace_t tr;
+	lead_t lead;
+
+	lead.water = false;
+
+	tr = gi.trace(self->s.origin, NULL, NULL, start, self, MASK_SHOT);
+
+	if (tr.fraction < 1.0f)
+	{
+		fire_lead_impact(self, start, aimdir, damage, kick, te_impact,
+			hspread, vspread, mod, &lead, tr, false);
+		return;
+	}
+
+	fire_lead_aim(start, aimdir, hspread, vspread, &lead);
+	tr = gi.trace(start, NULL, NULL, lead.end, self, lead.content_mask);
+	fire_lead_impact(self, start, aimdir, damage, kick, te_impact,
+		hspread, vspread, mod, &lead, tr, true);
+}
+
 /*
  * Fires a single round.  Used for machinegun and
  * chaingun.  Would be fine for pistols, rifles, etc....
@@ -323,12 +364,64 @@ void fire_bullet(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kic
  */
 void fire_shotgun(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick, int hspread, int vspread, int count, int mod)
 {
-	int i;
+	tracerequest_t requests[MAX_BATCHED_PELLETS];
+	lead_t leads[MAX_BATCHED_PELLETS];
+	int linkcounts[MAX_BATCHED_PELLETS];
+	trace_t tr;
+	int i, n;
+
+	tr = gi.trace(self->s.origin, NULL, NULL, start, self, MASK_SHOT);
+
+	if (tr.fraction < 1.0f)
+	{
+		for (i = 0; i < count; i++)
+		{
+			fire_lead(self, start, aimdir, damage, kick, TE_SHOTGUN,
+				hspread, vspread, mod);
+		}
 
-	for (i = 0; i < count; i++)
+		return;
+	}
+
+	/* the pellets are traced together, a pellet that hit
+	   something an earlier one moved or removed is traced
+	   again */
+	for ( ; count > 0; count -= n)
 	{
-		fire_lead(self, start, aimdir, damage, kick,
-			TE_SHOTGUN, hspread, vspread, mod);
+		n = (count < MAX_BATCHED_PELLETS) ? count : MAX_BATCHED_PELLETS;
+		memset(requests, 0, n * sizeof(requests[0]));
+
+		for (i = 0; i < n; i++)
+		{
+			leads[i].water = false;
+			fire_lead_aim(start, aimdir, hspread, vspread, &leads[i]);
+
+			VectorCopy(start, requests[i].start);
+			VectorCopy(leads[i].end, requests[i].end);
+			requests[i].passent = self;
+			requests[i].contentmask = leads[i].content_mask;
+		}
+
+		gi.tracebatch(requests, n);
+
+		for (i = 0; i < n; i++)
+		{
+			linkcounts[i] = requests[i].trace.ent->linkcount;
+		}
+
+		for (i = 0; i < n; i++)
+		{
+			tr = requests[i].trace;
+
+			if (!tr.ent->inuse || (tr.ent->linkcount != linkcounts[i]))
+			{
+				tr = gi.trace(start, NULL, NULL, leads[i].end, self,
+						leads[i].content_mask);
+			}
+
+			fire_lead_impact(self, start, aimdir, damage, kick, TE_SHOTGUN,
+				hspread, vspread, mod, &leads[i], tr, true);
+		}
 	}
 }
 
@@ -417,7 +510,7 @@ void fire_blaster(edict_t *self, vec3_t start, vec3_t dir, int damage, int speed
 	bolt->nextthink = level.time + 2;
 	bolt->think = G_FreeEdict;
 	bolt->dmg = damage;
-	bolt->classname = "bolt";
+	G_SetClassname(bolt, "bolt");
 
 	if (hyper)
 	{
@@ -592,7 +685,7 @@ void fire_grenade(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int sp
 	grenade->think = Grenade_Explode;
 	grenade->dmg = damage;
 	grenade->dmg_radius = damage_radius;
-	grenade->classname = "grenade";
+	G_SetClassname(grenade, "grenade");
 
 	gi.linkentity(grenade);
 }
@@ -625,7 +718,7 @@ void fire_grenade2(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int s
 	grenade->think = Grenade_Explode;
 	grenade->dmg = damage;
 	grenade->dmg_radius = damage_radius;
-	grenade->classname = "hgrenade";
+	G_SetClassname(grenade, "hgrenade");
 
 	if (held)
 	{
@@ -742,7 +835,7 @@ void fire_rocket(edict_t *self, vec3_t start, vec3_t dir, int damage, int speed,
 	rocket->radius_dmg = radius_damage;
 	rocket->dmg_radius = damage_radius;
 	rocket->s.sound = gi.soundindex("weapons/rockfly.wav");
-	rocket->classname = "rocket";
+	G_SetClassname(rocket, "rocket");
 
 	if (self->client)
 	{
@@ -1059,7 +1152,7 @@ void fire_bfg(edict_t *self, vec3_t start, vec3_t dir, int damage, int speed, fl
 	bfg->think = G_FreeEdict;
 	bfg->radius_dmg = damage;
 	bfg->dmg_radius = damage_radius;
-	bfg->classname = "bfg blast";
+	G_SetClassname(bfg, "bfg blast");
 	bfg->s.sound = gi.soundindex("weapons/bfg__l1a.wav");
 
 	bfg->think = bfg_think;
@@ -105,6 +105,16 @@ struct edict_s
 
 /* =============================================================== */
 
+/* one trace of a batch, with the arguments of trace() */
+typedef struct
+{
+	vec3_t start, end;
+	vec3_t mins, maxs;
+	edict_t *passent;
+	int contentmask;
+	trace_t trace; /* filled in by tracebatch() */
+} tracerequest_t;
+
 /* functions provided by the main engine */
 typedef struct
 {
@@ -170,6 +180,9 @@ typedef struct
 
 	void (*AddCommandString)(char *text);
 	void (*DebugGraph)(float value, int color);
+
+	/* independent traces, possibly run on several threads */
+	void (*tracebatch)(tracerequest_t *requests, int count);
 } game_import_t;
 
 /* functions exported by the game subsystem */
@@ -2042,7 +2042,7 @@ void SP_func_water(edict_t *self)
 		self->spawnflags |= DOOR_TOGGLE;
 	}
 
-	self->classname = "func_door";
+	G_SetClassname(self, "func_door");
 
 	gi.linkentity(self);
 }
@@ -2873,7 +2873,7 @@ void SP_func_door_secret(edict_t *ent)
 		ent->touch = door_touch;
 	}
 
-	ent->classname = "func_door";
+	G_SetClassname(ent, "func_door");
 
 	gi.linkentity(ent);
 }
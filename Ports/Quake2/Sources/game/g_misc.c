@@ -267,7 +267,7 @@ void ThrowHead(edict_t *self, char *gibname, int damage, int type)
 	self->flags |= FL_NO_KNOCKBACK;
 	self->svflags &= ~SVF_MONSTER;
 	self->takedamage = DAMAGE_YES;
-	self->targetname = NULL;
+	G_SetTargetname(self, NULL);
 	self->die = gib_die;
 
 	if (type == GIB_ORGANIC)
@@ -396,7 +396,7 @@ void ThrowDebris(edict_t *self, char *modelname, float speed, vec3_t origin)
 	chunk->nextthink = level.time + 5 + random() * 5;
 	chunk->s.frame = 0;
 	chunk->flags = 0;
-	chunk->classname = "debris";
+	G_SetClassname(chunk, "debris");
 	chunk->takedamage = DAMAGE_YES;
 	chunk->die = debris_die;
 	gi.linkentity(chunk);
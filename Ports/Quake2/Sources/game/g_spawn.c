@@ -595,6 +595,7 @@ void SpawnEntities(const char *mapname, char *entities, const char *spawnpoint)
 	gi.FreeTags(TAG_LEVEL);
 
 	memset(&level, 0, sizeof(level));
+	G_SuspendFindIndex();
 	memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
 
 	Q_strlcpy(level.mapname, mapname, sizeof(level.mapname));
@@ -683,6 +684,8 @@ void SpawnEntities(const char *mapname, char *entities, const char *spawnpoint)
 		ED_CallSpawn(ent);
 	}
 
+	G_InvalidateFindIndex();
+
 	gi.dprintf("%i entities inhibited.\n", inhibit);
 
 	G_FindTeams();
@@ -73,7 +73,7 @@ void SP_FixCoopSpots(edict_t *self)
 		{
 			if ((!self->targetname) || (Q_stricmp(self->targetname, spot->targetname) != 0))
 			{
-				self->targetname = spot->targetname;
+				G_SetTargetname(self, spot->targetname);
 			}
 
 			return;
@@ -99,27 +99,27 @@ void SP_CreateCoopSpots(edict_t *self)
 	if (Q_stricmp(level.mapname, "security") == 0)
 	{
 		spot = G_Spawn();
-		spot->classname = "info_player_coop";
+		G_SetClassname(spot, "info_player_coop");
 		spot->s.origin[0] = 188 - 64;
 		spot->s.origin[1] = -164;
 		spot->s.origin[2] = 80;
-		spot->targetname = "jail3";
+		G_SetTargetname(spot, "jail3");
 		spot->s.angles[1] = 90;
 
 		spot = G_Spawn();
-		spot->classname = "info_player_coop";
+		G_SetClassname(spot, "info_player_coop");
 		spot->s.origin[0] = 188 + 64;
 		spot->s.origin[1] = -164;
 		spot->s.origin[2] = 80;
-		spot->targetname = "jail3";
+		G_SetTargetname(spot, "jail3");
 		spot->s.angles[1] = 90;
 
 		spot = G_Spawn();
-		spot->classname = "info_player_coop";
+		G_SetClassname(spot, "info_player_coop");
 		spot->s.origin[0] = 188 + 128;
 		spot->s.origin[1] = -164;
 		spot->s.origin[2] = 80;
-		spot->targetname = "jail3";
+		G_SetTargetname(spot, "jail3");
 		spot->s.angles[1] = 90;
 
 		return;
@@ -149,12 +149,12 @@ void SP_CreateUnnamedSpawn(edict_t *self)
 	{
 		if (Q_stricmp(self->targetname, "mintro") == 0)
 		{
-			spot->classname = self->classname;
+			G_SetClassname(spot, self->classname);
 			spot->s.origin[0] = self->s.origin[0];
 			spot->s.origin[1] = self->s.origin[1];
 			spot->s.origin[2] = self->s.origin[2];
 			spot->s.angles[1] = self->s.angles[1];
-			spot->targetname = NULL;
+			G_SetTargetname(spot, NULL);
 
 			return;
 		}
@@ -165,12 +165,12 @@ void SP_CreateUnnamedSpawn(edict_t *self)
 	{
 		if (Q_stricmp(self->targetname, "mine1") == 0)
 		{
-			spot->classname = self->classname;
+			G_SetClassname(spot, self->classname);
 			spot->s.origin[0] = self->s.origin[0];
 			spot->s.origin[1] = self->s.origin[1];
 			spot->s.origin[2] = self->s.origin[2];
 			spot->s.angles[1] = self->s.angles[1];
-			spot->targetname = NULL;
+			G_SetTargetname(spot, NULL);
 
 			return;
 		}
@@ -181,12 +181,12 @@ void SP_CreateUnnamedSpawn(edict_t *self)
 	{
 		if (Q_stricmp(self->targetname, "mine2a") == 0)
 		{
-			spot->classname = self->classname;
+			G_SetClassname(spot, self->classname);
 			spot->s.origin[0] = self->s.origin[0];
 			spot->s.origin[1] = self->s.origin[1];
 			spot->s.origin[2] = self->s.origin[2];
 			spot->s.angles[1] = self->s.angles[1];
-			spot->targetname = NULL;
+			G_SetTargetname(spot, NULL);
 
 			return;
 		}
@@ -197,12 +197,12 @@ void SP_CreateUnnamedSpawn(edict_t *self)
 	{
 		if (Q_stricmp(self->targetname, "mine3") == 0)
 		{
-			spot->classname = self->classname;
+			G_SetClassname(spot, self->classname);
 			spot->s.origin[0] = self->s.origin[0];
 			spot->s.origin[1] = self->s.origin[1];
 			spot->s.origin[2] = self->s.origin[2];
 			spot->s.angles[1] = self->s.angles[1];
-			spot->targetname = NULL;
+			G_SetTargetname(spot, NULL);
 
 			return;
 		}
@@ -213,12 +213,12 @@ void SP_CreateUnnamedSpawn(edict_t *self)
 	{
 		if (Q_stricmp(self->targetname, "power1") == 0)
 		{
-			spot->classname = self->classname;
+			G_SetClassname(spot, self->classname);
 			spot->s.origin[0] = self->s.origin[0];
 			spot->s.origin[1] = self->s.origin[1];
 			spot->s.origin[2] = self->s.origin[2];
 			spot->s.angles[1] = self->s.angles[1];
-			spot->targetname = NULL;
+			G_SetTargetname(spot, NULL);
 
 			return;
 		}
@@ -229,12 +229,12 @@ void SP_CreateUnnamedSpawn(edict_t *self)
 	{
 		if (Q_stricmp(self->targetname, "power2") == 0)
 		{
-			spot->classname = self->classname;
+			G_SetClassname(spot, self->classname);
 			spot->s.origin[0] = self->s.origin[0];
 			spot->s.origin[1] = self->s.origin[1];
 			spot->s.origin[2] = self->s.origin[2];
 			spot->s.angles[1] = self->s.angles[1];
-			spot->targetname = NULL;
+			G_SetTargetname(spot, NULL);
 
 			return;
 		}
@@ -245,12 +245,12 @@ void SP_CreateUnnamedSpawn(edict_t *self)
 	{
 		if (Q_stricmp(self->targetname, "waste1") == 0)
 		{
-			spot->classname = self->classname;
+			G_SetClassname(spot, self->classname);
 			spot->s.origin[0] = self->s.origin[0];
 			spot->s.origin[1] = self->s.origin[1];
 			spot->s.origin[2] = self->s.origin[2];
 			spot->s.angles[1] = self->s.angles[1];
-			spot->targetname = NULL;
+			G_SetTargetname(spot, NULL);
 
 			return;
 		}
@@ -261,12 +261,12 @@ void SP_CreateUnnamedSpawn(edict_t *self)
 	{
 		if (Q_stricmp(self->targetname, "waste2") == 0)
 		{
-			spot->classname = self->classname;
+			G_SetClassname(spot, self->classname);
 			spot->s.origin[0] = self->s.origin[0];
 			spot->s.origin[1] = self->s.origin[1];
 			spot->s.origin[2] = self->s.origin[2];
 			spot->s.angles[1] = self->s.angles[1];
-			spot->targetname = NULL;
+			G_SetTargetname(spot, NULL);
 
 			return;
 		}
@@ -277,12 +277,12 @@ void SP_CreateUnnamedSpawn(edict_t *self)
 	{
 		if (Q_stricmp(self->targetname, "city2NL") == 0)
 		{
-			spot->classname = self->classname;
+			G_SetClassname(spot, self->classname);
 			spot->s.origin[0] = self->s.origin[0];
 			spot->s.origin[1] = self->s.origin[1];
 			spot->s.origin[2] = self->s.origin[2];
 			spot->s.angles[1] = self->s.angles[1];
-			spot->targetname = NULL;
+			G_SetTargetname(spot, NULL);
 
 			return;
 		}
@@ -1394,7 +1394,7 @@ void InitBodyQue(void)
 		for (i = 0; i < BODY_QUEUE_SIZE; i++)
 		{
 			ent = G_Spawn();
-			ent->classname = "bodyque";
+			G_SetClassname(ent, "bodyque");
 		}
 	}
 }
@@ -1684,7 +1684,7 @@ void PutClientInServer(edict_t *ent)
 	ent->movetype = MOVETYPE_WALK;
 	ent->viewheight = 22;
 	ent->inuse = true;
-	ent->classname = "player";
+	G_SetClassname(ent, "player");
 	ent->mass = 200;
 	ent->solid = SOLID_BBOX;
 	ent->deadflag = DEAD_NO;
@@ -1867,7 +1867,7 @@ void ClientBegin(edict_t *ent)
 		   except for the persistant data that was initialized at
 		   ClientConnect() time */
 		G_InitEdict(ent);
-		ent->classname = "player";
+		G_SetClassname(ent, "player");
 		InitClientResp(ent->client);
 		PutClientInServer(ent);
 	}
@@ -2103,7 +2103,7 @@ void ClientDisconnect(edict_t *ent)
 	ent->s.modelindex = 0;
 	ent->solid = SOLID_NOT;
 	ent->inuse = false;
-	ent->classname = "disconnected";
+	G_SetClassname(ent, "disconnected");
 	ent->client->pers.connected = false;
 
 	playernum = ent - g_edicts - 1;
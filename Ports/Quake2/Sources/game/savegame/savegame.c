@@ -268,6 +268,7 @@ void InitGame(void)
 	game.maxentities = maxentities->value;
 	g_edicts = gi.TagMalloc(game.maxentities * sizeof(g_edicts[0]), TAG_GAME);
 	globals.edicts = g_edicts;
+	G_InvalidateFindIndex();
 	globals.max_edicts = game.maxentities;
 
 	/* initialize all clients for this game */
@@ -885,6 +886,7 @@ void ReadGame(const char *filename)
 
 	g_edicts = gi.TagMalloc(game.maxentities * sizeof(g_edicts[0]), TAG_GAME);
 	globals.edicts = g_edicts;
+	G_InvalidateFindIndex();
 
 	fread(&game, sizeof(game), 1, f);
 	game.clients = gi.TagMalloc(game.maxclients * sizeof(game.clients[0]),
@@ -1068,6 +1070,7 @@ void ReadLevel(const char *filename)
 	gi.FreeTags(TAG_LEVEL);
 
 	/* wipe all the entities */
+	G_SuspendFindIndex();
 	memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
 	globals.num_edicts = maxclients->value + 1;
 
@@ -1112,6 +1115,8 @@ void ReadLevel(const char *filename)
 
 	fclose(f);
 
+	G_InvalidateFindIndex();
+
 	/* mark all clients as unconnected */
 	for (i = 0; i < maxclients->value; i++)
 	{
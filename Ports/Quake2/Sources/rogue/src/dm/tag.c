@@ -226,7 +226,7 @@ Tag_DropToken(edict_t *ent, gitem_t *item)
 
 	tag_token = G_Spawn();
 
-	tag_token->classname = item->classname;
+	G_SetClassname(tag_token, item->classname);
 	tag_token->item = item;
 	tag_token->spawnflags = DROPPED_ITEM;
 	tag_token->s.effects = EF_ROTATE | EF_TAGTRAIL;
@@ -321,7 +321,7 @@ Tag_PostInitSetup(void)
 	if (e == NULL)
 	{
 		e = G_Spawn();
-		e->classname = "dm_tag_token";
+		G_SetClassname(e, "dm_tag_token");
 
 		SelectSpawnPoint(e, origin, angles);
 		VectorCopy(origin, e->s.origin);
@@ -359,7 +359,7 @@ SP_dm_tag_token(edict_t *self)
 	tag_token = self;
 	tag_count = 0;
 
-	self->classname = "dm_tag_token";
+	G_SetClassname(self, "dm_tag_token");
 	self->model = "models/items/tagtoken/tris.md2";
 	self->count = 1;
 	SpawnItem(self, FindItem("Tag Token"));
@@ -2946,7 +2946,7 @@ void SP_func_water(edict_t *self)
 		self->spawnflags |= DOOR_TOGGLE;
 	}
 
-	self->classname = "func_door";
+	G_SetClassname(self, "func_door");
 
 	gi.linkentity(self);
 }
@@ -3798,7 +3798,7 @@ void SP_func_door_secret(edict_t *ent)
 		ent->touch = door_touch;
 	}
 
-	ent->classname = "func_door";
+	G_SetClassname(ent, "func_door");
 
 	gi.linkentity(ent);
 }
@@ -377,7 +377,7 @@ void ThrowDebris(edict_t *self, char *modelname, float speed, vec3_t origin)
 	chunk->nextthink = level.time + 5 + random() * 5;
 	chunk->s.frame = 0;
 	chunk->flags = 0;
-	chunk->classname = "debris";
+	G_SetClassname(chunk, "debris");
 	chunk->takedamage = DAMAGE_YES;
 	chunk->die = debris_die;
 	gi.linkentity(chunk);
@@ -1197,7 +1197,7 @@ edict_t* SpawnBadArea(vec3_t mins, vec3_t maxs, float lifespan, edict_t *owner)
 	badarea->touch = badarea_touch;
 	badarea->movetype = MOVETYPE_NONE;
 	badarea->solid = SOLID_TRIGGER;
-	badarea->classname = "bad_area";
+	G_SetClassname(badarea, "bad_area");
 	gi.linkentity(badarea);
 
 	if (lifespan)
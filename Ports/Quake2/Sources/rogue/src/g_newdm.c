@@ -263,7 +263,7 @@ edict_t* DoRandomRespawn(edict_t *ent)
 	gi.unlinkentity(ent);
 
 	newEnt = G_Spawn();
-	newEnt->classname = classname;
+	G_SetClassname(newEnt, classname);
 	VectorCopy(ent->s.origin, newEnt->s.origin);
 	VectorCopy(ent->s.old_origin, newEnt->s.old_origin);
 	VectorCopy(ent->mins, newEnt->mins);
@@ -419,7 +419,7 @@ void fire_doppleganger(edict_t *ent, vec3_t start, vec3_t aimdir)
 
 	base->nextthink = level.time + 30;
 	base->think = doppleganger_timeout;
-	base->classname = "doppleganger";
+	G_SetClassname(base, "doppleganger");
 
 	gi.linkentity(base);
 
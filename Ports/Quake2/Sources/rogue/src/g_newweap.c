@@ -494,7 +494,7 @@ void prox_land(edict_t *ent, edict_t *other, cplane_t *plane, csurface_t *surf)
 	field->movetype = MOVETYPE_NONE;
 	field->solid = SOLID_TRIGGER;
 	field->owner = ent;
-	field->classname = "prox_field";
+	G_SetClassname(field, "prox_field");
 	field->teammaster = ent;
 	gi.linkentity(field);
 
@@ -552,7 +552,7 @@ void fire_prox(edict_t *self, vec3_t start, vec3_t aimdir, int damage_multiplier
 	prox->touch = prox_land;
 	prox->think = Prox_Explode;
 	prox->dmg = PROX_DAMAGE * damage_multiplier;
-	prox->classname = "prox";
+	G_SetClassname(prox, "prox");
 	prox->svflags |= SVF_DAMAGEABLE;
 	prox->flags |= FL_MECHANICAL;
 
@@ -921,7 +921,7 @@ void fire_nuke(edict_t *self, vec3_t start, vec3_t aimdir, int speed)
 		nuke->dmg_radius = NUKE_RADIUS + NUKE_RADIUS * (0.25f * (float)damage_modifier);
 	}
 
-	nuke->classname = "nuke";
+	G_SetClassname(nuke, "nuke");
 	nuke->die = nuke_die;
 
 	gi.linkentity(nuke);
@@ -1144,7 +1144,7 @@ void tesla_activate(edict_t *self)
 	trigger->solid = SOLID_TRIGGER;
 	trigger->owner = self;
 	trigger->touch = tesla_zap;
-	trigger->classname = "tesla trigger";
+	G_SetClassname(trigger, "tesla trigger");
 
 	/* doesn't need to be marked as a teamslave since the move code for bounce looks for teamchains */
 	gi.linkentity(trigger);
@@ -1298,7 +1298,7 @@ void fire_tesla(edict_t *self, vec3_t start, vec3_t aimdir, int damage_multiplie
 	tesla->takedamage = DAMAGE_YES;
 	tesla->die = tesla_die;
 	tesla->dmg = TESLA_DAMAGE * damage_multiplier;
-	tesla->classname = "tesla";
+	G_SetClassname(tesla, "tesla");
 	tesla->svflags |= SVF_DAMAGEABLE;
 	tesla->clipmask = MASK_SHOT | CONTENTS_SLIME | CONTENTS_LAVA;
 	tesla->flags |= FL_MECHANICAL;
@@ -1591,7 +1591,7 @@ void fire_blaster2(edict_t *self, vec3_t start, vec3_t dir, int damage, int spee
 	bolt->nextthink = level.time + 2;
 	bolt->think = G_FreeEdict;
 	bolt->dmg = damage;
-	bolt->classname = "bolt";
+	G_SetClassname(bolt, "bolt");
 	gi.linkentity(bolt);
 
 	if (self->client)
@@ -1692,7 +1692,7 @@ void tracker_pain_daemon_spawn(edict_t *owner, edict_t *enemy, int damage)
 	}
 
 	daemon = G_Spawn();
-	daemon->classname = "pain daemon";
+	G_SetClassname(daemon, "pain daemon");
 	daemon->think = tracker_pain_daemon_think;
 	daemon->nextthink = level.time + FRAMETIME;
 	daemon->timestamp = level.time;
@@ -1865,7 +1865,7 @@ void fire_tracker(edict_t *self, vec3_t start, vec3_t dir, int damage, int speed
 	bolt->enemy = enemy;
 	bolt->owner = self;
 	bolt->dmg = damage;
-	bolt->classname = "tracker";
+	G_SetClassname(bolt, "tracker");
 	gi.linkentity(bolt);
 
 	if (enemy)
@@ -357,17 +357,17 @@ void ED_CallSpawn(edict_t *ent)
 
 	if (!strcmp(ent->classname, "weapon_nailgun"))
 	{
-		ent->classname = (FindItem("ETF Rifle"))->classname;
+		G_SetClassname(ent, (FindItem("ETF Rifle"))->classname);
 	}
 
 	if (!strcmp(ent->classname, "ammo_nails"))
 	{
-		ent->classname = (FindItem("Flechettes"))->classname;
+		G_SetClassname(ent, (FindItem("Flechettes"))->classname);
 	}
 
 	if (!strcmp(ent->classname, "weapon_heatbeam"))
 	{
-		ent->classname = (FindItem("Plasma Beam"))->classname;
+		G_SetClassname(ent, (FindItem("Plasma Beam"))->classname);
 	}
 
 	/* check item spawn functions */
@@ -754,6 +754,7 @@ void SpawnEntities(const char *mapname, char *entities, const char *spawnpoint)
 	gi.FreeTags(TAG_LEVEL);
 
 	memset(&level, 0, sizeof(level));
+	G_SuspendFindIndex();
 	memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
 
 	strncpy(level.mapname, mapname, sizeof(level.mapname) - 1);
@@ -887,6 +888,8 @@ void SpawnEntities(const char *mapname, char *entities, const char *spawnpoint)
 		ent->s.renderfx |= RF_IR_VISIBLE;
 	}
 
+	G_InvalidateFindIndex();
+
 	gi.dprintf("%i entities inhibited.\n", inhibit);
 
 	G_FindTeams();
@@ -1298,7 +1301,7 @@ edict_t* CreateMonster(vec3_t origin, vec3_t angles, char *classname)
 
 	VectorCopy(origin, newEnt->s.origin);
 	VectorCopy(angles, newEnt->s.angles);
-	newEnt->classname = ED_NewString(classname);
+	G_SetClassname(newEnt, ED_NewString(classname));
 	newEnt->monsterinfo.aiflags |= AI_DO_NOT_COUNT;
 
 	VectorSet(newEnt->gravityVector, 0, 0, -1);
@@ -1562,7 +1565,7 @@ void DetermineBBox(char *classname, vec3_t mins, vec3_t maxs)
 
 	VectorCopy(vec3_origin, newEnt->s.origin);
 	VectorCopy(vec3_origin, newEnt->s.angles);
-	newEnt->classname = ED_NewString(classname);
+	G_SetClassname(newEnt, ED_NewString(classname));
 	newEnt->monsterinfo.aiflags |= AI_DO_NOT_COUNT;
 
 	ED_CallSpawn(newEnt);
@@ -1635,7 +1638,7 @@ void SpawnGrow_Spawn(vec3_t startpos, int size)
 	ent->solid = SOLID_NOT;
 	ent->s.renderfx = RF_IR_VISIBLE;
 	ent->movetype = MOVETYPE_NONE;
-	ent->classname = "spawngro";
+	G_SetClassname(ent, "spawngro");
 
 	if (size <= 1)
 	{
@@ -1774,7 +1777,7 @@ void Widowlegs_Spawn(vec3_t startpos, vec3_t angles)
 	ent->solid = SOLID_NOT;
 	ent->s.renderfx = RF_IR_VISIBLE;
 	ent->movetype = MOVETYPE_NONE;
-	ent->classname = "widowlegs";
+	G_SetClassname(ent, "widowlegs");
 
 	ent->s.modelindex = gi.modelindex("models/monsters/legs/tris.md2");
 	ent->think = widowlegs_think;
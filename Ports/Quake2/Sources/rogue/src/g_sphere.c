@@ -721,7 +721,7 @@ edict_t* Sphere_Spawn(edict_t *owner, int spawnflags)
 		sphere->owner = owner;
 	}
 
-	sphere->classname = "sphere";
+	G_SetClassname(sphere, "sphere");
 	sphere->yaw_speed = 40;
 	sphere->monsterinfo.attack_finished = 0;
 	sphere->spawnflags = spawnflags; /* need this for the HUD to recognize sphere */
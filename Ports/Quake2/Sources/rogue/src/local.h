@@ -691,6 +691,10 @@ qboolean KillBox(edict_t *ent);
 void G_ProjectSource(vec3_t point, vec3_t distance, vec3_t forward, vec3_t right, vec3_t result);
 edict_t* G_Find(edict_t *from, int fieldofs, char *match);
 edict_t* findradius(edict_t *from, vec3_t org, float rad);
+void G_SetClassname(edict_t *ent, char *classname);
+void G_SetTargetname(edict_t *ent, char *targetname);
+void G_SuspendFindIndex(void);
+void G_InvalidateFindIndex(void);
 edict_t* G_PickTarget(char *targetname);
 void G_UseTargets(edict_t *ent, edict_t *activator);
 void G_SetMovedir(vec3_t angles, vec3_t movedir);
@@ -1087,7 +1087,7 @@ medic_cable_attack(edict_t *self)
 		self->enemy->spawnflags = 0;
 		self->enemy->monsterinfo.aiflags = 0;
 		self->enemy->target = NULL;
-		self->enemy->targetname = NULL;
+		G_SetTargetname(self->enemy, NULL);
 		self->enemy->combattarget = NULL;
 		self->enemy->deathtarget = NULL;
 		self->enemy->monsterinfo.healer = self;
@@ -1777,7 +1777,7 @@ MedicCommanderCache(void)
 
 		VectorCopy(vec3_origin, newEnt->s.origin);
 		VectorCopy(vec3_origin, newEnt->s.angles);
-		newEnt->classname = ED_NewString(reinforcements[i]);
+		G_SetClassname(newEnt, ED_NewString(reinforcements[i]));
 
 		newEnt->monsterinfo.aiflags |= AI_DO_NOT_COUNT;
 
@@ -25,7 +25,8 @@ M_CheckBottom(edict_t *ent)
 {
 	vec3_t mins, maxs, start, stop;
 	trace_t trace;
-	int x, y;
+	tracerequest_t requests[4];
+	int i, x, y;
 	float mid, bottom;
 
 	if (!ent)
@@ -92,16 +93,27 @@ realcheck:
 
 	mid = bottom = trace.endpos[2];
 
+	/* the midpoint passed, the four corners are traced together */
+	memset(requests, 0, sizeof(requests));
+
+	for (i = 0; i < 4; i++)
+	{
+		requests[i].start[0] = requests[i].end[0] = (i & 2) ? maxs[0] : mins[0];
+		requests[i].start[1] = requests[i].end[1] = (i & 1) ? maxs[1] : mins[1];
+		requests[i].start[2] = start[2];
+		requests[i].end[2] = stop[2];
+		requests[i].passent = ent;
+		requests[i].contentmask = MASK_MONSTERSOLID;
+	}
+
+	gi.tracebatch(requests, 4);
+
 	/* the corners must be within 16 of the midpoint */
 	for (x = 0; x <= 1; x++)
 	{
 		for (y = 0; y <= 1; y++)
 		{
-			start[0] = stop[0] = x ? maxs[0] : mins[0];
-			start[1] = stop[1] = y ? maxs[1] : mins[1];
-
-			trace = gi.trace(start, vec3_origin, vec3_origin,
-					stop, ent, MASK_MONSTERSOLID);
+			trace = requests[x * 2 + y].trace;
 
 			if (ent->gravityVector[2] > 0)
 			{
@@ -1340,7 +1340,7 @@ InitBodyQue(void)
 	for (i = 0; i < BODY_QUEUE_SIZE; i++)
 	{
 		ent = G_Spawn();
-		ent->classname = "bodyque";
+		G_SetClassname(ent, "bodyque");
 	}
 }
 
@@ -1631,7 +1631,7 @@ PutClientInServer(edict_t *ent)
 	ent->movetype = MOVETYPE_WALK;
 	ent->viewheight = 22;
 	ent->inuse = true;
-	ent->classname = "player";
+	G_SetClassname(ent, "player");
 	ent->mass = 200;
 	ent->solid = SOLID_BBOX;
 	ent->deadflag = DEAD_NO;
@@ -1838,7 +1838,7 @@ ClientBegin(edict_t *ent)
 		   except for the persistant data that was initialized at
 		   ClientConnect() time */
 		G_InitEdict(ent);
-		ent->classname = "player";
+		G_SetClassname(ent, "player");
 		InitClientResp(ent->client);
 		PutClientInServer(ent);
 	}
@@ -2098,7 +2098,7 @@ ClientDisconnect(edict_t *ent)
 	ent->s.modelindex = 0;
 	ent->solid = SOLID_NOT;
 	ent->inuse = false;
-	ent->classname = "disconnected";
+	G_SetClassname(ent, "disconnected");
 	ent->client->pers.connected = false;
 
 	playernum = ent - g_edicts - 1;
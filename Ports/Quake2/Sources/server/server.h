@@ -62,6 +62,7 @@ typedef struct
 
 	unsigned time; /* always sv.framenum * 100 msec */
 	int framenum;
+	long long frametime; /* Sys_Microseconds time sv.time is due at, 0 until known */
 
 	char name[MAX_QPATH]; /* map name, or cinematic name */
 	struct cmodel_s *models[MAX_MODELS];
@@ -98,6 +99,20 @@ typedef struct
 	int senttime; /* for ping calculations */
 } client_frame_t;
 
+struct client_s;
+
+/* a client frame being built and encoded, possibly by a worker thread */
+typedef struct
+{
+	struct client_s *client;
+	qboolean built; /* false if the client is not in game yet */
+	byte visible[MAX_EDICTS / 8]; /* entities sent to the client */
+	int num_entities;
+	qboolean datagram_overflowed;
+	sizebuf_t msg;
+	byte msg_buf[MAX_MSGLEN * 4]; /* large enough to check overflows after encoding */
+} client_snapshot_t;
+
 typedef struct client_s
 {
 	client_state_t state;
@@ -138,8 +153,20 @@ typedef struct client_s
 	int challenge; /* challenge of this user, randomly generated */
 
 	netchan_t netchan;
+
+	qboolean hashed; /* linked in the address hash */
+	int hash_next; /* next client + 1 with the same address hash */
+
+	/* where the client stands, for multicasts */
+	qboolean leaf_valid;
+	int leaf_spawncount; /* svs.spawncount of the map the leaf is in */
+	vec3_t leaf_origin;
+	int leaf_cluster;
+	int leaf_area;
 } client_t;
 
+#define CLIENT_HASH_SIZE 512 /* power of two */
+
 typedef struct
 {
 	netadr_t adr;
@@ -158,6 +185,7 @@ typedef struct
 	/* used to check late spawns */
 
 	client_t *clients; /* [maxclients->value]; */
+	int client_hash[CLIENT_HASH_SIZE]; /* first client + 1 for each (base address, qport) hash */
 	int num_client_entities; /* maxclients->value*UPDATE_BACKUP*MAX_PACKET_ENTITIES */
 	int next_client_entities; /* next client_entity to use */
 	entity_state_t *client_entities; /* [num_client_entities] */
@@ -186,6 +214,10 @@ extern cvar_t *sv_noreload; /* don't reload level state when reentering */
 extern cvar_t *sv_airaccelerate; /* don't reload level state when reentering */
 /* development tool */
 extern cvar_t *sv_enforcetime;
+extern cvar_t *sv_threads;
+extern cvar_t *sv_showlateness;
+extern cvar_t *sv_deltacache;
+extern cvar_t *sv_areaindex;
 
 extern client_t *sv_client;
 extern edict_t *sv_player;
@@ -235,8 +267,18 @@ void SV_ReadLevelFile(void);
 void SV_Status_f(void);
 
 void SV_WriteFrameToClient(client_t *client, sizebuf_t *msg);
+void SV_DeltaStats_f(void);
 void SV_RecordDemoMessage(void);
-void SV_BuildClientFrame(client_t *client);
+void SV_ClientHash_link(int *hash, client_t *clients, client_t *cl);
+void SV_ClientHash_unlink(int *hash, client_t *clients, client_t *cl);
+client_t *SV_ClientHash_find(int *hash, client_t *clients, netadr_t adr, int qport);
+
+void SV_BuildClientFrame(client_t *client, client_snapshot_t *snapshot);
+void SV_CopyClientFrame(client_snapshot_t *snapshot);
+void SV_ShutdownWorkers(void);
+
+typedef void (*sv_job_t)(void *data, int index);
+void SV_Workers_run(sv_job_t job, void *data, int jobNb);
 
 void SV_Error(char *error, ...);
 
@@ -269,9 +311,11 @@ void SV_LinkEdict(edict_t *ent);
    ent->v.absmax sets ent->leafnums[] for pvs determination even if
    the entity is not solid */
 int SV_AreaEdicts(vec3_t mins, vec3_t maxs, edict_t **list, int maxcount, int areatype);
+void SV_AreaBench_f(void);
 
 int SV_PointContents(vec3_t p);
 
 trace_t SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passedict, int contentmask);
+void SV_TraceBatch(tracerequest_t *requests, int count);
 
 #endif
@@ -596,6 +596,138 @@ void SV_ServerCommand_f(void)
 	ge->ServerCommand();
 }
 
+/*
+ * The client lookup SV_ReadPackets did before the address hash
+ */
+static client_t *SV_FindClientLinear(client_t *clients, int clientNb, netadr_t adr, int qport)
+{
+	int i;
+	client_t *cl;
+
+	for (i = 0, cl = clients; i < clientNb; i++, cl++)
+	{
+		if ((cl->state != cs_free) && (cl->netchan.qport == qport) &&
+		    NET_CompareBaseAdr(adr, cl->netchan.remote_address))
+		{
+			return cl;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Feeds synthetic packets to the linear and hashed client lookups,
+ * checks they agree and times them
+ */
+void SV_ClientHashTest_f(void)
+{
+	const int clientNb = 256;
+	client_t *clients;
+	int hash[CLIENT_HASH_SIZE];
+	netadr_t *adrs;
+	int *qports;
+	client_t **found;
+	int i, packetNb, mismatchNb, hitNb;
+	int linearTime, hashTime, start;
+	client_t *cl;
+
+	packetNb = (Cmd_Argc() > 1) ? (int)strtol(Cmd_Argv(1), (char **)NULL, 10) : 100000;
+
+	if (packetNb < 1)
+	{
+		packetNb = 1;
+	}
+
+	clients = Z_Malloc(clientNb * sizeof(client_t));
+	adrs = Z_Malloc(packetNb * sizeof(netadr_t));
+	qports = Z_Malloc(packetNb * sizeof(int));
+	found = Z_Malloc(packetNb * sizeof(client_t *));
+	memset(hash, 0, sizeof(hash));
+
+	/* some clients share an address and only differ by their qport */
+	for (i = 0, cl = clients; i < clientNb; i++, cl++)
+	{
+		netadr_t *adr = &cl->netchan.remote_address;
+
+		cl->state = (i & 7) ? cs_spawned : cs_zombie;
+		adr->type = (i & 3) ? NA_IP : NA_IP6;
+		adr->ip[0] = 10;
+		adr->ip[1] = (i & 3) ? 0 : 1;
+		adr->ip[2] = (i / 2) >> 8;
+		adr->ip[3] = (i / 2) & 0xff;
+		adr->port = BigShort(PORT_CLIENT);
+		cl->netchan.qport = randk() & 0xffff;
+		SV_ClientHash_link(hash, clients, cl);
+	}
+
+	/* most packets come from the clients, some through a NAT,
+	   the others are connectionless spam */
+	for (i = 0; i < packetNb; i++)
+	{
+		if (i & 3)
+		{
+			cl = &clients[randk() % clientNb];
+			adrs[i] = cl->netchan.remote_address;
+			qports[i] = cl->netchan.qport;
+
+			if (!(i & 15))
+			{
+				adrs[i].port = randk() & 0xffff;
+			}
+		}
+		else
+		{
+			memset(&adrs[i], 0, sizeof(adrs[i]));
+			adrs[i].type = NA_IP;
+			adrs[i].ip[0] = 192;
+			adrs[i].ip[1] = 168;
+			adrs[i].ip[2] = randk() & 0xff;
+			adrs[i].ip[3] = randk() & 0xff;
+			qports[i] = randk() & 0xffff;
+		}
+	}
+
+	start = Sys_Milliseconds();
+
+	for (i = 0; i < packetNb; i++)
+	{
+		found[i] = SV_FindClientLinear(clients, clientNb, adrs[i], qports[i]);
+	}
+
+	linearTime = Sys_Milliseconds() - start;
+
+	mismatchNb = 0;
+	hitNb = 0;
+	start = Sys_Milliseconds();
+
+	for (i = 0; i < packetNb; i++)
+	{
+		cl = SV_ClientHash_find(hash, clients, adrs[i], qports[i]);
+
+		if (cl != found[i])
+		{
+			mismatchNb++;
+		}
+
+		if (cl)
+		{
+			hitNb++;
+		}
+	}
+
+	hashTime = Sys_Milliseconds() - start;
+
+	Com_Printf("%i packets for %i clients, %i from clients, %i mismatches\n",
+		packetNb, clientNb, hitNb, mismatchNb);
+	Com_Printf("linear %i ms, hash %i ms\n", linearTime, hashTime);
+
+	Z_Free(found);
+	Z_Free(qports);
+	Z_Free(adrs);
+	Z_Free(clients);
+}
+
 void SV_InitOperatorCommands(void)
 {
 	Cmd_AddCommand("heartbeat", SV_Heartbeat_f);
@@ -623,4 +755,7 @@ void SV_InitOperatorCommands(void)
 	Cmd_AddCommand("killserver", SV_KillServer_f);
 
 	Cmd_AddCommand("sv", SV_ServerCommand_f);
+	Cmd_AddCommand("sv_clienthash_test", SV_ClientHashTest_f);
+	Cmd_AddCommand("sv_deltastats", SV_DeltaStats_f);
+	Cmd_AddCommand("sv_area_bench", SV_AreaBench_f);
 }
@@ -264,6 +264,9 @@ void SVC_DirectConnect(void)
 
 gotnewcl:
 
+	/* the slot is about to be cleared */
+	SV_ClientHash_unlink(svs.client_hash, svs.clients, newcl);
+
 	/* build a new connection  accept the new client this
 	   is the only place a client_t is ever initialized */
 	*newcl = temp;
@@ -302,6 +305,7 @@ gotnewcl:
 	Netchan_Setup(NS_SERVER, &newcl->netchan, adr, qport);
 
 	newcl->state = cs_connected;
+	SV_ClientHash_link(svs.client_hash, svs.clients, newcl);
 
 	SZ_Init(&newcl->datagram, newcl->datagram_buf, sizeof(newcl->datagram_buf));
 	newcl->datagram.allowoverflow = true;
@@ -27,19 +27,112 @@
  */
 
 #include "server/server.h"
+#include "SDL/SDLWrapper.h"
 
-byte fatpvs[65536 / 8];
+/*
+ * Encoded deltas are shared between the clients delta'ing an entity
+ * from the same state, typically because they acked the same frame.
+ * The cache is direct mapped and an entry only matches when both
+ * states are the ones it was encoded from, so the clients whose
+ * missiles are not solid never get the others' bytes. The entries
+ * are locked as frames are encoded by several threads.
+ */
+#define DELTA_CACHE_SIZE 4096 /* power of two */
+#define DELTA_CACHE_BYTES 96 /* larger than any entity delta */
+
+typedef struct
+{
+	SDL_SpinLock lock;
+	int framenum; /* sv.framenum + 1 when written, 0 if unused */
+	int fromframe; /* -1 for the baseline */
+	int flags;
+	entity_state_t from, to;
+	int size;
+	byte data[DELTA_CACHE_BYTES];
+} deltacache_t;
+
+static deltacache_t sv_deltaCache[DELTA_CACHE_SIZE];
+static SDL_atomic_t sv_deltaLookupNb;
+static SDL_atomic_t sv_deltaHitNb;
+
+static void SV_WriteDeltaEntityCached(entity_state_t *from, entity_state_t *to,
+		sizebuf_t *msg, qboolean force, qboolean newentity, int fromframe, int *hits)
+{
+	deltacache_t *entry;
+	sizebuf_t buf;
+	byte data[DELTA_CACHE_BYTES];
+	unsigned key;
+	int flags;
+	int size;
+
+	flags = (force ? 1 : 0) | (newentity ? 2 : 0);
+	key = (unsigned)to->number * 2654435761u ^ (unsigned)fromframe * 40503u ^ flags;
+	entry = &sv_deltaCache[(key ^ (key >> 16)) & (DELTA_CACHE_SIZE - 1)];
+
+	SDL_AtomicLock(&entry->lock);
+
+	if ((entry->framenum == sv.framenum + 1) &&
+	    (entry->fromframe == fromframe) && (entry->flags == flags) &&
+	    !memcmp(&entry->to, to, sizeof(*to)) &&
+	    !memcmp(&entry->from, from, sizeof(*from)))
+	{
+		size = entry->size;
+		memcpy(data, entry->data, size);
+		SDL_AtomicUnlock(&entry->lock);
+
+		SZ_Write(msg, data, size);
+		(*hits)++;
+		return;
+	}
+
+	SDL_AtomicUnlock(&entry->lock);
+
+	SZ_Init(&buf, data, sizeof(data));
+	buf.allowoverflow = true;
+	MSG_WriteDeltaEntity(from, to, &buf, force, newentity);
+
+	if (buf.overflowed)
+	{
+		MSG_WriteDeltaEntity(from, to, msg, force, newentity);
+		return;
+	}
+
+	SZ_Write(msg, buf.data, buf.cursize);
+
+	SDL_AtomicLock(&entry->lock);
+	entry->framenum = sv.framenum + 1;
+	entry->fromframe = fromframe;
+	entry->flags = flags;
+	entry->from = *from;
+	entry->to = *to;
+	entry->size = buf.cursize;
+	memcpy(entry->data, buf.data, buf.cursize);
+	SDL_AtomicUnlock(&entry->lock);
+}
+
+void SV_DeltaStats_f(void)
+{
+	int lookups, hits;
+
+	lookups = SDL_AtomicSet(&sv_deltaLookupNb, 0);
+	hits = SDL_AtomicSet(&sv_deltaHitNb, 0);
+
+	Com_Printf("%i entity deltas, %i from the cache (%.1f%%)\n", lookups, hits,
+		lookups ? hits * 100.0f / lookups : 0.0f);
+}
 
 /*
  * Writes a delta update of an entity_state_t list to the message.
  */
-void SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
+void SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, int fromframe, sizebuf_t *msg)
 {
 	entity_state_t *oldent, *newent;
 	int oldindex, newindex;
 	int oldnum, newnum;
 	int from_num_entities;
 	int bits;
+	qboolean cached;
+	int lookups, hits;
 
 	MSG_WriteByte(msg, svc_packetentities);
 
@@ -56,6 +149,9 @@ void SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *
 	oldindex = 0;
 	newent = NULL;
 	oldent = NULL;
+	cached = sv_deltacache->value != 0;
+	lookups = 0;
+	hits = 0;
 
 	while (newindex < to->num_entities || oldindex < from_num_entities)
 	{
@@ -93,8 +189,19 @@ void SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *
 			   being emited if the entity has not changed at all
 			   note that players are always 'newentities', this
 			   updates their oldorigin always and prevents warping */
-			MSG_WriteDeltaEntity(oldent, newent, msg,
-				false, newent->number <= maxclients->value);
+			if (cached)
+			{
+				SV_WriteDeltaEntityCached(oldent, newent, msg,
+					false, newent->number <= maxclients->value,
+					fromframe, &hits);
+				lookups++;
+			}
+			else
+			{
+				MSG_WriteDeltaEntity(oldent, newent, msg,
+					false, newent->number <= maxclients->value);
+			}
+
 			oldindex++;
 			newindex++;
 			continue;
@@ -103,7 +210,17 @@ void SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *
 		if (newnum < oldnum)
 		{
 			/* this is a new entity, send it from the baseline */
-			MSG_WriteDeltaEntity(&sv.baselines[newnum], newent, msg, true, true);
+			if (cached)
+			{
+				SV_WriteDeltaEntityCached(&sv.baselines[newnum], newent, msg,
+					true, true, -1, &hits);
+				lookups++;
+			}
+			else
+			{
+				MSG_WriteDeltaEntity(&sv.baselines[newnum], newent, msg, true, true);
+			}
+
 			newindex++;
 			continue;
 		}
@@ -140,6 +257,12 @@ void SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *
 	}
 
 	MSG_WriteShort(msg, 0);
+
+	if (lookups)
+	{
+		SDL_AtomicAdd(&sv_deltaLookupNb, lookups);
+		SDL_AtomicAdd(&sv_deltaHitNb, hits);
+	}
 }
 
 void SV_WritePlayerstateToClient(client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
@@ -418,18 +541,19 @@ void SV_WriteFrameToClient(client_t *client, sizebuf_t *msg)
 	SV_WritePlayerstateToClient(oldframe, frame, msg);
 
 	/* delta encode the entities */
-	SV_EmitPacketEntities(oldframe, frame, msg);
+	SV_EmitPacketEntities(oldframe, frame, lastframe, msg);
 }
 
 /*
  * The client will interpolate the view position,
  * so we can't use a single PVS point
  */
-void SV_FatPVS(vec3_t org)
+void SV_FatPVS(vec3_t org, byte *fatpvs)
 {
 	int leafs[64];
 	int i, j, count;
-	int longs;
+	int ints;
+	byte row[MAX_MAP_LEAFS / 8];
 	byte *src;
 	vec3_t mins, maxs;
 
@@ -446,7 +570,7 @@ void SV_FatPVS(vec3_t org)
 		Com_Error(ERR_FATAL, "SV_FatPVS: count < 1");
 	}
 
-	longs = (CM_NumClusters() + 31) >> 5;
+	ints = (CM_NumClusters() + 31) >> 5;
 
 	/* convert leafs to clusters */
 	for (i = 0; i < count; i++)
@@ -454,7 +578,7 @@ void SV_FatPVS(vec3_t org)
 		leafs[i] = CM_LeafCluster(leafs[i]);
 	}
 
-	memcpy(fatpvs, CM_ClusterPVS(leafs[0]), longs << 2);
+	CM_ClusterVis(leafs[0], DVIS_PVS, fatpvs);
 
 	/* or in all the other leaf bits */
 	for (i = 1; i < count; i++)
@@ -472,41 +596,56 @@ void SV_FatPVS(vec3_t org)
 			continue; /* already have the cluster we want */
 		}
 
-		src = CM_ClusterPVS(leafs[i]);
+		src = CM_ClusterVisRow(leafs[i], DVIS_PVS);
+
+		if (!src)
+		{
+			CM_ClusterVis(leafs[i], DVIS_PVS, row);
+			src = row;
+		}
 
-		for (j = 0; j < longs; j++)
+		for (j = 0; j < ints; j++)
 		{
-			((long *)fatpvs)[j] |= ((long *)src)[j];
+			((int *)fatpvs)[j] |= ((int *)src)[j];
 		}
 	}
 }
 
 /*
  * Decides which entities are going to be visible to the client, and
- * copies off the playerstat and areabits.
+ * copies off the playerstat and areabits. The entities are marked in
+ * the snapshot and copied by SV_CopyClientFrame once the frame has its
+ * place in svs.client_entities. Only touches the client and the
+ * snapshot, so several clients can be built at the same time.
  */
-void SV_BuildClientFrame(client_t *client)
+void SV_BuildClientFrame(client_t *client, client_snapshot_t *snapshot)
 {
 	int e, i;
 	vec3_t org;
 	edict_t *ent;
 	edict_t *clent;
 	client_frame_t *frame;
-	entity_state_t *state;
 	int l;
 	int clientarea, clientcluster;
 	int leafnum;
-	int c_fullsend;
+	byte fatpvs[MAX_MAP_LEAFS / 8];
+	byte phsrow[MAX_MAP_LEAFS / 8];
 	byte *clientphs;
 	byte *bitvector;
 
 	clent = client->edict;
 
+	snapshot->built = false;
+	snapshot->num_entities = 0;
+
 	if (!clent->client)
 	{
 		return; /* not in game yet */
 	}
 
+	snapshot->built = true;
+	memset(snapshot->visible, 0, sizeof(snapshot->visible));
+
 	/* this is the frame we are creating */
 	frame = &client->frames[sv.framenum & UPDATE_MASK];
 
@@ -529,15 +668,16 @@ void SV_BuildClientFrame(client_t *client)
 	/* grab the current player_state_t */
 	frame->ps = clent->client->ps;
 
-	SV_FatPVS(org);
-	clientphs = CM_ClusterPHS(clientcluster);
+	SV_FatPVS(org, fatpvs);
+	clientphs = CM_ClusterVisRow(clientcluster, DVIS_PHS);
 
-	/* build up the list of visible entities */
-	frame->num_entities = 0;
-	frame->first_entity = svs.next_client_entities;
-
-	c_fullsend = 0;
+	if (!clientphs)
+	{
+		CM_ClusterVis(clientcluster, DVIS_PHS, phsrow);
+		clientphs = phsrow;
+	}
 
+	/* build up the list of visible entities */
 	for (e = 1; e < ge->num_edicts; e++)
 	{
 		ent = EDICT_NUM(e);
@@ -591,8 +731,6 @@ void SV_BuildClientFrame(client_t *client)
 					{
 						continue;
 					}
-
-					c_fullsend++;
 				}
 				else
 				{
@@ -631,16 +769,43 @@ void SV_BuildClientFrame(client_t *client)
 			}
 		}
 
-		/* add it to the circular client_entities array */
-		state = &svs.client_entities[svs.next_client_entities %
-		                             svs.num_client_entities];
+		snapshot->visible[e >> 3] |= 1 << (e & 7);
+		snapshot->num_entities++;
+	}
+}
 
-		if (ent->s.number != e)
+/*
+ * Copies the entities marked by SV_BuildClientFrame to the slice of
+ * the circular client_entities array starting at frame->first_entity.
+ */
+void SV_CopyClientFrame(client_snapshot_t *snapshot)
+{
+	client_t *client;
+	client_frame_t *frame;
+	entity_state_t *state;
+	edict_t *ent;
+	int e, index;
+
+	if (!snapshot->built)
+	{
+		return;
+	}
+
+	client = snapshot->client;
+	frame = &client->frames[sv.framenum & UPDATE_MASK];
+	index = frame->first_entity;
+
+	for (e = 1; e < ge->num_edicts; e++)
+	{
+		if (!(snapshot->visible[e >> 3] & (1 << (e & 7))))
 		{
-			Com_DPrintf("FIXING ENT->S.NUMBER!!!\n");
-			ent->s.number = e;
+			continue;
 		}
 
+		ent = EDICT_NUM(e);
+
+		/* add it to the circular client_entities array */
+		state = &svs.client_entities[index % svs.num_client_entities];
 		*state = ent->s;
 
 		/* don't mark players missiles as solid */
@@ -649,8 +814,7 @@ void SV_BuildClientFrame(client_t *client)
 			state->solid = 0;
 		}
 
-		svs.next_client_entities++;
-		frame->num_entities++;
+		index++;
 	}
 }
 
@@ -49,6 +49,10 @@ cvar_t *maxclients; /* rename sv_maxclients */
 cvar_t *sv_showclamp;
 cvar_t *hostname;
 cvar_t *public_server; /* should heartbeats be sent */
+cvar_t *sv_threads; /* client frame workers, -1 for one per extra core */
+cvar_t *sv_showlateness; /* 1 prints frame lateness stats, 2 every frame */
+cvar_t *sv_deltacache; /* share encoded entity deltas between clients */
+cvar_t *sv_areaindex; /* 0 areanode tree, 1 loose quadtree */
 
 void Master_Shutdown(void);
 void SV_ConnectionlessPacket(void);
@@ -190,9 +194,121 @@ void SV_GiveMsec(void)
 	}
 }
 
-void SV_ReadPackets(void)
+/*
+ * Clients are hashed on their base address and qport, the port
+ * can change behind a NAT. The chains are client indices + 1 so
+ * that a zeroed table is empty.
+ */
+static unsigned SV_ClientHash_key(netadr_t *adr, int qport)
+{
+	unsigned hash = 2166136261u;
+	const byte *p;
+	int i, size;
+
+	switch (adr->type)
+	{
+	case NA_IP:
+		p = adr->ip;
+		size = 4;
+		break;
+
+	case NA_IP6:
+		p = adr->ip;
+		size = 16;
+		break;
+
+	case NA_IPX:
+		p = adr->ipx;
+		size = 10;
+		break;
+
+	default:
+		p = NULL;
+		size = 0;
+		break;
+	}
+
+	hash = (hash ^ adr->type) * 16777619u;
+
+	for (i = 0; i < size; i++)
+	{
+		hash = (hash ^ p[i]) * 16777619u;
+	}
+
+	hash = (hash ^ (qport & 0xff)) * 16777619u;
+	hash = (hash ^ ((qport >> 8) & 0xff)) * 16777619u;
+
+	return hash & (CLIENT_HASH_SIZE - 1);
+}
+
+void SV_ClientHash_link(int *hash, client_t *clients, client_t *cl)
+{
+	unsigned key;
+
+	if (cl->hashed)
+	{
+		return;
+	}
+
+	key = SV_ClientHash_key(&cl->netchan.remote_address, cl->netchan.qport);
+	cl->hash_next = hash[key];
+	hash[key] = (cl - clients) + 1;
+	cl->hashed = true;
+}
+
+void SV_ClientHash_unlink(int *hash, client_t *clients, client_t *cl)
+{
+	int *link;
+
+	if (!cl->hashed)
+	{
+		return;
+	}
+
+	link = &hash[SV_ClientHash_key(&cl->netchan.remote_address, cl->netchan.qport)];
+
+	while (*link)
+	{
+		if (&clients[*link - 1] == cl)
+		{
+			*link = cl->hash_next;
+			break;
+		}
+
+		link = &clients[*link - 1].hash_next;
+	}
+
+	cl->hash_next = 0;
+	cl->hashed = false;
+}
+
+/*
+ * A zombie can share its address with a new connection,
+ * the first slot wins as with a scan of the client list.
+ */
+client_t *SV_ClientHash_find(int *hash, client_t *clients, netadr_t adr, int qport)
 {
 	int i;
+	client_t *cl;
+	client_t *found = NULL;
+
+	for (i = hash[SV_ClientHash_key(&adr, qport)]; i; i = cl->hash_next)
+	{
+		cl = &clients[i - 1];
+
+		if ((cl->state != cs_free) && (cl->netchan.qport == qport) &&
+		    NET_CompareBaseAdr(adr, cl->netchan.remote_address) &&
+		    (!found || (cl < found)))
+		{
+			found = cl;
+		}
+	}
+
+	return found;
+}
+
+void SV_ReadPackets(void)
+{
 	client_t *cl;
 	int qport;
 
@@ -213,23 +329,10 @@ void SV_ReadPackets(void)
 		qport = MSG_ReadShort(&net_message) & 0xffff;
 
 		/* check for packets from connected clients */
-		for (i = 0, cl = svs.clients; i < maxclients->value; i++, cl++)
-		{
-			if (cl->state == cs_free)
-			{
-				continue;
-			}
-
-			if (!NET_CompareBaseAdr(net_from, cl->netchan.remote_address))
-			{
-				continue;
-			}
-
-			if (cl->netchan.qport != qport)
-			{
-				continue;
-			}
+		cl = SV_ClientHash_find(svs.client_hash, svs.clients, net_from, qport);
 
+		if (cl)
+		{
 			if (cl->netchan.remote_address.port != net_from.port)
 			{
 				Com_Printf("SV_ReadPackets: fixing up a translated port\n");
@@ -249,13 +352,6 @@ void SV_ReadPackets(void)
 					}
 				}
 			}
-
-			break;
-		}
-
-		if (i != maxclients->value)
-		{
-			continue;
 		}
 	}
 }
@@ -290,6 +386,7 @@ void SV_CheckTimeouts(void)
 		if ((cl->state == cs_zombie) &&
 		    (cl->lastmessage < zombiepoint))
 		{
+			SV_ClientHash_unlink(svs.client_hash, svs.clients, cl);
 			cl->state = cs_free; /* can now be reused */
 			continue;
 		}
@@ -299,6 +396,7 @@ void SV_CheckTimeouts(void)
 		{
 			SV_BroadcastPrintf(PRINT_HIGH, "%s timed out\n", cl->name);
 			SV_DropClient(cl);
+			SV_ClientHash_unlink(svs.client_hash, svs.clients, cl);
 			cl->state = cs_free; /* don't bother with zombie state */
 		}
 	}
@@ -367,8 +465,45 @@ void SV_RunGameFrame(void)
 	#endif
 }
 
+/*
+ * Reports how late the frames start compared to
+ * their deadline on the microsecond clock
+ */
+static void SV_ReportLateness(long long now)
+{
+	static long long total;
+	static int worst;
+	static int frameNb;
+	int lateness;
+
+	lateness = (int)(now - sv.frametime);
+
+	if (sv_showlateness->value > 1)
+	{
+		Com_Printf("sv frame %i: %i us late\n", sv.framenum, lateness);
+	}
+
+	total += lateness;
+	frameNb++;
+
+	if ((frameNb == 1) || (lateness > worst))
+	{
+		worst = lateness;
+	}
+
+	if (frameNb == 100)
+	{
+		Com_Printf("sv lateness: %i us average, %i us worst over %i frames\n",
+			(int)(total / frameNb), worst, frameNb);
+		total = 0;
+		frameNb = 0;
+	}
+}
+
 void SV_Frame(int msec)
 {
+	long long now;
+
 	#ifndef DEDICATED_ONLY
 	time_before_game = time_after_game = 0;
 	#endif
@@ -390,8 +525,18 @@ void SV_Frame(int msec)
 	/* get packets from clients */
 	SV_ReadPackets();
 
+	/* the millisecond clock of the main loop lags up to a
+	   millisecond behind, frames are due on the microsecond one */
+	now = Sys_Microseconds();
+
+	if (!sv.frametime)
+	{
+		sv.frametime = now + ((int)sv.time - svs.realtime) * 1000LL;
+	}
+
 	/* move autonomous things around if enough time has passed */
-	if (!sv_timedemo->value && (svs.realtime < (int)sv.time))
+	if (!sv_timedemo->value && (svs.realtime < (int)sv.time) &&
+	    (now < sv.frametime))
 	{
 		/* never let the time get too far off */
 		if (sv.time - svs.realtime > 100)
@@ -404,10 +549,34 @@ void SV_Frame(int msec)
 			svs.realtime = sv.time - 100;
 		}
 
-		NET_Sleep(sv.time - svs.realtime);
+		if (sv.frametime - now > 100000)
+		{
+			sv.frametime = now + 100000;
+		}
+
+		NET_SleepUntil(sv.frametime);
 		return;
 	}
 
+	if (!sv_timedemo->value && (svs.realtime < (int)sv.time))
+	{
+		svs.realtime = sv.time;
+	}
+
+	if (sv_showlateness->value && !sv_timedemo->value)
+	{
+		SV_ReportLateness(now);
+	}
+
+	/* the next frame is due 100 msec later, but
+	   never get more than one tic behind */
+	sv.frametime += 100000;
+
+	if (sv.frametime < now)
+	{
+		sv.frametime = now;
+	}
+
 	/* update ping based on the last known frame from all clients */
 	SV_CalcPings();
 
@@ -600,6 +769,11 @@ void SV_Init(void)
 
 	public_server = Cvar_Get("public", "0", 0);
 
+	sv_threads = Cvar_Get("sv_threads", "-1", CVAR_ARCHIVE);
+	sv_showlateness = Cvar_Get("sv_showlateness", "0", 0);
+	sv_deltacache = Cvar_Get("sv_deltacache", "1", 0);
+	sv_areaindex = Cvar_Get("sv_areaindex", "0", CVAR_ARCHIVE);
+
 	SZ_Init(&net_message, net_message_buffer, sizeof(net_message_buffer));
 }
 
@@ -662,6 +836,7 @@ void SV_Shutdown(char *finalmsg, qboolean reconnect)
 
 	Master_Shutdown();
 	SV_ShutdownGameProgs();
+	SV_ShutdownWorkers();
 
 	/* free current level */
 	if (sv.demofile)
@@ -25,6 +25,7 @@
  */
 
 #include "server/server.h"
+#include "SDL/SDLWrapper.h"
 
 char sv_outputbuf[SV_OUTPUTBUF_LENGTH];
 
@@ -143,14 +144,108 @@ void SV_BroadcastCommand(char *fmt, ...)
  * MULTICAST_PVS	send to clients potentially visible from org
  * MULTICAST_PHS	send to clients potentially hearable from org
  */
+/*
+ * Multicasts find their clients by cluster. The leaf of a client is
+ * only looked up again once it moved, and the clients are bucketed by
+ * cluster so each occupied cluster is checked once against the mask.
+ * The buckets are rebuilt when a client changes cluster.
+ */
+static int sv_bucketCluster[MAX_CLIENTS];
+static int sv_bucketFirst[MAX_CLIENTS]; /* client index + 1 */
+static int sv_bucketNext[MAX_CLIENTS]; /* by client, index + 1 */
+static int sv_bucketNb;
+static qboolean sv_bucketDirty = true;
+static client_t *sv_bucketClients; /* the client list the buckets index */
+static int sv_bucketClientNb;
+static int sv_clusterBucket[MAX_MAP_LEAFS]; /* valid if the stamp matches */
+static int sv_clusterStamp[MAX_MAP_LEAFS];
+static int sv_bucketStamp;
+
+static void SV_UpdateClientLeaf(client_t *client)
+{
+	int leafnum, cluster;
+	float *origin = client->edict->s.origin;
+
+	if (client->leaf_valid && (client->leaf_spawncount == svs.spawncount) &&
+	    VectorCompare(origin, client->leaf_origin))
+	{
+		return;
+	}
+
+	leafnum = CM_PointLeafnum(origin);
+	cluster = CM_LeafCluster(leafnum);
+	client->leaf_area = CM_LeafArea(leafnum);
+	VectorCopy(origin, client->leaf_origin);
+
+	if (!client->leaf_valid || (client->leaf_spawncount != svs.spawncount) ||
+	    (client->leaf_cluster != cluster))
+	{
+		sv_bucketDirty = true;
+	}
+
+	client->leaf_valid = true;
+	client->leaf_spawncount = svs.spawncount;
+	client->leaf_cluster = cluster;
+}
+
+static void SV_BuildClusterBuckets(void)
+{
+	client_t *client;
+	int j, bucket, cluster;
+
+	sv_bucketStamp++;
+	sv_bucketNb = 0;
+
+	for (j = 0, client = svs.clients; j < maxclients->value; j++, client++)
+	{
+		if (!client->leaf_valid || (client->leaf_cluster < 0) ||
+		    (client->state == cs_free) || (client->state == cs_zombie))
+		{
+			continue;
+		}
+
+		cluster = client->leaf_cluster;
+
+		if (sv_clusterStamp[cluster] != sv_bucketStamp)
+		{
+			sv_clusterStamp[cluster] = sv_bucketStamp;
+			sv_clusterBucket[cluster] = sv_bucketNb;
+			sv_bucketCluster[sv_bucketNb] = cluster;
+			sv_bucketFirst[sv_bucketNb] = 0;
+			sv_bucketNb++;
+		}
+
+		bucket = sv_clusterBucket[cluster];
+		sv_bucketNext[j] = sv_bucketFirst[bucket];
+		sv_bucketFirst[bucket] = j + 1;
+	}
+
+	sv_bucketClients = svs.clients;
+	sv_bucketClientNb = (int)maxclients->value;
+	sv_bucketDirty = false;
+}
+
+static void SV_MulticastToClient(client_t *client, qboolean reliable)
+{
+	if (reliable)
+	{
+		SZ_Write(&client->netchan.message, sv.multicast.data,
+			sv.multicast.cursize);
+	}
+	else
+	{
+		SZ_Write(&client->datagram, sv.multicast.data, sv.multicast.cursize);
+	}
+}
+
 void SV_Multicast(vec3_t origin, multicast_t to)
 {
 	client_t *client;
 	byte *mask;
 	int leafnum = 0, cluster;
-	int j;
+	int j, bucket;
 	qboolean reliable;
-	int area1, area2;
+	int area1;
 
 	reliable = false;
 
@@ -200,43 +295,71 @@ void SV_Multicast(vec3_t origin, multicast_t to)
 	}
 
 	/* send the data to all relevent clients */
+	if (!mask)
+	{
+		for (j = 0, client = svs.clients; j < maxclients->value; j++, client++)
+		{
+			if ((client->state == cs_free) || (client->state == cs_zombie))
+			{
+				continue;
+			}
+
+			if ((client->state != cs_spawned) && !reliable)
+			{
+				continue;
+			}
+
+			SV_MulticastToClient(client, reliable);
+		}
+
+		SZ_Clear(&sv.multicast);
+		return;
+	}
+
 	for (j = 0, client = svs.clients; j < maxclients->value; j++, client++)
 	{
-		if ((client->state == cs_free) || (client->state == cs_zombie))
+		if ((client->state != cs_free) && (client->state != cs_zombie))
 		{
-			continue;
+			SV_UpdateClientLeaf(client);
 		}
+	}
 
-		if ((client->state != cs_spawned) && !reliable)
+	if (sv_bucketDirty || (sv_bucketClients != svs.clients) ||
+	    (sv_bucketClientNb != (int)maxclients->value))
+	{
+		SV_BuildClusterBuckets();
+	}
+
+	for (bucket = 0; bucket < sv_bucketNb; bucket++)
+	{
+		cluster = sv_bucketCluster[bucket];
+
+		if (!(mask[cluster >> 3] & (1 << (cluster & 7))))
 		{
 			continue;
 		}
 
-		if (mask)
+		for (j = sv_bucketFirst[bucket]; j; j = sv_bucketNext[j - 1])
 		{
-			leafnum = CM_PointLeafnum(client->edict->s.origin);
-			cluster = CM_LeafCluster(leafnum);
-			area2 = CM_LeafArea(leafnum);
+			client = &svs.clients[j - 1];
 
-			if (!CM_AreasConnected(area1, area2))
+			/* the state may have changed since the buckets were built */
+			if ((client->state == cs_free) || (client->state == cs_zombie))
 			{
 				continue;
 			}
 
-			if (mask && (!(mask[cluster >> 3] & (1 << (cluster & 7)))))
+			if ((client->state != cs_spawned) && !reliable)
 			{
 				continue;
 			}
-		}
 
-		if (reliable)
-		{
-			SZ_Write(&client->netchan.message, sv.multicast.data,
-				sv.multicast.cursize);
-		}
-		else
-		{
-			SZ_Write(&client->datagram, sv.multicast.data, sv.multicast.cursize);
+			if (!CM_AreasConnected(area1, client->leaf_area))
+			{
+				continue;
+			}
+
+			SV_MulticastToClient(client, reliable);
 		}
 	}
 
@@ -409,49 +532,334 @@ void SV_StartSound(vec3_t origin, edict_t *entity, int channel, int soundindex,
 	}
 }
 
-qboolean SV_SendClientDatagram(client_t *client)
+/*
+ * Client frames are built and encoded by a small pool of worker
+ * threads, the main thread taking its share of the jobs. A job only
+ * writes to its own client and snapshot, everything else is read only
+ * while the pool runs. Batched game traces use the same pool.
+ */
+#define SV_MAX_WORKERS 8
+
+static SDL_mutex *sv_workerMutex;
+static SDL_cond *sv_workerJobCond; /* signaled when jobs are queued */
+static SDL_cond *sv_workerDoneCond; /* signaled when the last job is done */
+static SDL_Thread *sv_workerThreads[SV_MAX_WORKERS];
+static int sv_workerNb;
+static qboolean sv_workerQuit;
+static sv_job_t sv_workerJob;
+static void *sv_workerData;
+static int sv_workerJobNb;
+static int sv_workerJobNext;
+static int sv_workerJobDone;
+
+static client_snapshot_t *sv_snapshots;
+static int sv_snapshotMaxNb;
+
+static int SV_Workers_thread(void *data)
+{
+	int i;
+
+	SDL_LockMutex(sv_workerMutex);
+
+	for ( ; ; )
+	{
+		while (!sv_workerQuit && (sv_workerJobNext >= sv_workerJobNb))
+		{
+			SDL_CondWait(sv_workerJobCond, sv_workerMutex);
+		}
+
+		if (sv_workerQuit)
+		{
+			break;
+		}
+
+		i = sv_workerJobNext++;
+		SDL_UnlockMutex(sv_workerMutex);
+
+		sv_workerJob(sv_workerData, i);
+
+		SDL_LockMutex(sv_workerMutex);
+
+		if (++sv_workerJobDone == sv_workerJobNb)
+		{
+			SDL_CondBroadcast(sv_workerDoneCond);
+		}
+	}
+
+	SDL_UnlockMutex(sv_workerMutex);
+	return 0;
+}
+
+static void SV_Workers_stop(void)
+{
+	int i;
+
+	if (!sv_workerNb)
+	{
+		return;
+	}
+
+	SDL_LockMutex(sv_workerMutex);
+	sv_workerQuit = true;
+	SDL_CondBroadcast(sv_workerJobCond);
+	SDL_UnlockMutex(sv_workerMutex);
+
+	for (i = 0; i < sv_workerNb; i++)
+	{
+		SDL_WaitThread(sv_workerThreads[i], NULL);
+	}
+
+	sv_workerNb = 0;
+	sv_workerQuit = false;
+
+	SDL_DestroyCond(sv_workerDoneCond);
+	SDL_DestroyCond(sv_workerJobCond);
+	SDL_DestroyMutex(sv_workerMutex);
+}
+
+static void SV_Workers_start(void)
 {
-	byte msg_buf[MAX_MSGLEN];
-	sizebuf_t msg;
+	int i, threadNb;
 
-	SV_BuildClientFrame(client);
+	threadNb = (int)sv_threads->value;
 
-	SZ_Init(&msg, msg_buf, sizeof(msg_buf));
-	msg.allowoverflow = true;
+	if (threadNb < 0)
+	{
+		/* leave a core to the main thread */
+		threadNb = SDL_GetCPUCount() - 1;
+	}
+
+	if (threadNb > SV_MAX_WORKERS)
+	{
+		threadNb = SV_MAX_WORKERS;
+	}
+
+	if (threadNb <= 0)
+	{
+		return;
+	}
+
+	sv_workerMutex = SDL_CreateMutex();
+	sv_workerJobCond = SDL_CreateCond();
+	sv_workerDoneCond = SDL_CreateCond();
+
+	if (!sv_workerMutex || !sv_workerJobCond || !sv_workerDoneCond)
+	{
+		Com_Printf("SV_Workers_start: %s\n", SDL_GetError());
+		Cvar_SetValue("sv_threads", 0);
+		sv_threads->modified = false;
+		return;
+	}
+
+	for (i = 0; i < threadNb; i++)
+	{
+		sv_workerThreads[i] = SDL_CreateThread(SV_Workers_thread, "SV_Worker", NULL);
+
+		if (!sv_workerThreads[i])
+		{
+			break;
+		}
+
+		sv_workerNb++;
+	}
+
+	if (!sv_workerNb)
+	{
+		Com_Printf("SV_Workers_start: %s\n", SDL_GetError());
+		SDL_DestroyCond(sv_workerDoneCond);
+		SDL_DestroyCond(sv_workerJobCond);
+		SDL_DestroyMutex(sv_workerMutex);
+		Cvar_SetValue("sv_threads", 0);
+		sv_threads->modified = false;
+	}
+}
+
+/*
+ * Runs the job for every index below jobNb and returns once they
+ * are all done.
+ */
+void SV_Workers_run(sv_job_t job, void *data, int jobNb)
+{
+	int i;
+
+	if ((jobNb > 1) && !sv_workerNb)
+	{
+		SV_Workers_start();
+	}
+
+	if (!sv_workerNb || (jobNb < 2))
+	{
+		for (i = 0; i < jobNb; i++)
+		{
+			job(data, i);
+		}
+
+		return;
+	}
+
+	SDL_LockMutex(sv_workerMutex);
+	sv_workerJob = job;
+	sv_workerData = data;
+	sv_workerJobNb = jobNb;
+	sv_workerJobNext = 0;
+	sv_workerJobDone = 0;
+	SDL_CondBroadcast(sv_workerJobCond);
+
+	/* help the workers */
+	while (sv_workerJobNext < sv_workerJobNb)
+	{
+		i = sv_workerJobNext++;
+		SDL_UnlockMutex(sv_workerMutex);
+
+		job(data, i);
+
+		SDL_LockMutex(sv_workerMutex);
+		sv_workerJobDone++;
+	}
+
+	while (sv_workerJobDone < sv_workerJobNb)
+	{
+		SDL_CondWait(sv_workerDoneCond, sv_workerMutex);
+	}
+
+	sv_workerJobNb = 0;
+	sv_workerJobNext = 0;
+	SDL_UnlockMutex(sv_workerMutex);
+}
+
+void SV_ShutdownWorkers(void)
+{
+	SV_Workers_stop();
+
+	if (sv_snapshots)
+	{
+		Z_Free(sv_snapshots);
+		sv_snapshots = NULL;
+		sv_snapshotMaxNb = 0;
+	}
+}
+
+static void SV_BuildSnapshot(void *data, int index)
+{
+	client_snapshot_t *snapshot = (client_snapshot_t *)data + index;
+
+	SV_BuildClientFrame(snapshot->client, snapshot);
+}
+
+static void SV_EncodeSnapshot(void *data, int index)
+{
+	client_snapshot_t *snapshot = (client_snapshot_t *)data + index;
+	client_t *client = snapshot->client;
+
+	SV_CopyClientFrame(snapshot);
+
+	SZ_Init(&snapshot->msg, snapshot->msg_buf, sizeof(snapshot->msg_buf));
+	snapshot->msg.allowoverflow = true;
 
 	/* send over all the relevant entity_state_t
 	   and the player_state_t */
-	SV_WriteFrameToClient(client, &msg);
+	SV_WriteFrameToClient(client, &snapshot->msg);
 
 	/* copy the accumulated multicast datagram
 	   for this client out to the message
 	   it is necessary for this to be after the WriteEntities
 	   so that entity references will be current */
-	if (client->datagram.overflowed)
+	snapshot->datagram_overflowed = client->datagram.overflowed;
+
+	if (!snapshot->datagram_overflowed)
 	{
-		Com_Printf("WARNING: datagram overflowed for %s\n", client->name);
+		SZ_Write(&snapshot->msg, client->datagram.data, client->datagram.cursize);
 	}
-	else
+}
+
+static void SV_SendSnapshot(client_snapshot_t *snapshot)
+{
+	client_t *client = snapshot->client;
+	sizebuf_t *msg = &snapshot->msg;
+
+	if (snapshot->datagram_overflowed)
 	{
-		SZ_Write(&msg, client->datagram.data, client->datagram.cursize);
+		Com_Printf("WARNING: datagram overflowed for %s\n", client->name);
 	}
 
 	SZ_Clear(&client->datagram);
 
-	if (msg.overflowed)
+	/* the buffer has some slack so that
+	   workers never print, check the real limit */
+	if (msg->overflowed || (msg->cursize > MAX_MSGLEN))
 	{
 		/* must have room left for the packet header */
 		Com_Printf("WARNING: msg overflowed for %s\n", client->name);
-		SZ_Clear(&msg);
+		SZ_Clear(msg);
 	}
 
 	/* send the datagram */
-	Netchan_Transmit(&client->netchan, msg.cursize, msg.data);
+	Netchan_Transmit(&client->netchan, msg->cursize, msg->data);
 
 	/* record the size for rate estimation */
-	client->message_size[sv.framenum % RATE_MESSAGES] = msg.cursize;
+	client->message_size[sv.framenum % RATE_MESSAGES] = msg->cursize;
+}
+
+static void SV_FixEntityNumbers(void)
+{
+	int e;
+	edict_t *ent;
+
+	for (e = 1; e < ge->num_edicts; e++)
+	{
+		ent = EDICT_NUM(e);
+
+		/* only the ones that may be sent to a client */
+		if ((ent->svflags & SVF_NOCLIENT) ||
+		    (!ent->s.modelindex && !ent->s.effects &&
+		     !ent->s.sound && !ent->s.event))
+		{
+			continue;
+		}
+
+		if (ent->s.number != e)
+		{
+			Com_DPrintf("FIXING ENT->S.NUMBER!!!\n");
+			ent->s.number = e;
+		}
+	}
+}
+
+/*
+ * Builds, encodes and sends the frame of every client in the
+ * snapshot list. The frames only go through the shared state
+ * serially, when reserving their slice of client_entities and
+ * when they are transmitted in client order.
+ */
+static void SV_SendClientDatagrams(client_snapshot_t *snapshots, int snapshotNb)
+{
+	client_snapshot_t *snapshot;
+	client_frame_t *frame;
+	int i;
+
+	SV_FixEntityNumbers();
+
+	SV_Workers_run(SV_BuildSnapshot, snapshots, snapshotNb);
+
+	for (i = 0, snapshot = snapshots; i < snapshotNb; i++, snapshot++)
+	{
+		if (!snapshot->built)
+		{
+			continue;
+		}
+
+		frame = &snapshot->client->frames[sv.framenum & UPDATE_MASK];
+		frame->first_entity = svs.next_client_entities;
+		frame->num_entities = snapshot->num_entities;
+		svs.next_client_entities += snapshot->num_entities;
+	}
 
-	return true;
+	SV_Workers_run(SV_EncodeSnapshot, snapshots, snapshotNb);
+
+	for (i = 0, snapshot = snapshots; i < snapshotNb; i++, snapshot++)
+	{
+		SV_SendSnapshot(snapshot);
+	}
 }
 
 void SV_DemoCompleted(void)
@@ -504,8 +912,27 @@ void SV_SendClientMessages()
 	int msglen;
 	byte msgbuf[MAX_MSGLEN];
 	size_t r;
+	int snapshotNb;
 
 	msglen = 0;
+	snapshotNb = 0;
+
+	if (sv_threads->modified)
+	{
+		SV_Workers_stop();
+		sv_threads->modified = false;
+	}
+
+	if (sv_snapshotMaxNb < maxclients->value)
+	{
+		if (sv_snapshots)
+		{
+			Z_Free(sv_snapshots);
+		}
+
+		sv_snapshotMaxNb = (int)maxclients->value;
+		sv_snapshots = Z_Malloc(sv_snapshotMaxNb * sizeof(client_snapshot_t));
+	}
 
 	/* read the next demo message if needed */
 	if (sv.demofile && (sv.state == ss_demo))
@@ -549,6 +976,9 @@ void SV_SendClientMessages()
 		}
 	}
 
+	/* the packets of all clients go out together */
+	NET_BeginBatch();
+
 	/* send a message to each connected client */
 	for (i = 0, c = svs.clients; i < maxclients->value; i++, c++)
 	{
@@ -583,7 +1013,7 @@ void SV_SendClientMessages()
 				continue;
 			}
 
-			SV_SendClientDatagram(c);
+			sv_snapshots[snapshotNb++].client = c;
 		}
 		else
 		{
@@ -595,4 +1025,11 @@ void SV_SendClientMessages()
 			}
 		}
 	}
+
+	if (snapshotNb)
+	{
+		SV_SendClientDatagrams(sv_snapshots, snapshotNb);
+	}
+
+	NET_EndBatch();
 }
@@ -45,10 +45,57 @@ typedef struct areanode_s
 areanode_t sv_areanodes[AREA_NODES];
 int sv_numareanodes;
 
-float *area_mins, *area_maxs;
-edict_t **area_list;
-int area_count, area_maxcount;
-int area_type;
+/*
+ * The loose quadtree splits the world in x and y like the areanodes,
+ * but down to a fixed depth. An edict goes in the cell of its level
+ * holding its center, the level being the deepest one whose cells are
+ * at least as large as the edict. Each cell also catches what sticks
+ * out of it by half its size, so large edicts no longer pile up in
+ * the upper nodes.
+ */
+#define LOOSE_DEPTH 6
+#define LOOSE_NODES (((1 << (2 * (LOOSE_DEPTH + 1))) - 1) / 3)
+
+typedef struct
+{
+	link_t trigger_edicts;
+	link_t solid_edicts;
+} loosenode_t;
+
+static loosenode_t sv_loosenodes[LOOSE_NODES];
+static int sv_looseLevelFirst[LOOSE_DEPTH + 1]; /* first node of each level */
+static vec3_t sv_looseOrigin;
+static float sv_looseSize; /* of the square root cell */
+
+typedef enum
+{
+	AREAINDEX_TREE,
+	AREAINDEX_LOOSE
+} areaindex_t;
+
+static areaindex_t sv_areaIndex;
+
+/* state of an area query, on the stack so that queries are reentrant */
+typedef struct
+{
+	float *mins, *maxs;
+	edict_t **list;
+	int count, maxcount;
+	int type;
+	int nodeNb, checkNb; /* query costs, for sv_area_bench */
+} areawalk_t;
+
+/* the last queries, replayed by sv_area_bench */
+#define AREA_RECORD_SIZE 4096
+
+typedef struct
+{
+	vec3_t mins, maxs;
+	int areatype;
+} areaquery_t;
+
+static areaquery_t sv_areaRecord[AREA_RECORD_SIZE];
+static int sv_areaRecordNb;
 
 int SV_HullForEntity(edict_t *ent);
 
@@ -121,9 +168,42 @@ areanode_t* SV_CreateAreaNode(int depth, vec3_t mins, vec3_t maxs)
 
 void SV_ClearWorld(void)
 {
+	int i, level;
+	float *mins, *maxs;
+
 	memset(sv_areanodes, 0, sizeof(sv_areanodes));
 	sv_numareanodes = 0;
 	SV_CreateAreaNode(0, sv.models[1]->mins, sv.models[1]->maxs);
+
+	mins = sv.models[1]->mins;
+	maxs = sv.models[1]->maxs;
+	VectorCopy(mins, sv_looseOrigin);
+	sv_looseSize = maxs[0] - mins[0];
+
+	if (maxs[1] - mins[1] > sv_looseSize)
+	{
+		sv_looseSize = maxs[1] - mins[1];
+	}
+
+	if (sv_looseSize < 1)
+	{
+		sv_looseSize = 1;
+	}
+
+	for (level = 0, i = 0; level <= LOOSE_DEPTH; level++)
+	{
+		sv_looseLevelFirst[level] = i;
+		i += 1 << (2 * level);
+	}
+
+	for (i = 0; i < LOOSE_NODES; i++)
+	{
+		ClearLink(&sv_loosenodes[i].trigger_edicts);
+		ClearLink(&sv_loosenodes[i].solid_edicts);
+	}
+
+	sv_areaIndex = sv_areaindex->value ? AREAINDEX_LOOSE : AREAINDEX_TREE;
+	sv_areaindex->modified = false;
 }
 
 void SV_UnlinkEdict(edict_t *ent)
@@ -137,9 +217,11 @@ void SV_UnlinkEdict(edict_t *ent)
 	ent->area.prev = ent->area.next = NULL;
 }
 
+static void SV_AreaIndex_link(edict_t *ent);
+static void SV_AreaIndex_switch(areaindex_t index);
+
 void SV_LinkEdict(edict_t *ent)
 {
-	areanode_t *node;
 	int leafs[MAX_TOTAL_ENT_LEAFS];
 	int clusters[MAX_TOTAL_ENT_LEAFS];
 	int num_leafs;
@@ -359,6 +441,81 @@ void SV_LinkEdict(edict_t *ent)
 		return;
 	}
 
+	SV_AreaIndex_link(ent);
+}
+
+static loosenode_t *SV_LooseNode(edict_t *ent)
+{
+	float size, cellSize;
+	float center[2];
+	int i, level, x, y;
+
+	size = ent->absmax[0] - ent->absmin[0];
+
+	if (ent->absmax[1] - ent->absmin[1] > size)
+	{
+		size = ent->absmax[1] - ent->absmin[1];
+	}
+
+	for (i = 0; i < 2; i++)
+	{
+		center[i] = 0.5f * (ent->absmin[i] + ent->absmax[i]) - sv_looseOrigin[i];
+
+		if ((center[i] < 0) || (center[i] >= sv_looseSize))
+		{
+			return &sv_loosenodes[0]; /* outside the world */
+		}
+	}
+
+	level = LOOSE_DEPTH;
+	cellSize = sv_looseSize / (1 << LOOSE_DEPTH);
+
+	while ((level > 0) && (cellSize < size))
+	{
+		level--;
+		cellSize *= 2;
+	}
+
+	x = (int)(center[0] / cellSize);
+	y = (int)(center[1] / cellSize);
+
+	if (x > (1 << level) - 1)
+	{
+		x = (1 << level) - 1;
+	}
+
+	if (y > (1 << level) - 1)
+	{
+		y = (1 << level) - 1;
+	}
+
+	return &sv_loosenodes[sv_looseLevelFirst[level] + (y << level) + x];
+}
+
+/*
+ * Links a solid edict in the active area index
+ */
+static void SV_AreaIndex_link(edict_t *ent)
+{
+	areanode_t *node;
+	loosenode_t *loose;
+
+	if (sv_areaIndex == AREAINDEX_LOOSE)
+	{
+		loose = SV_LooseNode(ent);
+
+		if (ent->solid == SOLID_TRIGGER)
+		{
+			InsertLinkBefore(&ent->area, &loose->trigger_edicts);
+		}
+		else
+		{
+			InsertLinkBefore(&ent->area, &loose->solid_edicts);
+		}
+
+		return;
+	}
+
 	/* find the first node that the ent's box crosses */
 	node = sv_areanodes;
 
@@ -395,20 +552,12 @@ void SV_LinkEdict(edict_t *ent)
 	}
 }
 
-void SV_AreaEdicts_r(areanode_t *node)
+static void SV_AreaEdicts_list(areawalk_t *aw, link_t *start)
 {
-	link_t *l, *next, *start;
+	link_t *l, *next;
 	edict_t *check;
 
-	/* touch linked edicts */
-	if (area_type == AREA_SOLID)
-	{
-		start = &node->solid_edicts;
-	}
-	else
-	{
-		start = &node->trigger_edicts;
-	}
+	aw->nodeNb++;
 
 	for (l = start->next; l != start; l = next)
 	{
@@ -420,24 +569,39 @@ void SV_AreaEdicts_r(areanode_t *node)
 			continue; /* deactivated */
 		}
 
-		if ((check->absmin[0] > area_maxs[0]) ||
-		    (check->absmin[1] > area_maxs[1]) ||
-		    (check->absmin[2] > area_maxs[2]) ||
-		    (check->absmax[0] < area_mins[0]) ||
-		    (check->absmax[1] < area_mins[1]) ||
-		    (check->absmax[2] < area_mins[2]))
+		aw->checkNb++;
+
+		if ((check->absmin[0] > aw->maxs[0]) ||
+		    (check->absmin[1] > aw->maxs[1]) ||
+		    (check->absmin[2] > aw->maxs[2]) ||
+		    (check->absmax[0] < aw->mins[0]) ||
+		    (check->absmax[1] < aw->mins[1]) ||
+		    (check->absmax[2] < aw->mins[2]))
 		{
 			continue; /* not touching */
 		}
 
-		if (area_count == area_maxcount)
+		if (aw->count == aw->maxcount)
 		{
 			Com_Printf("SV_AreaEdicts: MAXCOUNT\n");
 			return;
 		}
 
-		area_list[area_count] = check;
-		area_count++;
+		aw->list[aw->count] = check;
+		aw->count++;
+	}
+}
+
+static void SV_AreaEdicts_r(areawalk_t *aw, areanode_t *node)
+{
+	/* touch linked edicts */
+	if (aw->type == AREA_SOLID)
+	{
+		SV_AreaEdicts_list(aw, &node->solid_edicts);
+	}
+	else
+	{
+		SV_AreaEdicts_list(aw, &node->trigger_edicts);
 	}
 
 	if (node->axis == -1)
@@ -446,35 +610,298 @@ void SV_AreaEdicts_r(areanode_t *node)
 	}
 
 	/* recurse down both sides */
-	if (area_maxs[node->axis] > node->dist)
+	if (aw->maxs[node->axis] > node->dist)
+	{
+		SV_AreaEdicts_r(aw, node->children[0]);
+	}
+
+	if (aw->mins[node->axis] < node->dist)
+	{
+		SV_AreaEdicts_r(aw, node->children[1]);
+	}
+}
+
+static void SV_AreaEdicts_loose(areawalk_t *aw)
+{
+	int level, x, y, size;
+	int lo[2], hi[2];
+	float cellSize;
+	loosenode_t *node;
+	int i;
+
+	/* the root holds everything outside the world */
+	node = &sv_loosenodes[0];
+	SV_AreaEdicts_list(aw, (aw->type == AREA_SOLID) ?
+			&node->solid_edicts : &node->trigger_edicts);
+
+	cellSize = sv_looseSize;
+
+	for (level = 1; level <= LOOSE_DEPTH; level++)
+	{
+		cellSize *= 0.5f;
+		size = 1 << level;
+
+		/* the cells whose loose bounds, a half cell larger
+		   on each side, touch the box */
+		for (i = 0; i < 2; i++)
+		{
+			lo[i] = (int)floorf((aw->mins[i] - sv_looseOrigin[i]) / cellSize - 1.5f);
+			hi[i] = (int)floorf((aw->maxs[i] - sv_looseOrigin[i]) / cellSize + 0.5f);
+
+			if (lo[i] < 0)
+			{
+				lo[i] = 0;
+			}
+
+			if (hi[i] > size - 1)
+			{
+				hi[i] = size - 1;
+			}
+		}
+
+		for (y = lo[1]; y <= hi[1]; y++)
+		{
+			for (x = lo[0]; x <= hi[0]; x++)
+			{
+				node = &sv_loosenodes[sv_looseLevelFirst[level] + (y << level) + x];
+				SV_AreaEdicts_list(aw, (aw->type == AREA_SOLID) ?
+						&node->solid_edicts : &node->trigger_edicts);
+			}
+		}
+	}
+}
+
+static int SV_AreaEdicts_query(areawalk_t *aw, vec3_t mins, vec3_t maxs, edict_t **list, int maxcount, int areatype)
+{
+	aw->mins = mins;
+	aw->maxs = maxs;
+	aw->list = list;
+	aw->maxcount = maxcount;
+	aw->type = areatype;
+	aw->count = 0;
+	aw->nodeNb = 0;
+	aw->checkNb = 0;
+
+	if (sv_areaIndex == AREAINDEX_LOOSE)
+	{
+		SV_AreaEdicts_loose(aw);
+	}
+	else
 	{
-		SV_AreaEdicts_r(node->children[0]);
+		SV_AreaEdicts_r(aw, sv_areanodes);
 	}
 
-	if (area_mins[node->axis] < node->dist)
+	return aw->count;
+}
+
+static void SV_AreaIndex_update(void)
+{
+	if (sv_areaindex->modified)
 	{
-		SV_AreaEdicts_r(node->children[1]);
+		SV_AreaIndex_switch(sv_areaindex->value ? AREAINDEX_LOOSE : AREAINDEX_TREE);
+		sv_areaindex->modified = false;
 	}
 }
 
 int SV_AreaEdicts(vec3_t mins, vec3_t maxs, edict_t **list, int maxcount, int areatype)
 {
-	area_mins = mins;
-	area_maxs = maxs;
-	area_list = list;
-	area_maxcount = maxcount;
-	area_type = areatype;
-	area_count = 0;
+	areawalk_t aw;
+	areaquery_t *query;
+
+	SV_AreaIndex_update();
+
+	query = &sv_areaRecord[sv_areaRecordNb++ & (AREA_RECORD_SIZE - 1)];
+	VectorCopy(mins, query->mins);
+	VectorCopy(maxs, query->maxs);
+	query->areatype = areatype;
+
+	return SV_AreaEdicts_query(&aw, mins, maxs, list, maxcount, areatype);
+}
+
+/*
+ * Moves the linked edicts to another area index
+ */
+static void SV_AreaIndex_switch(areaindex_t index)
+{
+	int e;
+	edict_t *ent;
 
-	SV_AreaEdicts_r(sv_areanodes);
+	if (sv_areaIndex == index)
+	{
+		return;
+	}
+
+	sv_areaIndex = index;
 
-	area_mins = 0;
-	area_maxs = 0;
-	area_list = 0;
-	area_maxcount = 0;
-	area_type = 0;
+	for (e = 1; e < ge->num_edicts; e++)
+	{
+		ent = EDICT_NUM(e);
 
-	return area_count;
+		if (ent->area.prev)
+		{
+			RemoveLink(&ent->area);
+			SV_AreaIndex_link(ent);
+		}
+	}
+}
+
+/* an edict and the list holding it, to restore the link order */
+typedef struct
+{
+	edict_t *ent;
+	link_t *head;
+} arealink_t;
+
+static int SV_AreaIndex_saveList(link_t *head, arealink_t *saved, int savedNb)
+{
+	link_t *l;
+
+	for (l = head->next; l != head; l = l->next)
+	{
+		saved[savedNb].ent = EDICT_FROM_AREA(l);
+		saved[savedNb].head = head;
+		savedNb++;
+	}
+
+	return savedNb;
+}
+
+/*
+ * Records the edicts of the active area index in their link order
+ */
+static int SV_AreaIndex_save(arealink_t *saved)
+{
+	int i, savedNb = 0;
+
+	if (sv_areaIndex == AREAINDEX_LOOSE)
+	{
+		for (i = 0; i < LOOSE_NODES; i++)
+		{
+			savedNb = SV_AreaIndex_saveList(&sv_loosenodes[i].trigger_edicts, saved, savedNb);
+			savedNb = SV_AreaIndex_saveList(&sv_loosenodes[i].solid_edicts, saved, savedNb);
+		}
+	}
+	else
+	{
+		for (i = 0; i < sv_numareanodes; i++)
+		{
+			savedNb = SV_AreaIndex_saveList(&sv_areanodes[i].trigger_edicts, saved, savedNb);
+			savedNb = SV_AreaIndex_saveList(&sv_areanodes[i].solid_edicts, saved, savedNb);
+		}
+	}
+
+	return savedNb;
+}
+
+/*
+ * Relinks the edicts in the recorded order, so that the
+ * game sees the same touch and BoxEdicts orders as before
+ */
+static void SV_AreaIndex_restore(const arealink_t *saved, int savedNb)
+{
+	int i;
+
+	for (i = 0; i < savedNb; i++)
+	{
+		RemoveLink(&saved[i].ent->area);
+		InsertLinkBefore(&saved[i].ent->area, saved[i].head);
+	}
+}
+
+/*
+ * Replays the last queries against both area indices,
+ * checks they find the same edicts and times them
+ */
+void SV_AreaBench_f(void)
+{
+	static edict_t *list[MAX_EDICTS];
+	static const char *names[] = { "areanodes", "loose quadtree" };
+	static int counts[AREA_RECORD_SIZE];
+	static unsigned sums[AREA_RECORD_SIZE];
+	static arealink_t saved[MAX_EDICTS];
+	int savedNb;
+	areaindex_t previous, index;
+	areaquery_t *query;
+	areawalk_t aw;
+	int nodeNb, checkNb;
+	int queryNb, iterationNb, iteration;
+	int i, j, count, start, time, mismatchNb;
+	unsigned sum;
+
+	if ((sv.state != ss_game) || !ge)
+	{
+		Com_Printf("No game running.\n");
+		return;
+	}
+
+	queryNb = (sv_areaRecordNb < AREA_RECORD_SIZE) ? sv_areaRecordNb : AREA_RECORD_SIZE;
+
+	if (!queryNb)
+	{
+		Com_Printf("No queries recorded yet.\n");
+		return;
+	}
+
+	iterationNb = (Cmd_Argc() > 1) ? (int)strtol(Cmd_Argv(1), (char **)NULL, 10) : 10;
+
+	if (iterationNb < 1)
+	{
+		iterationNb = 1;
+	}
+
+	previous = sv_areaIndex;
+	savedNb = SV_AreaIndex_save(saved);
+	mismatchNb = 0;
+
+	for (index = AREAINDEX_TREE; index <= AREAINDEX_LOOSE; index++)
+	{
+		SV_AreaIndex_switch(index);
+		nodeNb = 0;
+		checkNb = 0;
+		start = Sys_Milliseconds();
+
+		for (iteration = 0; iteration < iterationNb; iteration++)
+		{
+			for (i = 0, query = sv_areaRecord; i < queryNb; i++, query++)
+			{
+				count = SV_AreaEdicts_query(&aw, query->mins, query->maxs, list,
+						MAX_EDICTS, query->areatype);
+				nodeNb += aw.nodeNb;
+				checkNb += aw.checkNb;
+
+				if (iteration)
+				{
+					continue;
+				}
+
+				/* the order differs between indices */
+				for (j = 0, sum = 0; j < count; j++)
+				{
+					sum += (unsigned)NUM_FOR_EDICT(list[j]) * 2654435761u;
+				}
+
+				if (index == AREAINDEX_TREE)
+				{
+					counts[i] = count;
+					sums[i] = sum;
+				}
+				else
+				if ((counts[i] != count) || (sums[i] != sum))
+				{
+					mismatchNb++;
+				}
+			}
+		}
+
+		time = Sys_Milliseconds() - start;
+		Com_Printf("%s: %i ms, %i nodes, %i edict checks per pass\n", names[index],
+			time, nodeNb / iterationNb, checkNb / iterationNb);
+	}
+
+	SV_AreaIndex_switch(previous);
+	SV_AreaIndex_restore(saved, savedNb);
+
+	Com_Printf("%i queries x %i iterations, %i mismatches\n", queryNb, iterationNb, mismatchNb);
 }
 
 int SV_PointContents(vec3_t p)
@@ -514,6 +941,7 @@ typedef struct
 	trace_t trace;
 	edict_t *passedict;
 	int contentmask;
+	qboolean batched; /* on a worker, off the main thread */
 } moveclip_t;
 
 /*
@@ -550,10 +978,20 @@ void SV_ClipMoveToEntities(moveclip_t *clip)
 	edict_t *touchlist[MAX_EDICTS], *touch;
 	trace_t trace;
 	int headnode;
-	float *angles;
+	float *mins, *maxs;
+	areawalk_t aw;
 
-	num = SV_AreaEdicts(clip->boxmins, clip->boxmaxs, touchlist,
-			MAX_EDICTS, AREA_SOLID);
+	if (clip->batched)
+	{
+		/* neither records the query nor switches the area index */
+		num = SV_AreaEdicts_query(&aw, clip->boxmins, clip->boxmaxs, touchlist,
+				MAX_EDICTS, AREA_SOLID);
+	}
+	else
+	{
+		num = SV_AreaEdicts(clip->boxmins, clip->boxmaxs, touchlist,
+				MAX_EDICTS, AREA_SOLID);
+	}
 
 	/* be careful, it is possible to have an entity in this
 	   list removed before we get to it (killtriggered) */
@@ -596,25 +1034,30 @@ void SV_ClipMoveToEntities(moveclip_t *clip)
 		}
 
 		/* might intersect, so do an exact clip */
-		headnode = SV_HullForEntity(touch);
-		angles = touch->s.angles;
-
-		if (touch->solid != SOLID_BSP)
+		if (touch->svflags & SVF_MONSTER)
 		{
-			angles = vec3_origin; /* boxes don't rotate */
+			mins = clip->mins2;
+			maxs = clip->maxs2;
+		}
+		else
+		{
+			mins = clip->mins;
+			maxs = clip->maxs;
 		}
 
-		if (touch->svflags & SVF_MONSTER)
+		if ((touch->solid != SOLID_BSP) && clip->batched)
 		{
-			trace = CM_TransformedBoxTrace(clip->start, clip->end,
-					clip->mins2, clip->maxs2, headnode, clip->contentmask,
-					touch->s.origin, angles);
+			/* the shared box hull can't be rewritten from a worker */
+			trace = CM_BoxTraceToBox(clip->start, clip->end,
+					mins, maxs, touch->mins, touch->maxs, clip->contentmask,
+					touch->s.origin);
 		}
 		else
 		{
+			headnode = SV_HullForEntity(touch);
 			trace = CM_TransformedBoxTrace(clip->start, clip->end,
-					clip->mins, clip->maxs, headnode, clip->contentmask,
-					touch->s.origin, angles);
+					mins, maxs, headnode, clip->contentmask, touch->s.origin,
+					(touch->solid == SOLID_BSP) ? touch->s.angles : vec3_origin);
 		}
 
 		if (trace.allsolid || trace.startsolid ||
@@ -659,11 +1102,7 @@ void SV_TraceBounds(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, vec3_t b
 	}
 }
 
-/*
- * Moves the given mins/maxs volume through the world from start to end.
- * Passedict and edicts owned by passedict are explicitly not checked.
- */
-trace_t SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passedict, int contentmask)
+static trace_t SV_TraceMove(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passedict, int contentmask, qboolean batched)
 {
 	moveclip_t clip;
 
@@ -694,6 +1133,7 @@ trace_t SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *pa
 	clip.mins = mins;
 	clip.maxs = maxs;
 	clip.passedict = passedict;
+	clip.batched = batched;
 
 	VectorCopy(mins, clip.mins2);
 	VectorCopy(maxs, clip.maxs2);
@@ -707,3 +1147,65 @@ trace_t SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *pa
 
 	return clip.trace;
 }
+
+/*
+ * Moves the given mins/maxs volume through the world from start to end.
+ * Passedict and edicts owned by passedict are explicitly not checked.
+ */
+trace_t SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, edict_t *passedict, int contentmask)
+{
+	return SV_TraceMove(start, mins, maxs, end, passedict, contentmask, false);
+}
+
+/* requests traced per worker job */
+#define TRACE_BATCH_JOB 8
+
+typedef struct
+{
+	tracerequest_t *requests;
+	int count;
+} tracebatch_t;
+
+static void SV_TraceBatch_job(void *data, int index)
+{
+	tracebatch_t *batch = data;
+	tracerequest_t *request;
+	int i, last;
+
+	last = (index + 1) * TRACE_BATCH_JOB;
+
+	if (last > batch->count)
+	{
+		last = batch->count;
+	}
+
+	for (i = index * TRACE_BATCH_JOB; i < last; i++)
+	{
+		request = &batch->requests[i];
+		request->trace = SV_TraceMove(request->start, request->mins, request->maxs,
+				request->end, request->passent, request->contentmask, true);
+	}
+}
+
+/*
+ * Runs independent traces on the worker threads. Nothing moves while
+ * the game waits for them, so the world and the area index are only
+ * read.
+ */
+void SV_TraceBatch(tracerequest_t *requests, int count)
+{
+	tracebatch_t batch;
+
+	if (count <= 0)
+	{
+		return;
+	}
+
+	SV_AreaIndex_update();
+
+	batch.requests = requests;
+	batch.count = count;
+
+	SV_Workers_run(SV_TraceBatch_job, &batch,
+			(count + TRACE_BATCH_JOB - 1) / TRACE_BATCH_JOB);
+}
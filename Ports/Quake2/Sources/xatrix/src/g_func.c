@@ -2016,7 +2016,7 @@ void SP_func_water(edict_t *self)
 		self->spawnflags |= DOOR_TOGGLE;
 	}
 
-	self->classname = "func_door";
+	G_SetClassname(self, "func_door");
 
 	gi.linkentity(self);
 }
@@ -2848,7 +2848,7 @@ void SP_func_door_secret(edict_t *ent)
 		ent->touch = door_touch;
 	}
 
-	ent->classname = "func_door";
+	G_SetClassname(ent, "func_door");
 
 	gi.linkentity(ent);
 }
@@ -3096,7 +3096,7 @@ void SP_object_repair(edict_t *ent)
 
 	ent->movetype = MOVETYPE_NONE;
 	ent->solid = SOLID_BBOX;
-	ent->classname = "object_repair";
+	G_SetClassname(ent, "object_repair");
 	VectorSet(ent->mins, -8, -8, 8);
 	VectorSet(ent->maxs, 8, 8, 8);
 	ent->think = object_repair_sparks;
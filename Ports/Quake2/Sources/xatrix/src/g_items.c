@@ -1352,7 +1352,7 @@ edict_t* Drop_Item(edict_t *ent, gitem_t *item)
 
 	dropped = G_Spawn();
 
-	dropped->classname = item->classname;
+	G_SetClassname(dropped, item->classname);
 	dropped->item = item;
 	dropped->spawnflags = DROPPED_ITEM;
 	dropped->s.effects = item->world_model_flags;
@@ -2980,7 +2980,7 @@ void SP_item_foodcube(edict_t *self)
 	self->spawnflags |= DROPPED_ITEM;
 	self->style = HEALTH_IGNORE_MAX;
 	gi.soundindex("items/s_health.wav");
-	self->classname = "foodcube";
+	G_SetClassname(self, "foodcube");
 }
 
 void InitItems(void)
@@ -186,7 +186,7 @@ edict_t* CreateTargetChangeLevel(char *map)
 	}
 
 	ent = G_Spawn();
-	ent->classname = "target_changelevel";
+	G_SetClassname(ent, "target_changelevel");
 	Com_sprintf(level.nextmap, sizeof(level.nextmap), "%s", map);
 	ent->map = level.nextmap;
 	return ent;
@@ -162,7 +162,7 @@ landing_goal(edict_t *self)
 	}
 
 	ent = G_Spawn();
-	ent->classname = "bot_goal";
+	G_SetClassname(ent, "bot_goal");
 	ent->solid = SOLID_BBOX;
 	ent->owner = self;
 	gi.linkentity(ent);
@@ -197,7 +197,7 @@ takeoff_goal(edict_t *self)
 	}
 
 	ent = G_Spawn();
-	ent->classname = "bot_goal";
+	G_SetClassname(ent, "bot_goal");
 	ent->solid = SOLID_BBOX;
 	ent->owner = self;
 	gi.linkentity(ent);
@@ -284,7 +284,7 @@ roam_goal(edict_t *self)
 	whichvec[2] = 0;
 
 	ent = G_Spawn();
-	ent->classname = "bot_goal";
+	G_SetClassname(ent, "bot_goal");
 	ent->solid = SOLID_BBOX;
 	ent->owner = self;
 	gi.linkentity(ent);
@@ -1149,7 +1149,7 @@ fixbot_fire_laser(edict_t *self)
 			self->enemy->spawnflags = 0;
 			self->enemy->monsterinfo.aiflags = 0;
 			self->enemy->target = NULL;
-			self->enemy->targetname = NULL;
+			G_SetTargetname(self->enemy, NULL);
 			self->enemy->combattarget = NULL;
 			self->enemy->deathtarget = NULL;
 			self->enemy->owner = self;